@@ -0,0 +1,63 @@
+// Measures GPU step time against constraint count for a fixed number of objects.
+// With the per-object adjacency index the cost should grow linearly with constraints.
+#include "gpu_physics.h"
+#include "window.h"
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+const int SCREEN_WIDTH = 1600;
+const int SCREEN_HEIGHT = 1200;
+
+int main() {
+    Window window(SCREEN_WIDTH, SCREEN_HEIGHT, "ENN adjacency scaling benchmark");
+
+    const int object_count = 16384;
+    const int warmup_steps = 10;
+    const int timed_steps = 100;
+    const float dt = 1.0f / 60.0f;
+
+    std::printf("constraints,ms_per_step,ns_per_constraint\n");
+
+    for (int constraint_count = 1024; constraint_count <= 131072; constraint_count *= 2) {
+        GPUPhysicsSystem physics_system(object_count, constraint_count, 10, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (!physics_system.isSupported()) return 1;
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> x_dist(0.0f, float(SCREEN_WIDTH));
+        std::uniform_real_distribution<float> y_dist(0.0f, float(SCREEN_HEIGHT));
+        std::uniform_int_distribution<int> index_dist(0, object_count - 1);
+
+        for (int i = 0; i < object_count; ++i) {
+            GPUPhysicsObject ball = {};
+            ball.position = {x_dist(rng), y_dist(rng), 0.0f, 0.0f};
+            ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f};
+            ball.mass = 1.0f;
+            ball.radius = 2.0f;
+            physics_system.addObject(ball);
+        }
+
+        // Random spring network, every spring starts at rest
+        for (int i = 0; i < constraint_count; ++i) {
+            GPUPhysicsConstraint constraint = {};
+            constraint.type = 0;
+            constraint.indexA = index_dist(rng);
+            constraint.indexB = index_dist(rng);
+            constraint.stiffness = 1.0f;
+            constraint.restLength = 0.0f;
+            physics_system.addConstraint(constraint);
+        }
+
+        for (int i = 0; i < warmup_steps; ++i) physics_system.update(dt);
+        glFinish();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < timed_steps; ++i) physics_system.update(dt);
+        glFinish();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double ms_per_step = std::chrono::duration<double, std::milli>(end - start).count() / timed_steps;
+        std::printf("%d,%.4f,%.3f\n", constraint_count, ms_per_step, ms_per_step * 1e6 / constraint_count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+// Solver benchmark over procedural scenes (scenes.h): fixed-dt steps for every combination of
+// scene, size, iteration count and thread count, one result row each as CSV or JSON.
+// Built against the CPU backend as solver_benchmark, and against the GPU backend as
+// solver_benchmark_gpu (ENN_BENCHMARK_GPU, needs a window for the GL context, ignores --threads).
+// Sweeping --warm-start 0,1 against --iterations compares how many iterations each needs for the same error.
+// Steps run every iteration unless --tolerance is given, then --iterations is the most they run and
+// last_iterations / residual report what the final step needed.
+// --worlds N (GPU only) packs N copies of every scene into one batched system, objects and throughput count all
+// of them, and the spread of the worlds' centres of mass shows whether identical worlds stayed identical.
+// --shader-cache dir (GPU only) is where linked programs are cached, "" compiles every run, the program build
+// times on stderr show a cold start against a warm one.
+// --dimensions 2,3 compares the compact 2D object layout and 2x2 solve with the 3D solver on the same scenes.
+// Usage: solver_benchmark [--scenes rope,cloth,springs,balls] [--sizes 1000,10000] [--iterations 5,10]
+//                         [--threads 0] [--warm-start 0,1] [--dimensions 2,3] [--alpha a] [--gamma g] [--beta b] [--stiffness-max k]
+//                         [--tolerance t] [--min-iterations N] [--worlds N] [--shader-cache dir]
+//                         [--steps N] [--warmup N] [--dt seconds] [--csv path] [--json path]
+#include "scenes.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#ifdef ENN_BENCHMARK_GPU
+#include "gpu_physics.h"
+#include "shader_cache.h"
+#include "window.h"
+typedef GPUPhysicsSystem BenchmarkSystem;
+static const char* backend_name = "gpu";
+#else
+#include "cpu_physics.h"
+#include "soa_solver.h"
+typedef CPUPhysicsSystem BenchmarkSystem;
+static const char* backend_name = "cpu";
+#endif
+
+const int SCREEN_WIDTH = 1600;
+const int SCREEN_HEIGHT = 1200;
+
+struct BenchmarkResult {
+    std::string scene;
+    int worlds;
+    int dimensions;
+    int objects;
+    int constraints;
+    int iterations;
+    int threads;
+    bool warm_start;
+    int steps;
+    double seconds;
+    double steps_per_second;
+    double ns_per_vertex_iteration;
+    float max_constraint_error;
+    int last_iterations;
+    float residual;
+};
+
+static std::vector<std::string> splitList(const char* text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static std::vector<int> splitIntList(const char* text) {
+    std::vector<int> values;
+    for (const std::string& item : splitList(text)) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+#ifdef ENN_BENCHMARK_GPU
+static BenchmarkSystem* createSystem(const Scene& scene, int worlds, int iterations, int, int dimensions) {
+    GPUPhysicsSystem* physics_system = new GPUPhysicsSystem(int(scene.objects.size()) * worlds, std::max<int>(int(scene.constraints.size()) * worlds, 1),
+                                                            iterations, SCREEN_WIDTH, SCREEN_HEIGHT, dimensions);
+    // An unsupported system steps nothing, its timings would be meaningless
+    if (!physics_system->isSupported()) std::exit(1);
+    return physics_system;
+}
+
+static void addScene(BenchmarkSystem& physics_system, const Scene& scene, int worlds) {
+    for (int w = 0; w < worlds; ++w) {
+        physics_system.addWorld(PhysicsWorldParameters(), scene.objects.data(), scene.objects.size(), scene.constraints.data(), scene.constraints.size());
+    }
+}
+
+// Largest distance of a world's centre of mass from world 0's, 0 when every copy evolved the same
+static float worldSpread(BenchmarkSystem& physics_system) {
+    std::vector<GPUWorldStats> stats;
+    physics_system.requestWorldStats();
+    glFinish();
+    if (!physics_system.getLatestWorldStats(stats) || stats.empty()) return 0.0f;
+    float spread = 0.0f;
+    for (const GPUWorldStats& world : stats) {
+        spread = std::max(spread, glm::length(glm::vec3(world.centre_of_mass) - glm::vec3(stats[0].centre_of_mass)));
+    }
+    return spread;
+}
+
+static void finish(BenchmarkSystem&) {
+    glFinish();
+}
+
+static GPUPhysicsStats finalStats(BenchmarkSystem& physics_system) {
+    GPUPhysicsStats stats = {};
+    physics_system.requestStats();
+    glFinish();
+    physics_system.getLatestStats(stats);
+    return stats;
+}
+
+static int threadCount(BenchmarkSystem&) {
+    return 0;
+}
+#else
+static BenchmarkSystem* createSystem(const Scene&, int, int iterations, int threads, int dimensions) {
+    return new CPUPhysicsSystem(iterations, threads, dimensions);
+}
+
+// Batched worlds are GPU only, main() rejects --worlds here
+static void addScene(BenchmarkSystem& physics_system, const Scene& scene, int) {
+    physics_system.addObjects(scene.objects.data(), scene.objects.size());
+    physics_system.addConstraints(scene.constraints.data(), scene.constraints.size());
+}
+
+static float worldSpread(BenchmarkSystem&) {
+    return 0.0f;
+}
+
+static void finish(BenchmarkSystem&) {
+}
+
+static GPUPhysicsStats finalStats(BenchmarkSystem& physics_system) {
+    return physics_system.computeStats();
+}
+
+static int threadCount(BenchmarkSystem& physics_system) {
+    return physics_system.getThreadCount();
+}
+#endif
+
+static BenchmarkResult runScenario(const Scene& scene, int worlds, int dimensions, int iterations, int threads, const SolverParameters& parameters,
+                                   int warmup_steps, int steps, float dt, float* world_spread) {
+    BenchmarkSystem* physics_system = createSystem(scene, worlds, iterations, threads, dimensions);
+    physics_system->setCollisionsEnabled(scene.collisions);
+    physics_system->setSolverParameters(parameters);
+    addScene(*physics_system, scene, worlds);
+
+    // Warmup covers the one-off graph coloring and buffer growth
+    for (int i = 0; i < warmup_steps; ++i) physics_system->update(dt);
+    finish(*physics_system);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < steps; ++i) physics_system->update(dt);
+    finish(*physics_system);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    BenchmarkResult result;
+    result.scene = scene.name;
+    result.worlds = worlds;
+    result.dimensions = dimensions;
+    result.objects = int(scene.objects.size()) * worlds;
+    result.constraints = int(scene.constraints.size()) * worlds;
+    result.iterations = iterations;
+    result.threads = threadCount(*physics_system);
+    result.warm_start = parameters.warm_start;
+    result.steps = steps;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.steps_per_second = steps / result.seconds;
+    result.ns_per_vertex_iteration = result.seconds * 1e9 / (double(steps) * iterations * result.objects);
+    GPUPhysicsStats stats = finalStats(*physics_system);
+    result.max_constraint_error = stats.max_constraint_violation;
+    result.last_iterations = int(stats.solver_iterations);
+    result.residual = stats.solver_residual;
+    *world_spread = worlds > 1 ? worldSpread(*physics_system) : 0.0f;
+
+    delete physics_system;
+    return result;
+}
+
+static void writeCsv(FILE* file, const std::vector<BenchmarkResult>& results) {
+    std::fprintf(file, "backend,scene,worlds,dimensions,objects,constraints,iterations,threads,warm_start,steps,seconds,steps_per_second,ns_per_vertex_iteration,max_constraint_error,last_iterations,residual\n");
+    for (const BenchmarkResult& r : results) {
+        std::fprintf(file, "%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%.6f,%.3f,%.3f,%g,%d,%g\n", backend_name, r.scene.c_str(), r.worlds, r.dimensions, r.objects, r.constraints,
+                     r.iterations, r.threads, r.warm_start ? 1 : 0, r.steps, r.seconds, r.steps_per_second, r.ns_per_vertex_iteration, r.max_constraint_error,
+                     r.last_iterations, r.residual);
+    }
+}
+
+// JSON has no inf or nan, a diverged run writes null
+static std::string jsonNumber(float value) {
+    if (!std::isfinite(value)) return "null";
+    char text[32];
+    std::snprintf(text, sizeof(text), "%g", value);
+    return text;
+}
+
+static void writeJson(FILE* file, const std::vector<BenchmarkResult>& results) {
+    std::fprintf(file, "{\"backend\":\"%s\",", backend_name);
+#ifndef ENN_BENCHMARK_GPU
+    std::fprintf(file, "\"kernel\":\"%s\",", soaKernelName());
+#endif
+    std::fprintf(file, "\"results\":[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        std::fprintf(file, "{\"scene\":\"%s\",\"worlds\":%d,\"dimensions\":%d,\"objects\":%d,\"constraints\":%d,\"iterations\":%d,\"threads\":%d,\"warm_start\":%s,\"steps\":%d,"
+                     "\"seconds\":%.6f,\"steps_per_second\":%.3f,\"ns_per_vertex_iteration\":%.3f,\"max_constraint_error\":%s,"
+                     "\"last_iterations\":%d,\"residual\":%s}%s\n",
+                     r.scene.c_str(), r.worlds, r.dimensions, r.objects, r.constraints, r.iterations, r.threads, r.warm_start ? "true" : "false", r.steps, r.seconds,
+                     r.steps_per_second, r.ns_per_vertex_iteration, jsonNumber(r.max_constraint_error).c_str(),
+                     r.last_iterations, jsonNumber(r.residual).c_str(), i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "]}\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> scene_names = {"rope", "cloth", "springs", "balls"};
+    std::vector<int> sizes = {1024, 16384};
+    std::vector<int> iteration_counts = {10};
+    std::vector<int> thread_counts = {0};
+    std::vector<int> warm_starts = {1};
+    std::vector<int> dimension_counts = {2}; // every scene is flat
+    SolverParameters parameters;
+    parameters.residual_tolerance = 0.0f; // fixed work per step unless asked for
+    int worlds = 1;
+    int steps = 100;
+    int warmup_steps = 10;
+    float dt = 1.0f / 60.0f;
+    std::string csv_path, json_path;
+    std::string shader_cache = "shader_cache";
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "--scenes") == 0) scene_names = splitList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--sizes") == 0) sizes = splitIntList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--iterations") == 0) iteration_counts = splitIntList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--threads") == 0) thread_counts = splitIntList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--warm-start") == 0) warm_starts = splitIntList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--dimensions") == 0) dimension_counts = splitIntList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--alpha") == 0) parameters.alpha = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--gamma") == 0) parameters.gamma = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--beta") == 0) parameters.beta = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--stiffness-max") == 0) parameters.stiffness_max = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--tolerance") == 0) parameters.residual_tolerance = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--min-iterations") == 0) parameters.min_iterations = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--worlds") == 0) worlds = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--steps") == 0) steps = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--warmup") == 0) warmup_steps = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--dt") == 0) dt = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--csv") == 0) csv_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--json") == 0) json_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--shader-cache") == 0) shader_cache = argv[i + 1];
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (steps <= 0) {
+        std::fprintf(stderr, "--steps must be positive\n");
+        return 1;
+    }
+    for (int dimensions : dimension_counts) {
+        if (dimensions != 2 && dimensions != 3) {
+            std::fprintf(stderr, "--dimensions takes 2 and 3\n");
+            return 1;
+        }
+    }
+#ifdef ENN_BENCHMARK_GPU
+    if (worlds < 1) {
+        std::fprintf(stderr, "--worlds must be positive\n");
+        return 1;
+    }
+#else
+    if (worlds != 1) {
+        std::fprintf(stderr, "--worlds needs the GPU backend (solver_benchmark_gpu)\n");
+        return 1;
+    }
+#endif
+
+#ifdef ENN_BENCHMARK_GPU
+    Window window(SCREEN_WIDTH, SCREEN_HEIGHT, "ENN solver benchmark");
+    thread_counts = {0};
+    setShaderCacheDirectory(shader_cache);
+#endif
+
+    std::vector<BenchmarkResult> results;
+    for (const std::string& scene_name : scene_names) {
+        for (int size : sizes) {
+            Scene scene;
+            if (!makeScene(scene_name, size, scene)) {
+                std::fprintf(stderr, "Unknown scene %s\n", scene_name.c_str());
+                return 1;
+            }
+            for (int iterations : iteration_counts) {
+                for (int threads : thread_counts) {
+                    for (int warm_start : warm_starts) {
+                        for (int dimensions : dimension_counts) {
+                            parameters.warm_start = warm_start != 0;
+                            float world_spread = 0.0f;
+                            results.push_back(runScenario(scene, worlds, dimensions, iterations, threads, parameters, warmup_steps, steps, dt, &world_spread));
+                            const BenchmarkResult& r = results.back();
+                            std::fprintf(stderr, "%s %dD %d objects, %d iterations, %d threads, warm start %d: %.1f steps/s, %.2f ns per vertex-iteration, error %g, last step %d iterations, residual %g\n",
+                                         r.scene.c_str(), r.dimensions, r.objects, r.iterations, r.threads, warm_start, r.steps_per_second,
+                                         r.ns_per_vertex_iteration, r.max_constraint_error, r.last_iterations, r.residual);
+                            if (worlds > 1) std::fprintf(stderr, "  %d worlds, centres of mass within %g of world 0\n", worlds, world_spread);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef ENN_BENCHMARK_GPU
+    ShaderCacheStats shader_stats = getShaderCacheStats();
+    std::fprintf(stderr, "Shaders: %d compiled in %.1f ms, %d from cache in %.1f ms\n", shader_stats.compiled_programs,
+                 shader_stats.compile_ms, shader_stats.cached_programs, shader_stats.cache_ms);
+#endif
+
+    writeCsv(stdout, results);
+    if (!csv_path.empty()) {
+        FILE* file = std::fopen(csv_path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "Could not write %s\n", csv_path.c_str());
+            return 1;
+        }
+        writeCsv(file, results);
+        std::fclose(file);
+    }
+    if (!json_path.empty()) {
+        FILE* file = std::fopen(json_path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "Could not write %s\n", json_path.c_str());
+            return 1;
+        }
+        writeJson(file, results);
+        std::fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Micro-benchmark of the CPU controller kernel: controllers evaluated per second, single threaded,
+// for the SIMD kernel the build selected and for the scalar fallback.
+// Usage: controller_bench [controllers] [hidden units] [ticks]
+#include "controller.h"
+#include "scenes.h"
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+
+typedef void (*EvaluateFunction)(const ControllerPopulation&, const SoAObjectState&, SoAConstraintState&, size_t, size_t, float);
+
+static double runTicks(EvaluateFunction evaluate, const ControllerPopulation& population, const SoAObjectState& objects,
+                       SoAConstraintState& constraints, int ticks) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < ticks; ++t) {
+        evaluate(population, objects, constraints, 0, size_t(population.getControllerCount()), t / 60.0f);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// Whole argument as a positive integer, false for anything else ("--help", "10k", "0")
+static bool parseCount(const char* text, int& value) {
+    char* end = nullptr;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed <= 0 || parsed > INT_MAX) return false;
+    value = int(parsed);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int controller_count = 4096;
+    int hidden_count = 16;
+    int ticks = 100;
+    int* arguments[] = {&controller_count, &hidden_count, &ticks};
+    bool valid = argc <= 4;
+    for (int i = 1; valid && i < argc; ++i) valid = parseCount(argv[i], *arguments[i - 1]);
+    if (!valid) {
+        std::fprintf(stderr, "Usage: controller_bench [controllers] [hidden units] [ticks]\n");
+        return 1;
+    }
+
+    Scene scene = makeCreatureScene(controller_count);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+
+    // Jittered bodies so every sensor reads something
+    SoAObjectState objects;
+    objects.resize(scene.objects.size());
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        objects.x[i] = scene.objects[i].position.x + jitter(rng);
+        objects.y[i] = scene.objects[i].position.y + jitter(rng);
+        objects.vel_x[i] = 10.0f * jitter(rng);
+        objects.vel_y[i] = 10.0f * jitter(rng);
+    }
+    SoAConstraintState constraints;
+    constraints.resize(scene.constraints.size());
+    for (size_t k = 0; k < scene.constraints.size(); ++k) {
+        constraints.index_a[k] = scene.constraints[k].indexA;
+        constraints.index_b[k] = scene.constraints[k].indexB;
+        constraints.rest_length[k] = scene.constraints[k].restLength;
+    }
+
+    ControllerPopulation population(makeCreatureTopology(scene, hidden_count));
+    for (int c = 0; c < controller_count; ++c) {
+        population.addController(uint32_t(c * scene.body_object_count), uint32_t(c * scene.body_constraint_count));
+    }
+    population.randomizeGenomes(1234, 2.0f);
+
+    // Both kernels must agree before their speed means anything
+    SoAConstraintState native_check = constraints, scalar_check = constraints;
+    runTicks(evaluateControllersSoA, population, objects, native_check, 1);
+    runTicks(evaluateControllersSoAScalar, population, objects, scalar_check, 1);
+    float max_difference = 0.0f;
+    for (size_t k = 0; k < constraints.size(); ++k) {
+        max_difference = std::fmax(max_difference, std::fabs(native_check.rest_length[k] - scalar_check.rest_length[k]));
+    }
+
+    std::printf("controllers %d, inputs %d, hidden %d, outputs %d, parameters %d, ticks %d\n", controller_count,
+                population.getTopology().inputCount(), population.getTopology().hidden_count, population.getTopology().outputCount(),
+                population.getParameterCount(), ticks);
+    std::printf("max |native - scalar| rest length after one tick: %g\n", max_difference);
+
+    SoAConstraintState native_constraints = constraints;
+    double native_seconds = runTicks(evaluateControllersSoA, population, objects, native_constraints, ticks);
+    SoAConstraintState scalar_constraints = constraints;
+    double scalar_seconds = runTicks(evaluateControllersSoAScalar, population, objects, scalar_constraints, ticks);
+
+    double evaluations = double(controller_count) * ticks;
+    std::printf("kernel,width,controllers_per_second\n");
+    std::printf("%s,%d,%.4g\n", soaKernelName(), soaKernelWidth(), evaluations / native_seconds);
+    std::printf("scalar,1,%.4g\n", evaluations / scalar_seconds);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Micro-benchmark of the SoA vertex kernel: vertices solved per second, single threaded,
+// for the SIMD kernel the build selected and for the scalar fallback, each instantiated for 3 and 2 dimensions.
+// Usage: soa_kernel_bench [objects] [constraints per object] [sweeps]
+#include "soa_solver.h"
+#include "constraint_graph.h"
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+
+typedef float (*SolveFunction)(SoAObjectState&, const SoAConstraintView*, int, const uint32_t*, size_t, float, int);
+
+static double runSweeps(SolveFunction solve, SoAObjectState& objects, const SoAConstraintState& constraints,
+                        const ConstraintGraph& graph, int sweeps, float dt, int dimensions) {
+    const std::vector<uint32_t>& color_order = graph.getColorOrder();
+    const std::vector<uint32_t>& color_offsets = graph.getColorOffsets();
+    SoAConstraintView view = {&constraints, graph.getOffsets().data(), graph.getIndices().data()};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int s = 0; s < sweeps; ++s) {
+        for (int c = 0; c < graph.getColorCount(); ++c) {
+            solve(objects, &view, 1, color_order.data() + color_offsets[c], color_offsets[c + 1] - color_offsets[c], dt, dimensions);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// Whole argument as a positive integer, false for anything else ("--help", "10k", "0")
+static bool parseCount(const char* text, int& value) {
+    char* end = nullptr;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed <= 0 || parsed > INT_MAX) return false;
+    value = int(parsed);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int object_count = 262144;
+    int constraints_per_object = 3;
+    int sweeps = 20;
+    int* arguments[] = {&object_count, &constraints_per_object, &sweeps};
+    bool valid = argc <= 4;
+    for (int i = 1; valid && i < argc; ++i) valid = parseCount(argv[i], *arguments[i - 1]);
+    if (!valid) {
+        std::fprintf(stderr, "Usage: soa_kernel_bench [objects] [constraints per object] [sweeps]\n");
+        return 1;
+    }
+    const float dt = 1.0f / 60.0f;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position_dist(0.0f, 1000.0f);
+    std::uniform_int_distribution<int> index_dist(0, object_count - 1);
+
+    SoAObjectState objects;
+    objects.resize(object_count);
+    ConstraintGraph graph;
+    for (int i = 0; i < object_count; ++i) {
+        objects.x[i] = objects.inertial_x[i] = position_dist(rng);
+        objects.y[i] = objects.inertial_y[i] = position_dist(rng) - 0.1f;
+        objects.z[i] = objects.inertial_z[i] = 0.0f;
+        objects.mass[i] = 1.0f;
+        objects.inv_mass[i] = 1.0f;
+        graph.addObject();
+    }
+
+    SoAConstraintState constraints;
+    int constraint_count = object_count * constraints_per_object;
+    constraints.resize(constraint_count);
+    for (int k = 0; k < constraint_count; ++k) {
+        constraints.index_a[k] = index_dist(rng);
+        constraints.index_b[k] = index_dist(rng);
+        constraints.rest_length[k] = 10.0f;
+        constraints.stiffness[k] = 100.0f;
+        constraints.type[k] = k % 4 == 0 ? 1 : 0;
+        graph.addConstraint(k, constraints.index_a[k], constraints.index_b[k]);
+    }
+    graph.rebuild();
+
+    // Every kernel must agree with the scalar 3D one before its speed means anything, the scene is flat
+    // so the 2D instantiation solves the same problem
+    SoAObjectState reference = objects;
+    runSweeps(solveObjectsSoAScalar, reference, constraints, graph, 1, dt, 3);
+    float max_difference[2][2] = {};
+    SolveFunction kernels[2] = {solveObjectsSoA, solveObjectsSoAScalar};
+    for (int k = 0; k < 2; ++k) {
+        for (int d = 0; d < 2; ++d) {
+            SoAObjectState check = objects;
+            runSweeps(kernels[k], check, constraints, graph, 1, dt, 3 - d);
+            for (int i = 0; i < object_count; ++i) {
+                max_difference[k][d] = std::fmax(max_difference[k][d], std::fabs(check.x[i] - reference.x[i]));
+                max_difference[k][d] = std::fmax(max_difference[k][d], std::fabs(check.y[i] - reference.y[i]));
+            }
+        }
+    }
+
+    std::printf("objects %d, constraints %d, colors %d, sweeps %d\n", object_count, constraint_count, graph.getColorCount(), sweeps);
+    std::printf("max |kernel - scalar 3D| after one sweep: native 3D %g, native 2D %g, scalar 2D %g\n",
+                max_difference[0][0], max_difference[0][1], max_difference[1][1]);
+
+    double vertices = double(object_count) * sweeps;
+    std::printf("kernel,width,dimensions,vertices_per_second\n");
+    for (int d = 3; d >= 2; --d) {
+        SoAObjectState native_objects = objects;
+        double native_seconds = runSweeps(solveObjectsSoA, native_objects, constraints, graph, sweeps, dt, d);
+        SoAObjectState scalar_objects = objects;
+        double scalar_seconds = runSweeps(solveObjectsSoAScalar, scalar_objects, constraints, graph, sweeps, dt, d);
+        std::printf("%s,%d,%d,%.4g\n", soaKernelName(), soaKernelWidth(), d, vertices / native_seconds);
+        std::printf("scalar,1,%d,%.4g\n", d, vertices / scalar_seconds);
+    }
+
+    return 0;
+}
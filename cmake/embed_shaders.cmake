@@ -0,0 +1,33 @@
+# Writes OUTPUT, a C++ source holding every GLSL file in SHADER_DIR as a byte array (EmbeddedShader in
+# shader_cache.h). Runs as a build step with cmake -P, so editing a shader regenerates it
+if (NOT SHADER_DIR OR NOT OUTPUT)
+    message(FATAL_ERROR "embed_shaders.cmake needs -DSHADER_DIR=... -DOUTPUT=...")
+endif()
+
+file(GLOB shader_files "${SHADER_DIR}/*.glsl")
+list(SORT shader_files)
+
+set(arrays "")
+set(table "")
+set(index 0)
+foreach (shader_file ${shader_files})
+    get_filename_component(name "${shader_file}" NAME)
+    file(READ "${shader_file}" hex HEX)
+    string(LENGTH "${hex}" hex_length)
+    math(EXPR size "${hex_length} / 2")
+    # Bytes rather than a string literal, so no length limit or escaping applies
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(APPEND arrays "static const unsigned char shader_${index}[] = {${bytes}0};\n")
+    string(APPEND table "    {\"${name}\", shader_${index}, ${size}},\n")
+    math(EXPR index "${index} + 1")
+endforeach()
+
+set(content "// Generated by cmake/embed_shaders.cmake from shaders/*.glsl, do not edit\n")
+string(APPEND content "#include \"shader_cache.h\"\n\n${arrays}\n")
+string(APPEND content "const EmbeddedShader embedded_shaders[] = {\n${table}};\n")
+string(APPEND content "const size_t embedded_shader_count = ${index};\n")
+
+# Only touch the output when it changed, the targets that link it rebuild otherwise
+file(WRITE "${OUTPUT}.tmp" "${content}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
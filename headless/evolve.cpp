@@ -0,0 +1,90 @@
+// Evolves creature controllers (controller.h) on the CPU backend, one line per generation.
+// Usage: ENN_evolve [--generations N] [--population N] [--seconds S] [--threads N] [--hidden N] [--segments N] [--seed N]
+#include "evolution.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+
+static void printUsage() {
+    std::fprintf(stderr, "Usage: ENN_evolve [--generations N] [--population N] [--seconds S] [--threads N] [--hidden N] [--segments N] [--seed N]\n");
+}
+
+// Whole argument as an integer of at least min_value, false for anything else
+static bool parseInt(const char* text, int min_value, int& value) {
+    char* end = nullptr;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < min_value || parsed > INT_MAX) return false;
+    value = int(parsed);
+    return true;
+}
+
+static bool parseSeconds(const char* text, float& value) {
+    char* end = nullptr;
+    float parsed = std::strtof(text, &end);
+    if (end == text || *end != '\0' || !(parsed > 0.0f)) return false;
+    value = parsed;
+    return true;
+}
+
+static bool parseSeed(const char* text, uint32_t& value) {
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || text[0] == '-' || parsed > UINT32_MAX) return false;
+    value = uint32_t(parsed);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int generations = 20;
+    int hidden_count = 16;
+    int segment_count = 4;
+    EvolutionParameters parameters;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+            printUsage();
+            return 1;
+        }
+        const char* value = argv[i + 1];
+        bool valid;
+        if (std::strcmp(argv[i], "--generations") == 0) valid = parseInt(value, 1, generations);
+        else if (std::strcmp(argv[i], "--population") == 0) valid = parseInt(value, 2, parameters.population_size);
+        else if (std::strcmp(argv[i], "--seconds") == 0) valid = parseSeconds(value, parameters.evaluation_seconds);
+        else if (std::strcmp(argv[i], "--threads") == 0) valid = parseInt(value, 0, parameters.thread_count);
+        else if (std::strcmp(argv[i], "--hidden") == 0) valid = parseInt(value, 1, hidden_count);
+        else if (std::strcmp(argv[i], "--segments") == 0) valid = parseInt(value, 1, segment_count);
+        else if (std::strcmp(argv[i], "--seed") == 0) valid = parseSeed(value, parameters.seed);
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            printUsage();
+            return 1;
+        }
+        if (!valid) {
+            std::fprintf(stderr, "Bad value %s for %s\n", value, argv[i]);
+            printUsage();
+            return 1;
+        }
+    }
+
+    Scene scene = makeCreatureScene(1, segment_count);
+    EvolutionEngine engine(scene, makeCreatureTopology(scene, hidden_count), parameters);
+    std::printf("population %d, %d parameters per genome, %.1f s per evaluation, %d threads\n", parameters.population_size,
+                engine.getParameterCount(), parameters.evaluation_seconds, engine.getThreadCount());
+    std::printf("generation,best_fitness,mean_fitness,seconds,evaluations_per_second,steps_per_second\n");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t evaluations = 0;
+    for (int g = 0; g < generations; ++g) {
+        const GenerationStats& stats = engine.runGeneration();
+        evaluations += uint64_t(parameters.population_size);
+        std::printf("%d,%.4f,%.4f,%.3f,%.1f,%.4g\n", stats.generation, stats.best_fitness, stats.mean_fitness, stats.seconds,
+                    stats.evaluations_per_second, stats.seconds > 0.0 ? stats.physics_steps / stats.seconds : 0.0);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::printf("%llu evaluations in %.3f s (%.1f evaluations/s), best fitness %.4f\n", (unsigned long long)evaluations, seconds,
+                seconds > 0.0 ? evaluations / seconds : 0.0, engine.getBestFitness());
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Runs the demo scene on the CPU backend without a window or GL context.
+// --scene builds a procedural scene (scenes.h) instead, --load resumes from a snapshot, --save writes one after the steps.
+// --record writes every step to a trajectory file (trajectory.h) and checks the last frame reads back.
+// --controllers 1 with --scene creatures drives every creature's springs from its own random network (controller.h).
+// --dimensions 3 runs the 3D solver instead of the 2D one every scene here needs.
+// --sleep 0 keeps every island awake (SleepParameters).
+// Usage: ENN_headless [--steps N] [--dt seconds] [--iterations N] [--threads N] [--collisions 0|1] [--profile trace.json]
+//                     [--scene rope|cloth|springs|balls|creatures] [--objects N] [--load snapshot] [--save snapshot]
+//                     [--record trajectory] [--precision units] [--controllers 0|1] [--seed N] [--dimensions 2|3]
+//                     [--sleep 0|1]
+#include "cpu_physics.h"
+#include "scenes.h"
+#include "trajectory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+const int SCREEN_WIDTH = 1600;
+const int SCREEN_HEIGHT = 1200;
+
+// Same scene as the windowed demo
+static void addDemoScene(CPUPhysicsSystem& physics_system) {
+    GPUPhysicsObject ball = {};
+    ball.position = {SCREEN_WIDTH/2+SCREEN_HEIGHT/4, SCREEN_HEIGHT/2, 0.0f, 0.0f};
+    ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
+    ball.mass = 1.0f;
+    ball.radius = 20.0f;
+    physics_system.addObject(ball);
+
+    ball = {};
+    ball.position = {SCREEN_WIDTH/2.0f, 3.0f*SCREEN_HEIGHT/4.0f, 0.0f, 0.0f};
+    ball.velocity = {1.0f, 0.0f, 0.0f, 0.0f};
+    ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
+    ball.mass = 1.0f;
+    ball.radius = 20.0f;
+    physics_system.addObject(ball);
+
+    ball = {};
+    ball.position = {SCREEN_WIDTH/2, SCREEN_HEIGHT/2, 0.0f, 0.0f};
+    ball.mass = 1.0f;
+    ball.radius = SCREEN_HEIGHT/4.0f;
+    ball.flags = OBJECT_STATIC;
+    physics_system.addObject(ball);
+
+    for (int i = 0; i < physics_system.getObjectCount(); i++) {
+        if (i == 2) continue; // the anchor, a constraint to itself is violated by its whole rest length
+        GPUPhysicsConstraint constraint = {};
+        constraint.type = 0;
+        constraint.indexA = 2;
+        constraint.indexB = i;
+        constraint.restLength = SCREEN_HEIGHT/4.0f;
+        constraint.stiffness = 1.0f;
+        physics_system.addConstraint(constraint);
+    }
+}
+
+int main(int argc, char** argv) {
+    int steps = 600;
+    float dt = 1.0f / 60.0f;
+    int iterations = 10;
+    int threads = 0;
+    bool collisions = false;
+    std::string profile_path;
+    std::string scene_name, load_path, save_path, record_path;
+    TrajectoryOptions trajectory_options;
+    int scene_objects = 10000;
+    bool controllers = false;
+    uint32_t seed = 1234;
+    int dimensions = 2;
+    SleepParameters sleep_parameters;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "--steps") == 0) steps = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--dt") == 0) dt = float(std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--iterations") == 0) iterations = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--threads") == 0) threads = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--collisions") == 0) collisions = std::atoi(argv[i + 1]) != 0;
+        else if (std::strcmp(argv[i], "--profile") == 0) profile_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--scene") == 0) scene_name = argv[i + 1];
+        else if (std::strcmp(argv[i], "--objects") == 0) scene_objects = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--load") == 0) load_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--save") == 0) save_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--record") == 0) record_path = argv[i + 1];
+        else if (std::strcmp(argv[i], "--controllers") == 0) controllers = std::atoi(argv[i + 1]) != 0;
+        else if (std::strcmp(argv[i], "--seed") == 0) seed = uint32_t(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--dimensions") == 0) dimensions = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--sleep") == 0) sleep_parameters.enabled = std::atoi(argv[i + 1]) != 0;
+        else if (std::strcmp(argv[i], "--precision") == 0) {
+            trajectory_options.position_precision = float(std::atof(argv[i + 1]));
+            trajectory_options.velocity_precision = trajectory_options.position_precision;
+        }
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (dimensions != 2 && dimensions != 3) {
+        std::fprintf(stderr, "--dimensions must be 2 or 3\n");
+        return 1;
+    }
+
+    CPUPhysicsSystem physics_system(iterations, threads, dimensions);
+    physics_system.setCollisionsEnabled(collisions);
+    physics_system.setSleepParameters(sleep_parameters);
+
+    Profiler profiler;
+    if (!profile_path.empty()) {
+        profiler.setCapture(true);
+        physics_system.setProfiler(&profiler);
+    }
+
+    Scene scene;
+    if (!load_path.empty()) {
+        auto load_start = std::chrono::high_resolution_clock::now();
+        if (!physics_system.loadSnapshot(load_path.c_str())) return 1;
+        double load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - load_start).count();
+        std::printf("Loaded %s: %d objects, %d constraints at step %llu in %.3f ms\n", load_path.c_str(), physics_system.getObjectCount(),
+                    physics_system.getConstraintCount(), (unsigned long long)physics_system.getStepCount(), load_ms);
+    } else if (!scene_name.empty()) {
+        if (!makeScene(scene_name, scene_objects, scene, seed)) {
+            std::fprintf(stderr, "Unknown scene %s\n", scene_name.c_str());
+            return 1;
+        }
+        physics_system.setCollisionsEnabled(collisions || scene.collisions);
+        physics_system.addObjects(scene.objects.data(), scene.objects.size());
+        physics_system.addConstraints(scene.constraints.data(), scene.constraints.size());
+    } else {
+        addDemoScene(physics_system);
+    }
+
+    // One controller per creature, all in one population
+    ControllerPopulation population(makeCreatureTopology(scene));
+    if (controllers) {
+        if (scene.body_object_count == 0) {
+            std::fprintf(stderr, "--controllers needs --scene creatures\n");
+            return 1;
+        }
+        int creature_count = int(scene.objects.size()) / scene.body_object_count;
+        for (int c = 0; c < creature_count; ++c) {
+            population.addController(uint32_t(c * scene.body_object_count), uint32_t(c * scene.body_constraint_count));
+        }
+        population.randomizeGenomes(seed, 2.0f);
+        std::printf("%d controllers, %d inputs, %d parameters each\n", population.getControllerCount(),
+                    population.getTopology().inputCount(), population.getParameterCount());
+    }
+
+    TrajectoryWriter trajectory;
+    if (!record_path.empty() && !trajectory.open(record_path, trajectory_options)) return 1;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    double time = 0.0;
+    for (int i = 0; i < steps; ++i) {
+        profiler.beginFrame();
+        if (controllers) physics_system.updateControllers(population, float(physics_system.getStepCount()) * dt);
+        physics_system.update(dt);
+        if (trajectory.isOpen()) {
+            // Copied into the writer's queue, encoded and written on its thread
+            ProfileScope scope(&profiler, "record");
+            const SoAObjectState& state = physics_system.getObjectState();
+            const float* const fields[6] = {state.x.data(), state.y.data(), state.z.data(), state.vel_x.data(), state.vel_y.data(), state.vel_z.data()};
+            time += dt;
+            trajectory.push(physics_system.getStepCount(), time, fields, state.size());
+        }
+        profiler.endFrame();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::printf("%d steps on %d threads in %.3f ms (%.4f ms/step)\n", steps, physics_system.getThreadCount(), ms, steps > 0 ? ms / steps : 0.0);
+    std::vector<GPUPhysicsObject> objects = physics_system.getObjectsData();
+    for (size_t i = 0; i < objects.size() && i < 16; ++i) {
+        std::printf("object %zu position (%.3f, %.3f, %.3f) velocity (%.3f, %.3f, %.3f)\n", i,
+                    objects[i].position.x, objects[i].position.y, objects[i].position.z,
+                    objects[i].velocity.x, objects[i].velocity.y, objects[i].velocity.z);
+    }
+
+    GPUPhysicsStats stats = physics_system.computeStats();
+    std::printf("kinetic energy %.3f, momentum (%.3f, %.3f, %.3f), max constraint violation %.3f, %u objects asleep\n",
+                stats.kinetic_energy, stats.momentum.x, stats.momentum.y, stats.momentum.z, stats.max_constraint_violation,
+                stats.sleeping_count);
+
+    if (trajectory.isOpen()) {
+        trajectory.close();
+        uint64_t raw_bytes = trajectory.getFrameCount() * objects.size() * 6 * sizeof(float);
+        std::printf("Wrote trajectory %s: %llu frames, %llu bytes (%.1fx smaller than raw floats), %llu stalls\n", record_path.c_str(),
+                    (unsigned long long)trajectory.getFrameCount(), (unsigned long long)trajectory.getBytesWritten(),
+                    trajectory.getBytesWritten() > 0 ? double(raw_bytes) / double(trajectory.getBytesWritten()) : 0.0,
+                    (unsigned long long)trajectory.getStalledFrames());
+
+        // The last frame has to come back as the final state, within the quantization step
+        TrajectoryReader reader;
+        TrajectoryFrame frame;
+        if (!reader.open(record_path) || reader.getFrameCount() == 0 || !reader.readFrame(reader.getFrameCount() - 1, frame) ||
+            frame.positions.size() != objects.size()) {
+            std::fprintf(stderr, "Could not read back the last frame of %s\n", record_path.c_str());
+            return 1;
+        }
+        float position_error = 0.0f, velocity_error = 0.0f;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (int c = 0; c < 3; ++c) {
+                position_error = std::max(position_error, std::fabs(frame.positions[i][c] - objects[i].position[c]));
+                velocity_error = std::max(velocity_error, std::fabs(frame.velocities[i][c] - objects[i].velocity[c]));
+            }
+        }
+        std::printf("Last frame reads back within %g position, %g velocity\n", position_error, velocity_error);
+    }
+
+    if (!save_path.empty()) {
+        if (!physics_system.saveSnapshot(save_path.c_str())) return 1;
+        std::printf("Wrote snapshot %s\n", save_path.c_str());
+    }
+
+    if (!profile_path.empty()) {
+        for (const Profiler::Stat& stat : profiler.getTotalStats()) {
+            std::printf("%-18s %10.3f ms total, %8.4f ms/step, %d calls\n", stat.name, stat.total_ms, stat.total_ms / steps, stat.calls);
+        }
+        if (!profiler.writeChromeTrace(profile_path)) return 1;
+        std::printf("Wrote trace %s\n", profile_path.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object; // slot i of the awake objects sorted by color, not object i
+    uint color; // of object i the last time it was awake
+};
+
+struct DispatchIndirectCommand {
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+};
+
+layout(std430, binding = 0) restrict buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+// Objects sorted by color, from the host-side constraint graph
+layout(std430, binding = 5) restrict readonly buffer ColorOrderBuffer {
+    uint color_objects[];
+};
+
+// Counts, see GPUPhysicsHeader. One awake count per color follows the fixed fields, zeroed by the host
+// before the first pass
+layout(std430, binding = 2) restrict buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+    uint solver_converged;
+    uint solver_iterations;
+    uint solver_residual;
+    uint active_counts[];
+};
+
+// Indexed by PhysicsDispatch, then one slot per color
+layout(std430, binding = 6) restrict writeonly buffer DispatchBuffer {
+    DispatchIndirectCommand dispatches[];
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+layout(std430, binding = 7) restrict readonly buffer ColorOffsetBuffer {
+    uint color_offsets[];
+};
+
+layout(location = 0) uniform int u_pass; // 0 compacts the objects, 1 sizes the color dispatches
+layout(location = 1) uniform int u_colorCount;
+layout(location = 2) uniform int u_sleepEnabled;
+
+const uint WORK_GROUP_SIZE = 64;
+const uint DISPATCH_COUNT = 5;
+
+// Color of a slot of the color order
+uint slotColor(uint slot) {
+    uint low = 0, high = uint(u_colorCount);
+    while (high - low > 1) {
+        uint middle = (low + high) / 2;
+        if (color_offsets[middle] <= slot) low = middle; else high = middle;
+    }
+    return low;
+}
+
+// Once per step before the iterations: wakes touched islands and lists the objects the solver moves,
+// so static objects and sleeping islands cost no work group
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (u_pass == 1) {
+        for (uint c = index; c < uint(u_colorCount); c += WORK_GROUP_SIZE) {
+            dispatches[DISPATCH_COUNT + c] = DispatchIndirectCommand((active_counts[c] + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+        }
+        return;
+    }
+
+    if (index >= object_count) return;
+
+    uint object = color_objects[index];
+    uint flags = objects[object].flags;
+    if ((flags & OBJECT_STATIC) != 0u) return;
+    if ((flags & OBJECT_SLEEPING) != 0u) {
+        // Stays asleep unless its island was touched, or sleeping was turned off
+        if (u_sleepEnabled != 0 && island_states[island_states[object].label].wake == 0u) return;
+        objects[object].flags = flags & ~OBJECT_SLEEPING;
+        island_states[object].rest_time = 0.0;
+    }
+
+    uint color = slotColor(index);
+    island_states[object].color = color;
+    uint slot = atomicAdd(active_counts[color], 1u);
+    // Same layout as the color order, color c starts at color_offsets[c] and holds active_counts[c] objects
+    island_states[color_offsets[color] + slot].active_object = object;
+}
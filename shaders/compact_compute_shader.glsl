@@ -0,0 +1,96 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict readonly buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+layout(std430, binding = 4) restrict readonly buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+// The pass runs on its own and update() rebinds the solver's buffers after it, so these reuse their slots
+layout(std430, binding = 5) restrict writeonly buffer CompactObjectBuffer {
+    PhysicsObject compact_objects[];
+};
+
+layout(std430, binding = 6) restrict writeonly buffer CompactConstraintBuffer {
+    Constraint compact_constraints[];
+};
+
+layout(std430, binding = 7) restrict writeonly buffer CompactIslandBuffer {
+    IslandState compact_island_states[];
+};
+
+// New index of every object and constraint, REMOVED_INDEX for the removed ones (HandleTable::compact)
+layout(std430, binding = 8) restrict readonly buffer ObjectRemapBuffer {
+    uint object_remap[];
+};
+
+layout(std430, binding = 9) restrict readonly buffer ConstraintRemapBuffer {
+    uint constraint_remap[];
+};
+
+layout(location = 0) uniform int u_pass; // 0 moves the objects, 1 the constraints
+layout(location = 1) uniform int u_count; // objects or constraints before the compaction
+
+const uint REMOVED_INDEX = 0xffffffffu;
+
+// Moves the live objects and constraints down over the removed ones into fresh buffers, in order,
+// so the constraint graph and the world ranges only need renumbering
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+    if (index >= uint(u_count)) return;
+
+    if (u_pass == 0) {
+        uint target = object_remap[index];
+        if (target == REMOVED_INDEX) return;
+        compact_objects[target] = objects[index];
+
+        // Island labels point at the root object. An island whose root was removed splits into single objects
+        // until the next island pass, each taking over the root's wake request
+        IslandState island = island_states[index];
+        uint root = object_remap[island.label];
+        if (root == REMOVED_INDEX) {
+            island.wake = island_states[island.label].wake;
+            root = target;
+        }
+        island.label = root;
+        compact_island_states[target] = island;
+        return;
+    }
+
+    uint target = constraint_remap[index];
+    if (target == REMOVED_INDEX) return;
+    Constraint constraint = constraints[index];
+    constraint.indexA = int(object_remap[constraint.indexA]);
+    constraint.indexB = int(object_remap[constraint.indexB]);
+    compact_constraints[target] = constraint;
+}
@@ -2,21 +2,17 @@
 
 layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
 
-struct PhysicsObject {
-    vec4 position;
-    vec4 velocity;
-    vec4 acceleration;
-    float mass;
-    float radius;
-};
+// PhysicsObject, World and WorldBuffer are inserted by the loader, see physicsShaderPrelude()
 
 struct Constraint {
     int type;
     int indexA;
     int indexB;
     float restLength;
-    float stiffness; // k_j^(n)
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
     float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
     // Could also add min/max bounds for inequality constraints
 };
 
@@ -28,32 +24,118 @@ layout(std430, binding = 1) restrict buffer ConstraintBuffer {
     Constraint constraints[];
 };
 
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+// Counts, see GPUPhysicsHeader. The contact count is written by contact_compute_shader.glsl
+layout(std430, binding = 2) restrict readonly buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+};
+
+const int CONSTRAINT_CONTACT = 4;
+
 layout(location = 0) uniform float u_deltaTime;
 layout(location = 1) uniform int u_iterations;
-layout(location = 2) uniform vec2 u_screenSize;
-layout(location = 3) uniform int u_objectCount;
-layout(location = 4) uniform int u_constraintCount;
+layout(location = 3) uniform int u_iteration;
+layout(location = 5) uniform int u_contactPass; // binding 1 holds the contacts instead of the constraints
+layout(location = 6) uniform int u_warmStartPass; // once per step before the iterations, see SolverParameters
+layout(location = 7) uniform int u_warmStart;
+layout(location = 8) uniform float u_alpha;
+layout(location = 9) uniform float u_gamma;
+layout(location = 10) uniform float u_beta;
+layout(location = 11) uniform float u_stiffnessMin;
+layout(location = 12) uniform float u_stiffnessMax;
 
 float DistanceConstraint(vec3 X, vec3 Y, float restLength) {
     return distance(X, Y) - restLength;
 }
 
+// Objects the solver leaves where they are this step
+bool isResting(uint index) {
+    return (objects[index].flags & (OBJECT_STATIC | OBJECT_SLEEPING)) != 0u;
+}
+
+// An awake object that moves, kinematic objects at a standstill leave sleeping neighbours alone
+bool isMoving(uint index) {
+    uint flags = objects[index].flags;
+    if ((flags & (OBJECT_STATIC | OBJECT_SLEEPING)) != 0u) return false;
+    return (flags & OBJECT_KINEMATIC) == 0u || dot(toVec3(objects[index].velocity), toVec3(objects[index].velocity)) > 0.0;
+}
+
+// A sleeping object pulled on by a moving one wakes its whole island before the iterations
+void wakeIfPulled(uint index, uint other) {
+    if ((objects[index].flags & OBJECT_SLEEPING) != 0u && isMoving(other)) island_states[island_states[index].label].wake = 1u;
+}
+
+// A soft constraint's penalty ramps up to its material stiffness, hard constraints and contacts only stop at the clamp
+float penaltyCap(uint index) {
+    bool hard = constraints[index].type == 1 || constraints[index].type == CONSTRAINT_CONTACT;
+    return hard ? u_stiffnessMax : min(constraints[index].stiffness, u_stiffnessMax);
+}
+
 // 26. loop over all constraints, TODO: needs to be done seperately to object parallelization
 void main() {
     uint index = uint(gl_GlobalInvocationID.x);
 
-    float beta = 10.0;
+    if (index >= (u_contactPass != 0 ? contact_count : constraint_count)) return;
+    if (constraints[index].type == CONSTRAINT_REMOVED) return;
+
+    uint a = uint(constraints[index].indexA);
+    uint b = uint(constraints[index].indexB);
+
+    // 1. Warm start (Eq. 19), scale down what the last step left behind
+    if (u_warmStartPass != 0) {
+        wakeIfPulled(a, b);
+        wakeIfPulled(b, a);
+        // Constraints of sleeping islands keep their duals until they wake
+        if (isResting(a) && isResting(b)) return;
+        float cap = penaltyCap(index);
+        if (u_warmStart != 0) {
+            constraints[index].lambda *= u_alpha * u_gamma;
+            constraints[index].penalty = min(max(u_gamma * constraints[index].penalty, u_stiffnessMin), cap);
+        } else {
+            constraints[index].lambda = 0.0;
+            constraints[index].penalty = min(u_stiffnessMin, cap);
+        }
+        return;
+    }
+
+    // Worlds past their iteration count leave their duals alone, both endpoints share the world
+    int world_iterations = worlds[objectWorld(a)].iterations;
+    if (world_iterations > 0 && u_iteration >= world_iterations) return;
+    if (isResting(a) && isResting(b)) return;
 
     // 28. Update lambda
-    vec3 currentX = objects[constraints[index].indexA].position.xyz;
-    vec3 otherX = objects[constraints[index].indexB].position.xyz;
-    float currentDistance = DistanceConstraint(currentX, otherX, constraints[index].restLength);
-    float constraint_force = constraints[index].stiffness * currentDistance;
-
-    constraints[index].lambda = constraint_force; // max(constraint_force, lambda_min);
-    // 29. Check lambda against bounds
-    // if (lambda_min < lambda) {
-        // 30. Update stiffness
-        constraints[index].stiffness += beta * abs(constraints[index].stiffness * currentDistance + constraints[index].lambda);
-    // }
+    vec3 currentX = toVec3(objects[a].position);
+    vec3 otherX = toVec3(objects[b].position);
+    float currentDistance = DistanceConstraint(currentX, otherX, constraints[index].restLength) - constraints[index].stabilization;
+
+    // Contacts only push: λ is clamped to λ ≤ 0 and the penalty stops ramping once the contact lets go
+    if (constraints[index].type == CONSTRAINT_CONTACT) {
+        constraints[index].lambda = min(constraints[index].penalty * currentDistance + constraints[index].lambda, 0.0);
+        if (constraints[index].lambda == 0.0) return;
+        constraints[index].penalty = min(constraints[index].penalty + u_beta * abs(currentDistance), penaltyCap(index));
+        return;
+    }
+
+    // Only hard constraints and contacts carry a dual variable (Eq. 11)
+    bool hard = constraints[index].type == 1 || constraints[index].type == CONSTRAINT_CONTACT;
+    constraints[index].lambda = hard ? constraints[index].penalty * currentDistance + constraints[index].lambda : 0.0;
+
+    // 30. Update the penalty (Eq. 12), clamped so it cannot grow without bound
+    constraints[index].penalty = min(constraints[index].penalty + u_beta * abs(currentDistance), penaltyCap(index));
 }
\ No newline at end of file
@@ -1,12 +1,6 @@
 #version 430 core
 
-struct PhysicsObject {
-    vec4 position;
-    vec4 velocity;
-    vec4 acceleration;
-    float mass;
-    float radius;
-};
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
 
 struct PhysicsConstraint {
     int type;
@@ -15,6 +9,8 @@ struct PhysicsConstraint {
     float restLength;
     float stiffness;
     float lambda;
+    float penalty;
+    float stabilization;
 };
 
 layout(std430, binding = 0) readonly buffer ObjectBuffer {
@@ -25,20 +21,31 @@ layout(std430, binding = 1) readonly buffer ConstraintBuffer {
     PhysicsConstraint constraints[];
 };
 
+// State one step earlier, blended towards objects by u_alpha
+layout(std430, binding = 5) readonly buffer PreviousObjectBuffer {
+    PhysicsObject previous_objects[];
+};
+
+// Constraints on screen, from cull_compute_shader.glsl
+layout(std430, binding = 7) readonly buffer VisibleConstraintBuffer {
+    uint visible_constraints[];
+};
+
 uniform mat4 u_projection;
+uniform float u_alpha;
 
 out float v_stress;
 
 void main() {
-    PhysicsConstraint c = constraints[gl_InstanceID];
-    PhysicsObject a = objects[c.indexA];
-    PhysicsObject b = objects[c.indexB];
+    PhysicsConstraint c = constraints[visible_constraints[gl_InstanceID]];
+    vec2 positionA = mix(previous_objects[c.indexA].position.xy, objects[c.indexA].position.xy, u_alpha);
+    vec2 positionB = mix(previous_objects[c.indexB].position.xy, objects[c.indexB].position.xy, u_alpha);
 
     // Choose start (vertex 0) or end (vertex 1) of line
-    vec2 pos = (gl_VertexID == 0) ? a.position.xy : b.position.xy;
+    vec2 pos = (gl_VertexID == 0) ? positionA : positionB;
 
     // Stress = relative deviation from rest length
-    float currentLength = distance(a.position.xy, b.position.xy);
+    float currentLength = distance(positionA, positionB);
     v_stress = (currentLength - c.restLength) / c.restLength;
 
     gl_Position = u_projection * vec4(pos, 0.0, 1.0);
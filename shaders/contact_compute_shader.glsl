@@ -0,0 +1,178 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject, World and WorldBuffer are inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+// [0, cells) counts then cursors, [cells, 2 cells] starts, then sorted objects, then the cell of every object
+layout(std430, binding = 5) restrict readonly buffer GridBuffer {
+    uint grid[];
+};
+
+// Contacts of this step and of the previous one, the buffers swap every step
+layout(std430, binding = 8) restrict writeonly buffer ContactBuffer {
+    Constraint contacts[];
+};
+
+layout(std430, binding = 6) restrict readonly buffer PreviousContactBuffer {
+    Constraint previous_contacts[];
+};
+
+// Per object: contact count, then MAX_CONTACTS_PER_OBJECT contact indices
+layout(std430, binding = 9) restrict buffer ContactListBuffer {
+    uint contact_lists[];
+};
+
+layout(std430, binding = 7) restrict readonly buffer PreviousContactListBuffer {
+    uint previous_contact_lists[];
+};
+
+// Counts, see GPUPhysicsHeader
+layout(std430, binding = 2) restrict buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+};
+
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+layout(location = 1) uniform int u_cellCount;
+layout(location = 2) uniform float u_cellSize;
+layout(location = 4) uniform float u_contactStiffness;
+layout(location = 5) uniform int u_warmStart; // see SolverParameters
+layout(location = 6) uniform float u_alpha;
+layout(location = 7) uniform float u_gamma;
+layout(location = 8) uniform float u_stiffnessMin;
+layout(location = 9) uniform float u_stiffnessMax;
+
+const uint MAX_CONTACTS_PER_OBJECT = 8;
+const int CONSTRAINT_CONTACT = 4;
+
+uint cellHash(ivec2 cell, uint world) {
+    return (uint(cell.x) + uint(cell.y) * 19349663u + world * 83492791u) & uint(u_cellCount - 1);
+}
+
+void appendContact(uint object, uint contact) {
+    uint slot = atomicAdd(contact_lists[object * (MAX_CONTACTS_PER_OBJECT + 1)], 1u);
+    if (slot < MAX_CONTACTS_PER_OBJECT) {
+        contact_lists[object * (MAX_CONTACTS_PER_OBJECT + 1) + 1 + slot] = contact;
+    } else {
+        contact_overflow = 1;
+    }
+}
+
+// An awake object that moves, kinematic objects at a standstill leave sleeping neighbours alone
+bool isMoving(uint index) {
+    uint flags = objects[index].flags;
+    if ((flags & (OBJECT_STATIC | OBJECT_SLEEPING)) != 0u) return false;
+    return (flags & OBJECT_KINEMATIC) == 0u || dot(toVec3(objects[index].velocity), toVec3(objects[index].velocity)) > 0.0;
+}
+
+// A sleeping object touched by a moving one wakes its whole island before the iterations
+void wakeIfTouched(uint index, uint other) {
+    if ((objects[index].flags & OBJECT_SLEEPING) != 0u && isMoving(other)) island_states[island_states[index].label].wake = 1u;
+}
+
+// 4. Narrow phase, one contact constraint per overlapping pair, emitted by the lower index
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    // Removed objects touch nothing until the compaction drops them
+    if (index >= object_count || (objects[index].flags & OBJECT_REMOVED) != 0u) return;
+
+    vec3 position = toVec3(objects[index].position);
+    float radius = objects[index].radius;
+    uint world = objectWorld(index);
+    ivec2 cell = ivec2(floor(position.xy / u_cellSize));
+    uint cells = uint(u_cellCount);
+
+    // Neighbouring cells can hash to the same bucket, visit each bucket once
+    uint visited[9];
+    int visited_count = 0;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            uint hash = cellHash(cell + ivec2(dx, dy), world);
+            bool seen = false;
+            for (int v = 0; v < visited_count; v++) {
+                seen = seen || visited[v] == hash;
+            }
+            if (seen) continue;
+            visited[visited_count++] = hash;
+
+            uint end = grid[cells + hash + 1];
+            for (uint s = grid[cells + hash]; s < end; s++) {
+                uint other = grid[2 * cells + 1 + s];
+                // Buckets are shared between hash collisions, worlds never touch
+                if (other <= index || objectWorld(other) != world || (objects[other].flags & OBJECT_REMOVED) != 0u) continue;
+
+                float rest_length = radius + objects[other].radius;
+                vec3 offset = position - toVec3(objects[other].position);
+                if (dot(offset, offset) >= rest_length * rest_length) continue;
+
+                wakeIfTouched(index, other);
+                wakeIfTouched(other, index);
+
+                uint k = atomicAdd(contact_count, 1u);
+                if (k >= contact_capacity) {
+                    contact_overflow = 1;
+                    continue;
+                }
+
+                // Warm start from the same pair last step, found in this object's previous list,
+                // scaled down like the constraints (Eq. 19)
+                float penalty = u_contactStiffness;
+                float lambda = 0.0;
+                uint list = index * (MAX_CONTACTS_PER_OBJECT + 1);
+                uint previous_count = u_warmStart != 0 ? min(previous_contact_lists[list], MAX_CONTACTS_PER_OBJECT) : 0u;
+                for (uint p = 0; p < previous_count; p++) {
+                    uint previous = previous_contact_lists[list + 1 + p];
+                    if (previous_contacts[previous].indexA == int(index) && previous_contacts[previous].indexB == int(other)) {
+                        penalty = clamp(u_gamma * previous_contacts[previous].penalty, u_stiffnessMin, u_stiffnessMax);
+                        lambda = u_alpha * u_gamma * previous_contacts[previous].lambda;
+                        break;
+                    }
+                }
+
+                contacts[k].type = CONSTRAINT_CONTACT;
+                contacts[k].indexA = int(index);
+                contacts[k].indexB = int(other);
+                contacts[k].restLength = rest_length;
+                contacts[k].stiffness = u_contactStiffness;
+                contacts[k].lambda = lambda;
+                contacts[k].penalty = penalty;
+                contacts[k].stabilization = u_warmStart != 0 ? u_alpha * (length(offset) - rest_length) : 0.0;
+
+                appendContact(index, k);
+                appendContact(other, k);
+            }
+        }
+    }
+}
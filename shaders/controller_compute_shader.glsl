@@ -0,0 +1,157 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// Must match max_controller_hidden in controller.h
+#define MAX_HIDDEN 64
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+// Parameter p of controller c at p * u_stride + c, see ControllerPopulation
+layout(std430, binding = 5) restrict readonly buffer ControllerWeightBuffer {
+    float weights[];
+};
+
+// Sensor objects, sensor constraints, actuators, then the actuators' base rest lengths as float bits
+layout(std430, binding = 6) restrict readonly buffer ControllerTopologyBuffer {
+    uint topology[];
+};
+
+// Object and constraint offset of each controller's creature
+layout(std430, binding = 7) restrict readonly buffer ControllerInstanceBuffer {
+    uvec2 instances[];
+};
+
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+layout(location = 0) uniform int u_controllerCount;
+layout(location = 1) uniform int u_stride;
+layout(location = 2) uniform int u_sensorObjectCount;
+layout(location = 3) uniform int u_sensorConstraintCount;
+layout(location = 4) uniform int u_actuatorCount;
+layout(location = 5) uniform int u_hiddenCount;
+layout(location = 6) uniform float u_actuatorRange;
+layout(location = 7) uniform float u_positionScale;
+layout(location = 8) uniform float u_velocityScale;
+layout(location = 9) uniform vec2 u_clock; // sin and cos of the clock phase
+
+float hidden[MAX_HIDDEN];
+uint controller;
+uint row; // inputs plus the bias of one hidden unit
+
+// Clamped rational approximation of tanh, exactly ±1 at ±3, same as activation() in controller.cpp
+float activation(float x) {
+    x = clamp(x, -3.0, 3.0);
+    float x2 = x * x;
+    return x * (27.0 + x2) / (27.0 + 9.0 * x2);
+}
+
+// Adds one input to every hidden unit as soon as it is sensed, so only the hidden layer is held
+void accumulate(uint input_index, float value) {
+    for (int j = 0; j < u_hiddenCount; ++j) {
+        hidden[j] += weights[(uint(j) * row + input_index) * uint(u_stride) + controller] * value;
+    }
+}
+
+// One thread per controller: sense, run the network, write the actuators' rest lengths in place
+void main() {
+    controller = gl_GlobalInvocationID.x;
+    if (controller >= uint(u_controllerCount)) return;
+
+    uint object_offset = instances[controller].x;
+    uint constraint_offset = instances[controller].y;
+    uint sensor_constraint_base = uint(u_sensorObjectCount);
+    uint actuator_base = sensor_constraint_base + uint(u_sensorConstraintCount);
+    uint rest_length_base = actuator_base + uint(u_actuatorCount);
+    uint input_count = uint(6 * u_sensorObjectCount + u_sensorConstraintCount + 2);
+    row = input_count + 1;
+
+    // 1. Biases
+    for (int j = 0; j < u_hiddenCount; ++j) {
+        hidden[j] = weights[(uint(j) * row + input_count) * uint(u_stride) + controller];
+    }
+
+    // 2. Centroid of the sensor objects, positions are sensed relative to it
+    vec3 centre = vec3(0.0);
+    for (int s = 0; s < u_sensorObjectCount; ++s) {
+        centre += toVec3(objects[object_offset + topology[s]].position);
+    }
+    if (u_sensorObjectCount > 0) centre /= float(u_sensorObjectCount);
+
+    // 3. Inputs in the same order as the CPU path
+    uint input_index = 0;
+    for (int s = 0; s < u_sensorObjectCount; ++s) {
+        PhysicsObject object = objects[object_offset + topology[s]];
+        vec3 position = (toVec3(object.position) - centre) * u_positionScale;
+        vec3 velocity = toVec3(object.velocity) * u_velocityScale;
+        accumulate(input_index++, position.x);
+        accumulate(input_index++, position.y);
+        accumulate(input_index++, position.z);
+        accumulate(input_index++, velocity.x);
+        accumulate(input_index++, velocity.y);
+        accumulate(input_index++, velocity.z);
+    }
+    for (int k = 0; k < u_sensorConstraintCount; ++k) {
+        Constraint constraint = constraints[constraint_offset + topology[sensor_constraint_base + uint(k)]];
+        float length = distance(toVec3(objects[constraint.indexA].position), toVec3(objects[constraint.indexB].position));
+        float rest = constraint.restLength;
+        accumulate(input_index++, rest > 0.0 ? (length - rest) / rest : 0.0);
+    }
+    accumulate(input_index++, u_clock.x);
+    accumulate(input_index++, u_clock.y);
+
+    for (int j = 0; j < u_hiddenCount; ++j) hidden[j] = activation(hidden[j]);
+
+    // 4. Output layer, each output sets its actuator's rest length
+    uint output_base = uint(u_hiddenCount) * row;
+    uint output_row = uint(u_hiddenCount) + 1;
+    for (int k = 0; k < u_actuatorCount; ++k) {
+        uint w = output_base + uint(k) * output_row;
+        float sum = weights[(w + uint(u_hiddenCount)) * uint(u_stride) + controller];
+        for (int j = 0; j < u_hiddenCount; ++j) {
+            sum += weights[(w + uint(j)) * uint(u_stride) + controller] * hidden[j];
+        }
+        float base_rest_length = uintBitsToFloat(topology[rest_length_base + uint(k)]);
+        uint actuator = constraint_offset + topology[actuator_base + uint(k)];
+        float rest_length = base_rest_length * (1.0 + u_actuatorRange * activation(sum));
+
+        // A muscle that moves wakes a sleeping creature
+        if (rest_length != constraints[actuator].restLength) {
+            uint a = uint(constraints[actuator].indexA);
+            uint b = uint(constraints[actuator].indexB);
+            if ((objects[a].flags & OBJECT_SLEEPING) != 0u) island_states[island_states[a].label].wake = 1u;
+            if ((objects[b].flags & OBJECT_SLEEPING) != 0u) island_states[island_states[b].label].wake = 1u;
+        }
+        constraints[actuator].restLength = rest_length;
+    }
+}
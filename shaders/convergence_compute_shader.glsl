@@ -0,0 +1,54 @@
+#version 430 core
+
+layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+struct DispatchIndirectCommand {
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+};
+
+layout(std430, binding = 2) restrict buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+    uint solver_converged;
+    uint solver_iterations;
+    uint solver_residual; // float bits, non-negative floats order like their bits
+};
+
+// Indexed by PhysicsDispatch
+layout(std430, binding = 6) restrict writeonly buffer DispatchBuffer {
+    DispatchIndirectCommand dispatches[];
+};
+
+layout(location = 0) uniform int u_iteration;
+layout(location = 1) uniform int u_minIterations;
+layout(location = 2) uniform int u_maxIterations;
+layout(location = 3) uniform float u_tolerance; // 0 never converges early
+layout(location = 4) uniform int u_colorCount;
+
+const uint DISPATCH_COUNT = 5;
+
+// Runs after every iteration: records it, and once the largest step of the iteration is within tolerance
+// turns the rest of the step into empty dispatches, so the host never has to read the residual back
+void main() {
+    if (solver_converged != 0) return;
+
+    solver_iterations = uint(u_iteration + 1);
+    float residual = uintBitsToFloat(solver_residual);
+
+    if (u_iteration + 1 >= u_minIterations && u_tolerance > 0.0 && residual <= u_tolerance) {
+        solver_converged = 1;
+        dispatches[3] = DispatchIndirectCommand(0, 1, 1);
+        dispatches[4] = DispatchIndirectCommand(0, 1, 1);
+        // The color batches too, activation sizes them again next step
+        for (uint c = 0; c < uint(u_colorCount); c++) dispatches[DISPATCH_COUNT + c] = DispatchIndirectCommand(0, 1, 1);
+        return;
+    }
+
+    // The next iteration measures its own steps, the last one keeps its residual
+    if (u_iteration + 1 < u_maxIterations) solver_residual = 0;
+}
@@ -0,0 +1,106 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct PhysicsConstraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness;
+    float lambda;
+    float penalty;
+    float stabilization;
+};
+
+struct DrawArraysIndirectCommand {
+    uint count;
+    uint instance_count;
+    uint first;
+    uint base_instance;
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict readonly buffer ConstraintBuffer {
+    PhysicsConstraint constraints[];
+};
+
+// State one step earlier, blended towards objects by u_alpha
+layout(std430, binding = 5) restrict readonly buffer PreviousObjectBuffer {
+    PhysicsObject previous_objects[];
+};
+
+// Bodies drawn as quads from 0, bodies drawn as points from u_count
+layout(std430, binding = 6) restrict writeonly buffer VisibleObjectBuffer {
+    uint visible_objects[];
+};
+
+layout(std430, binding = 7) restrict writeonly buffer VisibleConstraintBuffer {
+    uint visible_constraints[];
+};
+
+// Indexed by RenderDraw, instance counts zeroed by the host before the pass
+layout(std430, binding = 8) restrict buffer DrawCommandBuffer {
+    DrawArraysIndirectCommand draw_commands[];
+};
+
+layout(location = 0) uniform mat4 u_projection;
+layout(location = 4) uniform float u_alpha;
+layout(location = 5) uniform vec2 u_viewportSize;
+layout(location = 6) uniform float u_pointRadius; // pixels, smaller bodies become points
+layout(location = 7) uniform int u_count;
+layout(location = 8) uniform int u_pass; // 0 culls the objects, 1 the constraints
+
+const uint DRAW_QUADS = 0;
+const uint DRAW_POINTS = 1;
+const uint DRAW_CONSTRAINTS = 2;
+
+vec2 drawPosition(uint index) {
+    return mix(previous_objects[index].position.xy, objects[index].position.xy, u_alpha);
+}
+
+// Clip space of the orthographic projection, w is 1
+vec2 toClip(vec2 position) {
+    return (u_projection * vec4(position, 0.0, 1.0)).xy;
+}
+
+bool outsideView(vec2 low, vec2 high) {
+    return any(greaterThan(low, vec2(1.0))) || any(lessThan(high, vec2(-1.0)));
+}
+
+// Once per frame before the draws: lists what is on screen, so off-screen bodies cost no vertices and
+// sub-pixel bodies one point each
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (index >= uint(u_count)) return;
+
+    if (u_pass == 1) {
+        if (constraints[index].type == CONSTRAINT_REMOVED) return;
+        vec2 a = toClip(drawPosition(uint(constraints[index].indexA)));
+        vec2 b = toClip(drawPosition(uint(constraints[index].indexB)));
+        if (outsideView(min(a, b), max(a, b))) return;
+        uint slot = atomicAdd(draw_commands[DRAW_CONSTRAINTS].instance_count, 1u);
+        visible_constraints[slot] = index;
+        return;
+    }
+
+    if ((objects[index].flags & OBJECT_REMOVED) != 0u) return;
+    vec2 center = toClip(drawPosition(index));
+    vec2 extent = abs(vec2(u_projection[0][0], u_projection[1][1])) * objects[index].radius;
+    if (outsideView(center - extent, center + extent)) return;
+
+    float pixel_radius = 0.5 * max(extent.x * u_viewportSize.x, extent.y * u_viewportSize.y);
+    if (pixel_radius < u_pointRadius) {
+        uint slot = atomicAdd(draw_commands[DRAW_POINTS].instance_count, 1u);
+        visible_objects[uint(u_count) + slot] = index;
+    } else {
+        uint slot = atomicAdd(draw_commands[DRAW_QUADS].instance_count, 1u);
+        visible_objects[slot] = index;
+    }
+}
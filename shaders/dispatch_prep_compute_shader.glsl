@@ -0,0 +1,54 @@
+#version 430 core
+
+layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+struct DispatchIndirectCommand {
+    uint num_groups_x;
+    uint num_groups_y;
+    uint num_groups_z;
+};
+
+layout(std430, binding = 2) restrict buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+    uint solver_converged;
+    uint solver_iterations;
+    uint solver_residual;
+};
+
+// Indexed by PhysicsDispatch
+layout(std430, binding = 6) restrict writeonly buffer DispatchBuffer {
+    DispatchIndirectCommand dispatches[];
+};
+
+const uint WORK_GROUP_SIZE = 64;
+
+uint workGroups(uint count) {
+    return (count + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE;
+}
+
+// Turns the counts in the header into work group counts for glDispatchComputeIndirect,
+// and starts the step's convergence tracking over
+void main() {
+    // The narrow phase keeps counting past the capacity, those contacts were dropped
+    if (contact_count > contact_capacity) {
+        contact_count = contact_capacity;
+        contact_overflow = 1;
+    }
+
+    // The buffer is write-only, slots sharing a count are built from locals
+    DispatchIndirectCommand constraint_dispatch = DispatchIndirectCommand(workGroups(constraint_count), 1, 1);
+    DispatchIndirectCommand contact_dispatch = DispatchIndirectCommand(workGroups(contact_count), 1, 1);
+    dispatches[0] = DispatchIndirectCommand(workGroups(object_count), 1, 1);
+    dispatches[1] = constraint_dispatch;
+    dispatches[2] = contact_dispatch;
+    dispatches[3] = constraint_dispatch;
+    dispatches[4] = contact_dispatch;
+
+    solver_converged = 0;
+    solver_iterations = 0;
+    solver_residual = 0;
+}
@@ -0,0 +1,82 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+struct Edit {
+    int field;
+    int index;
+    vec4 value;
+};
+
+layout(std430, binding = 0) restrict buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+layout(std430, binding = 5) restrict readonly buffer EditBuffer {
+    Edit edits[];
+};
+
+struct IslandState {
+    uint label;
+    float rest_time;
+    uint min_rest;
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+layout(location = 0) uniform int u_editCount;
+
+void wakeIsland(uint object) {
+    island_states[object].rest_time = 0.0;
+    island_states[island_states[object].label].wake = 1u;
+}
+
+// Scatters the edits queued on the host since the last step, at most one per field of a record.
+// Whatever an edit touches wakes up with its island on the next step
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (index >= u_editCount) return;
+
+    Edit edit = edits[index];
+    if ((edit.field >= 5 && edit.field <= 7) || edit.field == 9) {
+        wakeIsland(uint(constraints[edit.index].indexA));
+        wakeIsland(uint(constraints[edit.index].indexB));
+    } else {
+        wakeIsland(uint(edit.index));
+    }
+    switch (edit.field) {
+        case 0: objects[edit.index].position = toObjectVector(edit.value, edit.value.w); break;
+        case 1: objects[edit.index].velocity = toObjectVector(edit.value, edit.value.w); break;
+        case 2: objects[edit.index].acceleration = toObjectVector(edit.value, edit.value.w); break;
+        case 3: objects[edit.index].mass = edit.value.x; break;
+        case 4: objects[edit.index].radius = edit.value.x; break;
+        case 5: constraints[edit.index].restLength = edit.value.x; break;
+        case 6: constraints[edit.index].stiffness = edit.value.x; break;
+        case 7: constraints[edit.index].lambda = edit.value.x; break;
+        case 8: objects[edit.index].flags = uint(edit.value.x); break;
+        case 9: constraints[edit.index].type = int(edit.value.x); break;
+    }
+}
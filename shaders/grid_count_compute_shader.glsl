@@ -0,0 +1,53 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject, World and WorldBuffer are inserted by the loader, see physicsShaderPrelude()
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+// [0, cells) counts then cursors, [cells, 2 cells] starts, then sorted objects, then the cell of every object
+layout(std430, binding = 5) restrict buffer GridBuffer {
+    uint grid[];
+};
+
+// Per object: contact count, then MAX_CONTACTS_PER_OBJECT contact indices
+layout(std430, binding = 9) restrict writeonly buffer ContactListBuffer {
+    uint contact_lists[];
+};
+
+// Counts, see GPUPhysicsHeader
+layout(std430, binding = 2) restrict readonly buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+};
+
+layout(location = 1) uniform int u_cellCount;
+layout(location = 2) uniform float u_cellSize;
+
+const uint MAX_CONTACTS_PER_OBJECT = 8;
+
+// Same hash as UniformGrid::cellHash, cells next to each other along x land in neighbouring buckets.
+// The world term keeps the copies of a batch that sit on top of each other out of each other's buckets
+uint cellHash(ivec2 cell, uint world) {
+    return (uint(cell.x) + uint(cell.y) * 19349663u + world * 83492791u) & uint(u_cellCount - 1);
+}
+
+// 1. Count the objects in every cell
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (index >= object_count) return;
+
+    uint hash = cellHash(ivec2(floor(objects[index].position.xy / u_cellSize)), objectWorld(index));
+    grid[2 * u_cellCount + 1 + object_count + index] = hash;
+    atomicAdd(grid[hash], 1u);
+
+    // Empty this step's contact list before the narrow phase appends to it
+    contact_lists[index * (MAX_CONTACTS_PER_OBJECT + 1)] = 0;
+}
@@ -0,0 +1,50 @@
+#version 430 core
+
+// One work group: every thread scans a run of cells, the run totals are scanned in shared memory
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+// [0, cells) counts then cursors, [cells, 2 cells] starts, then sorted objects, then the cell of every object
+layout(std430, binding = 5) restrict buffer GridBuffer {
+    uint grid[];
+};
+
+layout(location = 1) uniform int u_cellCount;
+
+shared uint run_totals[1024];
+
+// 2. Exclusive prefix sum of the cell counts
+void main() {
+    uint thread = gl_LocalInvocationID.x;
+    uint cells = uint(u_cellCount);
+    uint run = (cells + 1023) / 1024;
+    uint begin = min(thread * run, cells);
+    uint end = min(begin + run, cells);
+
+    uint total = 0;
+    for (uint c = begin; c < end; c++) {
+        total += grid[c];
+    }
+    run_totals[thread] = total;
+    memoryBarrierShared();
+    barrier();
+
+    // Hillis-Steele inclusive scan over the run totals
+    for (uint offset = 1; offset < 1024; offset <<= 1) {
+        uint previous = thread >= offset ? run_totals[thread - offset] : 0u;
+        memoryBarrierShared();
+        barrier();
+        run_totals[thread] += previous;
+        memoryBarrierShared();
+        barrier();
+    }
+
+    // Starts, and the counts become the scatter cursors
+    uint start = run_totals[thread] - total;
+    for (uint c = begin; c < end; c++) {
+        uint count = grid[c];
+        grid[cells + c] = start;
+        grid[c] = start;
+        start += count;
+    }
+    if (thread == 1023) grid[2 * cells] = run_totals[1023];
+}
@@ -0,0 +1,30 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// [0, cells) counts then cursors, [cells, 2 cells] starts, then sorted objects, then the cell of every object
+layout(std430, binding = 5) restrict buffer GridBuffer {
+    uint grid[];
+};
+
+// Counts, see GPUPhysicsHeader
+layout(std430, binding = 2) restrict readonly buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+};
+
+layout(location = 1) uniform int u_cellCount;
+
+// 3. Write every object into its cell's range, the order inside a cell is arbitrary
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (index >= object_count) return;
+
+    uint hash = grid[2 * u_cellCount + 1 + object_count + index];
+    uint slot = atomicAdd(grid[hash], 1u);
+    grid[2 * u_cellCount + 1 + slot] = index;
+}
@@ -0,0 +1,120 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+struct IslandState {
+    uint label; // parent while merging, root object once compressed
+    float rest_time;
+    uint min_rest; // float bits, non-negative floats order like their bits
+    uint wake;
+    uint active_object;
+    uint color;
+};
+
+layout(std430, binding = 0) restrict buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+// Constraints, or this step's contacts in the contact pass
+layout(std430, binding = 1) restrict readonly buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+// Counts, see GPUPhysicsHeader
+layout(std430, binding = 2) restrict readonly buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+};
+
+// Labels are linked by other invocations of the same dispatch while they are read
+layout(std430, binding = 4) restrict coherent buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+layout(location = 0) uniform int u_pass; // 0 resets, 1 merges along the edges, 2 compresses, 3 puts islands to sleep
+layout(location = 1) uniform int u_contactPass; // binding 1 holds the contacts instead of the constraints
+layout(location = 2) uniform float u_sleepTime;
+
+// Static and kinematic objects hold their neighbours without joining them into one island
+bool joinsIsland(uint index) {
+    return (objects[index].flags & (OBJECT_STATIC | OBJECT_KINEMATIC)) == 0u;
+}
+
+// Labels only ever point at a lower index, so the chain ends at the root
+uint findRoot(uint index) {
+    uint parent = island_states[index].label;
+    while (parent != index) {
+        index = parent;
+        parent = island_states[index].label;
+    }
+    return index;
+}
+
+// Lock-free union: the higher root is hooked under the lower one, unless another invocation
+// linked it first, then both roots are looked up again
+void unite(uint a, uint b) {
+    for (;;) {
+        a = findRoot(a);
+        b = findRoot(b);
+        if (a == b) return;
+        if (a < b) {
+            uint swap = a;
+            a = b;
+            b = swap;
+        }
+        if (atomicCompSwap(island_states[a].label, a, b) == a) return;
+    }
+}
+
+// Islands by union-find over the constraints and contacts, run every SleepParameters::island_interval steps
+void main() {
+    uint index = uint(gl_GlobalInvocationID.x);
+
+    if (u_pass == 1) {
+        // 2. Merge the endpoints of every edge between two objects that join islands
+        if (index >= (u_contactPass != 0 ? contact_count : constraint_count)) return;
+        if (constraints[index].type == CONSTRAINT_REMOVED) return;
+        uint a = uint(constraints[index].indexA);
+        uint b = uint(constraints[index].indexB);
+        if (joinsIsland(a) && joinsIsland(b)) unite(a, b);
+        return;
+    }
+
+    if (index >= object_count) return;
+
+    if (u_pass == 0) {
+        // 1. Every object is its own island, wake requests were acted on by this step's activation
+        island_states[index].label = index;
+        island_states[index].min_rest = floatBitsToUint(3.402823466e38);
+        island_states[index].wake = 0u;
+    } else if (u_pass == 2) {
+        // 3. Point straight at the root and fold the rest time into it
+        uint root = findRoot(index);
+        island_states[index].label = root;
+        if (joinsIsland(index)) atomicMin(island_states[root].min_rest, floatBitsToUint(island_states[index].rest_time));
+    } else {
+        // 4. An island sleeps once every object in it has rested long enough, and stops dead
+        if (!joinsIsland(index)) return;
+        bool asleep = uintBitsToFloat(island_states[island_states[index].label].min_rest) >= u_sleepTime;
+        if (asleep) {
+            if ((objects[index].flags & OBJECT_SLEEPING) == 0u) objects[index].velocity = toObjectVector(vec4(0.0), 0.0);
+            objects[index].flags |= OBJECT_SLEEPING;
+        } else {
+            objects[index].flags &= ~OBJECT_SLEEPING;
+        }
+    }
+}
@@ -2,21 +2,18 @@
 
 layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
 
-struct PhysicsObject {
-    vec4 position;
-    vec4 velocity;
-    vec4 acceleration;
-    float mass;
-    float radius;
-};
+// PhysicsObject, World and WorldBuffer are inserted by the loader, see physicsShaderPrelude().
+// With it this kernel reads 10 storage blocks, the most of any pass (required_compute_storage_blocks)
 
 struct Constraint {
     int type;
     int indexA;
     int indexB;
     float restLength;
-    float stiffness; // k_j^(n)
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
     float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
     // Could also add min/max bounds for inequality constraints
 };
 
@@ -28,105 +25,264 @@ layout(std430, binding = 1) restrict buffer ConstraintBuffer {
     Constraint constraints[];
 };
 
+// Constraints touching object i are adjacency_indices[adjacency_offsets[i] .. adjacency_offsets[i + 1] - 1]
+layout(std430, binding = 5) restrict readonly buffer AdjacencyOffsetBuffer {
+    uint adjacency_offsets[];
+};
+
+layout(std430, binding = 6) restrict readonly buffer AdjacencyIndexBuffer {
+    uint adjacency_indices[];
+};
+
+struct SolverState {
+    ObjectVector inertial_position; // y, fixed for the whole step
+    ObjectVector previous_position; // x at the start of the step
+    ObjectVector iteration_position; // x at the start of the iteration, written by the snapshot pass
+};
+
+layout(std430, binding = 7) restrict buffer SolverStateBuffer {
+    SolverState solver_states[];
+};
+
+// Contacts found this step and the contacts of every object: count, then MAX_CONTACTS_PER_OBJECT indices
+layout(std430, binding = 8) restrict readonly buffer ContactBuffer {
+    Constraint contacts[];
+};
+
+layout(std430, binding = 9) restrict readonly buffer ContactListBuffer {
+    uint contact_lists[];
+};
+
+// Convergence of the step, see convergence_compute_shader.glsl
+layout(std430, binding = 2) restrict buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+    uint solver_converged;
+    uint solver_iterations;
+    uint solver_residual; // float bits
+    uint active_counts[]; // awake objects per color, see activation_compute_shader.glsl
+};
+
+struct IslandState {
+    uint label;
+    float rest_time; // seconds at or below u_sleepEnergy, advanced by the velocity pass
+    uint min_rest;
+    uint wake;
+    uint active_object; // slot i of the awake objects sorted by color, not object i
+    uint color; // of object i the last time it was awake
+};
+
+layout(std430, binding = 4) restrict buffer IslandBuffer {
+    IslandState island_states[];
+};
+
+const uint MAX_CONTACTS_PER_OBJECT = 8;
+
 layout(location = 0) uniform float u_deltaTime;
-layout(location = 1) uniform int u_iterations;
 layout(location = 2) uniform int u_iteration;
-layout(location = 3) uniform vec2 u_screenSize;
 layout(location = 4) uniform int u_objectCount;
-layout(location = 5) uniform int u_constraintCount;
+layout(location = 6) uniform int u_colorOffset;
+layout(location = 7) uniform int u_color;
+layout(location = 8) uniform int u_collisionsEnabled;
+layout(location = 9) uniform int u_velocityPass; // 1 runs step 37 over every object once the iterations are done
+layout(location = 10) uniform float u_sleepEnergy; // see SleepParameters
+layout(location = 11) uniform int u_snapshotPass; // 1 copies every position to iteration_position before the colors run
+
+shared uint group_step; // largest |Δx| of the work group, float bits
 
-float DistanceConstraint(vec3 X, vec3 Y, float restLength) {
+// Fallback direction of a constraint between coincident objects
+#if DIMENSION == 2
+const vecD up = vecD(0.0, 1.0);
+#else
+const vecD up = vecD(0.0, 1.0, 0.0);
+#endif
+
+float DistanceConstraint(vecD X, vecD Y, float restLength) {
     return distance(X, Y) - restLength;
 }
 
-void main() {
-    uint index = uint(gl_GlobalInvocationID.x);
+// One local solve of the object in slot of the current color, returns |Δx|. The awake objects of the color
+// are island_states[u_colorOffset .. u_colorOffset + active_counts[u_color] - 1].active_object
+float solveObject(uint slot) {
+    if (slot >= active_counts[u_color]) return 0.0;
+
+    uint index = island_states[u_colorOffset + slot].active_object;
     
-    if (index >= u_objectCount || index == 2) return;
+    if (index >= u_objectCount) return 0.0;
+
+    // Worlds with fewer iterations are done, the rest of the batch keeps going
+    World world = worlds[objectWorld(index)];
+    if (world.iterations > 0 && u_iteration >= world.iterations) return 0.0;
+    float dt = world.dt > 0.0 ? world.dt : u_deltaTime;
+
+    // Kinematic objects move along their own velocity once per step, nothing pushes them back
+    if ((objects[index].flags & OBJECT_KINEMATIC) != 0u) {
+        if (u_iteration == 0) {
+            solver_states[index].previous_position = objects[index].position;
+            objects[index].position += dt * objects[index].velocity;
+        }
+        return 0.0;
+    }
 
     // Initialize constraint variables
 
     // float lambda_min = 0.0; // paper says to set as 0 but that doesn't work
     // float lambda_max = 100.0; // paper says to set to infinity
 
-    float beta = 10.0;
-
     // For point objects - mass matrix M_i
     float mass = objects[index].mass;
-    mat3 Mass = mass * mat3(1.0);
+    matD Mass = mass * matD(1.0);
 
-    // 3. Calculate new position/y
-    vec3 y = (objects[index].position + u_deltaTime * objects[index].velocity + u_deltaTime * u_deltaTime * objects[index].acceleration).xyz;
+    // 3. Calculate new position/y, once per step
+    if (u_iteration == 0) {
+        solver_states[index].previous_position = objects[index].position;
+        ObjectVector acceleration = objects[index].acceleration + toObjectVector(world.gravity, 0.0);
+        solver_states[index].inertial_position = objects[index].position + dt * objects[index].velocity + dt * dt * acceleration;
+    }
+    vecD y = toVecD(solver_states[index].inertial_position);
 
-    // Store previous position
-    vec3 initialX = objects[index].position.xyz;
     // Store current position
-    vec3 currentX = objects[index].position.xyz;
-
-    // 9. Iterate over all colors
-    for (uint j = 0; j < 1; j++) {
-
-        // 10. Calculate the force required to have moved the obect by the amount it moved
-        vec3 force = -(Mass / (u_deltaTime * u_deltaTime)) * (currentX - y);
-        // 11. Initialize the local hessian matrix
-        mat3 LocalHessian = Mass / (u_deltaTime * u_deltaTime);
-
-            // 12. Iterate over all constraints affecting this object
-            for (uint k = 0; k < u_constraintCount; k++) {
-                if (!(constraints[k].indexA == index || constraints[k].indexB == index)) continue;
-
-                vec3 constraint_gradient;
-                vec3 otherX = (index == constraints[k].indexA) ? objects[constraints[k].indexB].position.xyz : objects[constraints[k].indexA].position.xyz;
-
-                // 13. check if hard constraint
-                if (constraints[k].type == 1) { // hard constraint
-                    // 14. Hard constraint C_j(x)
-                    float currentDistance = DistanceConstraint(currentX, otherX, constraints[k].restLength);
-                    // direction of the constraint δCⱼ/δxⱼ
-                    vec3 dir = (index == constraints[k].indexA) ? (currentX - otherX) : (currentX - otherX);
-                    vec3 constraint_gradient = (length(dir) > 1e-6) ? normalize(dir) : vec3(0.0, 1.0, 0.0);
-                    // force of the constraint
-                    float constraint_force = constraints[k].stiffness * currentDistance + constraints[k].lambda;
-                    // clamping values and adding the direction of the constraint
-                    force -= constraint_force * constraint_gradient;
-
-                // 15. check if soft constraint
-                } else { // soft constraint
-                    // 16. Constraint
-                    float currentDistance = DistanceConstraint(currentX, otherX, constraints[k].restLength);
-                    // direction of the constraint δCⱼ/δxⱼ
-                    vec3 dir = (index == constraints[k].indexA) ? (currentX - otherX) : (currentX - otherX);
-                    vec3 constraint_gradient = (length(dir) > 1e-6) ? normalize(dir) : vec3(0.0, 1.0, 0.0);
-                    if (index == constraints[k].indexB) { // reverse direction if indexB
-                        constraint_gradient = -constraint_gradient;
-                    }
-                    // force of the constraint
-                    float constraint_force = constraints[k].stiffness * currentDistance;
-                    // clamping values and adding the direction of the constraint
-                    force -= constraint_force * constraint_gradient;
-                }
-
-                // 18. Update the local hessian matrix missing geometric stiffness matrix
-                LocalHessian += constraints[k].stiffness * outerProduct(constraint_gradient, constraint_gradient);
-            }
-
-        // 20. Apply force to objects position
-        float det = determinant(LocalHessian);
-        if (abs(det) < 1e-6) {
-            continue; // skip this iteration, matrix not invertible
+    vecD currentX = toVecD(objects[index].position);
+
+    // 9. Colors are iterated by the host, one dispatch per color
+
+    // 10. Calculate the force required to have moved the obect by the amount it moved
+    vecD force = -(Mass / (dt * dt)) * (currentX - y);
+    // 11. Initialize the local hessian matrix
+    matD LocalHessian = Mass / (dt * dt);
+
+    // 12. Iterate over all constraints affecting this object
+    uint adjacency_end = adjacency_offsets[index + 1];
+    for (uint a = adjacency_offsets[index]; a < adjacency_end; a++) {
+        uint k = adjacency_indices[a];
+
+        vecD constraint_gradient;
+        vecD otherX = (index == constraints[k].indexA) ? toVecD(objects[constraints[k].indexB].position) : toVecD(objects[constraints[k].indexA].position);
+
+        // 13. check if hard constraint
+        if (constraints[k].type == 1) { // hard constraint
+            // 14. Hard constraint C_j(x)
+            float currentDistance = DistanceConstraint(currentX, otherX, constraints[k].restLength) - constraints[k].stabilization;
+            // direction of the constraint δCⱼ/δxⱼ
+            vecD dir = currentX - otherX;
+            constraint_gradient = (length(dir) > 1e-6) ? normalize(dir) : up;
+            // force of the constraint
+            float constraint_force = constraints[k].penalty * currentDistance + constraints[k].lambda;
+            // clamping values and adding the direction of the constraint
+            force -= constraint_force * constraint_gradient;
+
+        // 15. check if soft constraint
+        } else { // soft constraint
+            // 16. Constraint
+            float currentDistance = DistanceConstraint(currentX, otherX, constraints[k].restLength) - constraints[k].stabilization;
+            // direction of the constraint δCⱼ/δxⱼ
+            vecD dir = currentX - otherX;
+            constraint_gradient = (length(dir) > 1e-6) ? normalize(dir) : up;
+            // force of the constraint
+            float constraint_force = constraints[k].penalty * currentDistance;
+            // clamping values and adding the direction of the constraint
+            force -= constraint_force * constraint_gradient;
+        }
+
+        // 18. Update the local hessian matrix
+        LocalHessian += constraints[k].penalty * outerProduct(constraint_gradient, constraint_gradient);
+        // Geometric stiffness f/|d| (I - ∇C ∇Cᵀ) of stretched constraints. Compressed ones would make the
+        // Hessian indefinite and are left out. Without it stiff chains overshoot sideways and blow up
+        float constraint_tension = max(constraints[k].penalty * (DistanceConstraint(currentX, otherX, constraints[k].restLength) - constraints[k].stabilization)
+                                       + (constraints[k].type == 1 ? constraints[k].lambda : 0.0), 0.0);
+        float dir_length = distance(currentX, otherX);
+        if (dir_length > 1e-6) {
+            LocalHessian += (constraint_tension / dir_length) * (matD(1.0) - outerProduct(constraint_gradient, constraint_gradient));
         }
-        vec3 delta_x_i = inverse(LocalHessian) * force;
+    }
+
+    // 19. Contacts act like hard constraints, but only while the objects overlap
+    if (u_collisionsEnabled != 0) {
+        uint list = index * (MAX_CONTACTS_PER_OBJECT + 1);
+        uint contact_count = min(contact_lists[list], MAX_CONTACTS_PER_OBJECT);
+        for (uint c = 0; c < contact_count; c++) {
+            uint k = contact_lists[list + 1 + c];
+
+            // Contacts are not in the coloring, so a partner of this color is moved by another invocation right
+            // now and is read where it started the iteration. Other colors are done or have not started
+            uint other = uint((index == contacts[k].indexA) ? contacts[k].indexB : contacts[k].indexA);
+            bool same_batch = island_states[other].color == uint(u_color)
+                              && (objects[other].flags & (OBJECT_STATIC | OBJECT_KINEMATIC | OBJECT_SLEEPING)) == 0u;
+            vecD otherX = same_batch ? toVecD(solver_states[other].iteration_position) : toVecD(objects[other].position);
+            float currentDistance = DistanceConstraint(currentX, otherX, contacts[k].restLength) - contacts[k].stabilization;
+            // Clamped like λ, a contact only pushes. Its stiffness stays in the Hessian while it is released,
+            // or the object would drop straight back to y and the next iteration push it out again
+            float constraint_force = min(contacts[k].penalty * currentDistance + contacts[k].lambda, 0.0);
+
+            vecD dir = currentX - otherX;
+            vecD constraint_gradient = (length(dir) > 1e-6) ? normalize(dir) : up;
+            force -= constraint_force * constraint_gradient;
+            LocalHessian += contacts[k].penalty * outerProduct(constraint_gradient, constraint_gradient);
+        }
+    }
+
+    // 20. Apply force to objects position
+#if DIMENSION == 2
+    // Closed-form inverse of the symmetric 2x2 Hessian
+    float det = LocalHessian[0][0] * LocalHessian[1][1] - LocalHessian[1][0] * LocalHessian[0][1];
+    if (abs(det) > 1e-6) { // otherwise skip this iteration, matrix not invertible
+        vecD delta_x_i = vecD(LocalHessian[1][1] * force.x - LocalHessian[1][0] * force.y,
+                              LocalHessian[0][0] * force.y - LocalHessian[0][1] * force.x) / det;
+#else
+    float det = determinant(LocalHessian);
+    if (abs(det) > 1e-6) { // otherwise skip this iteration, matrix not invertible
+        vecD delta_x_i = inverse(LocalHessian) * force;
+#endif
         currentX += delta_x_i;
 
         // 23. Update position
         if (any(isnan(currentX))) {
-            currentX = initialX; // or some safe fallback
+            return 0.0; // keep the old position
         }
-        objects[index].position = vec4(currentX, 1.0);
+        objects[index].position = toObjectVector(currentX, 1.0);
+        return length(delta_x_i);
     }
+    return 0.0;
+}
+
+void main() {
+    if (u_velocityPass != 0) {
+        // 37. Update velocity, after however many iterations the step ran
+        uint index = uint(gl_GlobalInvocationID.x);
+        if (index >= u_objectCount) return;
+        // Static and sleeping objects were not moved, kinematic ones keep the velocity they were given
+        if ((objects[index].flags & (OBJECT_STATIC | OBJECT_KINEMATIC | OBJECT_SLEEPING)) != 0u) return;
+        float world_dt = worlds[objectWorld(index)].dt;
+        float dt = world_dt > 0.0 ? world_dt : u_deltaTime;
+        vecD velocity = (toVecD(objects[index].position) - toVecD(solver_states[index].previous_position)) / dt;
+        objects[index].velocity = toObjectVector(velocity, 0.0);
 
-    if (u_iteration == u_iterations - 1) {
-        // 37. Update velocity
-        objects[index].velocity = vec4((objects[index].position.xyz - initialX) / u_deltaTime, 0.0);
+        // Time at rest, an island falls asleep once all of its objects have rested long enough
+        bool resting = 0.5 * dot(velocity, velocity) <= u_sleepEnergy;
+        island_states[index].rest_time = resting ? island_states[index].rest_time + dt : 0.0;
+        return;
     }
+
+    // Converged earlier this step, the same for the whole dispatch
+    if (solver_converged != 0) return;
+
+    if (u_snapshotPass != 0) {
+        uint index = uint(gl_GlobalInvocationID.x);
+        if (index < u_objectCount) solver_states[index].iteration_position = objects[index].position;
+        return;
+    }
+
+    if (gl_LocalInvocationIndex == 0) group_step = 0;
+    memoryBarrierShared();
+    barrier();
+
+    atomicMax(group_step, floatBitsToUint(solveObject(uint(gl_GlobalInvocationID.x))));
+    memoryBarrierShared();
+    barrier();
+
+    // One global atomic per work group
+    if (gl_LocalInvocationIndex == 0) atomicMax(solver_residual, group_step);
 }
\ No newline at end of file
@@ -1,8 +1,26 @@
 #version 430 core
 
+in vec2 v_local;
+in float v_pixelSize;
 in vec3 v_color;
 out vec4 fragment_color;
 
+uniform int u_pointPass;
+uniform float u_outlineWidth; // pixels, 0 fills the circle
+
+// Analytic circle, coverage antialiased over one pixel
 void main() {
-    fragment_color = vec4(v_color, 1.0);
-}
\ No newline at end of file
+    if (u_pointPass != 0) {
+        fragment_color = vec4(v_color, 1.0);
+        return;
+    }
+
+    float d = length(v_local);
+    float coverage = clamp((1.0 - d) / v_pixelSize + 0.5, 0.0, 1.0);
+    if (u_outlineWidth > 0.0) {
+        float inner = 1.0 - u_outlineWidth * v_pixelSize;
+        coverage = min(coverage, clamp((d - inner) / v_pixelSize + 0.5, 0.0, 1.0));
+    }
+    if (coverage <= 0.0) discard;
+    fragment_color = vec4(v_color, coverage);
+}
@@ -1,31 +1,53 @@
 #version 430 core
 
-layout(location = 0) in vec2 template_pos;
-
-struct PhysicsObject {
-    vec4 position;
-    vec4 velocity;
-    vec4 acceleration;  
-    float mass;
-    float radius;
-};
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
 
 layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
     PhysicsObject objects[];
 };
 
+// State one step earlier, blended towards objects by u_alpha
+layout(std430, binding = 5) restrict readonly buffer PreviousObjectBuffer {
+    PhysicsObject previous_objects[];
+};
+
+// Bodies on screen, from cull_compute_shader.glsl
+layout(std430, binding = 6) restrict readonly buffer VisibleObjectBuffer {
+    uint visible_objects[];
+};
+
 uniform mat4 u_projection;
+uniform float u_alpha;
+uniform vec2 u_viewportSize;
+uniform int u_listOffset; // 0 for the quads, the object count for the points
+uniform int u_pointPass;
 
+out vec2 v_local; // position in the quad in radii, the circle's edge is at length 1
+out float v_pixelSize; // one pixel in radii
 out vec3 v_color;
 
+// Triangle strip
+const vec2 corners[4] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
 void main() {
-    PhysicsObject obj = objects[gl_InstanceID];
-    
-    vec2 world_pos;
-    
-    // circle
-    world_pos = obj.position.xy + template_pos * obj.radius;
-    
-    gl_Position = u_projection * vec4(world_pos, 0.0, 1.0);
+    uint index = visible_objects[u_listOffset + gl_InstanceID];
+    PhysicsObject obj = objects[index];
+    vec2 position = mix(previous_objects[index].position.xy, obj.position.xy, u_alpha);
+    vec2 pixels_per_unit = 0.5 * u_viewportSize * abs(vec2(u_projection[0][0], u_projection[1][1]));
+    float pixel_radius = obj.radius * max(pixels_per_unit.x, pixels_per_unit.y);
     v_color = vec3(1.0);
-}
\ No newline at end of file
+
+    // Sub-pixel bodies are one point, at least a pixel wide
+    if (u_pointPass != 0) {
+        gl_Position = u_projection * vec4(position, 0.0, 1.0);
+        gl_PointSize = max(2.0 * pixel_radius, 1.0);
+        v_local = vec2(0.0);
+        v_pixelSize = 1.0;
+        return;
+    }
+
+    // Screen-aligned quad around the circle, a pixel larger so the antialiased edge is not cut off
+    v_pixelSize = 1.0 / max(pixel_radius, 1e-6);
+    v_local = corners[gl_VertexID] * (1.0 + v_pixelSize);
+    gl_Position = u_projection * vec4(position + v_local * obj.radius, 0.0, 1.0);
+}
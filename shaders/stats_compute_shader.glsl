@@ -0,0 +1,153 @@
+#version 430 core
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject is inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+// Same layout as GPUPhysicsStats
+struct Stats {
+    vec4 momentum;
+    vec4 bounds_min;
+    vec4 bounds_max;
+    float kinetic_energy;
+    float potential_energy;
+    float max_constraint_violation;
+    uint object_count;
+    uint solver_iterations;
+    float solver_residual;
+    uint sleeping_count;
+    uint _pad;
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict readonly buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+// Counts, see GPUPhysicsHeader
+layout(std430, binding = 2) restrict readonly buffer PhysicsHeaderBuffer {
+    uint object_count;
+    uint constraint_count;
+    uint contact_count;
+    uint contact_overflow;
+    uint contact_capacity;
+    uint solver_converged;
+    uint solver_iterations;
+    uint solver_residual; // float bits
+};
+
+// One partial result per work group of the first pass
+layout(std430, binding = 5) restrict buffer StatsPartialBuffer {
+    Stats partials[];
+};
+
+layout(std430, binding = 6) restrict writeonly buffer StatsBuffer {
+    Stats stats;
+};
+
+layout(location = 0) uniform int u_pass; // 0 reduces objects and constraints into partials, 1 reduces the partials
+layout(location = 1) uniform float u_referenceHeight;
+layout(location = 2) uniform int u_partialCount;
+
+const float FLOAT_MAX = 3.402823466e38;
+
+shared vec3 shared_momentum[256];
+shared vec3 shared_min[256];
+shared vec3 shared_max[256];
+shared vec4 shared_scalars[256]; // kinetic energy, potential energy, max constraint violation, sleeping objects
+
+void main() {
+    uint thread = gl_LocalInvocationID.x;
+
+    vec3 momentum = vec3(0.0);
+    vec3 bounds_min = vec3(FLOAT_MAX);
+    vec3 bounds_max = vec3(-FLOAT_MAX);
+    vec4 scalars = vec4(0.0);
+
+    if (u_pass == 0) {
+        // Grid-stride loops, a fixed number of work groups covers any count
+        uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+        for (uint i = gl_GlobalInvocationID.x; i < object_count; i += stride) {
+            if ((objects[i].flags & OBJECT_REMOVED) != 0u) continue;
+            vec3 position = toVec3(objects[i].position);
+            vec3 velocity = toVec3(objects[i].velocity);
+            float mass = objects[i].mass;
+            momentum += mass * velocity;
+            bounds_min = min(bounds_min, position);
+            bounds_max = max(bounds_max, position);
+            scalars.x += 0.5 * mass * dot(velocity, velocity);
+            scalars.y -= mass * objects[i].acceleration.y * (position.y - u_referenceHeight);
+            if ((objects[i].flags & OBJECT_SLEEPING) != 0u) scalars.w += 1.0;
+        }
+        for (uint k = gl_GlobalInvocationID.x; k < constraint_count; k += stride) {
+            if (constraints[k].type == CONSTRAINT_REMOVED) continue;
+            vec3 a = toVec3(objects[constraints[k].indexA].position);
+            vec3 b = toVec3(objects[constraints[k].indexB].position);
+            scalars.z = max(scalars.z, abs(distance(a, b) - constraints[k].restLength));
+        }
+    } else {
+        for (uint p = thread; p < uint(u_partialCount); p += gl_WorkGroupSize.x) {
+            momentum += partials[p].momentum.xyz;
+            bounds_min = min(bounds_min, partials[p].bounds_min.xyz);
+            bounds_max = max(bounds_max, partials[p].bounds_max.xyz);
+            scalars.xy += vec2(partials[p].kinetic_energy, partials[p].potential_energy);
+            scalars.z = max(scalars.z, partials[p].max_constraint_violation);
+            scalars.w += float(partials[p].sleeping_count);
+        }
+    }
+
+    shared_momentum[thread] = momentum;
+    shared_min[thread] = bounds_min;
+    shared_max[thread] = bounds_max;
+    shared_scalars[thread] = scalars;
+    memoryBarrierShared();
+    barrier();
+
+    // Tree reduction in shared memory
+    for (uint offset = gl_WorkGroupSize.x / 2; offset > 0; offset >>= 1) {
+        if (thread < offset) {
+            shared_momentum[thread] += shared_momentum[thread + offset];
+            shared_min[thread] = min(shared_min[thread], shared_min[thread + offset]);
+            shared_max[thread] = max(shared_max[thread], shared_max[thread + offset]);
+            shared_scalars[thread].xyw += shared_scalars[thread + offset].xyw;
+            shared_scalars[thread].z = max(shared_scalars[thread].z, shared_scalars[thread + offset].z);
+        }
+        memoryBarrierShared();
+        barrier();
+    }
+
+    if (thread != 0) return;
+
+    Stats result;
+    result.momentum = vec4(shared_momentum[0], 0.0);
+    result.bounds_min = vec4(shared_min[0], 0.0);
+    result.bounds_max = vec4(shared_max[0], 0.0);
+    result.kinetic_energy = shared_scalars[0].x;
+    result.potential_energy = shared_scalars[0].y;
+    result.max_constraint_violation = shared_scalars[0].z;
+    result.object_count = object_count;
+    result.solver_iterations = solver_iterations;
+    result.solver_residual = uintBitsToFloat(solver_residual);
+    result.sleeping_count = uint(shared_scalars[0].w);
+    result._pad = 0;
+
+    if (u_pass == 0) {
+        partials[gl_WorkGroupID.x] = result;
+    } else {
+        stats = result;
+    }
+}
@@ -0,0 +1,114 @@
+#version 430 core
+
+layout(local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
+
+// PhysicsObject, World and WorldBuffer are inserted by the loader, see physicsShaderPrelude()
+
+struct Constraint {
+    int type;
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n)
+    float stabilization; // αC_j(x^t) of a contact, the part of its starting overlap this step leaves alone
+};
+
+// Same layout as GPUWorldStats
+struct WorldStats {
+    vec4 centre_of_mass; // w total mass
+    vec4 momentum;
+    vec4 bounds_min;
+    vec4 bounds_max;
+    float kinetic_energy;
+    float max_constraint_violation;
+    uint object_count;
+    uint _pad;
+};
+
+layout(std430, binding = 0) restrict readonly buffer ObjectBuffer {
+    PhysicsObject objects[];
+};
+
+layout(std430, binding = 1) restrict readonly buffer ConstraintBuffer {
+    Constraint constraints[];
+};
+
+layout(std430, binding = 5) restrict writeonly buffer WorldStatsBuffer {
+    WorldStats world_stats[];
+};
+
+const float FLOAT_MAX = 3.402823466e38;
+
+shared vec4 shared_weighted[128]; // Σ m x, Σ m
+shared vec4 shared_momentum[128]; // Σ m v, kinetic energy
+shared vec3 shared_min[128];
+shared vec3 shared_max[128];
+shared float shared_violation[128];
+
+// One work group per world, each reduces its own object and constraint range
+void main() {
+    uint thread = gl_LocalInvocationID.x;
+    World world = worlds[gl_WorkGroupID.x];
+
+    vec4 weighted = vec4(0.0);
+    vec4 momentum = vec4(0.0);
+    vec3 bounds_min = vec3(FLOAT_MAX);
+    vec3 bounds_max = vec3(-FLOAT_MAX);
+    float violation = 0.0;
+
+    uint object_end = world.object_offset + world.object_count;
+    for (uint i = world.object_offset + thread; i < object_end; i += gl_WorkGroupSize.x) {
+        if ((objects[i].flags & OBJECT_REMOVED) != 0u) continue;
+        vec3 position = toVec3(objects[i].position);
+        vec3 velocity = toVec3(objects[i].velocity);
+        float mass = objects[i].mass;
+        weighted += vec4(mass * position, mass);
+        momentum += vec4(mass * velocity, 0.5 * mass * dot(velocity, velocity));
+        bounds_min = min(bounds_min, position);
+        bounds_max = max(bounds_max, position);
+    }
+    uint constraint_end = world.constraint_offset + world.constraint_count;
+    for (uint k = world.constraint_offset + thread; k < constraint_end; k += gl_WorkGroupSize.x) {
+        if (constraints[k].type == CONSTRAINT_REMOVED) continue;
+        vec3 a = toVec3(objects[constraints[k].indexA].position);
+        vec3 b = toVec3(objects[constraints[k].indexB].position);
+        violation = max(violation, abs(distance(a, b) - constraints[k].restLength));
+    }
+
+    shared_weighted[thread] = weighted;
+    shared_momentum[thread] = momentum;
+    shared_min[thread] = bounds_min;
+    shared_max[thread] = bounds_max;
+    shared_violation[thread] = violation;
+    memoryBarrierShared();
+    barrier();
+
+    // Tree reduction in shared memory
+    for (uint offset = gl_WorkGroupSize.x / 2; offset > 0; offset >>= 1) {
+        if (thread < offset) {
+            shared_weighted[thread] += shared_weighted[thread + offset];
+            shared_momentum[thread] += shared_momentum[thread + offset];
+            shared_min[thread] = min(shared_min[thread], shared_min[thread + offset]);
+            shared_max[thread] = max(shared_max[thread], shared_max[thread + offset]);
+            shared_violation[thread] = max(shared_violation[thread], shared_violation[thread + offset]);
+        }
+        memoryBarrierShared();
+        barrier();
+    }
+
+    if (thread != 0) return;
+
+    float total_mass = shared_weighted[0].w;
+    WorldStats result;
+    result.centre_of_mass = vec4(total_mass > 0.0 ? shared_weighted[0].xyz / total_mass : vec3(0.0), total_mass);
+    result.momentum = vec4(shared_momentum[0].xyz, 0.0);
+    result.bounds_min = vec4(shared_min[0], 0.0);
+    result.bounds_max = vec4(shared_max[0], 0.0);
+    result.kinetic_energy = shared_momentum[0].w;
+    result.max_constraint_violation = shared_violation[0];
+    result.object_count = world.object_count;
+    result._pad = 0;
+    world_stats[gl_WorkGroupID.x] = result;
+}
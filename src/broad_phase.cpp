@@ -0,0 +1,93 @@
+#include "broad_phase.h"
+#include <cmath>
+#include <algorithm>
+
+// Cells next to each other along x land in neighbouring buckets, so the 3x3 neighbourhood
+// reads three contiguous runs of the sorted arrays instead of nine scattered ones
+uint32_t UniformGrid::cellHash(int32_t cx, int32_t cy) const {
+    return (uint32_t(cx) + uint32_t(cy) * 19349663u) & (cell_count - 1);
+}
+
+void UniformGrid::build(const float* x, const float* y, size_t count, float cell_size) {
+    this->cell_size = cell_size;
+
+    // About one cell per object keeps buckets short
+    cell_count = 1024;
+    while (cell_count < count) cell_count <<= 1;
+
+    // Count
+    cell_starts.assign(cell_count + 1, 0);
+    object_cells.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t hash = cellHash(int32_t(std::floor(x[i] / cell_size)), int32_t(std::floor(y[i] / cell_size)));
+        object_cells[i] = hash;
+        cell_starts[hash + 1]++;
+    }
+
+    // Prefix sum
+    for (uint32_t c = 0; c < cell_count; ++c) cell_starts[c + 1] += cell_starts[c];
+
+    // Scatter, in index order so every cell lists its objects ascending
+    sorted_objects.resize(count);
+    std::vector<uint32_t> cursor(cell_starts.begin(), cell_starts.end() - 1);
+    for (size_t i = 0; i < count; ++i) sorted_objects[cursor[object_cells[i]]++] = uint32_t(i);
+}
+
+void UniformGrid::findContacts(const float* x, const float* y, const float* z, const float* radius,
+                               ThreadPool& thread_pool, std::vector<ContactPair>& contacts) {
+    const size_t count = sorted_objects.size();
+
+    // Gather the positions in cell order once so the neighbour loops below read contiguous memory
+    sorted_positions.resize(count);
+    thread_pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            uint32_t i = sorted_objects[s];
+            sorted_positions[s] = {x[i], y[i], z[i], radius[i]};
+        }
+    }, 4096);
+
+    const size_t block_count = std::min<size_t>(256, std::max<size_t>(count / 256, 1));
+    const size_t block_size = (count + block_count - 1) / block_count;
+
+    std::vector<std::vector<ContactPair>>& blocks = block_contacts;
+    blocks.resize(block_count);
+
+    thread_pool.parallelFor(0, block_count, [&](size_t block_begin, size_t block_end) {
+        for (size_t block = block_begin; block < block_end; ++block) {
+            std::vector<ContactPair>& out = blocks[block];
+            out.clear();
+            size_t end = std::min(count, (block + 1) * block_size);
+            for (size_t s = block * block_size; s < end; ++s) {
+                uint32_t i = sorted_objects[s];
+                const SortedPosition& p = sorted_positions[s];
+                int32_t cx = int32_t(std::floor(p.x / cell_size));
+                int32_t cy = int32_t(std::floor(p.y / cell_size));
+
+                // Neighbouring cells can hash to the same bucket, visit each bucket once
+                uint32_t visited[9];
+                int visited_count = 0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        uint32_t hash = cellHash(cx + dx, cy + dy);
+                        if (std::find(visited, visited + visited_count, hash) != visited + visited_count) continue;
+                        visited[visited_count++] = hash;
+
+                        for (uint32_t t = cell_starts[hash]; t < cell_starts[hash + 1]; ++t) {
+                            uint32_t other = sorted_objects[t];
+                            if (other <= i) continue;
+
+                            const SortedPosition& q = sorted_positions[t];
+                            float ox = p.x - q.x, oy = p.y - q.y, oz = p.z - q.z;
+                            float rest = p.radius + q.radius;
+                            if (ox * ox + oy * oy + oz * oz >= rest * rest) continue;
+                            out.push_back({i, other, rest});
+                        }
+                    }
+                }
+            }
+        }
+    }, 1);
+
+    contacts.clear();
+    for (const std::vector<ContactPair>& block : blocks) contacts.insert(contacts.end(), block.begin(), block.end());
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "thread_pool.h"
+
+struct ContactPair {
+    uint32_t a, b; // a < b
+    float rest_length; // sum of the radii
+};
+
+// Uniform-grid broad phase over hashed xy cells, rebuilt every step.
+// Objects are counting-sorted by cell (count, prefix sum, scatter), then every object
+// tests the objects in its own and the 8 neighbouring cells against their radii.
+// Matches grid_*_compute_shader.glsl and contact_compute_shader.glsl on the GPU.
+class UniformGrid {
+public:
+    void build(const float* x, const float* y, size_t count, float cell_size);
+    // Overlapping pairs in a deterministic order (cell order of a, then of b)
+    void findContacts(const float* x, const float* y, const float* z, const float* radius,
+                      ThreadPool& thread_pool, std::vector<ContactPair>& contacts);
+
+    uint32_t getCellCount() const { return cell_count; }
+
+private:
+    float cell_size = 1.0f;
+    uint32_t cell_count = 0;          // power of two
+    std::vector<uint32_t> cell_starts; // cell_count + 1
+    std::vector<uint32_t> sorted_objects;
+    std::vector<uint32_t> object_cells;
+    struct SortedPosition {
+        float x, y, z, radius;
+    };
+    std::vector<SortedPosition> sorted_positions; // in sorted_objects order
+    std::vector<std::vector<ContactPair>> block_contacts; // per parallel block, concatenated in order
+
+    uint32_t cellHash(int32_t cx, int32_t cy) const;
+};
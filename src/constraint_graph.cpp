@@ -0,0 +1,248 @@
+#include "constraint_graph.h"
+#include "handle_table.h"
+#include <algorithm>
+
+static const uint32_t uncolored = 0xffffffffu;
+
+void ConstraintGraph::addObject() {
+    if (incident_stale) expandIncident();
+    // The slot may already exist if a constraint named the object before it was added
+    object_count++;
+    if (incident.size() < object_count) incident.resize(object_count);
+    dirty = true;
+}
+
+void ConstraintGraph::addConstraint(int constraint_index, int indexA, int indexB) {
+    if (incident_stale) expandIncident();
+
+    // Constraints may reference objects that are added later
+    int highest = indexA > indexB ? indexA : indexB;
+    if (highest >= int(incident.size())) incident.resize(highest + 1);
+
+    if (constraint_index >= int(endpoint_a.size())) {
+        endpoint_a.resize(constraint_index + 1);
+        endpoint_b.resize(constraint_index + 1);
+    }
+    endpoint_a[constraint_index] = uint32_t(indexA);
+    endpoint_b[constraint_index] = uint32_t(indexB);
+
+    incident[indexA].push_back(uint32_t(constraint_index));
+    edge_count++;
+    if (indexB != indexA) {
+        incident[indexB].push_back(uint32_t(constraint_index));
+        edge_count++;
+        // The later object gives way, as it would in a full greedy pass
+        recolor.push_back(uint32_t(highest));
+    }
+    touchObject(size_t(indexA < indexB ? indexA : indexB));
+    dirty = true;
+}
+
+void ConstraintGraph::removeConstraint(int constraint_index) {
+    if (incident_stale) expandIncident();
+
+    // Erased in place so the remaining constraints keep their order, and with it the coloring
+    uint32_t endpoints[2] = {endpoint_a[constraint_index], endpoint_b[constraint_index]};
+    int endpoint_count = endpoints[0] == endpoints[1] ? 1 : 2;
+    for (int e = 0; e < endpoint_count; ++e) {
+        std::vector<uint32_t>& list = incident[endpoints[e]];
+        auto found = std::find(list.begin(), list.end(), uint32_t(constraint_index));
+        if (found == list.end()) continue;
+        list.erase(found);
+        edge_count--;
+    }
+    // Fewer neighbours never invalidate a color
+    touchObject(endpoints[0] < endpoints[1] ? endpoints[0] : endpoints[1]);
+    dirty = true;
+}
+
+const std::vector<uint32_t>& ConstraintGraph::getIncidentConstraints(int object) {
+    if (incident_stale) expandIncident();
+    return incident[object];
+}
+
+void ConstraintGraph::compact(const std::vector<uint32_t>& object_remap, size_t object_count,
+                              const std::vector<uint32_t>& constraint_remap, size_t constraint_count) {
+    if (incident_stale) expandIncident();
+
+    // Both remaps keep the order, so entries only ever move down and everything compacts in place
+    for (size_t i = 0; i < object_remap.size(); ++i) {
+        if (object_remap[i] == removed_index) continue;
+        std::vector<uint32_t>& list = incident[i];
+        for (uint32_t& constraint_index : list) constraint_index = constraint_remap[constraint_index];
+        if (object_remap[i] != i) incident[object_remap[i]].swap(list);
+    }
+    incident.resize(object_count);
+    this->object_count = object_count;
+
+    for (size_t k = 0; k < endpoint_a.size(); ++k) {
+        uint32_t target = constraint_remap[k];
+        if (target == removed_index) continue;
+        endpoint_a[target] = object_remap[endpoint_a[k]];
+        endpoint_b[target] = object_remap[endpoint_b[k]];
+    }
+    endpoint_a.resize(constraint_count);
+    endpoint_b.resize(constraint_count);
+
+    // Every index moved, so start over with a full greedy coloring
+    colors.clear();
+    recolor.clear();
+    first_changed_object = 0;
+    dirty = true;
+}
+
+bool ConstraintGraph::rebuild() {
+    if (!dirty) return false;
+
+    // Lists before the first changed object keep their offsets and indices, the rest is flattened again.
+    // Objects past the last flattened one are new
+    size_t flattened = offsets.empty() ? 0 : offsets.size() - 1;
+    size_t first = std::min(first_changed_object, flattened);
+    offsets.resize(incident.size() + 1);
+    indices.resize(edge_count);
+
+    uint32_t offset = offsets[first];
+    changes.first_offset = first;
+    changes.first_index = offset;
+    for (size_t i = first; i < incident.size(); ++i) {
+        offsets[i] = offset;
+        for (uint32_t constraint_index : incident[i]) {
+            indices[offset++] = constraint_index;
+        }
+    }
+    offsets[incident.size()] = offset;
+    first_changed_object = incident.size();
+
+    // New objects and the later end of new constraints, in index order so a fresh graph gets exactly the
+    // colors of colorGraph()
+    size_t colored = colors.size();
+    colors.resize(incident.size(), uncolored);
+    for (size_t i = colored; i < incident.size(); ++i) recolor.push_back(uint32_t(i));
+    std::sort(recolor.begin(), recolor.end());
+    recolor.erase(std::unique(recolor.begin(), recolor.end()), recolor.end());
+
+    uint32_t first_color = uncolored;
+    for (uint32_t object : recolor) {
+        uint32_t previous = colors[object];
+        uint32_t color = recolorObject(object);
+        if (color == previous) continue;
+        colors[object] = color;
+        first_color = std::min(first_color, std::min(previous, color));
+    }
+    recolor.clear();
+    sortByColor(first_color);
+
+    dirty = false;
+    return true;
+}
+
+uint32_t ConstraintGraph::recolorObject(uint32_t object) {
+    // Colors of the neighbours colored so far, uncolored ones are newer and pick after this one
+    const std::vector<uint32_t>& list = incident[object];
+    for (uint32_t k : list) {
+        uint32_t other = endpoint_a[k] == object ? endpoint_b[k] : endpoint_a[k];
+        if (other == object || colors[other] == uncolored) continue;
+        if (colors[other] >= forbidden.size()) forbidden.resize(colors[other] + 1, 0);
+        forbidden[colors[other]] = 1;
+    }
+
+    // Keep the current color while it still fits, otherwise first fit
+    uint32_t color = colors[object];
+    if (color == uncolored || (color < forbidden.size() && forbidden[color])) {
+        color = 0;
+        while (color < forbidden.size() && forbidden[color]) color++;
+    }
+
+    for (uint32_t k : list) {
+        uint32_t other = endpoint_a[k] == object ? endpoint_b[k] : endpoint_a[k];
+        if (other != object && colors[other] != uncolored) forbidden[colors[other]] = 0;
+    }
+    return color;
+}
+
+void ConstraintGraph::sortByColor(uint32_t first_color) {
+    // Counting sort by color, objects keep index order within their color
+    uint32_t color_count = 0;
+    for (uint32_t color : colors) color_count = std::max(color_count, color + 1);
+    color_offsets.assign(color_count + 1, 0);
+    for (uint32_t color : colors) color_offsets[color + 1]++;
+    for (uint32_t c = 0; c < color_count; ++c) color_offsets[c + 1] += color_offsets[c];
+
+    // Colors below the lowest one that gained or lost an object keep their place
+    color_order.resize(colors.size());
+    first_color = std::min(first_color, color_count);
+    changes.first_color_entry = color_offsets[first_color];
+    if (first_color == color_count) return;
+    std::vector<uint32_t> cursor(color_offsets.begin() + first_color, color_offsets.end() - 1);
+    for (size_t i = 0; i < colors.size(); ++i) {
+        if (colors[i] >= first_color) color_order[cursor[colors[i] - first_color]++] = uint32_t(i);
+    }
+}
+
+void ConstraintGraph::assign(size_t object_count, size_t constraint_count, const CSREdgeSet& edges,
+                             const uint32_t* color_order, const uint32_t* color_offsets, size_t color_count) {
+    edge_count = edges.offsets[object_count];
+    offsets.assign(edges.offsets, edges.offsets + object_count + 1);
+    indices.assign(edges.indices, edges.indices + edge_count);
+    endpoint_a.assign(edges.endpoint_a, edges.endpoint_a + constraint_count);
+    endpoint_b.assign(edges.endpoint_b, edges.endpoint_b + constraint_count);
+    this->color_order.assign(color_order, color_order + object_count);
+    this->color_offsets.assign(color_offsets, color_offsets + color_count + 1);
+
+    colors.assign(object_count, uncolored);
+    for (size_t c = 0; c < color_count; ++c) {
+        for (uint32_t j = color_offsets[c]; j < color_offsets[c + 1]; ++j) colors[color_order[j]] = uint32_t(c);
+    }
+    recolor.clear();
+    first_changed_object = object_count;
+
+    // Sized now, filled only when needed
+    incident.clear();
+    incident.resize(object_count);
+    this->object_count = object_count;
+    incident_stale = true;
+    dirty = false;
+}
+
+void ConstraintGraph::expandIncident() {
+    for (size_t i = 0; i < incident.size(); ++i) {
+        incident[i].assign(indices.begin() + offsets[i], indices.begin() + offsets[i + 1]);
+    }
+    incident_stale = false;
+}
+
+void colorGraph(size_t object_count, const CSREdgeSet* edge_sets, int edge_set_count,
+                std::vector<uint32_t>& color_order, std::vector<uint32_t>& color_offsets) {
+    std::vector<uint32_t> colors(object_count);
+    // forbidden[c] == i + 1 means color c is taken by a neighbour of object i
+    std::vector<uint32_t> forbidden;
+    uint32_t color_count = object_count > 0 ? 1 : 0;
+
+    // Greedy first-fit in index order, deterministic for a given scene
+    for (size_t i = 0; i < object_count; ++i) {
+        for (int e = 0; e < edge_set_count; ++e) {
+            const CSREdgeSet& edges = edge_sets[e];
+            for (uint32_t a = edges.offsets[i]; a < edges.offsets[i + 1]; ++a) {
+                uint32_t k = edges.indices[a];
+                uint32_t other = edges.endpoint_a[k] == i ? edges.endpoint_b[k] : edges.endpoint_a[k];
+                if (other >= i) continue; // not colored yet
+                if (colors[other] >= forbidden.size()) forbidden.resize(colors[other] + 1, 0);
+                forbidden[colors[other]] = uint32_t(i + 1);
+            }
+        }
+
+        uint32_t color = 0;
+        while (color < forbidden.size() && forbidden[color] == i + 1) color++;
+        colors[i] = color;
+        if (color + 1 > color_count) color_count = color + 1;
+    }
+
+    // Counting sort of the objects by color
+    color_offsets.assign(color_count + 1, 0);
+    for (size_t i = 0; i < object_count; ++i) color_offsets[colors[i] + 1]++;
+    for (uint32_t c = 0; c < color_count; ++c) color_offsets[c + 1] += color_offsets[c];
+
+    color_order.resize(object_count);
+    std::vector<uint32_t> cursor(color_offsets.begin(), color_offsets.end() - 1);
+    for (size_t i = 0; i < object_count; ++i) color_order[cursor[colors[i]]++] = uint32_t(i);
+}
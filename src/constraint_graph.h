@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// One set of pairwise edges in CSR form: edges touching object i are indices[offsets[i]] .. indices[offsets[i + 1] - 1],
+// and edge k connects endpoint_a[k] and endpoint_b[k]
+struct CSREdgeSet {
+    const uint32_t* offsets;
+    const uint32_t* indices;
+    const uint32_t* endpoint_a;
+    const uint32_t* endpoint_b;
+};
+
+// Greedy first-fit coloring over the union of the edge sets, in index order so it is deterministic.
+// Objects of color c end up in color_order[color_offsets[c]] .. color_order[color_offsets[c + 1] - 1]
+void colorGraph(size_t object_count, const CSREdgeSet* edge_sets, int edge_set_count,
+                std::vector<uint32_t>& color_order, std::vector<uint32_t>& color_offsets);
+
+// Per-object constraint adjacency stored in compressed sparse row (CSR) form.
+// Constraints incident to object i are indices[offsets[i]] .. indices[offsets[i + 1] - 1].
+//
+// Objects are also greedily colored so that no two objects sharing a constraint have the same color.
+// Objects of color c are color_order[color_offsets[c]] .. color_order[color_offsets[c + 1] - 1],
+// so every color can be solved in parallel and the colors one after another (Gauss-Seidel).
+//
+// Both are kept up to date incrementally: rebuild() re-flattens the lists from the first object that changed and
+// recolors only the objects added or given a new constraint, so appending a body to a large scene costs about
+// as much as the body. compact() starts over with a full greedy coloring.
+class ConstraintGraph {
+public:
+    void addObject();
+    void addConstraint(int constraint_index, int indexA, int indexB);
+    // Takes the constraint out of its objects' lists, its index stays taken until compact()
+    void removeConstraint(int constraint_index);
+    // Constraints touching the object
+    const std::vector<uint32_t>& getIncidentConstraints(int object);
+    // Renumbers objects and constraints after a compaction, remap[old index] is the new index or
+    // removed_index (handle_table.h). Removed objects must have no constraints left, and every constraint's
+    // objects must have been added
+    void compact(const std::vector<uint32_t>& object_remap, size_t object_count,
+                 const std::vector<uint32_t>& constraint_remap, size_t constraint_count);
+
+    // Flattens the per-object lists and recolors, only if something changed since the last call
+    bool rebuild();
+    // Entries of offsets, indices and color_order before these were left as they were by the last rebuild(),
+    // so copies of them only need the rest
+    struct Changes {
+        size_t first_offset = 0;
+        size_t first_index = 0;
+        size_t first_color_entry = 0;
+    };
+    const Changes& getChanges() const { return changes; }
+    // Replaces the graph with an already flattened and colored one (a loaded snapshot), so rebuild() has nothing
+    // to do. The per-object lists are only rebuilt from it if objects or constraints are added afterwards
+    void assign(size_t object_count, size_t constraint_count, const CSREdgeSet& edges,
+                const uint32_t* color_order, const uint32_t* color_offsets, size_t color_count);
+
+    const std::vector<uint32_t>& getOffsets() const { return offsets; }
+    const std::vector<uint32_t>& getIndices() const { return indices; }
+    const std::vector<uint32_t>& getColorOrder() const { return color_order; }
+    const std::vector<uint32_t>& getColorOffsets() const { return color_offsets; }
+    int getObjectCount() const { return int(object_count); }
+    int getColorCount() const { return color_offsets.empty() ? 0 : int(color_offsets.size()) - 1; }
+    CSREdgeSet getEdgeSet() const { return {offsets.data(), indices.data(), endpoint_a.data(), endpoint_b.data()}; }
+
+private:
+    std::vector<std::vector<uint32_t>> incident; // constraints touching each object
+    std::vector<uint32_t> endpoint_a, endpoint_b; // objects of each constraint
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> color_order;
+    std::vector<uint32_t> color_offsets;
+    std::vector<uint32_t> colors; // color of each flattened object, uncolored past the last rebuild()
+    std::vector<uint32_t> recolor; // objects whose color has to be checked against their neighbours
+    std::vector<uint32_t> forbidden; // scratch of recolorObject()
+    size_t first_changed_object = 0; // lowest object whose list changed since the last rebuild()
+    Changes changes;
+    size_t edge_count = 0;
+    size_t object_count = 0; // objects added, incident can be longer while constraints name objects not added yet
+    bool dirty = true;
+    bool incident_stale = false; // incident still has to be expanded from offsets / indices after assign()
+
+    void expandIncident();
+    void touchObject(size_t object) { if (object < first_changed_object) first_changed_object = object; }
+    uint32_t recolorObject(uint32_t object);
+    void sortByColor(uint32_t first_color);
+};
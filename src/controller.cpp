@@ -0,0 +1,140 @@
+#include "controller.h"
+#include "simd_kernels.h"
+#include <cmath>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+ControllerTopology makeCreatureTopology(const Scene& scene, int hidden_count) {
+    ControllerTopology topology;
+    topology.hidden_count = hidden_count;
+    for (int i = 0; i < scene.body_object_count; ++i) topology.sensor_objects.push_back(uint32_t(i));
+    for (int k = 0; k < scene.body_constraint_count && k < int(scene.constraints.size()); ++k) {
+        topology.sensor_constraints.push_back(uint32_t(k));
+        topology.actuators.push_back(uint32_t(k));
+        topology.actuator_rest_lengths.push_back(scene.constraints[k].restLength);
+    }
+    return topology;
+}
+
+ControllerPopulation::ControllerPopulation(const ControllerTopology& topology) : topology(topology) {
+    if (this->topology.hidden_count > max_controller_hidden) {
+        std::fprintf(stderr, "Controller has %d hidden units, clamped to %d\n", this->topology.hidden_count, max_controller_hidden);
+        this->topology.hidden_count = max_controller_hidden;
+    }
+    this->topology.actuator_rest_lengths.resize(this->topology.actuators.size(), 0.0f);
+    parameter_count = this->topology.parameterCount();
+}
+
+void ControllerPopulation::restride(size_t new_stride) {
+    std::vector<float> restrided(size_t(parameter_count) * new_stride, 0.0f);
+    size_t kept = std::min(stride, new_stride);
+    for (int p = 0; p < parameter_count; ++p) {
+        std::copy(weights.begin() + p * stride, weights.begin() + p * stride + kept, restrided.begin() + p * new_stride);
+    }
+    weights.swap(restrided);
+    stride = new_stride;
+}
+
+int ControllerPopulation::addController(uint32_t object_offset, uint32_t constraint_offset) {
+    int controller = int(object_offsets.size());
+    if (size_t(controller) >= stride) {
+        // Doubles like the GPU buffers so adding a population one controller at a time stays linear
+        restride(std::max<size_t>(stride * 2, controller_lane_padding));
+    }
+    object_offsets.push_back(object_offset);
+    constraint_offsets.push_back(constraint_offset);
+    ++version;
+    return controller;
+}
+
+void ControllerPopulation::clearControllers() {
+    object_offsets.clear();
+    constraint_offsets.clear();
+    std::fill(weights.begin(), weights.end(), 0.0f);
+    ++version;
+}
+
+void ControllerPopulation::setGenome(int controller, const float* parameters) {
+    for (int p = 0; p < parameter_count; ++p) weights[p * stride + controller] = parameters[p];
+    ++version;
+}
+
+void ControllerPopulation::getGenome(int controller, float* parameters) const {
+    for (int p = 0; p < parameter_count; ++p) parameters[p] = weights[p * stride + controller];
+}
+
+void ControllerPopulation::randomizeGenomes(uint32_t seed, float scale) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    int input_count = topology.inputCount();
+    int hidden_count = topology.hidden_count;
+    std::vector<float> genome(parameter_count);
+    for (int c = 0; c < getControllerCount(); ++c) {
+        int p = 0;
+        for (int j = 0; j < hidden_count; ++j) {
+            for (int i = 0; i < input_count; ++i) genome[p++] = dist(rng) * scale / std::sqrt(float(input_count));
+            genome[p++] = 0.0f;
+        }
+        for (int k = 0; k < topology.outputCount(); ++k) {
+            for (int j = 0; j < hidden_count; ++j) genome[p++] = dist(rng) * scale / std::sqrt(float(hidden_count));
+            genome[p++] = 0.0f;
+        }
+        setGenome(c, genome.data());
+    }
+}
+
+// The population as the raw arrays the kernels take, see simd_kernels.h
+static SimdControllerArrays simdControllerArrays(const ControllerPopulation& population) {
+    const ControllerTopology& topology = population.getTopology();
+    SimdControllerArrays arrays;
+    arrays.weights = population.getWeights().data();
+    arrays.stride = population.getStride();
+    arrays.controller_count = size_t(population.getControllerCount());
+    arrays.object_offsets = population.getObjectOffsets().data();
+    arrays.constraint_offsets = population.getConstraintOffsets().data();
+    arrays.sensor_objects = topology.sensor_objects.data();
+    arrays.sensor_count = int(topology.sensor_objects.size());
+    arrays.sensor_constraints = topology.sensor_constraints.data();
+    arrays.strain_count = int(topology.sensor_constraints.size());
+    arrays.actuators = topology.actuators.data();
+    arrays.actuator_rest_lengths = topology.actuator_rest_lengths.data();
+    arrays.actuator_count = int(topology.actuators.size());
+    arrays.input_count = topology.inputCount();
+    arrays.hidden_count = topology.hidden_count;
+    arrays.actuator_range = topology.actuator_range;
+    arrays.position_scale = topology.position_scale;
+    arrays.velocity_scale = topology.velocity_scale;
+    arrays.clock_frequency = topology.clock_frequency;
+    return arrays;
+}
+
+// Lane-major scratch of the widest kernel
+static size_t simdControllerScratch(const ControllerTopology& topology) {
+    return size_t(topology.inputCount() + topology.hidden_count) * controller_lane_padding;
+}
+
+void evaluateControllersSoA(const ControllerPopulation& population, const SoAObjectState& objects, SoAConstraintState& constraints,
+                            size_t first, size_t count, float time) {
+    std::vector<float> scratch(simdControllerScratch(population.getTopology()));
+    SimdControllerArrays controllers = simdControllerArrays(population);
+    SimdObjectArrays object_arrays = simdObjectArrays(objects);
+    SimdConstraintArrays constraint_arrays = simdConstraintArrays(constraints);
+    float* rest_length = constraints.rest_length.data();
+    switch (getSimdLevel()) {
+#if defined(ENN_SIMD_AVX512)
+    case SIMD_AVX512: evaluateControllersAvx512(controllers, object_arrays, constraint_arrays, rest_length, first, count, time, scratch.data()); break;
+#endif
+#if defined(ENN_SIMD_AVX2) || defined(ENN_SIMD_AVX512)
+    case SIMD_AVX2: evaluateControllersAvx2(controllers, object_arrays, constraint_arrays, rest_length, first, count, time, scratch.data()); break;
+#endif
+    default: evaluateControllersScalar(controllers, object_arrays, constraint_arrays, rest_length, first, count, time, scratch.data()); break;
+    }
+}
+
+void evaluateControllersSoAScalar(const ControllerPopulation& population, const SoAObjectState& objects, SoAConstraintState& constraints,
+                                  size_t first, size_t count, float time) {
+    std::vector<float> scratch(simdControllerScratch(population.getTopology()));
+    evaluateControllersScalar(simdControllerArrays(population), simdObjectArrays(objects), simdConstraintArrays(constraints),
+                              constraints.rest_length.data(), first, count, time, scratch.data());
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "soa_solver.h"
+#include "scenes.h"
+
+// Hidden units a controller can have, must match MAX_HIDDEN in controller_compute_shader.glsl
+const int max_controller_hidden = 64;
+// Controller counts are padded to a multiple of the widest SIMD kernel, so every lane reads inside the weights
+const int controller_lane_padding = 16;
+
+// Body plan and network shape every controller of a population shares. Object and constraint indices are local
+// to one creature, counted from the creature's own object and constraint offsets.
+// Inputs, in order: position relative to the sensors' centroid and velocity of each sensor object (6 each),
+// strain (length - rest) / rest of each sensor constraint, then sin and cos of a clock. One tanh hidden layer,
+// one tanh output per actuator, which sets its rest length to base * (1 + actuator_range * output)
+struct ControllerTopology {
+    std::vector<uint32_t> sensor_objects;
+    std::vector<uint32_t> sensor_constraints;
+    std::vector<uint32_t> actuators;          // constraints the outputs drive
+    std::vector<float> actuator_rest_lengths; // base rest length of each actuator
+    int hidden_count = 16;
+    float actuator_range = 0.25f;
+    float position_scale = 0.05f; // brings sensor inputs to about [-1, 1]
+    float velocity_scale = 0.02f;
+    float clock_frequency = 1.0f; // Hz
+
+    int inputCount() const { return 6 * int(sensor_objects.size()) + int(sensor_constraints.size()) + 2; }
+    int outputCount() const { return int(actuators.size()); }
+    // Weights and biases of one controller
+    int parameterCount() const { return hidden_count * (inputCount() + 1) + outputCount() * (hidden_count + 1); }
+};
+
+// Every object of a creature as a sensor and every constraint as both a strain sensor and an actuator,
+// rest lengths taken from the first creature of a makeCreatureScene() scene
+ControllerTopology makeCreatureTopology(const Scene& scene, int hidden_count = 16);
+
+// Controllers of one population and all their weights in one contiguous buffer. Weights are stored
+// parameter-major, parameter p of controller c at p * getStride() + c, so SIMD lanes and GPU threads that
+// evaluate neighbouring controllers read neighbouring floats.
+// A genome is one controller's parameterCount() floats: each hidden unit's input weights then its bias,
+// then each output's hidden weights then its bias
+class ControllerPopulation {
+public:
+    ControllerPopulation(const ControllerTopology& topology = ControllerTopology());
+
+    // A creature whose objects start at object_offset and constraints at constraint_offset (a batched world's
+    // GPUPhysicsWorld offsets). Its genome starts at zero. Returns its index
+    int addController(uint32_t object_offset, uint32_t constraint_offset);
+    void clearControllers();
+    void setGenome(int controller, const float* parameters);
+    void getGenome(int controller, float* parameters) const;
+    // Uniform weights scaled by 1/sqrt(fan-in), zero biases
+    void randomizeGenomes(uint32_t seed, float scale = 1.0f);
+
+    const ControllerTopology& getTopology() const { return topology; }
+    int getControllerCount() const { return int(object_offsets.size()); }
+    int getParameterCount() const { return parameter_count; }
+    size_t getStride() const { return stride; }
+    const std::vector<float>& getWeights() const { return weights; }
+    const std::vector<uint32_t>& getObjectOffsets() const { return object_offsets; }
+    const std::vector<uint32_t>& getConstraintOffsets() const { return constraint_offsets; }
+    // Bumped by every change, the GPU path re-uploads when it differs from what it last uploaded
+    uint64_t getVersion() const { return version; }
+
+private:
+    ControllerTopology topology;
+    int parameter_count;
+    size_t stride = 0;
+    std::vector<float> weights;
+    std::vector<uint32_t> object_offsets;
+    std::vector<uint32_t> constraint_offsets;
+    uint64_t version = 0;
+
+    void restride(size_t new_stride);
+};
+
+// One control tick on the CPU for controllers [first, first + count): reads the sensors from the structure-of-arrays
+// state and writes the actuators' rest lengths. first must be a multiple of controller_lane_padding, controllers
+// must not share constraints. time drives the clock input.
+// Runs the widest kernel the build compiles and the CPU supports, scalar code otherwise
+void evaluateControllersSoA(const ControllerPopulation& population, const SoAObjectState& objects, SoAConstraintState& constraints,
+                            size_t first, size_t count, float time);
+// Same but always scalar, the reference the SIMD kernels are checked against
+void evaluateControllersSoAScalar(const ControllerPopulation& population, const SoAObjectState& objects, SoAConstraintState& constraints,
+                                  size_t first, size_t count, float time);
@@ -0,0 +1,845 @@
+#include "cpu_physics.h"
+#include <algorithm>
+#include <limits>
+#include <atomic>
+
+CPUPhysicsSystem::CPUPhysicsSystem(int iterations, int thread_count, int dimensions)
+    : thread_pool(thread_count), iterations(iterations), dimensions(dimensions == 2 ? 2 : 3) {
+}
+
+PhysicsHandle CPUPhysicsSystem::addObject(const GPUPhysicsObject& obj) {
+    PhysicsHandle handle;
+    addObjects(&obj, 1, &handle);
+    return handle;
+}
+
+PhysicsHandle CPUPhysicsSystem::addConstraint(const GPUPhysicsConstraint& constraint) {
+    PhysicsHandle handle;
+    addConstraints(&constraint, 1, &handle);
+    return handle;
+}
+
+void CPUPhysicsSystem::addObjects(const GPUPhysicsObject* data, size_t count, PhysicsHandle* handles) {
+    size_t first = objects.size();
+    objects.resize(first + count);
+
+    for (size_t i = 0; i < count; ++i) {
+        const GPUPhysicsObject& obj = data[i];
+        size_t index = first + i;
+        objects.x[index] = obj.position.x;
+        objects.y[index] = obj.position.y;
+        objects.z[index] = dimensions == 3 ? obj.position.z : 0.0f;
+        objects.vel_x[index] = obj.velocity.x;
+        objects.vel_y[index] = obj.velocity.y;
+        objects.vel_z[index] = dimensions == 3 ? obj.velocity.z : 0.0f;
+        objects.acc_x[index] = obj.acceleration.x;
+        objects.acc_y[index] = obj.acceleration.y;
+        objects.acc_z[index] = dimensions == 3 ? obj.acceleration.z : 0.0f;
+        objects.mass[index] = obj.mass;
+        objects.inv_mass[index] = obj.mass > 0.0f ? 1.0f / obj.mass : 0.0f;
+        objects.radius[index] = obj.radius;
+        objects.flags[index] = obj.flags;
+
+        constraint_graph.addObject();
+        PhysicsHandle handle = object_handles.add();
+        if (handles) handles[i] = handle;
+    }
+    initializeIslands(first);
+}
+
+void CPUPhysicsSystem::addConstraints(const GPUPhysicsConstraint* data, size_t count, PhysicsHandle* handles) {
+    size_t first = constraints.size();
+    constraints.resize(first + count);
+
+    for (size_t i = 0; i < count; ++i) {
+        const GPUPhysicsConstraint& constraint = data[i];
+        size_t index = first + i;
+        constraints.type[index] = constraint.type;
+        constraints.index_a[index] = constraint.indexA;
+        constraints.index_b[index] = constraint.indexB;
+        constraints.rest_length[index] = constraint.restLength;
+        constraints.stiffness[index] = constraint.stiffness;
+        constraints.lambda[index] = constraint.lambda;
+        constraints.penalty[index] = constraint.penalty;
+        constraints.stabilization[index] = constraint.stabilization;
+
+        constraint_graph.addConstraint(int(index), constraint.indexA, constraint.indexB);
+        PhysicsHandle handle = constraint_handles.add();
+        if (handles) handles[i] = handle;
+    }
+}
+
+// Mirrors GPUPhysicsSystem::removeObject, with the flags edit applied at once
+bool CPUPhysicsSystem::removeObject(PhysicsHandle handle) {
+    int index = object_handles.getIndex(handle);
+    if (index < 0) return false;
+
+    std::vector<uint32_t> incident = constraint_graph.getIncidentConstraints(index);
+    for (uint32_t k : incident) removeConstraintAt(int(k));
+
+    wakeIsland(uint32_t(index));
+    if (objects.flags[index] & OBJECT_SLEEPING) sleeping_count--;
+    objects.flags[index] = OBJECT_REMOVED | OBJECT_STATIC;
+    solve_order_dirty = true;
+    object_handles.remove(handle);
+    return true;
+}
+
+bool CPUPhysicsSystem::removeConstraint(PhysicsHandle handle) {
+    int index = constraint_handles.getIndex(handle);
+    if (index < 0) return false;
+    removeConstraintAt(index);
+    return true;
+}
+
+void CPUPhysicsSystem::removeConstraintAt(int index) {
+    // The edit kernel wakes both objects' islands for a constraint edit
+    wakeIsland(uint32_t(constraints.index_a[index]));
+    wakeIsland(uint32_t(constraints.index_b[index]));
+    constraint_graph.removeConstraint(index);
+    constraints.type[index] = CONSTRAINT_REMOVED;
+    constraint_handles.remove(constraint_handles.getHandle(index));
+}
+
+bool CPUPhysicsSystem::needsCompaction() const {
+    size_t removed_objects = object_handles.getRemovedCount();
+    size_t removed_constraints = constraint_handles.getRemovedCount();
+    if (removed_objects == 0 && removed_constraints == 0) return false;
+    return removed_objects >= compaction_threshold * float(objects.size()) ||
+           removed_constraints >= compaction_threshold * float(constraints.size());
+}
+
+// Mirrors GPUPhysicsSystem::compact and compact_compute_shader.glsl, in place since the remap keeps the order
+void CPUPhysicsSystem::compact() {
+    if (object_handles.getRemovedCount() == 0 && constraint_handles.getRemovedCount() == 0) return;
+    ProfileScope scope(profiler, "compaction");
+
+    object_handles.compact(object_remap);
+    constraint_handles.compact(constraint_remap);
+    size_t object_count = object_handles.size();
+    size_t constraint_count = constraint_handles.size();
+
+    // Island labels follow their root, objects whose root was removed become their own island and take over its wake.
+    // Wake requests are read by the old root index, which the move may already have overwritten
+    std::vector<uint8_t> old_wake = island_wake;
+    for (size_t i = 0; i < object_remap.size(); ++i) {
+        uint32_t target = object_remap[i];
+        if (target == removed_index) continue;
+        uint32_t label = island_labels[i];
+        uint32_t root = object_remap[label];
+        uint8_t wake = old_wake[i];
+        if (root == removed_index) {
+            wake = old_wake[label];
+            root = target;
+        }
+        island_labels[target] = root;
+        island_min_rest[target] = island_min_rest[i];
+        island_wake[target] = wake;
+    }
+    island_labels.resize(object_count);
+    island_min_rest.resize(object_count);
+    island_wake.resize(object_count);
+    objects.compact(object_remap, object_count);
+
+    constraints.compact(constraint_remap, constraint_count);
+    for (size_t k = 0; k < constraint_count; ++k) {
+        constraints.index_a[k] = int32_t(object_remap[constraints.index_a[k]]);
+        constraints.index_b[k] = int32_t(object_remap[constraints.index_b[k]]);
+    }
+    if (controller_rest_lengths.size() > constraint_count) controller_rest_lengths.resize(constraint_count);
+
+    constraint_graph.compact(object_remap, object_count, constraint_remap, constraint_count);
+    solve_order_dirty = true;
+    // Cached contacts name the old indices
+    contacts.resize(0);
+    contact_cache.clear();
+    compaction_count++;
+}
+
+// Mirrors initializeIslands in gpu_physics.cpp
+void CPUPhysicsSystem::initializeIslands(size_t first) {
+    size_t count = objects.size();
+    island_labels.resize(count);
+    island_min_rest.resize(count);
+    island_wake.resize(count);
+    for (size_t i = first; i < count; ++i) {
+        bool sleeping = (objects.flags[i] & OBJECT_SLEEPING) != 0;
+        objects.rest_time[i] = sleeping ? sleep_parameters.sleep_time : 0.0f;
+        island_labels[i] = uint32_t(i);
+        island_min_rest[i] = 0.0f;
+        island_wake[i] = 0;
+        if (sleeping) sleeping_count++;
+    }
+    solve_order_dirty = true;
+}
+
+// Same as the edit kernel, the island wakes on the next update()
+void CPUPhysicsSystem::wakeIsland(uint32_t object) {
+    objects.rest_time[object] = 0.0f;
+    island_wake[island_labels[object]] = 1;
+}
+
+void CPUPhysicsSystem::setObjectPosition(int index, const glm::vec4& position) {
+    wakeIsland(uint32_t(index));
+    objects.x[index] = position.x;
+    objects.y[index] = position.y;
+    objects.z[index] = dimensions == 3 ? position.z : 0.0f;
+}
+
+void CPUPhysicsSystem::setObjectVelocity(int index, const glm::vec4& velocity) {
+    wakeIsland(uint32_t(index));
+    objects.vel_x[index] = velocity.x;
+    objects.vel_y[index] = velocity.y;
+    objects.vel_z[index] = dimensions == 3 ? velocity.z : 0.0f;
+}
+
+void CPUPhysicsSystem::setObjectAcceleration(int index, const glm::vec4& acceleration) {
+    wakeIsland(uint32_t(index));
+    objects.acc_x[index] = acceleration.x;
+    objects.acc_y[index] = acceleration.y;
+    objects.acc_z[index] = dimensions == 3 ? acceleration.z : 0.0f;
+}
+
+void CPUPhysicsSystem::setObjectMass(int index, float mass) {
+    wakeIsland(uint32_t(index));
+    objects.mass[index] = mass;
+    objects.inv_mass[index] = mass > 0.0f ? 1.0f / mass : 0.0f;
+}
+
+void CPUPhysicsSystem::setObjectRadius(int index, float radius) {
+    wakeIsland(uint32_t(index));
+    objects.radius[index] = radius;
+}
+
+// OBJECT_SLEEPING belongs to the island pass, as on the GPU
+void CPUPhysicsSystem::setObjectFlags(int index, uint32_t flags) {
+    wakeIsland(uint32_t(index));
+    if (objects.flags[index] & OBJECT_SLEEPING) sleeping_count--;
+    objects.flags[index] = flags & ~uint32_t(OBJECT_SLEEPING);
+    solve_order_dirty = true;
+}
+
+void CPUPhysicsSystem::setConstraintRestLength(int index, float rest_length) {
+    wakeIsland(uint32_t(constraints.index_a[index]));
+    wakeIsland(uint32_t(constraints.index_b[index]));
+    constraints.rest_length[index] = rest_length;
+}
+
+void CPUPhysicsSystem::setConstraintStiffness(int index, float stiffness) {
+    wakeIsland(uint32_t(constraints.index_a[index]));
+    wakeIsland(uint32_t(constraints.index_b[index]));
+    constraints.stiffness[index] = stiffness;
+}
+
+void CPUPhysicsSystem::setConstraintLambda(int index, float lambda) {
+    wakeIsland(uint32_t(constraints.index_a[index]));
+    wakeIsland(uint32_t(constraints.index_b[index]));
+    constraints.lambda[index] = lambda;
+}
+
+void CPUPhysicsSystem::restoreState(const CPUPhysicsSystem& source) {
+    objects = source.objects;
+    constraints = source.constraints;
+    contacts.resize(0);
+    contact_cache.clear();
+    step_count = source.step_count;
+    last_iterations = source.last_iterations;
+    last_residual = source.last_residual;
+    island_labels = source.island_labels;
+    island_min_rest = source.island_min_rest;
+    island_wake = source.island_wake;
+    sleeping_count = source.sleeping_count;
+    object_handles = source.object_handles;
+    constraint_handles = source.constraint_handles;
+    compaction_count = source.compaction_count;
+    solve_order_dirty = true;
+}
+
+void CPUPhysicsSystem::updateControllers(const ControllerPopulation& population, float time) {
+    ProfileScope scope(profiler, "controllers");
+    // A muscle that moves wakes a sleeping creature, as in controller_compute_shader.glsl
+    if (sleeping_count > 0) controller_rest_lengths = constraints.rest_length;
+
+    size_t block_count = (size_t(population.getControllerCount()) + controller_lane_padding - 1) / controller_lane_padding;
+    thread_pool.parallelFor(0, block_count, [&](size_t block_begin, size_t block_end) {
+        evaluateControllersSoA(population, objects, constraints, block_begin * controller_lane_padding,
+                               (block_end - block_begin) * controller_lane_padding, time);
+    }, 4);
+
+    if (sleeping_count == 0) return;
+    for (size_t k = 0; k < constraints.size(); ++k) {
+        if (constraints.rest_length[k] == controller_rest_lengths[k]) continue;
+        uint32_t a = uint32_t(constraints.index_a[k]);
+        uint32_t b = uint32_t(constraints.index_b[k]);
+        if (objects.flags[a] & OBJECT_SLEEPING) island_wake[island_labels[a]] = 1;
+        if (objects.flags[b] & OBJECT_SLEEPING) island_wake[island_labels[b]] = 1;
+    }
+}
+
+void CPUPhysicsSystem::setIterations(int iterations) {
+    this->iterations = iterations;
+}
+
+std::vector<GPUPhysicsObject> CPUPhysicsSystem::getObjectsData() {
+    std::vector<GPUPhysicsObject> data(objects.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i].position = {objects.x[i], objects.y[i], objects.z[i], 1.0f};
+        data[i].velocity = {objects.vel_x[i], objects.vel_y[i], objects.vel_z[i], 0.0f};
+        data[i].acceleration = {objects.acc_x[i], objects.acc_y[i], objects.acc_z[i], 0.0f};
+        data[i].mass = objects.mass[i];
+        data[i].radius = objects.radius[i];
+        data[i].flags = objects.flags[i];
+    }
+    return data;
+}
+
+std::vector<GPUPhysicsConstraint> CPUPhysicsSystem::getConstraintsData() {
+    std::vector<GPUPhysicsConstraint> data(constraints.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i].type = constraints.type[i];
+        data[i].indexA = constraints.index_a[i];
+        data[i].indexB = constraints.index_b[i];
+        data[i].restLength = constraints.rest_length[i];
+        data[i].stiffness = constraints.stiffness[i];
+        data[i].lambda = constraints.lambda[i];
+        data[i].penalty = constraints.penalty[i];
+        data[i].stabilization = constraints.stabilization[i];
+    }
+    return data;
+}
+
+bool CPUPhysicsSystem::saveSnapshot(const char* path) {
+    compact();
+    if (constraint_graph.rebuild()) solve_order_dirty = true;
+
+    std::vector<GPUPhysicsObject> object_data = getObjectsData();
+    std::vector<GPUPhysicsConstraint> constraint_data = getConstraintsData();
+    float max_radius = 0.0f;
+    for (float radius : objects.radius) max_radius = std::max(max_radius, radius);
+
+    SnapshotData data;
+    data.objects = object_data.data();
+    data.object_count = object_data.size();
+    data.constraints = constraint_data.data();
+    data.constraint_count = constraint_data.size();
+    data.graph = constraint_graph.getEdgeSet();
+    data.edge_count = constraint_graph.getIndices().size();
+    data.color_order = constraint_graph.getColorOrder().data();
+    data.color_offsets = constraint_graph.getColorOffsets().data();
+    data.color_count = size_t(constraint_graph.getColorCount());
+    data.state.step = step_count;
+    data.state.iterations = iterations;
+    data.state.collisions_enabled = collisions_enabled;
+    data.state.contact_cell_size = contact_cell_size;
+    data.state.contact_stiffness = contact_stiffness;
+    data.state.max_radius = max_radius;
+    data.state.solver_parameters = solver_parameters;
+    return writeSnapshot(path, data);
+}
+
+bool CPUPhysicsSystem::loadSnapshot(const char* path) {
+    SnapshotFile file;
+    if (!file.open(path)) return false;
+    const SnapshotData& data = file.getData();
+
+    objects.resize(0);
+    objects.resize(data.object_count);
+    thread_pool.parallelFor(0, data.object_count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const GPUPhysicsObject& obj = data.objects[i];
+            objects.x[i] = obj.position.x;
+            objects.y[i] = obj.position.y;
+            objects.z[i] = dimensions == 3 ? obj.position.z : 0.0f;
+            objects.vel_x[i] = obj.velocity.x;
+            objects.vel_y[i] = obj.velocity.y;
+            objects.vel_z[i] = dimensions == 3 ? obj.velocity.z : 0.0f;
+            objects.acc_x[i] = obj.acceleration.x;
+            objects.acc_y[i] = obj.acceleration.y;
+            objects.acc_z[i] = dimensions == 3 ? obj.acceleration.z : 0.0f;
+            objects.mass[i] = obj.mass;
+            objects.inv_mass[i] = obj.mass > 0.0f ? 1.0f / obj.mass : 0.0f;
+            objects.radius[i] = obj.radius;
+            objects.flags[i] = obj.flags;
+        }
+    }, 4096);
+    sleeping_count = 0;
+    initializeIslands(0);
+    object_handles.clear();
+    for (size_t i = 0; i < data.object_count; ++i) object_handles.add();
+
+    constraints.resize(0);
+    constraints.resize(data.constraint_count);
+    thread_pool.parallelFor(0, data.constraint_count, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            const GPUPhysicsConstraint& constraint = data.constraints[k];
+            constraints.type[k] = constraint.type;
+            constraints.index_a[k] = constraint.indexA;
+            constraints.index_b[k] = constraint.indexB;
+            constraints.rest_length[k] = constraint.restLength;
+            constraints.stiffness[k] = constraint.stiffness;
+            constraints.lambda[k] = constraint.lambda;
+            constraints.penalty[k] = constraint.penalty;
+            constraints.stabilization[k] = constraint.stabilization;
+        }
+    }, 4096);
+
+    constraint_handles.clear();
+    for (size_t k = 0; k < data.constraint_count; ++k) constraint_handles.add();
+
+    constraint_graph = ConstraintGraph();
+    constraint_graph.assign(data.object_count, data.constraint_count, data.graph, data.color_order, data.color_offsets, data.color_count);
+    solve_order_dirty = true;
+
+    const SnapshotState& state = data.state;
+    step_count = state.step;
+    iterations = state.iterations;
+    collisions_enabled = state.collisions_enabled;
+    contact_cell_size = state.contact_cell_size;
+    contact_stiffness = state.contact_stiffness;
+    solver_parameters = state.solver_parameters;
+    // Contacts are found again on the next step, without a warm start
+    contacts.resize(0);
+    contact_cache.clear();
+    return true;
+}
+
+static GPUPhysicsStats emptyStats() {
+    GPUPhysicsStats stats = {};
+    stats.bounds_min = glm::vec4(std::numeric_limits<float>::max());
+    stats.bounds_max = glm::vec4(-std::numeric_limits<float>::max());
+    return stats;
+}
+
+static void mergeStats(GPUPhysicsStats& into, const GPUPhysicsStats& from) {
+    into.momentum += from.momentum;
+    into.bounds_min = glm::min(into.bounds_min, from.bounds_min);
+    into.bounds_max = glm::max(into.bounds_max, from.bounds_max);
+    into.kinetic_energy += from.kinetic_energy;
+    into.potential_energy += from.potential_energy;
+    into.max_constraint_violation = std::max(into.max_constraint_violation, from.max_constraint_violation);
+    into.sleeping_count += from.sleeping_count;
+}
+
+// Mirrors stats_compute_shader.glsl, fixed blocks merged in order so the sums don't depend on the thread count
+GPUPhysicsStats CPUPhysicsSystem::computeStats(float reference_height) {
+    const size_t block_count = 64;
+    size_t object_block = (objects.size() + block_count - 1) / block_count;
+    size_t constraint_block = (constraints.size() + block_count - 1) / block_count;
+    stats_partials.assign(block_count, emptyStats());
+
+    thread_pool.parallelFor(0, block_count, [&](size_t block_begin, size_t block_end) {
+        for (size_t block = block_begin; block < block_end; ++block) {
+            GPUPhysicsStats& partial = stats_partials[block];
+
+            size_t end = std::min(objects.size(), (block + 1) * object_block);
+            for (size_t i = block * object_block; i < end; ++i) {
+                if (objects.flags[i] & OBJECT_REMOVED) continue;
+                float mass = objects.mass[i];
+                glm::vec4 position(objects.x[i], objects.y[i], objects.z[i], 0.0f);
+                glm::vec4 velocity(objects.vel_x[i], objects.vel_y[i], objects.vel_z[i], 0.0f);
+                partial.momentum += mass * velocity;
+                partial.bounds_min = glm::min(partial.bounds_min, position);
+                partial.bounds_max = glm::max(partial.bounds_max, position);
+                partial.kinetic_energy += 0.5f * mass * (velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
+                partial.potential_energy -= mass * objects.acc_y[i] * (objects.y[i] - reference_height);
+                if (objects.flags[i] & OBJECT_SLEEPING) partial.sleeping_count++;
+            }
+
+            end = std::min(constraints.size(), (block + 1) * constraint_block);
+            for (size_t k = block * constraint_block; k < end; ++k) {
+                if (constraints.type[k] == CONSTRAINT_REMOVED) continue;
+                uint32_t a = constraints.index_a[k];
+                uint32_t b = constraints.index_b[k];
+                float dx = objects.x[a] - objects.x[b];
+                float dy = objects.y[a] - objects.y[b];
+                float dz = objects.z[a] - objects.z[b];
+                float violation = std::abs(std::sqrt(dx * dx + dy * dy + dz * dz) - constraints.rest_length[k]);
+                partial.max_constraint_violation = std::max(partial.max_constraint_violation, violation);
+            }
+        }
+    }, 1);
+
+    GPUPhysicsStats stats = emptyStats();
+    for (const GPUPhysicsStats& partial : stats_partials) mergeStats(stats, partial);
+    stats.object_count = uint32_t(objects.size());
+    stats.solver_iterations = uint32_t(last_iterations);
+    stats.solver_residual = last_residual;
+    return stats;
+}
+
+static void atomicMax(std::atomic<float>& value, float candidate) {
+    float current = value.load(std::memory_order_relaxed);
+    while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {}
+}
+
+void CPUPhysicsSystem::rebuildSolveOrder(const std::vector<uint32_t>& color_order, const std::vector<uint32_t>& color_offsets) {
+    int color_count = color_offsets.empty() ? 0 : int(color_offsets.size()) - 1;
+
+    solve_order.clear();
+    solve_offsets.assign(1, 0);
+    kinematic_order.clear();
+    for (int c = 0; c < color_count; ++c) {
+        for (uint32_t slot = color_offsets[c]; slot < color_offsets[c + 1]; ++slot) {
+            // Static and sleeping objects stay put, kinematic ones move by themselves before the iterations
+            uint32_t index = color_order[slot];
+            if (isResting(index)) continue;
+            if (objects.flags[index] & OBJECT_KINEMATIC) {
+                kinematic_order.push_back(index);
+                continue;
+            }
+            solve_order.push_back(index);
+        }
+        solve_offsets.push_back(uint32_t(solve_order.size()));
+    }
+}
+
+// An awake object that moves, kinematic objects at a standstill leave sleeping neighbours alone
+bool CPUPhysicsSystem::isMoving(uint32_t index) const {
+    if (isResting(index)) return false;
+    if ((objects.flags[index] & OBJECT_KINEMATIC) == 0) return true;
+    return objects.vel_x[index] != 0.0f || objects.vel_y[index] != 0.0f || objects.vel_z[index] != 0.0f;
+}
+
+// Mirrors the wake-ups of the constraint and contact kernels and the activation pass: a sleeping object pulled
+// or touched by a moving one wakes its whole island, as do edits and controllers through island_wake
+void CPUPhysicsSystem::wakeTouchedIslands() {
+    const SoAConstraintState* sets[2] = {&constraints, &contacts};
+    for (const SoAConstraintState* set : sets) {
+        for (size_t k = 0; k < set->size(); ++k) {
+            if (set->type[k] == CONSTRAINT_REMOVED) continue;
+            uint32_t a = uint32_t(set->index_a[k]);
+            uint32_t b = uint32_t(set->index_b[k]);
+            if ((objects.flags[a] & OBJECT_SLEEPING) && isMoving(b)) island_wake[island_labels[a]] = 1;
+            if ((objects.flags[b] & OBJECT_SLEEPING) && isMoving(a)) island_wake[island_labels[b]] = 1;
+        }
+    }
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if ((objects.flags[i] & OBJECT_SLEEPING) == 0) continue;
+        if (sleep_parameters.enabled && !island_wake[island_labels[i]]) continue;
+        objects.flags[i] &= ~uint32_t(OBJECT_SLEEPING);
+        objects.rest_time[i] = 0.0f;
+        sleeping_count--;
+        solve_order_dirty = true;
+    }
+}
+
+// Mirrors island_compute_shader.glsl with a serial union-find, labels point at the lower index as there
+void CPUPhysicsSystem::findIslands() {
+    size_t count = objects.size();
+    auto joinsIsland = [&](uint32_t index) { return (objects.flags[index] & (OBJECT_STATIC | OBJECT_KINEMATIC)) == 0; };
+    auto findRoot = [&](uint32_t index) {
+        while (island_labels[index] != index) {
+            island_labels[index] = island_labels[island_labels[index]];
+            index = island_labels[index];
+        }
+        return index;
+    };
+
+    // 1. Every object is its own island, wake requests were acted on by this step
+    for (size_t i = 0; i < count; ++i) {
+        island_labels[i] = uint32_t(i);
+        island_min_rest[i] = std::numeric_limits<float>::max();
+        island_wake[i] = 0;
+    }
+
+    // 2. Merge the endpoints of every constraint and contact between two objects that join islands
+    const SoAConstraintState* sets[2] = {&constraints, &contacts};
+    for (const SoAConstraintState* set : sets) {
+        for (size_t k = 0; k < set->size(); ++k) {
+            if (set->type[k] == CONSTRAINT_REMOVED) continue;
+            uint32_t a = uint32_t(set->index_a[k]);
+            uint32_t b = uint32_t(set->index_b[k]);
+            if (!joinsIsland(a) || !joinsIsland(b)) continue;
+            a = findRoot(a);
+            b = findRoot(b);
+            if (a != b) island_labels[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    // 3. Point straight at the root and fold the rest time into it
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t root = findRoot(uint32_t(i));
+        island_labels[i] = root;
+        if (joinsIsland(uint32_t(i))) island_min_rest[root] = std::min(island_min_rest[root], objects.rest_time[i]);
+    }
+
+    // 4. An island sleeps once every object in it has rested long enough, and stops dead
+    sleeping_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!joinsIsland(uint32_t(i))) continue;
+        bool asleep = island_min_rest[island_labels[i]] >= sleep_parameters.sleep_time;
+        bool sleeping = (objects.flags[i] & OBJECT_SLEEPING) != 0;
+        if (asleep && !sleeping) {
+            objects.vel_x[i] = objects.vel_y[i] = objects.vel_z[i] = 0.0f;
+            objects.flags[i] |= OBJECT_SLEEPING;
+        } else if (!asleep && sleeping) {
+            objects.flags[i] &= ~uint32_t(OBJECT_SLEEPING);
+        }
+        if (asleep != sleeping) solve_order_dirty = true;
+        if (asleep) sleeping_count++;
+    }
+}
+
+void CPUPhysicsSystem::findContacts() {
+    size_t count = objects.size();
+
+    float cell_size = contact_cell_size;
+    if (cell_size <= 0.0f) {
+        float max_radius = 0.0f;
+        for (size_t i = 0; i < count; ++i) max_radius = std::max(max_radius, objects.radius[i]);
+        cell_size = std::max(2.0f * max_radius, 1e-3f);
+    }
+
+    grid.build(objects.x.data(), objects.y.data(), count, cell_size);
+    grid.findContacts(objects.x.data(), objects.y.data(), objects.z.data(), objects.radius.data(),
+                      thread_pool, contact_pairs);
+    // Removed objects touch nothing until the compaction drops them, as in contact_compute_shader.glsl
+    if (objects.size() > size_t(getLiveObjectCount())) {
+        contact_pairs.erase(std::remove_if(contact_pairs.begin(), contact_pairs.end(), [&](const ContactPair& pair) {
+            return ((objects.flags[pair.a] | objects.flags[pair.b]) & OBJECT_REMOVED) != 0;
+        }), contact_pairs.end());
+    }
+
+    // Contact constraints, warm-started from the same pair last step
+    size_t contact_count = contact_pairs.size();
+    contacts.resize(contact_count);
+    contact_a.resize(contact_count);
+    contact_b.resize(contact_count);
+    for (size_t k = 0; k < contact_count; ++k) {
+        const ContactPair& pair = contact_pairs[k];
+        contacts.type[k] = CONSTRAINT_CONTACT;
+        contacts.index_a[k] = int32_t(pair.a);
+        contacts.index_b[k] = int32_t(pair.b);
+        contacts.rest_length[k] = pair.rest_length;
+        contacts.stiffness[k] = contact_stiffness;
+        contacts.lambda[k] = 0.0f;
+        contacts.penalty[k] = contact_stiffness;
+        contacts.stabilization[k] = 0.0f;
+        contact_a[k] = pair.a;
+        contact_b[k] = pair.b;
+
+        if (!solver_parameters.warm_start) continue;
+        contacts.stabilization[k] = solver_parameters.alpha * (distance(pair.a, pair.b) - pair.rest_length);
+        auto cached = contact_cache.find(uint64_t(pair.a) << 32 | pair.b);
+        if (cached != contact_cache.end()) {
+            contacts.penalty[k] = std::min(std::max(solver_parameters.gamma * cached->second.penalty, solver_parameters.stiffness_min), solver_parameters.stiffness_max);
+            contacts.lambda[k] = solver_parameters.alpha * solver_parameters.gamma * cached->second.lambda;
+        }
+    }
+
+    // CSR adjacency, count then prefix sum then fill
+    contact_offsets.assign(count + 1, 0);
+    for (size_t k = 0; k < contact_count; ++k) {
+        contact_offsets[contact_a[k] + 1]++;
+        contact_offsets[contact_b[k] + 1]++;
+    }
+    for (size_t i = 0; i < count; ++i) contact_offsets[i + 1] += contact_offsets[i];
+    contact_indices.resize(2 * contact_count);
+    std::vector<uint32_t> cursor(contact_offsets.begin(), contact_offsets.end() - 1);
+    for (size_t k = 0; k < contact_count; ++k) {
+        contact_indices[cursor[contact_a[k]]++] = uint32_t(k);
+        contact_indices[cursor[contact_b[k]]++] = uint32_t(k);
+    }
+}
+
+void CPUPhysicsSystem::cacheContacts() {
+    contact_cache.clear();
+    for (size_t k = 0; k < contacts.size(); ++k) {
+        contact_cache[uint64_t(contact_a[k]) << 32 | contact_b[k]] = {contacts.penalty[k], contacts.lambda[k]};
+    }
+}
+
+void CPUPhysicsSystem::update(float dt) {
+    if (needsCompaction()) compact();
+    if (objects.size() == 0) return;
+    ProfileScope update_scope(profiler, "physics update");
+
+    {
+        ProfileScope scope(profiler, "constraint graph");
+        if (constraint_graph.rebuild()) solve_order_dirty = true;
+    }
+
+    // Scale down what the constraints carry over, contacts are warm-started as the narrow phase matches them
+    warmStartConstraints();
+
+    if (collisions_enabled) {
+        ProfileScope scope(profiler, "contacts");
+        findContacts();
+    } else {
+        contacts.resize(0);
+        contact_cache.clear();
+    }
+
+    // Wake the islands something touched before the colors are filtered
+    if (sleeping_count > 0) wakeTouchedIslands();
+
+    SoAConstraintView sets[2] = {
+        {&constraints, constraint_graph.getOffsets().data(), constraint_graph.getIndices().data()},
+        {&contacts, contact_offsets.data(), contact_indices.data()},
+    };
+    int set_count = contacts.size() > 0 ? 2 : 1;
+
+    // Contacts change every step, so the colors of the union graph do too
+    if (set_count == 2) {
+        ProfileScope scope(profiler, "coloring");
+        CSREdgeSet edge_sets[2] = {
+            constraint_graph.getEdgeSet(),
+            {contact_offsets.data(), contact_indices.data(), contact_a.data(), contact_b.data()},
+        };
+        colorGraph(objects.size(), edge_sets, 2, union_color_order, union_color_offsets);
+        rebuildSolveOrder(union_color_order, union_color_offsets);
+        solve_order_dirty = true; // back to the constraint colors once contacts are gone
+    } else if (solve_order_dirty) {
+        rebuildSolveOrder(constraint_graph.getColorOrder(), constraint_graph.getColorOffsets());
+        solve_order_dirty = false;
+    }
+    int color_count = int(solve_offsets.size()) - 1;
+
+    // 3. Calculate new position/y, once per step
+    {
+        ProfileScope scope(profiler, "inertial");
+        thread_pool.parallelFor(0, solve_order.size(), [&](size_t begin, size_t end) {
+            for (size_t slot = begin; slot < end; ++slot) {
+                uint32_t i = solve_order[slot];
+                objects.prev_x[i] = objects.x[i];
+                objects.prev_y[i] = objects.y[i];
+                objects.inertial_x[i] = objects.x[i] + dt * objects.vel_x[i] + dt * dt * objects.acc_x[i];
+                objects.inertial_y[i] = objects.y[i] + dt * objects.vel_y[i] + dt * dt * objects.acc_y[i];
+                if (dimensions == 2) continue;
+                objects.prev_z[i] = objects.z[i];
+                objects.inertial_z[i] = objects.z[i] + dt * objects.vel_z[i] + dt * dt * objects.acc_z[i];
+            }
+        }, 1024);
+
+        // Kinematic objects move along their own velocity once per step, nothing pushes them back
+        for (uint32_t i : kinematic_order) {
+            objects.x[i] += dt * objects.vel_x[i];
+            objects.y[i] += dt * objects.vel_y[i];
+            objects.z[i] += dt * objects.vel_z[i];
+        }
+    }
+
+    // Iterates until the largest step of an iteration is within tolerance, as convergence_compute_shader.glsl
+    const SolverParameters& p = solver_parameters;
+    last_iterations = 0;
+    last_residual = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        // Objects of one color share no constraint, so each batch runs in parallel
+        std::atomic<float> residual(0.0f);
+        {
+            ProfileScope scope(profiler, "solve colors");
+            for (int c = 0; c < color_count; ++c) {
+                thread_pool.parallelFor(solve_offsets[c], solve_offsets[c + 1], [&](size_t begin, size_t end) {
+                    atomicMax(residual, solveObjectsSoA(objects, sets, set_count, solve_order.data() + begin, end - begin, dt, dimensions));
+                });
+            }
+        }
+
+        ProfileScope scope(profiler, "constraint update");
+        thread_pool.parallelFor(0, constraints.size(), [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                updateConstraint(constraints, uint32_t(k));
+            }
+        });
+        thread_pool.parallelFor(0, contacts.size(), [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                updateConstraint(contacts, uint32_t(k));
+            }
+        });
+
+        last_iterations = i + 1;
+        last_residual = residual.load();
+        if (last_iterations >= p.min_iterations && p.residual_tolerance > 0.0f && last_residual <= p.residual_tolerance) break;
+    }
+
+    if (collisions_enabled) {
+        ProfileScope scope(profiler, "cache contacts");
+        cacheContacts();
+    }
+
+    // 37. Update velocity
+    {
+        ProfileScope scope(profiler, "velocity");
+        thread_pool.parallelFor(0, solve_order.size(), [&](size_t begin, size_t end) {
+            for (size_t slot = begin; slot < end; ++slot) {
+                uint32_t i = solve_order[slot];
+                objects.vel_x[i] = (objects.x[i] - objects.prev_x[i]) / dt;
+                objects.vel_y[i] = (objects.y[i] - objects.prev_y[i]) / dt;
+                if (dimensions == 3) objects.vel_z[i] = (objects.z[i] - objects.prev_z[i]) / dt;
+
+                // Time at rest, an island falls asleep once all of its objects have rested long enough
+                float energy = 0.5f * (objects.vel_x[i] * objects.vel_x[i] + objects.vel_y[i] * objects.vel_y[i] + objects.vel_z[i] * objects.vel_z[i]);
+                objects.rest_time[i] = energy <= sleep_parameters.sleep_energy ? objects.rest_time[i] + dt : 0.0f;
+            }
+        }, 1024);
+    }
+
+    // Islands from this step's constraints and contacts, every few steps
+    if (sleep_parameters.enabled && step_count % uint64_t(std::max(sleep_parameters.island_interval, 1)) == 0) {
+        ProfileScope scope(profiler, "islands");
+        findIslands();
+    }
+    step_count++;
+}
+
+// Mirrors penaltyCap() in constraint_compute_shader.glsl: a soft constraint's penalty ramps up to its
+// material stiffness, hard constraints and contacts only stop at stiffness_max
+static float penaltyCap(int32_t type, float stiffness, const SolverParameters& p) {
+    bool hard = type == 1 || type == CONSTRAINT_CONTACT;
+    return hard ? p.stiffness_max : std::min(stiffness, p.stiffness_max);
+}
+
+// Mirrors the warm start pass of constraint_compute_shader.glsl
+void CPUPhysicsSystem::warmStartConstraints() {
+    const SolverParameters& p = solver_parameters;
+    thread_pool.parallelFor(0, constraints.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            // Constraints of sleeping islands keep their duals until they wake
+            if (constraints.type[k] == CONSTRAINT_REMOVED) continue;
+            if (isResting(uint32_t(constraints.index_a[k])) && isResting(uint32_t(constraints.index_b[k]))) continue;
+            float cap = penaltyCap(constraints.type[k], constraints.stiffness[k], p);
+            if (p.warm_start) {
+                constraints.lambda[k] *= p.alpha * p.gamma;
+                constraints.penalty[k] = std::min(std::max(p.gamma * constraints.penalty[k], p.stiffness_min), cap);
+            } else {
+                constraints.lambda[k] = 0.0f;
+                constraints.penalty[k] = std::min(p.stiffness_min, cap);
+            }
+        }
+    }, 4096);
+}
+
+float CPUPhysicsSystem::distance(uint32_t a, uint32_t b) const {
+    float dx = objects.x[a] - objects.x[b];
+    float dy = objects.y[a] - objects.y[b];
+    float dz = objects.z[a] - objects.z[b];
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// Mirrors main() in constraint_compute_shader.glsl
+void CPUPhysicsSystem::updateConstraint(SoAConstraintState& set, uint32_t index) {
+    // 28. Update lambda
+    if (set.type[index] == CONSTRAINT_REMOVED) return;
+    uint32_t a = set.index_a[index];
+    uint32_t b = set.index_b[index];
+    if (isResting(a) && isResting(b)) return;
+    float currentDistance = distance(a, b) - set.rest_length[index] - set.stabilization[index];
+
+    // Contacts only push: λ is clamped to λ ≤ 0 and the penalty stops ramping once the contact lets go
+    if (set.type[index] == CONSTRAINT_CONTACT) {
+        set.lambda[index] = std::min(set.penalty[index] * currentDistance + set.lambda[index], 0.0f);
+        if (set.lambda[index] == 0.0f) return;
+        float cap = penaltyCap(set.type[index], set.stiffness[index], solver_parameters);
+        set.penalty[index] = std::min(set.penalty[index] + solver_parameters.beta * std::abs(currentDistance), cap);
+        return;
+    }
+
+    // Only hard constraints and contacts carry a dual variable (Eq. 11)
+    bool hard = set.type[index] == 1 || set.type[index] == CONSTRAINT_CONTACT;
+    set.lambda[index] = hard ? set.penalty[index] * currentDistance + set.lambda[index] : 0.0f;
+
+    // 30. Update the penalty (Eq. 12), clamped so it cannot grow without bound
+    float cap = penaltyCap(set.type[index], set.stiffness[index], solver_parameters);
+    set.penalty[index] = std::min(set.penalty[index] + solver_parameters.beta * std::abs(currentDistance), cap);
+}
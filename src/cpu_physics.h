@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <unordered_map>
+#include "physics_types.h"
+#include "constraint_graph.h"
+#include "handle_table.h"
+#include "thread_pool.h"
+#include "soa_solver.h"
+#include "broad_phase.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "controller.h"
+
+// CPU implementation of the VBD step in object_compute_shader.glsl and constraint_compute_shader.glsl.
+// Exposes the same API as GPUPhysicsSystem but needs no GL context, so it can run headless.
+// State is kept as structure-of-arrays (see soa_solver.h), each color batch and the constraint pass
+// are spread over a thread pool.
+// With collisions enabled, overlapping balls get contact constraints (type 4) every step from a uniform-grid
+// broad phase; contacts that survive between steps keep their penalty and lambda.
+// Islands are found and put to sleep by the same rules as on the GPU (SleepParameters), sleeping and static
+// objects are left out of the color batches.
+class CPUPhysicsSystem {
+public:
+    // dimensions 2 runs the 2D instantiation of the solver kernel and keeps every z at zero,
+    // as GPUPhysicsSystem does for its compact layout
+    CPUPhysicsSystem(int iterations = 5, int thread_count = 0, int dimensions = 3);
+
+    PhysicsHandle addObject(const GPUPhysicsObject& obj);
+    PhysicsHandle addConstraint(const GPUPhysicsConstraint& constraint);
+    void addObjects(const GPUPhysicsObject* objects, size_t count, PhysicsHandle* handles = nullptr);
+    void addConstraints(const GPUPhysicsConstraint* constraints, size_t count, PhysicsHandle* handles = nullptr);
+
+    // Same removal and compaction as GPUPhysicsSystem, removal applies immediately and compaction moves the
+    // structure-of-arrays state in place
+    bool removeObject(PhysicsHandle handle);
+    bool removeConstraint(PhysicsHandle handle);
+    int getObjectIndex(PhysicsHandle handle) const { return object_handles.getIndex(handle); }
+    int getConstraintIndex(PhysicsHandle handle) const { return constraint_handles.getIndex(handle); }
+    PhysicsHandle getObjectHandle(int index) const { return object_handles.getHandle(index); }
+    PhysicsHandle getConstraintHandle(int index) const { return constraint_handles.getHandle(index); }
+    void setCompactionThreshold(float fraction) { compaction_threshold = fraction; }
+    void compact();
+    uint64_t getCompactionCount() const { return compaction_count; }
+    int getLiveObjectCount() const { return int(objects.size() - object_handles.getRemovedCount()); }
+    int getLiveConstraintCount() const { return int(constraints.size() - constraint_handles.getRemovedCount()); }
+
+    // Same edit API as GPUPhysicsSystem, applied immediately since there is no buffer to sync
+    void setObjectPosition(int index, const glm::vec4& position);
+    void setObjectVelocity(int index, const glm::vec4& velocity);
+    void setObjectAcceleration(int index, const glm::vec4& acceleration);
+    void setObjectMass(int index, float mass);
+    void setObjectRadius(int index, float radius);
+    void setObjectFlags(int index, uint32_t flags);
+    void setConstraintRestLength(int index, float rest_length);
+    void setConstraintStiffness(int index, float stiffness);
+    void setConstraintLambda(int index, float lambda);
+
+    void update(float dt);
+    // One control tick of a controller population, blocks of controllers spread over the thread pool.
+    // The new rest lengths take effect from the next update()
+    void updateControllers(const ControllerPopulation& population, float time);
+    void setIterations(int iterations);
+    void setCollisionsEnabled(bool enabled) { collisions_enabled = enabled; }
+    // Grid cell size, 0 picks twice the largest radius every step
+    void setContactCellSize(float cell_size) { contact_cell_size = cell_size; }
+    // Stiffness a new contact starts from
+    void setContactStiffness(float stiffness) { contact_stiffness = stiffness; }
+    // Same as GPUPhysicsSystem::setSolverParameters
+    void setSolverParameters(const SolverParameters& parameters) { solver_parameters = parameters; }
+    const SolverParameters& getSolverParameters() const { return solver_parameters; }
+    // Same as GPUPhysicsSystem::setSleepParameters
+    void setSleepParameters(const SleepParameters& parameters) { sleep_parameters = parameters; }
+    const SleepParameters& getSleepParameters() const { return sleep_parameters; }
+    int getSleepingCount() const { return sleeping_count; }
+    std::vector<GPUPhysicsObject> getObjectsData();
+    std::vector<GPUPhysicsConstraint> getConstraintsData();
+    // Same snapshot files as GPUPhysicsSystem::saveSnapshot / loadSnapshot. Loading splits the mapped
+    // records into the structure-of-arrays state but keeps the saved coloring
+    bool saveSnapshot(const char* path);
+    bool loadSnapshot(const char* path);
+    // Rewinds to source's objects, constraints, handles and step count. source must have been built from the same objects
+    // and constraints, with the same removals and compactions, this system keeps its own graph and settings and, once sized, allocates nothing. Contacts are found again
+    void restoreState(const CPUPhysicsSystem& source);
+    // Iterations the last step ran, at most the count set by setIterations(), and the largest |Δx| of its last one
+    uint64_t getStepCount() const { return step_count; }
+    int getLastIterationCount() const { return last_iterations; }
+    float getLastResidual() const { return last_residual; }
+    // Same diagnostics as GPUPhysicsSystem::requestStats, reduced over the thread pool
+    GPUPhysicsStats computeStats(float reference_height = 0.0f);
+
+    const SoAObjectState& getObjectState() const { return objects; }
+    const SoAConstraintState& getConstraintState() const { return constraints; }
+    const SoAConstraintState& getContactState() const { return contacts; }
+    const ConstraintGraph& getConstraintGraph() const { return constraint_graph; }
+    int getObjectCount() const { return int(objects.size()); }
+    int getConstraintCount() const { return int(constraints.size()); }
+    int getContactCount() const { return int(contacts.size()); }
+    int getColorCount() const { return solve_offsets.empty() ? 0 : int(solve_offsets.size()) - 1; }
+    int getThreadCount() const { return thread_pool.getThreadCount(); }
+    // Times each stage of update(), null turns profiling off
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+
+private:
+    SoAObjectState objects;
+    SoAConstraintState constraints;
+    ConstraintGraph constraint_graph;
+    ThreadPool thread_pool;
+    Profiler* profiler = nullptr;
+    int iterations;
+    int dimensions;
+    int last_iterations = 0;
+    uint64_t step_count = 0;
+    float last_residual = 0.0f;
+
+    HandleTable object_handles;
+    HandleTable constraint_handles;
+    std::vector<uint32_t> object_remap, constraint_remap;
+    float compaction_threshold = 0.25f;
+    uint64_t compaction_count = 0;
+
+    // Color batches without the objects the kernels never move, and the kinematic objects that move by themselves
+    std::vector<uint32_t> solve_order;
+    std::vector<uint32_t> solve_offsets;
+    std::vector<uint32_t> kinematic_order;
+    bool solve_order_dirty = true;
+
+    // Islands of the last island pass, by root object
+    SleepParameters sleep_parameters;
+    std::vector<uint32_t> island_labels;
+    std::vector<float> island_min_rest;
+    std::vector<uint8_t> island_wake; // set when something touched the island, acted on at the next update()
+    int sleeping_count = 0;
+    std::vector<float> controller_rest_lengths; // rest lengths before a control tick, to spot muscles that moved
+
+    // Contacts of the current step, with their own CSR adjacency
+    struct ContactWarmStart {
+        float penalty;
+        float lambda;
+    };
+    bool collisions_enabled = false;
+    float contact_cell_size = 0.0f;
+    float contact_stiffness = 1.0f;
+    SolverParameters solver_parameters;
+    UniformGrid grid;
+    std::vector<ContactPair> contact_pairs;
+    SoAConstraintState contacts;
+    std::vector<uint32_t> contact_offsets, contact_indices;
+    std::vector<uint32_t> contact_a, contact_b;
+    std::unordered_map<uint64_t, ContactWarmStart> contact_cache; // keyed by (a << 32 | b)
+    std::vector<uint32_t> union_color_order, union_color_offsets; // constraints and contacts together
+
+    std::vector<GPUPhysicsStats> stats_partials; // one per block, merged in block order
+
+    void findContacts();
+    void cacheContacts();
+    void initializeIslands(size_t first);
+    void wakeIsland(uint32_t object);
+    void removeConstraintAt(int index);
+    bool needsCompaction() const;
+    void wakeTouchedIslands();
+    void findIslands();
+    bool isResting(uint32_t index) const { return (objects.flags[index] & (OBJECT_STATIC | OBJECT_SLEEPING)) != 0; }
+    bool isMoving(uint32_t index) const;
+    float distance(uint32_t a, uint32_t b) const;
+    void rebuildSolveOrder(const std::vector<uint32_t>& color_order, const std::vector<uint32_t>& color_offsets);
+    void updateConstraint(SoAConstraintState& set, uint32_t index);
+    void warmStartConstraints();
+};
@@ -0,0 +1,141 @@
+#include "evolution.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+float displacementFitness(const Scene& scene, const CPUPhysicsSystem& physics_system) {
+    const SoAObjectState& objects = physics_system.getObjectState();
+    float start = 0.0f, end = 0.0f, mass = 0.0f;
+    for (size_t i = 0; i < objects.size() && i < scene.objects.size(); ++i) {
+        start += objects.mass[i] * scene.objects[i].position.x;
+        end += objects.mass[i] * objects.x[i];
+        mass += objects.mass[i];
+    }
+    return mass > 0.0f ? (end - start) / mass : 0.0f;
+}
+
+void GenomeArena::resize(int genome_count, int parameter_count) {
+    this->genome_count = genome_count;
+    this->parameter_count = parameter_count;
+    current.assign(size_t(genome_count) * parameter_count, 0.0f);
+    next.assign(size_t(genome_count) * parameter_count, 0.0f);
+}
+
+EvolutionEngine::EvolutionEngine(const Scene& scene, const ControllerTopology& topology, const EvolutionParameters& parameters,
+                                 const FitnessFunction& fitness)
+    : scene(scene), parameters(parameters), fitness_function(fitness), thread_pool(parameters.thread_count), rng(parameters.seed) {
+    this->parameters.population_size = std::max(this->parameters.population_size, 2);
+    this->parameters.elite_count = std::min(std::max(this->parameters.elite_count, 0), this->parameters.population_size);
+    this->parameters.tournament_size = std::max(this->parameters.tournament_size, 1);
+    this->parameters.control_interval = std::max(this->parameters.control_interval, 1);
+
+    initial_state.reset(new CPUPhysicsSystem(parameters.iterations, 1, parameters.dimensions));
+    initial_state->addObjects(scene.objects.data(), scene.objects.size());
+    initial_state->addConstraints(scene.constraints.data(), scene.constraints.size());
+    initial_state->setCollisionsEnabled(scene.collisions);
+
+    // Each slot colors its own copy once, rewinding later only copies the state
+    for (int slot = 0; slot < thread_pool.getThreadCount(); ++slot) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->physics_system.reset(new CPUPhysicsSystem(parameters.iterations, 1, parameters.dimensions));
+        worker->physics_system->addObjects(scene.objects.data(), scene.objects.size());
+        worker->physics_system->addConstraints(scene.constraints.data(), scene.constraints.size());
+        worker->physics_system->setCollisionsEnabled(scene.collisions);
+        worker->population = ControllerPopulation(topology);
+        worker->population.addController(0, 0);
+        workers.push_back(std::move(worker));
+    }
+
+    // The first generation comes from the population's own initializer
+    ControllerPopulation initial(topology);
+    for (int g = 0; g < this->parameters.population_size; ++g) initial.addController(0, 0);
+    initial.randomizeGenomes(parameters.seed, parameters.initial_scale);
+    arena.resize(this->parameters.population_size, initial.getParameterCount());
+    for (int g = 0; g < this->parameters.population_size; ++g) initial.getGenome(g, arena.getGenome(g));
+
+    fitness_scores.resize(this->parameters.population_size);
+    ranking.resize(this->parameters.population_size);
+    best_genome.resize(arena.getParameterCount());
+}
+
+void EvolutionEngine::evaluate(size_t genome, int slot) {
+    Worker& worker = *workers[slot];
+    CPUPhysicsSystem& physics_system = *worker.physics_system;
+    physics_system.restoreState(*initial_state);
+    worker.population.setGenome(0, arena.getGenome(int(genome)));
+
+    int steps = std::max(1, int(std::lround(parameters.evaluation_seconds / parameters.dt)));
+    for (int step = 0; step < steps; ++step) {
+        if (step % parameters.control_interval == 0) physics_system.updateControllers(worker.population, step * parameters.dt);
+        physics_system.update(parameters.dt);
+    }
+    worker.physics_steps += uint64_t(steps);
+
+    // A creature that blew up scores last
+    float score = fitness_function(scene, physics_system);
+    fitness_scores[genome] = std::isfinite(score) ? score : -std::numeric_limits<float>::max();
+}
+
+int EvolutionEngine::tournament() {
+    std::uniform_int_distribution<int> pick(0, parameters.population_size - 1);
+    int best = pick(rng);
+    for (int i = 1; i < parameters.tournament_size; ++i) {
+        int challenger = pick(rng);
+        if (fitness_scores[challenger] > fitness_scores[best]) best = challenger;
+    }
+    return best;
+}
+
+void EvolutionEngine::breed() {
+    int parameter_count = arena.getParameterCount();
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+    std::normal_distribution<float> perturbation(0.0f, parameters.mutation_scale);
+
+    for (int e = 0; e < parameters.elite_count; ++e) {
+        std::copy(arena.getGenome(ranking[e]), arena.getGenome(ranking[e]) + parameter_count, arena.getNextGenome(e));
+    }
+    for (int child = parameters.elite_count; child < parameters.population_size; ++child) {
+        const float* first = arena.getGenome(tournament());
+        const float* second = chance(rng) < parameters.crossover_rate ? arena.getGenome(tournament()) : first;
+        float* genome = arena.getNextGenome(child);
+        for (int p = 0; p < parameter_count; ++p) {
+            genome[p] = chance(rng) < 0.5f ? first[p] : second[p];
+            if (chance(rng) < parameters.mutation_rate) genome[p] += perturbation(rng);
+        }
+    }
+    arena.swap();
+}
+
+const GenerationStats& EvolutionEngine::runGeneration() {
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t steps_before = 0;
+    for (const std::unique_ptr<Worker>& worker : workers) steps_before += worker->physics_steps;
+
+    // 1. Evaluate, genomes cost more or less depending on how hard their creature moves so slots steal
+    thread_pool.parallelForStealing(size_t(parameters.population_size), [this](size_t genome, int slot) {
+        evaluate(genome, slot);
+    });
+
+    // 2. Rank
+    for (int g = 0; g < parameters.population_size; ++g) ranking[g] = g;
+    std::sort(ranking.begin(), ranking.end(), [this](int a, int b) { return fitness_scores[a] > fitness_scores[b]; });
+    double total = 0.0;
+    for (float score : fitness_scores) total += score;
+    std::copy(arena.getGenome(ranking[0]), arena.getGenome(ranking[0]) + arena.getParameterCount(), best_genome.begin());
+
+    stats.best_fitness = fitness_scores[ranking[0]];
+    stats.mean_fitness = float(total / parameters.population_size);
+    stats.physics_steps = 0;
+    for (const std::unique_ptr<Worker>& worker : workers) stats.physics_steps += worker->physics_steps;
+    stats.physics_steps -= steps_before;
+    double evaluation_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // 3. Breed the next generation into the other half of the arena
+    breed();
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    stats.evaluations_per_second = evaluation_seconds > 0.0 ? parameters.population_size / evaluation_seconds : 0.0;
+    stats.generation++;
+    return stats;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <random>
+#include <functional>
+#include <cstdint>
+#include "cpu_physics.h"
+#include "controller.h"
+#include "scenes.h"
+#include "thread_pool.h"
+
+struct EvolutionParameters {
+    int population_size = 256;
+    int elite_count = 4;          // best genomes copied unchanged into the next generation
+    int tournament_size = 4;
+    float crossover_rate = 0.9f;  // chance a child mixes two parents (uniform crossover), else copies one
+    float mutation_rate = 0.05f;  // chance each parameter is perturbed
+    float mutation_scale = 0.1f;  // standard deviation of a perturbation
+    float initial_scale = 2.0f;   // see ControllerPopulation::randomizeGenomes
+    float evaluation_seconds = 5.0f;
+    float dt = 1.0f / 60.0f;
+    int iterations = 10;
+    int control_interval = 1;     // physics steps per control tick
+    int dimensions = 2;           // creatures are flat, see CPUPhysicsSystem
+    int thread_count = 0;         // 0 uses every hardware thread
+    uint32_t seed = 1234;
+};
+
+// Score of one creature after its evaluation, higher is better. scene is the creature as it started
+typedef std::function<float(const Scene& scene, const CPUPhysicsSystem& physics_system)> FitnessFunction;
+
+// Distance the centre of mass travelled along +x
+float displacementFitness(const Scene& scene, const CPUPhysicsSystem& physics_system);
+
+struct GenerationStats {
+    int generation = 0;
+    float best_fitness = 0.0f;
+    float mean_fitness = 0.0f;
+    double seconds = 0.0;         // evaluation and breeding
+    double evaluations_per_second = 0.0;
+    uint64_t physics_steps = 0;
+};
+
+// Genomes of a whole generation in one block, genome i at i * parameter_count. The next generation is bred
+// into a second block and the two swap, so a generation allocates nothing
+class GenomeArena {
+public:
+    void resize(int genome_count, int parameter_count);
+    float* getGenome(int index) { return current.data() + size_t(index) * parameter_count; }
+    const float* getGenome(int index) const { return current.data() + size_t(index) * parameter_count; }
+    float* getNextGenome(int index) { return next.data() + size_t(index) * parameter_count; }
+    void swap() { current.swap(next); }
+    int getGenomeCount() const { return genome_count; }
+    int getParameterCount() const { return parameter_count; }
+
+private:
+    std::vector<float> current, next;
+    int genome_count = 0;
+    int parameter_count = 0;
+};
+
+// Generational GA over controller genomes: every genome drives one copy of the scene's creature for
+// evaluation_seconds on the CPU backend and is scored by the fitness function, then tournament selection,
+// uniform crossover and Gaussian mutation breed the next generation.
+// Evaluations are spread over a work-stealing thread pool, each slot owning one single-threaded physics system
+// that is rewound between genomes, and write their fitness into their own element with no lock
+class EvolutionEngine {
+public:
+    // scene holds one creature, topology its controller (makeCreatureTopology)
+    EvolutionEngine(const Scene& scene, const ControllerTopology& topology, const EvolutionParameters& parameters = EvolutionParameters(),
+                    const FitnessFunction& fitness = displacementFitness);
+
+    // Evaluates the current generation and breeds the next one from it
+    const GenerationStats& runGeneration();
+
+    int getGeneration() const { return stats.generation; }
+    const GenerationStats& getLastStats() const { return stats; }
+    // Best genome of the last evaluated generation
+    const std::vector<float>& getBestGenome() const { return best_genome; }
+    float getBestFitness() const { return stats.best_fitness; }
+    int getParameterCount() const { return arena.getParameterCount(); }
+    int getThreadCount() const { return thread_pool.getThreadCount(); }
+
+private:
+    // Everything one pool slot evaluates with, padded so slots never share a cache line
+    struct alignas(64) Worker {
+        std::unique_ptr<CPUPhysicsSystem> physics_system;
+        ControllerPopulation population;
+        uint64_t physics_steps = 0;
+    };
+
+    Scene scene;
+    EvolutionParameters parameters;
+    FitnessFunction fitness_function;
+    ThreadPool thread_pool;
+    std::unique_ptr<CPUPhysicsSystem> initial_state; // the creature at rest, what workers rewind to
+    std::vector<std::unique_ptr<Worker>> workers;
+    GenomeArena arena;
+    std::vector<float> fitness_scores; // one per genome, each written only by the evaluation of that genome
+    std::vector<int> ranking;
+    std::vector<float> best_genome;
+    std::mt19937 rng;
+    GenerationStats stats;
+
+    void evaluate(size_t genome, int slot);
+    void breed();
+    int tournament();
+};
@@ -0,0 +1,25 @@
+#include "fixed_timestep.h"
+#include <algorithm>
+
+FixedTimestep::FixedTimestep(double step_seconds, int max_steps_per_advance)
+    : step_seconds(std::max(step_seconds, 1e-6)), max_steps_per_advance(std::max(max_steps_per_advance, 1)) {
+}
+
+int FixedTimestep::advance(double elapsed_seconds) {
+    accumulator += std::max(elapsed_seconds, 0.0);
+    int due = int(accumulator / step_seconds);
+    accumulator -= due * step_seconds;
+
+    if (due > max_steps_per_advance) {
+        dropped_seconds += (due - max_steps_per_advance) * step_seconds;
+        due = max_steps_per_advance;
+    }
+    step_count += due;
+    return due;
+}
+
+void FixedTimestep::setStepSeconds(double step_seconds) {
+    this->step_seconds = std::max(step_seconds, 1e-6);
+    // Keep the remainder below one step of the new size
+    if (accumulator >= this->step_seconds) accumulator = 0.0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Fixed-timestep accumulator: wall time goes in, a whole number of fixed steps comes out, so the result
+// of a run does not depend on the frame rate. When the simulation falls behind by more than
+// max_steps_per_advance steps the excess time is dropped rather than caught up, so a stall cannot snowball.
+class FixedTimestep {
+public:
+    FixedTimestep(double step_seconds = 1.0 / 120.0, int max_steps_per_advance = 8);
+
+    // Adds elapsed wall time, returns how many steps are now due
+    int advance(double elapsed_seconds);
+
+    void setStepSeconds(double step_seconds);
+    double getStepSeconds() const { return step_seconds; }
+    // Wall time not yet covered by a step, less than one step
+    double getRemainder() const { return accumulator; }
+    // Fraction of a step the remainder covers, to interpolate between the last two states
+    double getAlpha() const { return accumulator / step_seconds; }
+    double getTimeToNextStep() const { return step_seconds - accumulator; }
+    uint64_t getStepCount() const { return step_count; }
+    double getDroppedSeconds() const { return dropped_seconds; }
+
+private:
+    double step_seconds;
+    int max_steps_per_advance;
+    double accumulator = 0.0;
+    double dropped_seconds = 0.0;
+    uint64_t step_count = 0;
+};
@@ -0,0 +1,99 @@
+#include "gpu_controller.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+GPUControllerSystem::GPUControllerSystem() {
+    glGenBuffers(1, &weight_buffer);
+    glGenBuffers(1, &topology_buffer);
+    glGenBuffers(1, &instance_buffer);
+}
+
+GPUControllerSystem::~GPUControllerSystem() {
+    glDeleteBuffers(1, &weight_buffer);
+    glDeleteBuffers(1, &topology_buffer);
+    glDeleteBuffers(1, &instance_buffer);
+    glDeleteProgram(controller_compute_shader_program);
+}
+
+void GPUControllerSystem::uploadBuffer(GLuint buffer, size_t& capacity_bytes, const void* data, size_t bytes) {
+    // Same policy as GPUPhysicsSystem: reallocate only when the data outgrows the buffer
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (std::max<size_t>(bytes, 16) > capacity_bytes) {
+        capacity_bytes = std::max<size_t>(std::max<size_t>(bytes, 16), capacity_bytes * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_bytes, nullptr, GL_DYNAMIC_DRAW);
+    }
+    if (bytes > 0 && data) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUControllerSystem::upload(const ControllerPopulation& population) {
+    const ControllerTopology& topology = population.getTopology();
+    const std::vector<float>& weights = population.getWeights();
+    uploadBuffer(weight_buffer, weight_capacity, weights.data(), weights.size() * sizeof(float));
+
+    // Index lists, then the base rest lengths as float bits
+    std::vector<uint32_t> packed;
+    packed.insert(packed.end(), topology.sensor_objects.begin(), topology.sensor_objects.end());
+    packed.insert(packed.end(), topology.sensor_constraints.begin(), topology.sensor_constraints.end());
+    packed.insert(packed.end(), topology.actuators.begin(), topology.actuators.end());
+    for (float rest_length : topology.actuator_rest_lengths) {
+        uint32_t bits;
+        std::memcpy(&bits, &rest_length, sizeof(bits));
+        packed.push_back(bits);
+    }
+    uploadBuffer(topology_buffer, topology_capacity, packed.data(), packed.size() * sizeof(uint32_t));
+
+    std::vector<uint32_t> instances(size_t(population.getControllerCount()) * 2);
+    for (int c = 0; c < population.getControllerCount(); ++c) {
+        instances[2 * c] = population.getObjectOffsets()[c];
+        instances[2 * c + 1] = population.getConstraintOffsets()[c];
+    }
+    uploadBuffer(instance_buffer, instance_capacity, instances.data(), instances.size() * sizeof(uint32_t));
+
+    uploaded_population = &population;
+    uploaded_version = population.getVersion();
+}
+
+void GPUControllerSystem::update(GPUPhysicsSystem& physics_system, const ControllerPopulation& population, float time) {
+    if (population.getControllerCount() == 0) return;
+    ProfileScope cpu_scope(physics_system.getProfiler() ? physics_system.getProfiler()->getProfiler() : nullptr, "controllers");
+    GPUProfileScope gpu_scope(physics_system.getProfiler(), "controllers");
+    if (uploaded_population != &population || uploaded_version != population.getVersion()) upload(population);
+    // Built on first use for the object layout of the system it drives
+    if (program_dimensions != physics_system.getDimensions()) {
+        glDeleteProgram(controller_compute_shader_program);
+        controller_compute_shader_program = GPUPhysicsSystem::loadComputeShader("controller_compute_shader.glsl", physics_system.getDimensions());
+        program_dimensions = physics_system.getDimensions();
+    }
+
+    const ControllerTopology& topology = population.getTopology();
+    float clock = 2.0f * 3.14159265f * topology.clock_frequency * time;
+
+    glUseProgram(controller_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, physics_system.getObjectDataBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, physics_system.getConstraintDataBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, weight_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, topology_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, instance_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, physics_system.getIslandBuffer());
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_controllerCount"), population.getControllerCount());
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_stride"), int(population.getStride()));
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_sensorObjectCount"), int(topology.sensor_objects.size()));
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_sensorConstraintCount"), int(topology.sensor_constraints.size()));
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_actuatorCount"), int(topology.actuators.size()));
+    glUniform1i(glGetUniformLocation(controller_compute_shader_program, "u_hiddenCount"), topology.hidden_count);
+    glUniform1f(glGetUniformLocation(controller_compute_shader_program, "u_actuatorRange"), topology.actuator_range);
+    glUniform1f(glGetUniformLocation(controller_compute_shader_program, "u_positionScale"), topology.position_scale);
+    glUniform1f(glGetUniformLocation(controller_compute_shader_program, "u_velocityScale"), topology.velocity_scale);
+    glUniform2f(glGetUniformLocation(controller_compute_shader_program, "u_clock"), std::sin(clock), std::cos(clock));
+
+    // The last step's positions must be written before they are sensed, and the rest lengths before the next step reads them
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glDispatchCompute((GLuint(population.getControllerCount()) + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram(0);
+}
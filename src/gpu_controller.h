@@ -0,0 +1,36 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include "controller.h"
+#include "gpu_physics.h"
+
+// GPU path of the controllers in controller.h: one thread per controller reads its sensors straight from the
+// physics system's object and constraint buffers and writes the actuators' rest lengths in place, so a control
+// tick is one dispatch with nothing read back. Weights, topology and creature offsets are uploaded when the
+// population's version changes, weights parameter-major so neighbouring threads read neighbouring floats.
+class GPUControllerSystem {
+public:
+    GPUControllerSystem();
+    ~GPUControllerSystem();
+
+    GPUControllerSystem(const GPUControllerSystem&) = delete;
+    GPUControllerSystem& operator=(const GPUControllerSystem&) = delete;
+
+    // One control tick, the new rest lengths take effect from the next physics_system.update()
+    void update(GPUPhysicsSystem& physics_system, const ControllerPopulation& population, float time);
+
+private:
+    GLuint controller_compute_shader_program = 0;
+    int program_dimensions = 0; // the object layout the program was built for, see GPUPhysicsSystem::getDimensions
+    GLuint weight_buffer;
+    GLuint topology_buffer;
+    GLuint instance_buffer;
+    size_t weight_capacity = 0; // bytes
+    size_t topology_capacity = 0;
+    size_t instance_capacity = 0;
+    const ControllerPopulation* uploaded_population = nullptr;
+    uint64_t uploaded_version = 0;
+
+    void upload(const ControllerPopulation& population);
+    void uploadBuffer(GLuint buffer, size_t& capacity_bytes, const void* data, size_t bytes);
+};
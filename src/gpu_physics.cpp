@@ -1,272 +1,1161 @@
 #include "gpu_physics.h"
+#include "shader_cache.h"
 
-GPUPhysicsSystem::GPUPhysicsSystem(int max_objects, int max_constraints, int iterations, int SCREEN_WIDTH, int SCREEN_HEIGHT) 
-    : max_objects(max_objects), max_constraints(max_constraints), iterations(iterations), SCREEN_WIDTH(SCREEN_WIDTH), SCREEN_HEIGHT(SCREEN_HEIGHT), object_count(0), constraint_count(0) {
-    
-    object_compute_shader_program = loadComputeShader("../shaders/object_compute_shader.glsl");
+bool checkShaderStorageLimits(const char* user, GLenum stage_limit, int stage_blocks) {
+    GLint bindings = 0, blocks = 0;
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &bindings);
+    glGetIntegerv(stage_limit, &blocks);
+    bool supported = true;
+    if (bindings < required_storage_bindings) {
+        std::cerr << user << " needs " << required_storage_bindings << " shader storage buffer bindings, this driver has " << bindings << std::endl;
+        supported = false;
+    }
+    if (blocks < stage_blocks) {
+        std::cerr << user << " needs " << stage_blocks << " shader storage blocks per shader, this driver has " << blocks << std::endl;
+        supported = false;
+    }
+    return supported;
+}
+
+GPUPhysicsSystem::GPUPhysicsSystem(int object_capacity, int constraint_capacity, int iterations, int SCREEN_WIDTH, int SCREEN_HEIGHT, int dimensions) 
+    : adjacency_offset_capacity(0), adjacency_index_capacity(0), color_order_capacity(0), edit_capacity(0), grid_capacity(0), object_capacity(std::max(object_capacity, 1)), constraint_capacity(std::max(constraint_capacity, 1)), iterations(iterations), object_count(0), constraint_count(0), SCREEN_WIDTH(SCREEN_WIDTH), SCREEN_HEIGHT(SCREEN_HEIGHT) {
+    this->dimensions = dimensions == 2 ? 2 : 3;
+    object_stride = this->dimensions == 2 ? sizeof(GPUPhysicsObject2D) : sizeof(GPUPhysicsObject);
+    solver_state_stride = this->dimensions == 2 ? 3 * sizeof(glm::vec2) : 3 * sizeof(glm::vec4);
+    supported = checkShaderStorageLimits("GPUPhysicsSystem");
+    if (!supported) std::cerr << "GPUPhysicsSystem: unsupported context, update() and compact() will do nothing" << std::endl;
+
+    object_compute_shader_program = loadComputeShader("object_compute_shader.glsl", this->dimensions);
+    constraint_compute_shader_program = loadComputeShader("constraint_compute_shader.glsl", this->dimensions);
+    edit_compute_shader_program = loadComputeShader("edit_compute_shader.glsl", this->dimensions);
+    grid_count_compute_shader_program = loadComputeShader("grid_count_compute_shader.glsl", this->dimensions);
+    grid_scan_compute_shader_program = loadComputeShader("grid_scan_compute_shader.glsl", this->dimensions);
+    grid_scatter_compute_shader_program = loadComputeShader("grid_scatter_compute_shader.glsl", this->dimensions);
+    contact_compute_shader_program = loadComputeShader("contact_compute_shader.glsl", this->dimensions);
+    dispatch_prep_compute_shader_program = loadComputeShader("dispatch_prep_compute_shader.glsl", this->dimensions);
+    stats_compute_shader_program = loadComputeShader("stats_compute_shader.glsl", this->dimensions);
+    convergence_compute_shader_program = loadComputeShader("convergence_compute_shader.glsl", this->dimensions);
+    world_stats_compute_shader_program = loadComputeShader("world_stats_compute_shader.glsl", this->dimensions);
+    activation_compute_shader_program = loadComputeShader("activation_compute_shader.glsl", this->dimensions);
+    island_compute_shader_program = loadComputeShader("island_compute_shader.glsl", this->dimensions);
+    compact_compute_shader_program = loadComputeShader("compact_compute_shader.glsl", this->dimensions);
     setupBuffers();
+    worlds.push_back(GPUPhysicsWorld());
 }
 
 GPUPhysicsSystem::~GPUPhysicsSystem() {
     glDeleteBuffers(1, &object_data_buffer);
     glDeleteBuffers(1, &constraint_data_buffer);
+    glDeleteBuffers(1, &adjacency_offset_buffer);
+    glDeleteBuffers(1, &adjacency_index_buffer);
+    glDeleteBuffers(1, &color_order_buffer);
+    glDeleteBuffers(1, &solver_state_buffer);
+    glDeleteBuffers(1, &edit_buffer);
+    glDeleteBuffers(1, &grid_buffer);
+    glDeleteBuffers(2, contact_buffers);
+    glDeleteBuffers(2, contact_list_buffers);
+    glDeleteBuffers(1, &header_buffer);
+    glDeleteBuffers(1, &dispatch_buffer);
+    glDeleteBuffers(1, &stats_partial_buffer);
+    glDeleteBuffers(1, &stats_buffer);
+    glDeleteBuffers(1, &world_buffer);
+    glDeleteBuffers(1, &world_stats_buffer);
+    glDeleteBuffers(1, &island_buffer);
+    glDeleteBuffers(1, &color_offset_buffer);
+    glDeleteBuffers(1, &object_remap_buffer);
+    glDeleteBuffers(1, &constraint_remap_buffer);
     glDeleteProgram(object_compute_shader_program);
     glDeleteProgram(constraint_compute_shader_program);
+    glDeleteProgram(edit_compute_shader_program);
+    glDeleteProgram(grid_count_compute_shader_program);
+    glDeleteProgram(grid_scan_compute_shader_program);
+    glDeleteProgram(grid_scatter_compute_shader_program);
+    glDeleteProgram(contact_compute_shader_program);
+    glDeleteProgram(dispatch_prep_compute_shader_program);
+    glDeleteProgram(stats_compute_shader_program);
+    glDeleteProgram(convergence_compute_shader_program);
+    glDeleteProgram(world_stats_compute_shader_program);
+    glDeleteProgram(activation_compute_shader_program);
+    glDeleteProgram(island_compute_shader_program);
+    glDeleteProgram(compact_compute_shader_program);
 }
 
 void GPUPhysicsSystem::setupBuffers() {
     // Single buffer for all object data
     glGenBuffers(1, &object_data_buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_data_buffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, max_objects * sizeof(GPUPhysicsObject), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, object_capacity * object_stride, nullptr, GL_DYNAMIC_DRAW);
 
     glGenBuffers(1, &constraint_data_buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, constraint_data_buffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, max_constraints * sizeof(GPUPhysicsConstraint), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, constraint_capacity * sizeof(GPUPhysicsConstraint), nullptr, GL_DYNAMIC_DRAW);
+
+    // Per-step inertial target and start position of every object (2 x vec2 or 2 x vec4)
+    glGenBuffers(1, &solver_state_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, solver_state_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, object_capacity * solver_state_stride, nullptr, GL_DYNAMIC_DRAW);
+
+    // Island label and rest time of every object
+    glGenBuffers(1, &island_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, island_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, object_capacity * sizeof(GPUIslandState), nullptr, GL_DYNAMIC_DRAW);
+
+    // Per-object constraint adjacency (CSR), color batches and queued edits, sized on first upload
+    glGenBuffers(1, &adjacency_offset_buffer);
+    glGenBuffers(1, &adjacency_index_buffer);
+    glGenBuffers(1, &color_order_buffer);
+    glGenBuffers(1, &edit_buffer);
+    glGenBuffers(1, &color_offset_buffer);
+    glGenBuffers(1, &object_remap_buffer);
+    glGenBuffers(1, &constraint_remap_buffer);
+
+    // Broad phase grid and contacts, sized once collisions are enabled.
+    // Until then they hold a few bytes so the bindings in the object kernel stay valid
+    glGenBuffers(1, &grid_buffer);
+    glGenBuffers(2, contact_buffers);
+    glGenBuffers(2, contact_list_buffers);
+    for (GLuint buffer : {contact_buffers[0], contact_buffers[1], contact_list_buffers[0], contact_list_buffers[1]}) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, 16, nullptr, GL_DYNAMIC_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+
+    // Object, constraint and contact counts live on the GPU, dispatches read their sizes from dispatch_buffer
+    GPUPhysicsHeader header = {};
+    glGenBuffers(1, &header_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, header_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUPhysicsHeader), &header, GL_DYNAMIC_DRAW);
+    header_capacity = sizeof(GPUPhysicsHeader);
+
+    GPUDispatchIndirectCommand dispatches[DISPATCH_COUNT] = {};
+    glGenBuffers(1, &dispatch_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatch_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(dispatches), dispatches, GL_DYNAMIC_DRAW);
+    dispatch_capacity = sizeof(dispatches);
+
+    // Diagnostics reduction, only the final GPUPhysicsStats is ever read back
+    glGenBuffers(1, &stats_partial_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_partial_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, stats_work_groups * sizeof(GPUPhysicsStats), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &stats_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUPhysicsStats), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // One entry per world, sized on first upload
+    glGenBuffers(1, &world_buffer);
+    glGenBuffers(1, &world_stats_buffer);
+}
+
+void GPUPhysicsSystem::writeHeader(size_t offset, uint32_t value) {
+    // A small write queued behind the earlier GL commands, nothing waits on the GPU
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, header_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, sizeof(uint32_t), &value);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUPhysicsSystem::prepareDispatch() {
+    GPUProfileScope gpu_scope(profiler, "dispatch prep");
+    glUseProgram(dispatch_prep_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, dispatch_buffer);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void GPUPhysicsSystem::dispatchIndirect(int slot) {
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatch_buffer);
+    glDispatchComputeIndirect(GLintptr(slot * sizeof(GPUDispatchIndirectCommand)));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void GPUPhysicsSystem::uploadBuffer(GLuint buffer, size_t& capacity_bytes, const void* data, size_t bytes, size_t first_byte) {
+    // Reallocate only when the data outgrows the buffer, otherwise overwrite in place from first_byte.
+    // Keep at least a few bytes so the binding is always valid
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (std::max<size_t>(bytes, 16) > capacity_bytes) {
+        capacity_bytes = std::max<size_t>(std::max<size_t>(bytes, 16), capacity_bytes * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_bytes, nullptr, GL_DYNAMIC_DRAW);
+        first_byte = 0;
+    }
+    // No data only makes sure the buffer is large enough
+    if (bytes > first_byte && data) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first_byte, bytes - first_byte, static_cast<const uint8_t*>(data) + first_byte);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUPhysicsSystem::uploadIndexBuffer(GLuint buffer, size_t& capacity, const uint32_t* data, size_t count, size_t first) {
+    size_t capacity_bytes = capacity * sizeof(uint32_t);
+    uploadBuffer(buffer, capacity_bytes, data, count * sizeof(uint32_t), first * sizeof(uint32_t));
+    capacity = capacity_bytes / sizeof(uint32_t);
+}
+
+void GPUPhysicsSystem::growBuffer(GLuint& buffer, size_t used_bytes, size_t new_bytes) {
+    // Copy the live part into a larger buffer on the GPU, nothing goes through the host
+    GLuint new_buffer;
+    glGenBuffers(1, &new_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_bytes, nullptr, GL_DYNAMIC_DRAW);
+    if (used_bytes > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used_bytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    buffer = new_buffer;
+}
+
+void GPUPhysicsSystem::reserveObjects(int capacity) {
+    if (capacity <= object_capacity) return;
+
+    // Grow geometrically so a run of single adds stays amortised O(1)
+    int new_capacity = std::max(capacity, object_capacity * 2);
+    growBuffer(object_data_buffer, object_count * object_stride, new_capacity * object_stride);
+    growBuffer(solver_state_buffer, object_count * solver_state_stride, new_capacity * solver_state_stride);
+    growBuffer(island_buffer, object_count * sizeof(GPUIslandState), new_capacity * sizeof(GPUIslandState));
+    object_capacity = new_capacity;
+}
+
+void GPUPhysicsSystem::reserveConstraints(int capacity) {
+    if (capacity <= constraint_capacity) return;
+
+    int new_capacity = std::max(capacity, constraint_capacity * 2);
+    growBuffer(constraint_data_buffer, constraint_count * sizeof(GPUPhysicsConstraint), new_capacity * sizeof(GPUPhysicsConstraint));
+    constraint_capacity = new_capacity;
+}
+
+void GPUPhysicsSystem::uploadConstraintGraph() {
+    if (!constraint_graph.rebuild()) return;
+
+    const std::vector<uint32_t>& offsets = constraint_graph.getOffsets();
+    const std::vector<uint32_t>& indices = constraint_graph.getIndices();
+    const std::vector<uint32_t>& color_order = constraint_graph.getColorOrder();
+    // Only what the rebuild touched goes over the bus
+    const ConstraintGraph::Changes& changes = constraint_graph.getChanges();
+    uploadIndexBuffer(adjacency_offset_buffer, adjacency_offset_capacity, offsets.data(), offsets.size(), changes.first_offset);
+    uploadIndexBuffer(adjacency_index_buffer, adjacency_index_capacity, indices.data(), indices.size(), changes.first_index);
+    uploadIndexBuffer(color_order_buffer, color_order_capacity, color_order.data(), color_order.size(), changes.first_color_entry);
+    uploadColorBatches();
+}
+
+void GPUPhysicsSystem::uploadColorBatches() {
+    // The activation pass fills one batch of awake objects and one dispatch slot per color
+    const std::vector<uint32_t>& color_offsets = constraint_graph.getColorOffsets();
+    size_t color_count = size_t(constraint_graph.getColorCount());
+    uploadBuffer(color_offset_buffer, color_offset_capacity, color_offsets.data(), color_offsets.size() * sizeof(uint32_t));
+    // The awake counts follow the header, growing keeps the header's counts
+    size_t header_bytes = sizeof(GPUPhysicsHeader) + color_count * sizeof(uint32_t);
+    if (header_bytes > header_capacity) {
+        growBuffer(header_buffer, sizeof(GPUPhysicsHeader), header_bytes);
+        header_capacity = header_bytes;
+    }
+    // Growing drops the fixed slots too, prepareDispatch() writes them again before they are read
+    uploadBuffer(dispatch_buffer, dispatch_capacity, nullptr, (DISPATCH_COUNT + color_count) * sizeof(GPUDispatchIndirectCommand));
+}
+
+void GPUPhysicsSystem::initializeIslands(const GPUPhysicsObject* objects, int first, size_t count) {
+    // Every object starts as its own island, one added asleep has rested long enough to stay that way
+    std::vector<GPUIslandState> islands(count);
+    for (size_t i = 0; i < count; ++i) {
+        islands[i].label = uint32_t(first) + uint32_t(i);
+        islands[i].rest_time = (objects[i].flags & OBJECT_SLEEPING) ? sleep_parameters.sleep_time : 0.0f;
+        islands[i].min_rest = 0;
+        islands[i].wake = 0;
+        islands[i].active_object = 0;
+        islands[i].color = 0;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, island_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GPUIslandState), count * sizeof(GPUIslandState), islands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+PhysicsHandle GPUPhysicsSystem::addObject(const GPUPhysicsObject& obj) {
+    PhysicsHandle handle;
+    addObjects(&obj, 1, &handle);
+    return handle;
+}
+
+PhysicsHandle GPUPhysicsSystem::addConstraint(const GPUPhysicsConstraint& constraint) {
+    PhysicsHandle handle;
+    addConstraints(&constraint, 1, &handle);
+    return handle;
+}
+
+int GPUPhysicsSystem::addWorld(const PhysicsWorldParameters& parameters) {
+    // Nothing added yet, world 0 becomes the first world of the batch instead of staying empty
+    if (worlds.size() > 1 || object_count > 0 || constraint_count > 0) {
+        GPUPhysicsWorld world = {};
+        world.object_offset = uint32_t(object_count);
+        world.constraint_offset = uint32_t(constraint_count);
+        worlds.push_back(world);
+    }
+    setWorldParameters(int(worlds.size()) - 1, parameters);
+    return int(worlds.size()) - 1;
+}
+
+int GPUPhysicsSystem::addWorld(const PhysicsWorldParameters& parameters, const GPUPhysicsObject* objects, size_t object_count,
+                               const GPUPhysicsConstraint* constraints, size_t constraint_count) {
+    int world = addWorld(parameters);
+
+    // Constraint indices from world-local to the shared object buffer
+    int first_object = this->object_count;
+    std::vector<GPUPhysicsConstraint> shifted(constraints, constraints + constraint_count);
+    for (GPUPhysicsConstraint& constraint : shifted) {
+        constraint.indexA += first_object;
+        constraint.indexB += first_object;
+    }
+    addObjects(objects, object_count);
+    addConstraints(shifted.data(), shifted.size());
+    return world;
+}
+
+void GPUPhysicsSystem::setWorldParameters(int world, const PhysicsWorldParameters& parameters) {
+    if (world < 0 || world >= int(worlds.size())) return;
+    worlds[world].gravity = glm::vec4(parameters.gravity, 0.0f);
+    worlds[world].dt = parameters.dt;
+    worlds[world].iterations = parameters.iterations;
+    worlds_dirty = true;
+}
+
+void GPUPhysicsSystem::uploadWorlds() {
+    if (!worlds_dirty) return;
+    uploadBuffer(world_buffer, world_capacity, worlds.data(), worlds.size() * sizeof(GPUPhysicsWorld));
+    worlds_dirty = false;
 }
 
-void GPUPhysicsSystem::addObject(const GPUPhysicsObject& obj) {
-    if (object_count >= max_objects) return;
+void GPUPhysicsSystem::addObjects(const GPUPhysicsObject* objects, size_t count, PhysicsHandle* handles) {
+    if (count == 0) return;
+    reserveObjects(object_count + int(count));
+
+    // The 3D kernels look the world up per object, stamp it unless the caller already has.
+    // The 2D layout has no world, its kernels find it from the index
+    uint32_t world = uint32_t(worlds.size() - 1);
+    std::vector<GPUPhysicsObject> stamped;
+    std::vector<GPUPhysicsObject2D> compact;
+    const void* upload = objects;
+    if (dimensions == 2) {
+        compact.resize(count);
+        for (size_t i = 0; i < count; ++i) compact[i] = toObject2D(objects[i]);
+        upload = compact.data();
+    } else if (std::any_of(objects, objects + count, [world](const GPUPhysicsObject& object) { return object.world != world; })) {
+        stamped.assign(objects, objects + count);
+        for (GPUPhysicsObject& object : stamped) object.world = world;
+        upload = stamped.data();
+    }
     
-    // Upload entire object to buffer
+    // Upload all objects to buffer in one transfer
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_data_buffer);
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 
-                    object_count * sizeof(GPUPhysicsObject), 
-                    sizeof(GPUPhysicsObject), 
-                    &obj);
+                    object_count * object_stride, 
+                    count * object_stride, 
+                    upload);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    initializeIslands(objects, object_count, count);
     
-    object_count++;
+    object_count += int(count);
+    worlds.back().object_count += uint32_t(count);
+    worlds_dirty = true;
+    writeHeader(offsetof(GPUPhysicsHeader, object_count), uint32_t(object_count));
+    for (size_t i = 0; i < count; ++i) {
+        constraint_graph.addObject();
+        max_radius = std::max(max_radius, objects[i].radius);
+        PhysicsHandle handle = object_handles.add();
+        if (handles) handles[i] = handle;
+    }
 }
 
-void GPUPhysicsSystem::addConstraint(const GPUPhysicsConstraint& constraint) {
-    if (constraint_count >= max_constraints) return;
+void GPUPhysicsSystem::addConstraints(const GPUPhysicsConstraint* constraints, size_t count, PhysicsHandle* handles) {
+    if (count == 0) return;
+    reserveConstraints(constraint_count + int(count));
     
-    // Upload entire constraint to buffer
+    // Upload all constraints to buffer in one transfer
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, constraint_data_buffer);
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 
                     constraint_count * sizeof(GPUPhysicsConstraint), 
-                    sizeof(GPUPhysicsConstraint), 
-                    &constraint);
+                    count * sizeof(GPUPhysicsConstraint), 
+                    constraints);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     
-    constraint_count++;
+    for (size_t i = 0; i < count; ++i) {
+        constraint_graph.addConstraint(constraint_count, constraints[i].indexA, constraints[i].indexB);
+        constraint_count++;
+        PhysicsHandle handle = constraint_handles.add();
+        if (handles) handles[i] = handle;
+    }
+    worlds.back().constraint_count += uint32_t(count);
+    worlds_dirty = true;
+    writeHeader(offsetof(GPUPhysicsHeader, constraint_count), uint32_t(constraint_count));
+}
+
+bool GPUPhysicsSystem::removeObject(PhysicsHandle handle) {
+    int index = object_handles.getIndex(handle);
+    if (index < 0) return false;
+
+    // Its constraints would pull on nothing, they go with it
+    std::vector<uint32_t> incident = constraint_graph.getIncidentConstraints(index);
+    for (uint32_t k : incident) removeConstraintAt(int(k));
+
+    // Static too, so every pass that leaves anchors alone leaves it alone. The edit wakes its island
+    queueEdit(EDIT_OBJECT_FLAGS, index, glm::vec4(float(OBJECT_REMOVED | OBJECT_STATIC)));
+    object_handles.remove(handle);
+    return true;
+}
+
+bool GPUPhysicsSystem::removeConstraint(PhysicsHandle handle) {
+    int index = constraint_handles.getIndex(handle);
+    if (index < 0) return false;
+    removeConstraintAt(index);
+    return true;
+}
+
+void GPUPhysicsSystem::removeConstraintAt(int index) {
+    // Out of the adjacency at the next recolor, out of the constraint passes once the edit lands
+    constraint_graph.removeConstraint(index);
+    queueEdit(EDIT_CONSTRAINT_TYPE, index, glm::vec4(float(CONSTRAINT_REMOVED)));
+    constraint_handles.remove(constraint_handles.getHandle(index));
+}
+
+bool GPUPhysicsSystem::needsCompaction() const {
+    size_t removed_objects = object_handles.getRemovedCount();
+    size_t removed_constraints = constraint_handles.getRemovedCount();
+    if (removed_objects == 0 && removed_constraints == 0) return false;
+    return removed_objects >= compaction_threshold * float(object_count) ||
+           removed_constraints >= compaction_threshold * float(constraint_count);
+}
+
+static GLuint createBuffer(size_t bytes) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(bytes, 16), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+void GPUPhysicsSystem::compact() {
+    if (!supported) return;
+    if (object_handles.getRemovedCount() == 0 && constraint_handles.getRemovedCount() == 0) return;
+    // Removals and edits queued by the old indices land first
+    applyEdits();
+    GPUProfileScope gpu_scope(profiler, "compaction");
+
+    // The new indices come from the host, which knows what was removed, only the data moves on the GPU
+    int old_object_count = object_count;
+    int old_constraint_count = constraint_count;
+    object_handles.compact(object_remap);
+    constraint_handles.compact(constraint_remap);
+    object_count = int(object_handles.size());
+    constraint_count = int(constraint_handles.size());
+    uploadBuffer(object_remap_buffer, object_remap_capacity, object_remap.data(), object_remap.size() * sizeof(uint32_t));
+    uploadBuffer(constraint_remap_buffer, constraint_remap_capacity, constraint_remap.data(), constraint_remap.size() * sizeof(uint32_t));
+
+    // Out of place, the old buffers are released once the copy has read them
+    GLuint compact_objects = createBuffer(object_capacity * object_stride);
+    GLuint compact_islands = createBuffer(object_capacity * sizeof(GPUIslandState));
+    GLuint compact_constraints = createBuffer(constraint_capacity * sizeof(GPUPhysicsConstraint));
+    glUseProgram(compact_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, compact_objects);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, compact_constraints);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, compact_islands);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, object_remap_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, constraint_remap_buffer);
+    GLint pass_location = glGetUniformLocation(compact_compute_shader_program, "u_pass");
+    GLint count_location = glGetUniformLocation(compact_compute_shader_program, "u_count");
+
+    // 1. Objects and their island state, 2. constraints with their object indices rewritten
+    glUniform1i(pass_location, 0);
+    glUniform1i(count_location, old_object_count);
+    glDispatchCompute(GLuint((old_object_count + 63) / 64), 1, 1);
+    glUniform1i(pass_location, 1);
+    glUniform1i(count_location, old_constraint_count);
+    glDispatchCompute(GLuint((old_constraint_count + 63) / 64), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glDeleteBuffers(1, &object_data_buffer);
+    glDeleteBuffers(1, &island_buffer);
+    glDeleteBuffers(1, &constraint_data_buffer);
+    object_data_buffer = compact_objects;
+    island_buffer = compact_islands;
+    constraint_data_buffer = compact_constraints;
+
+    // Worlds stay contiguous and in order, each keeps what is left of its ranges
+    uint32_t object_end = 0, constraint_end = 0;
+    for (GPUPhysicsWorld& world : worlds) {
+        uint32_t live_objects = 0, live_constraints = 0;
+        for (uint32_t i = world.object_offset; i < world.object_offset + world.object_count; ++i) live_objects += object_remap[i] != removed_index;
+        for (uint32_t k = world.constraint_offset; k < world.constraint_offset + world.constraint_count; ++k) live_constraints += constraint_remap[k] != removed_index;
+        world.object_offset = object_end;
+        world.object_count = live_objects;
+        world.constraint_offset = constraint_end;
+        world.constraint_count = live_constraints;
+        object_end += live_objects;
+        constraint_end += live_constraints;
+    }
+    worlds_dirty = true;
+
+    // Recolored and uploaded by the next update(), which sizes the object dispatches from the new count
+    constraint_graph.compact(object_remap, size_t(object_count), constraint_remap, size_t(constraint_count));
+    writeHeader(offsetof(GPUPhysicsHeader, object_count), uint32_t(object_count));
+    writeHeader(offsetof(GPUPhysicsHeader, constraint_count), uint32_t(constraint_count));
+    // Last step's contacts name the old indices, the next step starts its contacts cold
+    previous_contacts_valid = false;
+    compaction_count++;
+}
+
+void GPUPhysicsSystem::queueEdit(PhysicsEditField field, int index, const glm::vec4& value) {
+    GPUPhysicsEdit edit = {};
+    edit.field = field;
+    edit.index = index;
+    edit.value = value;
+
+    // Keep one edit per (field, index) so the scatter pass has no write conflicts
+    uint64_t key = (uint64_t(field) << 32) | uint32_t(index);
+    auto slot = pending_edit_slots.find(key);
+    if (slot != pending_edit_slots.end()) {
+        pending_edits[slot->second] = edit;
+    } else {
+        pending_edit_slots[key] = pending_edits.size();
+        pending_edits.push_back(edit);
+    }
+}
+
+void GPUPhysicsSystem::setObjectPosition(int index, const glm::vec4& position) { queueEdit(EDIT_OBJECT_POSITION, index, position); }
+void GPUPhysicsSystem::setObjectVelocity(int index, const glm::vec4& velocity) { queueEdit(EDIT_OBJECT_VELOCITY, index, velocity); }
+void GPUPhysicsSystem::setObjectAcceleration(int index, const glm::vec4& acceleration) { queueEdit(EDIT_OBJECT_ACCELERATION, index, acceleration); }
+void GPUPhysicsSystem::setObjectMass(int index, float mass) { queueEdit(EDIT_OBJECT_MASS, index, glm::vec4(mass)); }
+void GPUPhysicsSystem::setObjectRadius(int index, float radius) {
+    max_radius = std::max(max_radius, radius);
+    queueEdit(EDIT_OBJECT_RADIUS, index, glm::vec4(radius));
+}
+// A removed object stays removed, OBJECT_REMOVED is removeObject()'s
+void GPUPhysicsSystem::setObjectFlags(int index, uint32_t flags) {
+    if (object_handles.isRemoved(index)) return;
+    queueEdit(EDIT_OBJECT_FLAGS, index, glm::vec4(float(flags & ~uint32_t(OBJECT_SLEEPING | OBJECT_REMOVED))));
+}
+void GPUPhysicsSystem::setConstraintRestLength(int index, float rest_length) { queueEdit(EDIT_CONSTRAINT_REST_LENGTH, index, glm::vec4(rest_length)); }
+void GPUPhysicsSystem::setConstraintStiffness(int index, float stiffness) { queueEdit(EDIT_CONSTRAINT_STIFFNESS, index, glm::vec4(stiffness)); }
+void GPUPhysicsSystem::setConstraintLambda(int index, float lambda) { queueEdit(EDIT_CONSTRAINT_LAMBDA, index, glm::vec4(lambda)); }
+
+void GPUPhysicsSystem::applyEdits() {
+    if (pending_edits.empty()) return;
+    GPUProfileScope gpu_scope(profiler, "edits");
+
+    size_t edit_capacity_bytes = edit_capacity * sizeof(GPUPhysicsEdit);
+    uploadBuffer(edit_buffer, edit_capacity_bytes, pending_edits.data(), pending_edits.size() * sizeof(GPUPhysicsEdit));
+    edit_capacity = edit_capacity_bytes / sizeof(GPUPhysicsEdit);
+
+    glUseProgram(edit_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, edit_buffer);
+    glUniform1i(glGetUniformLocation(edit_compute_shader_program, "u_editCount"), int(pending_edits.size()));
+    glDispatchCompute((GLuint(pending_edits.size()) + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    pending_edits.clear();
+    pending_edit_slots.clear();
+}
+
+void GPUPhysicsSystem::setCollisionsEnabled(bool enabled) {
+    collisions_enabled = enabled;
+    // Contacts from before a pause are stale, don't warm-start from them
+    if (!enabled) previous_contacts_valid = false;
+}
+
+void GPUPhysicsSystem::reserveContacts() {
+    if (contact_list_capacity >= object_capacity) return;
+
+    // A few contacts per object on average, each object lists at most max_contacts_per_object
+    contact_capacity = object_capacity * 4;
+    contact_list_capacity = object_capacity;
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, contact_buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, contact_capacity * sizeof(GPUPhysicsConstraint), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, contact_list_buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, contact_list_capacity * (max_contacts_per_object + 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    writeHeader(offsetof(GPUPhysicsHeader, contact_capacity), uint32_t(contact_capacity));
+    previous_contacts_valid = false;
+}
+
+void GPUPhysicsSystem::findContacts() {
+    reserveContacts();
+
+    int current = contact_frame & 1;
+    int previous = current ^ 1;
+    if (!previous_contacts_valid) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, contact_list_buffers[previous]);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    // Reset the contact count and overflow flag
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, header_buffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, offsetof(GPUPhysicsHeader, contact_count), 2 * sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    // Sized by capacity rather than count, so objects created on the GPU fit too.
+    // About one cell per object keeps buckets short, the count must be a power of two for the hash
+    int cell_count = 1024;
+    while (cell_count < object_capacity) cell_count <<= 1;
+    float cell_size = contact_cell_size > 0.0f ? contact_cell_size : std::max(2.0f * max_radius, 1e-3f);
+
+    uploadBuffer(grid_buffer, grid_capacity, nullptr, (2 * size_t(cell_count) + 1 + 2 * size_t(object_capacity)) * sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid_buffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, cell_count * sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, world_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, grid_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, contact_buffers[previous]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, contact_list_buffers[previous]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, contact_buffers[current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, contact_list_buffers[current]);
+
+    // Counting sort of the objects by cell: count, prefix sum, scatter
+    int broad_phase_range = profiler ? profiler->begin("broad phase") : -1;
+    glUseProgram(grid_count_compute_shader_program);
+    glUniform1i(glGetUniformLocation(grid_count_compute_shader_program, "u_cellCount"), cell_count);
+    glUniform1f(glGetUniformLocation(grid_count_compute_shader_program, "u_cellSize"), cell_size);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(grid_scan_compute_shader_program);
+    glUniform1i(glGetUniformLocation(grid_scan_compute_shader_program, "u_cellCount"), cell_count);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(grid_scatter_compute_shader_program);
+    glUniform1i(glGetUniformLocation(grid_scatter_compute_shader_program, "u_cellCount"), cell_count);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (profiler) profiler->end(broad_phase_range);
+
+    // Narrow phase, warm-started from last step's contacts
+    GPUProfileScope gpu_scope(profiler, "narrow phase");
+    glUseProgram(contact_compute_shader_program);
+    glUniform1i(glGetUniformLocation(contact_compute_shader_program, "u_cellCount"), cell_count);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_cellSize"), cell_size);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_contactStiffness"), contact_stiffness);
+    glUniform1i(glGetUniformLocation(contact_compute_shader_program, "u_warmStart"), solver_parameters.warm_start ? 1 : 0);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_alpha"), solver_parameters.alpha);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_gamma"), solver_parameters.gamma);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_stiffnessMin"), solver_parameters.stiffness_min);
+    glUniform1f(glGetUniformLocation(contact_compute_shader_program, "u_stiffnessMax"), solver_parameters.stiffness_max);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Size the contact passes from the count the narrow phase just wrote
+    prepareDispatch();
 }
 
 void GPUPhysicsSystem::update(float dt) {
+    ProfileScope cpu_scope(profiler ? profiler->getProfiler() : nullptr, "physics update");
+    if (!supported) return;
+
+    // Scatter edits queued since the last step, then drop what was removed once enough has piled up
+    applyEdits();
+    if (needsCompaction()) compact();
+
     if (object_count == 0) return;
+
+    // Flatten, recolor and upload the constraint graph if constraints were added since the last step
+    uploadConstraintGraph();
+    uploadWorlds();
+
+    // Work group counts from the GPU-side counts
+    prepareDispatch();
+
+    // Broad and narrow phase, contacts are not part of the host coloring, see the snapshot pass below
+    if (collisions_enabled) findContacts();
+    GLuint contact_buffer = contact_buffers[contact_frame & 1];
     
-    glUseProgram(object_compute_shader_program);
-    glUseProgram(constraint_compute_shader_program);
-    
-    // Bind single buffer
+    // Bind the buffers every pass shares
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, world_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
     
-    // Set uniforms
+    // Set uniforms (glUniform* writes to the program currently in use)
+    glUseProgram(object_compute_shader_program);
     glUniform1f(glGetUniformLocation(object_compute_shader_program, "u_deltaTime"), dt);
-    glUniform2f(glGetUniformLocation(object_compute_shader_program, "u_screenSize"), SCREEN_WIDTH, SCREEN_HEIGHT);
-    glUniform1i(glGetUniformLocation(object_compute_shader_program, "u_iterations"), iterations);
     glUniform1i(glGetUniformLocation(object_compute_shader_program, "u_objectCount"), object_count);
-    glUniform1i(glGetUniformLocation(object_compute_shader_program, "u_constraintCount"), constraint_count);
+    glUniform1i(glGetUniformLocation(object_compute_shader_program, "u_collisionsEnabled"), collisions_enabled ? 1 : 0);
+    glUniform1f(glGetUniformLocation(object_compute_shader_program, "u_sleepEnergy"), sleep_parameters.sleep_energy);
+    GLint velocity_pass_location = glGetUniformLocation(object_compute_shader_program, "u_velocityPass");
+    glUniform1i(velocity_pass_location, 0);
+    GLint snapshot_pass_location = glGetUniformLocation(object_compute_shader_program, "u_snapshotPass");
+    glUniform1i(snapshot_pass_location, 0);
+    glUseProgram(convergence_compute_shader_program);
+    glUniform1i(glGetUniformLocation(convergence_compute_shader_program, "u_minIterations"), std::max(solver_parameters.min_iterations, 1));
+    glUniform1i(glGetUniformLocation(convergence_compute_shader_program, "u_maxIterations"), iterations);
+    glUniform1f(glGetUniformLocation(convergence_compute_shader_program, "u_tolerance"), solver_parameters.residual_tolerance);
+    glUniform1i(glGetUniformLocation(convergence_compute_shader_program, "u_colorCount"), constraint_graph.getColorCount());
+    GLint convergence_iteration_location = glGetUniformLocation(convergence_compute_shader_program, "u_iteration");
+    glUseProgram(constraint_compute_shader_program);
     glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_deltaTime"), dt);
-    glUniform2f(glGetUniformLocation(constraint_compute_shader_program, "u_screenSize"), SCREEN_WIDTH, SCREEN_HEIGHT);
     glUniform1i(glGetUniformLocation(constraint_compute_shader_program, "u_iterations"), iterations);
-    glUniform1i(glGetUniformLocation(constraint_compute_shader_program, "u_objectCount"), object_count);
-    glUniform1i(glGetUniformLocation(constraint_compute_shader_program, "u_constraintCount"), constraint_count);
+    glUniform1i(glGetUniformLocation(constraint_compute_shader_program, "u_warmStart"), solver_parameters.warm_start ? 1 : 0);
+    glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_alpha"), solver_parameters.alpha);
+    glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_gamma"), solver_parameters.gamma);
+    glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_beta"), solver_parameters.beta);
+    glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_stiffnessMin"), solver_parameters.stiffness_min);
+    glUniform1f(glGetUniformLocation(constraint_compute_shader_program, "u_stiffnessMax"), solver_parameters.stiffness_max);
+
+    GLint contact_pass_location = glGetUniformLocation(constraint_compute_shader_program, "u_contactPass");
+    GLint constraint_iteration_location = glGetUniformLocation(constraint_compute_shader_program, "u_iteration");
+    GLint warm_start_pass_location = glGetUniformLocation(constraint_compute_shader_program, "u_warmStartPass");
 
+    // Scale down the penalty and lambda the constraints carry over from the last step,
+    // contacts were scaled when the narrow phase matched them
+    glUniform1i(contact_pass_location, 0);
+    glUniform1i(warm_start_pass_location, 1);
+    dispatchIndirect(DISPATCH_CONSTRAINTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(warm_start_pass_location, 0);
+    GLint iteration_location = glGetUniformLocation(object_compute_shader_program, "u_iteration");
+    GLint color_offset_location = glGetUniformLocation(object_compute_shader_program, "u_colorOffset");
+    GLint color_location = glGetUniformLocation(object_compute_shader_program, "u_color");
+    const std::vector<uint32_t>& color_offsets = constraint_graph.getColorOffsets();
+    int color_count = constraint_graph.getColorCount();
+
+    // Wake the islands something touched and list the objects each color solves this step
+    activateObjects();
+
+    // The object pass's own buffers, bindings from 5 are numbered per pass
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, adjacency_offset_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, solver_state_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, contact_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, contact_list_buffers[contact_frame & 1]);
     
-    // Dispatch compute shader
-    int object_work_groups = (object_count + 63) / 64;
-    int constraint_work_groups = (constraint_count + 63) / 64;
+    // Dispatch compute shader. Every iteration is queued, once the convergence pass finds the step converged
+    // the object passes return straight away and the constraint and contact passes have no work groups
     for (int i = 0; i < iterations; ++i) {
-        // optionally set u_iterations to 1 if shader uses it (not necessary)
-        glUniform1i(glGetUniformLocation(object_compute_shader_program, "u_iteration"), i);
-        glUniform1i(glGetUniformLocation(constraint_compute_shader_program, "u_iteration"), i);
-
-        // Dispatch object compute shader
-        glDispatchCompute(object_work_groups, 1, 1);
+        // The convergence pass holds binding 6 for the dispatch slots
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, adjacency_index_buffer);
+        // Dispatch object compute shader once per color, objects of one color share no constraint.
+        // Colors come from the host-side constraint graph, their awake objects were counted on the GPU
+        int object_range = profiler ? profiler->begin("object pass") : -1;
+        glUseProgram(object_compute_shader_program);
+        glUniform1i(iteration_location, i);
+        // Contacts can join two objects of one color, each reads the other where it started the iteration
+        if (collisions_enabled) {
+            glUniform1i(snapshot_pass_location, 1);
+            dispatchIndirect(DISPATCH_OBJECTS);
+            glUniform1i(snapshot_pass_location, 0);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        for (int c = 0; c < color_count; ++c) {
+            glUniform1i(color_offset_location, int(color_offsets[c]));
+            glUniform1i(color_location, c);
+            dispatchIndirect(DISPATCH_COUNT + c);
+            // next color reads the positions this one wrote
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
         // ensure writes are visible to next dispatch
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        if (profiler) profiler->end(object_range);
+
+        // Dispatch constraint compute shader, sized on the GPU
+        {
+            GPUProfileScope gpu_scope(profiler, "constraint pass");
+            glUseProgram(constraint_compute_shader_program);
+            glUniform1i(contact_pass_location, 0);
+            glUniform1i(constraint_iteration_location, i);
+            dispatchIndirect(DISPATCH_SOLVE_CONSTRAINTS);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        }
 
-        // Dispatch constraint compute shader
-        glDispatchCompute(constraint_work_groups, 1, 1);
+        // Same pass over the contacts
+        if (collisions_enabled) {
+            GPUProfileScope gpu_scope(profiler, "contact pass");
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, contact_buffer);
+            glUniform1i(contact_pass_location, 1);
+            dispatchIndirect(DISPATCH_SOLVE_CONTACTS);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+        }
+
+        // Residual of this iteration against the tolerance
+        {
+            GPUProfileScope gpu_scope(profiler, "convergence");
+            glUseProgram(convergence_compute_shader_program);
+            glUniform1i(convergence_iteration_location, i);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, dispatch_buffer);
+            glDispatchCompute(1, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        }
+    }
+
+    // 37. Velocities from the positions the iterations ended at
+    {
+        GPUProfileScope gpu_scope(profiler, "velocity");
+        glUseProgram(object_compute_shader_program);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, adjacency_index_buffer);
+        glUniform1i(velocity_pass_location, 1);
+        dispatchIndirect(DISPATCH_OBJECTS);
+        glUniform1i(velocity_pass_location, 0);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
     }
-}
 
-GLuint GPUPhysicsSystem::loadComputeShader(const std::string compute_path) {
+    // Islands from this step's constraints and contacts, every few steps
+    if (sleep_parameters.enabled && step_count % uint64_t(std::max(sleep_parameters.island_interval, 1)) == 0) {
+        findIslands(contact_buffer);
+    }
 
-    // Load the shader file
-    std::ifstream shaderFile(compute_path);
-    std::string compute_shader_source((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
-    const char* compute_source = compute_shader_source.c_str();
+    if (collisions_enabled) {
+        contact_frame++;
+        previous_contacts_valid = true;
+    }
+    step_count++;
+}
 
-    GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(compute_shader, 1, &compute_source, nullptr);
-    glCompileShader(compute_shader);
-    
-    // Check compilation
-    int success;
-    char info_log[512];
-    glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(compute_shader, 512, nullptr, info_log);
-        std::cerr << "Compute shader compilation failed: " << info_log << std::endl;
+void GPUPhysicsSystem::activateObjects() {
+    GPUProfileScope gpu_scope(profiler, "activation");
+    int color_count = constraint_graph.getColorCount();
+    // Zero the awake counts behind the header
+    if (color_count > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, header_buffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(GPUPhysicsHeader), color_count * sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
-    
-    GLuint program = glCreateProgram();
-    glAttachShader(program, compute_shader);
-    glLinkProgram(program);
-    
-    // Check linking
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(program, 512, nullptr, info_log);
-        std::cerr << "Compute shader program linking failed: " << info_log << std::endl;
+
+    glUseProgram(activation_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, color_order_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, dispatch_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, color_offset_buffer);
+    glUniform1i(glGetUniformLocation(activation_compute_shader_program, "u_colorCount"), color_count);
+    glUniform1i(glGetUniformLocation(activation_compute_shader_program, "u_sleepEnabled"), sleep_parameters.enabled ? 1 : 0);
+    GLint pass_location = glGetUniformLocation(activation_compute_shader_program, "u_pass");
+
+    // Compact the awake objects of every color, then size one dispatch per color from the counts
+    glUniform1i(pass_location, 0);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(pass_location, 1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void GPUPhysicsSystem::findIslands(GLuint contact_buffer) {
+    GPUProfileScope gpu_scope(profiler, "islands");
+    glUseProgram(island_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, island_buffer);
+    glUniform1f(glGetUniformLocation(island_compute_shader_program, "u_sleepTime"), sleep_parameters.sleep_time);
+    GLint pass_location = glGetUniformLocation(island_compute_shader_program, "u_pass");
+    GLint contact_pass_location = glGetUniformLocation(island_compute_shader_program, "u_contactPass");
+
+    // 1. Reset the labels
+    glUniform1i(pass_location, 0);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 2. Union-find over the constraints, then the contacts
+    glUniform1i(pass_location, 1);
+    glUniform1i(contact_pass_location, 0);
+    dispatchIndirect(DISPATCH_CONSTRAINTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if (collisions_enabled) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, contact_buffer);
+        glUniform1i(contact_pass_location, 1);
+        dispatchIndirect(DISPATCH_CONTACTS);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
     }
-    
-    glDeleteShader(compute_shader);
-    return program;
+
+    // 3. Compress to the roots, 4. put the islands that rested long enough to sleep
+    glUniform1i(pass_location, 2);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(pass_location, 3);
+    dispatchIndirect(DISPATCH_OBJECTS);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+std::string GPUPhysicsSystem::insertShaderPrelude(const std::string& source, int dimensions) {
+    // #version has to stay the first line
+    size_t line_end = source.find('\n');
+    if (line_end == std::string::npos || source.compare(0, 8, "#version") != 0) return physicsShaderPrelude(dimensions) + source;
+    return source.substr(0, line_end + 1) + physicsShaderPrelude(dimensions) + source.substr(line_end + 1);
+}
+
+GLuint GPUPhysicsSystem::loadComputeShader(const std::string& name, int dimensions) {
+    ShaderStage stage = {GL_COMPUTE_SHADER, insertShaderPrelude(loadShaderSource(name), dimensions), name};
+    return buildProgram(&stage, 1);
 }
 
 // GPURenderer2D Implementation
-GPURenderer2D::GPURenderer2D(int width, int height) {
+GPURenderer2D::GPURenderer2D(int width, int height, int dimensions) : dimensions(dimensions) {
     projection = glm::ortho(0.0f, float(width), 0.0f, float(height));
-    render_object_program = loadRenderShaders("../shaders/object_vertex_shader.glsl", "../shaders/object_fragment_shader.glsl");
-    render_constraint_program = loadRenderShaders("../shaders/constraint_vertex_shader.glsl", "../shaders/constraint_fragment_shader.glsl");
-    setupInstancedRendering();
+    viewport_size = glm::vec2(float(width), float(height));
+    bool compute_supported = checkShaderStorageLimits("GPURenderer2D");
+    bool vertex_supported = checkShaderStorageLimits("GPURenderer2D", GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, required_vertex_storage_blocks);
+    supported = compute_supported && vertex_supported;
+    render_object_program = loadRenderShaders("object_vertex_shader.glsl", "object_fragment_shader.glsl");
+    render_constraint_program = loadRenderShaders("constraint_vertex_shader.glsl", "constraint_fragment_shader.glsl");
+    cull_compute_program = GPUPhysicsSystem::loadComputeShader("cull_compute_shader.glsl", dimensions);
+    setupBuffers();
 }
 
 GPURenderer2D::~GPURenderer2D() {
     glDeleteProgram(render_object_program);
     glDeleteProgram(render_constraint_program);
-    glDeleteVertexArrays(1, &circle_template_vao);
-    glDeleteBuffers(1, &circle_template_vbo);
+    glDeleteProgram(cull_compute_program);
+    glDeleteVertexArrays(1, &dummy_vao);
+    glDeleteBuffers(1, &visible_object_buffer);
+    glDeleteBuffers(1, &visible_constraint_buffer);
+    glDeleteBuffers(1, &draw_command_buffer);
 }
 
-void GPURenderer2D::setupInstancedRendering() {
-    // Create a simple vertex template that we'll use for all shapes
-    // We'll generate actual geometry in the vertex shader
-    std::vector<float> vertices;
-    
-    // Create enough vertices to handle the largest polygon (let's say up to 16 sides)
-    for (int i = 0; i < circle_segments; ++i) {
-        float angle = 2.0f * M_PI * i / circle_segments;
-        vertices.push_back(cosf(angle));
-        vertices.push_back(sinf(angle));
-    }
-
+void GPURenderer2D::setupBuffers() {
+    // Quads and points are expanded in the vertex shaders, no vertex attributes
     glGenVertexArrays(1, &dummy_vao);
-    
-    glGenVertexArrays(1, &circle_template_vao);
-    glGenBuffers(1, &circle_template_vbo);
-    
-    glBindVertexArray(circle_template_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, circle_template_vbo);
-    glBufferData(GL_ARRAY_BUFFER, 
-                 vertices.size() * sizeof(float), 
-                 vertices.data(), 
-                 GL_STATIC_DRAW);
-    
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    
-    glBindVertexArray(0);
+
+    // Visible lists grow with the drawn counts
+    glGenBuffers(1, &visible_object_buffer);
+    glGenBuffers(1, &visible_constraint_buffer);
+    reserveBuffer(visible_object_buffer, visible_object_capacity, 0);
+    reserveBuffer(visible_constraint_buffer, visible_constraint_capacity, 0);
+
+    glGenBuffers(1, &draw_command_buffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, DRAW_COUNT * sizeof(GPUDrawArraysIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GPURenderer2D::reserveBuffer(GLuint buffer, size_t& capacity_bytes, size_t bytes) {
+    // Contents are rewritten every frame, so growing drops them
+    bytes = std::max<size_t>(bytes, 16);
+    if (bytes <= capacity_bytes) return;
+    capacity_bytes = std::max(bytes, capacity_bytes * 2);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_bytes, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPURenderer2D::resetDrawCommand(int draw, uint32_t vertex_count) {
+    GPUDrawArraysIndirectCommand command = {vertex_count, 0, 0, 0};
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_command_buffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, draw * sizeof(GPUDrawArraysIndirectCommand), sizeof(command), &command);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GPURenderer2D::cull(int pass, GLuint object_buffer, GLuint previous_object_buffer, int count, float alpha) {
+    glUseProgram(cull_compute_program);
+    glUniformMatrix4fv(glGetUniformLocation(cull_compute_program, "u_projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(cull_compute_program, "u_alpha"), alpha);
+    glUniform2f(glGetUniformLocation(cull_compute_program, "u_viewportSize"), viewport_size.x, viewport_size.y);
+    glUniform1f(glGetUniformLocation(cull_compute_program, "u_pointRadius"), render_parameters.point_radius);
+    glUniform1i(glGetUniformLocation(cull_compute_program, "u_count"), count);
+    glUniform1i(glGetUniformLocation(cull_compute_program, "u_pass"), pass);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, previous_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, visible_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, visible_constraint_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, draw_command_buffer);
+    glDispatchCompute(GLuint((count + 63) / 64), 1, 1);
+    // The draws read the lists and take their instance counts from the commands
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
 }
 
 void GPURenderer2D::renderObjects(const GPUPhysicsSystem& physics_system) {
-    if (physics_system.getObjectCount() == 0) return;
+    GLuint object_buffer = physics_system.getObjectDataBuffer();
+    renderObjects(object_buffer, object_buffer, physics_system.getObjectCount(), 1.0f);
+}
+
+void GPURenderer2D::renderConstraints(const GPUPhysicsSystem& physics_system) {
+    GLuint object_buffer = physics_system.getObjectDataBuffer();
+    renderConstraints(object_buffer, object_buffer, physics_system.getConstraintDataBuffer(), physics_system.getConstraintCount(), 1.0f);
+}
+
+void GPURenderer2D::renderObjects(GLuint object_buffer, GLuint previous_object_buffer, int object_count, float alpha) {
+    if (!supported || object_count == 0) return;
+
+    // Sort the bodies on screen into quads and points
+    reserveBuffer(visible_object_buffer, visible_object_capacity, 2 * size_t(object_count) * sizeof(uint32_t));
+    resetDrawCommand(DRAW_QUADS, 4);
+    resetDrawCommand(DRAW_POINTS, 1);
+    cull(0, object_buffer, previous_object_buffer, object_count, alpha);
     
     glUseProgram(render_object_program);
     
     // Set projection matrix
     glUniformMatrix4fv(glGetUniformLocation(render_object_program, "u_projection"), 
                        1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(render_object_program, "u_alpha"), alpha);
+    glUniform2f(glGetUniformLocation(render_object_program, "u_viewportSize"), viewport_size.x, viewport_size.y);
+    glUniform1f(glGetUniformLocation(render_object_program, "u_outlineWidth"), render_parameters.outline_width);
+    GLint list_offset_location = glGetUniformLocation(render_object_program, "u_listOffset");
+    GLint point_pass_location = glGetUniformLocation(render_object_program, "u_pointPass");
     
-    // Bind physics buffer for reading
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, physics_system.getObjectDataBuffer());
-    
-    // Render all instances
-    glBindVertexArray(circle_template_vao);
+    // Bind physics buffers for reading
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, previous_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, visible_object_buffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_command_buffer);
+    glBindVertexArray(dummy_vao);
     
-    // Draw as line loops (wireframe) - using all 16 vertices but shader will cull extras
-    glDrawArraysInstanced(GL_LINE_LOOP, 0, circle_segments, physics_system.getObjectCount());
+    // Quads blend their antialiased edge
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUniform1i(list_offset_location, 0);
+    glUniform1i(point_pass_location, 0);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, (const void*)(DRAW_QUADS * sizeof(GPUDrawArraysIndirectCommand)));
+    glDisable(GL_BLEND);
+
+    // Points size themselves in the vertex shader
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glUniform1i(list_offset_location, object_count);
+    glUniform1i(point_pass_location, 1);
+    glDrawArraysIndirect(GL_POINTS, (const void*)(DRAW_POINTS * sizeof(GPUDrawArraysIndirectCommand)));
+    glDisable(GL_PROGRAM_POINT_SIZE);
     
     glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
-void GPURenderer2D::renderConstraints(const GPUPhysicsSystem& physics_system) {
-    if (physics_system.getConstraintCount() == 0) return;
+void GPURenderer2D::renderConstraints(GLuint object_buffer, GLuint previous_object_buffer, GLuint constraint_buffer, int constraint_count, float alpha) {
+    if (!supported || constraint_count == 0) return;
+
+    // Only constraints with some of their line on screen
+    reserveBuffer(visible_constraint_buffer, visible_constraint_capacity, size_t(constraint_count) * sizeof(uint32_t));
+    resetDrawCommand(DRAW_CONSTRAINTS, 2);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_buffer);
+    cull(1, object_buffer, previous_object_buffer, constraint_count, alpha);
 
     glUseProgram(render_constraint_program);
 
     glUniformMatrix4fv(glGetUniformLocation(render_constraint_program, "u_projection"), 
                        1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(render_constraint_program, "u_alpha"), alpha);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, physics_system.getObjectDataBuffer());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, physics_system.getConstraintDataBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, previous_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, visible_constraint_buffer);
 
     // Draw each constraint as a line (2 vertices per instance)
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_command_buffer);
     glBindVertexArray(dummy_vao);
-    glDrawArraysInstanced(GL_LINES, 0, 2, physics_system.getConstraintCount());
+    glDrawArraysIndirect(GL_LINES, (const void*)(DRAW_CONSTRAINTS * sizeof(GPUDrawArraysIndirectCommand)));
     glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
-GLuint GPURenderer2D::loadRenderShaders(const char* instanced_vertex_shader_path, const char* instanced_fragment_shader_path) {
+GLuint GPURenderer2D::loadRenderShaders(const char* vertex_shader, const char* fragment_shader) {
+    // Only the vertex shaders read the object buffers
+    ShaderStage stages[2] = {
+        {GL_VERTEX_SHADER, GPUPhysicsSystem::insertShaderPrelude(loadShaderSource(vertex_shader), dimensions), vertex_shader},
+        {GL_FRAGMENT_SHADER, loadShaderSource(fragment_shader), fragment_shader},
+    };
+    return buildProgram(stages, 2);
+}
 
-    // Load the shader file
-    std::ifstream shaderFile(instanced_vertex_shader_path);
-    std::string shader_source((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
-    const char* instanced_vertex_shader = shader_source.c_str();
+void GPUPhysicsSystem::requestObjectsReadback(int first, int count) {
+    first = std::max(0, std::min(first, object_count));
+    if (count < 0 || first + count > object_count) count = object_count - first;
+    object_readback.enqueue(object_data_buffer, first * object_stride, count * object_stride, step_count);
+}
 
-    // Load the shader file
-    std::ifstream shaderFile2(instanced_fragment_shader_path);
-    std::string shader_source2((std::istreambuf_iterator<char>(shaderFile2)), std::istreambuf_iterator<char>());
-    const char* instanced_fragment_shader = shader_source2.c_str();
+bool GPUPhysicsSystem::getLatestObjectsData(std::vector<GPUPhysicsObject>& data, int* first, uint64_t* step) {
+    size_t size = 0, offset = 0;
+    const void* latest = object_readback.latest(&size, step, &offset);
+    if (!latest) return false;
 
-    // Compile vertex shader
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &instanced_vertex_shader, nullptr);
-    glCompileShader(vertex_shader);
-    
-    // Check vertex shader compilation
-    int success;
-    char info_log[512];
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex_shader, 512, nullptr, info_log);
-        std::cerr << "Vertex shader compilation failed: " << info_log << std::endl;
-    }
-    
-    // Compile fragment shader
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &instanced_fragment_shader, nullptr);
-    glCompileShader(fragment_shader);
-    
-    // Check fragment shader compilation
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment_shader, 512, nullptr, info_log);
-        std::cerr << "Fragment shader compilation failed: " << info_log << std::endl;
+    // Reuses the caller's storage, only grows it
+    data.resize(size / object_stride);
+    unpackObjects(latest, int(offset / object_stride), data.size(), data.data());
+    if (first) *first = int(offset / object_stride);
+    return true;
+}
+
+void GPUPhysicsSystem::unpackObjects(const void* device_objects, int first, size_t count, GPUPhysicsObject* objects) const {
+    if (dimensions == 3) {
+        std::memcpy(objects, device_objects, count * sizeof(GPUPhysicsObject));
+        return;
     }
-    
-    // Create program
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
-    
-    // Check program linking
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(program, 512, nullptr, info_log);
-        std::cerr << "Shader program linking failed: " << info_log << std::endl;
+
+    // Worlds are contiguous and in order, walk them alongside the objects
+    const GPUPhysicsObject2D* compact = static_cast<const GPUPhysicsObject2D*>(device_objects);
+    size_t world = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t index = uint32_t(first) + uint32_t(i);
+        while (world + 1 < worlds.size() && worlds[world + 1].object_offset <= index) world++;
+        objects[i] = toObject3D(compact[i], uint32_t(world));
     }
-    
-    // Cleanup
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    
-    return program;
+}
+
+void GPUPhysicsSystem::requestStats(float reference_height) {
+    GPUProfileScope gpu_scope(profiler, "stats");
+    glUseProgram(stats_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, header_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, stats_partial_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stats_buffer);
+    glUniform1f(glGetUniformLocation(stats_compute_shader_program, "u_referenceHeight"), reference_height);
+    glUniform1i(glGetUniformLocation(stats_compute_shader_program, "u_partialCount"), stats_work_groups);
+    GLint pass_location = glGetUniformLocation(stats_compute_shader_program, "u_pass");
+
+    // Work groups reduce into partials, then one work group reduces the partials
+    glUniform1i(pass_location, 0);
+    glDispatchCompute(stats_work_groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(pass_location, 1);
+    glDispatchCompute(1, 1, 1);
+
+    stats_readback.enqueue(stats_buffer, 0, sizeof(GPUPhysicsStats), step_count);
+}
+
+bool GPUPhysicsSystem::getLatestStats(GPUPhysicsStats& stats, uint64_t* step) {
+    const void* latest = stats_readback.latest(nullptr, step);
+    if (!latest) return false;
+
+    std::memcpy(&stats, latest, sizeof(GPUPhysicsStats));
+    return true;
+}
+
+void GPUPhysicsSystem::requestWorldStats() {
+    GPUProfileScope gpu_scope(profiler, "world stats");
+    uploadWorlds();
+    size_t bytes = worlds.size() * sizeof(GPUWorldStats);
+    uploadBuffer(world_stats_buffer, world_stats_capacity, nullptr, bytes);
+
+    glUseProgram(world_stats_compute_shader_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, constraint_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, world_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, world_stats_buffer);
+    // One work group per world
+    glDispatchCompute(GLuint(worlds.size()), 1, 1);
+
+    world_stats_readback.enqueue(world_stats_buffer, 0, bytes, step_count);
+}
+
+bool GPUPhysicsSystem::getLatestWorldStats(std::vector<GPUWorldStats>& stats, uint64_t* step) {
+    size_t size = 0;
+    const void* latest = world_stats_readback.latest(&size, step);
+    if (!latest) return false;
+
+    stats.resize(size / sizeof(GPUWorldStats));
+    std::memcpy(stats.data(), latest, size);
+    return true;
 }
 
 std::vector<GPUPhysicsObject> GPUPhysicsSystem::getObjectsData() {
@@ -276,7 +1165,7 @@ std::vector<GPUPhysicsObject> GPUPhysicsSystem::getObjectsData() {
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_data_buffer);
     GLvoid* ptr = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_ONLY);
     if (ptr) {
-        memcpy(data.data(), ptr, object_count * sizeof(GPUPhysicsObject));
+        unpackObjects(ptr, 0, data.size(), data.data());
         glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
     }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
@@ -284,6 +1173,114 @@ std::vector<GPUPhysicsObject> GPUPhysicsSystem::getObjectsData() {
     return data;
 }
 
+std::vector<GPUPhysicsConstraint> GPUPhysicsSystem::getConstraintsData() {
+    std::vector<GPUPhysicsConstraint> data(constraint_count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, constraint_data_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(GPUPhysicsConstraint), data.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return data;
+}
+
+bool GPUPhysicsSystem::saveSnapshot(const char* path) {
+    if (!supported) return false;
+    // Pending edits and a graph not yet flattened belong to the state being saved, removed elements do not
+    applyEdits();
+    compact();
+    uploadConstraintGraph();
+
+    std::vector<GPUPhysicsObject> objects = getObjectsData();
+    std::vector<GPUPhysicsConstraint> constraints = getConstraintsData();
+
+    SnapshotData data;
+    data.objects = objects.data();
+    data.object_count = objects.size();
+    data.constraints = constraints.data();
+    data.constraint_count = constraints.size();
+    data.graph = constraint_graph.getEdgeSet();
+    data.edge_count = constraint_graph.getIndices().size();
+    data.color_order = constraint_graph.getColorOrder().data();
+    data.color_offsets = constraint_graph.getColorOffsets().data();
+    data.color_count = size_t(constraint_graph.getColorCount());
+    data.worlds = worlds.data();
+    data.world_count = worlds.size();
+    data.state.step = step_count;
+    data.state.iterations = iterations;
+    data.state.collisions_enabled = collisions_enabled;
+    data.state.contact_cell_size = contact_cell_size;
+    data.state.contact_stiffness = contact_stiffness;
+    data.state.max_radius = max_radius;
+    data.state.solver_parameters = solver_parameters;
+    return writeSnapshot(path, data);
+}
+
+bool GPUPhysicsSystem::loadSnapshot(const char* path) {
+    SnapshotFile file;
+    if (!file.open(path)) return false;
+    const SnapshotData& data = file.getData();
+
+    // Everything queued for the old state is dropped
+    pending_edits.clear();
+    pending_edit_slots.clear();
+    object_count = 0;
+    constraint_count = 0;
+    reserveObjects(int(data.object_count));
+    reserveConstraints(int(data.constraint_count));
+
+    // Straight from the mapped pages into the buffers, one transfer per array. Snapshots hold the 3D layout,
+    // a 2D system packs the objects first
+    std::vector<GPUPhysicsObject2D> compact;
+    const void* object_data = data.objects;
+    if (dimensions == 2) {
+        compact.resize(data.object_count);
+        for (size_t i = 0; i < data.object_count; ++i) compact[i] = toObject2D(data.objects[i]);
+        object_data = compact.data();
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_data_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.object_count * object_stride, object_data);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, constraint_data_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.constraint_count * sizeof(GPUPhysicsConstraint), data.constraints);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    uploadIndexBuffer(adjacency_offset_buffer, adjacency_offset_capacity, data.graph.offsets, data.object_count + 1);
+    uploadIndexBuffer(adjacency_index_buffer, adjacency_index_capacity, data.graph.indices, data.edge_count);
+    uploadIndexBuffer(color_order_buffer, color_order_capacity, data.color_order, data.object_count);
+    initializeIslands(data.objects, 0, data.object_count);
+
+    // The host keeps the colors, so update() neither recolors nor uploads the graph again
+    constraint_graph = ConstraintGraph();
+    constraint_graph.assign(data.object_count, data.constraint_count, data.graph, data.color_order, data.color_offsets, data.color_count);
+    object_handles.clear();
+    constraint_handles.clear();
+    for (size_t i = 0; i < data.object_count; ++i) object_handles.add();
+    for (size_t k = 0; k < data.constraint_count; ++k) constraint_handles.add();
+
+    object_count = int(data.object_count);
+    constraint_count = int(data.constraint_count);
+    uploadColorBatches();
+    // A snapshot of a single system, or from the CPU backend, is one world over everything
+    if (data.world_count > 0) {
+        worlds.assign(data.worlds, data.worlds + data.world_count);
+    } else {
+        worlds.assign(1, GPUPhysicsWorld());
+        worlds[0].object_count = uint32_t(object_count);
+        worlds[0].constraint_count = uint32_t(constraint_count);
+    }
+    worlds_dirty = true;
+    writeHeader(offsetof(GPUPhysicsHeader, object_count), uint32_t(object_count));
+    writeHeader(offsetof(GPUPhysicsHeader, constraint_count), uint32_t(constraint_count));
+
+    const SnapshotState& state = data.state;
+    step_count = state.step;
+    iterations = state.iterations;
+    collisions_enabled = state.collisions_enabled;
+    contact_cell_size = state.contact_cell_size;
+    contact_stiffness = state.contact_stiffness;
+    max_radius = state.max_radius;
+    solver_parameters = state.solver_parameters;
+    // Contacts are found again on the next step, without a warm start
+    previous_contacts_valid = false;
+    return true;
+}
+
 void GPUPhysicsSystem::setIterations(int iterations) {
     this->iterations = iterations;
 }
\ No newline at end of file
@@ -3,85 +3,328 @@
 #include <vector>
 #include <cmath>
 #include <cstring>
+#include <cstddef>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <unordered_map>
 #include "../vendor/glm/glm/gtc/type_ptr.hpp"
 #include "../vendor/glm/glm/gtc/matrix_transform.hpp"
+#include "constraint_graph.h"
+#include "handle_table.h"
+#include "physics_types.h"
+#include "readback_ring.h"
+#include "gpu_profiler.h"
+#include "snapshot.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-// GPU-aligned struct (std430 layout)
-struct GPUPhysicsObject {
-    glm::vec4 position;     // 16 bytes
-    glm::vec4 velocity;     // 16 bytes
-    glm::vec4 acceleration; // 16 bytes
-    float mass;             // 4 bytes
-    float radius;           // 4 bytes
-    glm::vec2 _pad;        // 8 bytes 
-}; // 64 bytes it must be a multiple of 16 bytes
-
-struct GPUPhysicsConstraint {
-    int type;       // 0 for distance, 1 for hard, 2 for angle, 3 for volume
-    int indexA;
-    int indexB;
-    float restLength;
-    float stiffness; // k_j^(n)
-    float lambda; // λ_j^(n)
-    glm::vec2 _pad;
-    // Could also add min/max bounds for inequality constraints
-}; // 32 bytes
-
-const int circle_segments = 64;
+// Work groups of the first stats reduction pass, each reduces a grid-stride slice
+const int stats_work_groups = 256;
+// Contacts each object can hold per step, must match MAX_CONTACTS_PER_OBJECT in the shaders
+const int max_contacts_per_object = 8;
+// Shader storage the kernels need, above the OpenGL 4.3 minimums of 8 bindings and 8 blocks per compute shader.
+// Every pass shares bindings 0-4 (objects, constraints, header, worlds, islands) and numbers its own blocks
+// from 5, so object_compute_shader.glsl, the widest pass, reads 10 blocks at bindings 0-9
+const int required_storage_bindings = 10;
+const int required_compute_storage_blocks = 10;
+// constraint_vertex_shader.glsl reads objects, constraints, previous objects, visible constraints and worlds
+const int required_vertex_storage_blocks = 5;
+
+// Compares the limits above with the current context, and stage_blocks with its block limit (for example
+// GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS). Every shortfall goes to stderr, false if there was one
+bool checkShaderStorageLimits(const char* user, GLenum stage_limit = GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS,
+                              int stage_blocks = required_compute_storage_blocks);
 
 class GPUPhysicsSystem {
 public:
-    GPUPhysicsSystem(int max_objects = 1000, int max_constraints = 1000, int iterations = 5, int SCREEN_WIDTH = 1600, int SCREEN_HEIGHT = 1200);
+    // Capacities are only the initial buffer sizes, buffers grow as objects and constraints are added.
+    // dimensions 2 builds every kernel for the compact GPUPhysicsObject2D layout and the 2x2 solve, z is ignored;
+    // 3 keeps the full GPUPhysicsObject layout. The object API takes and returns GPUPhysicsObject either way
+    GPUPhysicsSystem(int object_capacity = 1000, int constraint_capacity = 1000, int iterations = 5, int SCREEN_WIDTH = 1600, int SCREEN_HEIGHT = 1200,
+                     int dimensions = 3);
     ~GPUPhysicsSystem();
+    // False if the context is short of the shader storage the kernels need (checkShaderStorageLimits()),
+    // the constructor has then reported it and update() and compact() do nothing
+    bool isSupported() const { return supported; }
     
-    void addObject(const GPUPhysicsObject& obj);
-    void addConstraint(const GPUPhysicsConstraint& constraint);
+    // Every object and constraint gets a handle (PhysicsHandle) that stays valid across compactions,
+    // constraints still name their objects by index
+    PhysicsHandle addObject(const GPUPhysicsObject& obj);
+    PhysicsHandle addConstraint(const GPUPhysicsConstraint& constraint);
+    // Uploads a whole batch in one transfer, handles receives count handles if given
+    void addObjects(const GPUPhysicsObject* objects, size_t count, PhysicsHandle* handles = nullptr);
+    void addConstraints(const GPUPhysicsConstraint* constraints, size_t count, PhysicsHandle* handles = nullptr);
+    void reserveObjects(int capacity);
+    void reserveConstraints(int capacity);
+
+    // Removal is O(1) and queued like an edit: the object is flagged OBJECT_REMOVED (with its constraints) or
+    // the constraint retyped CONSTRAINT_REMOVED, every pass skips it and the solver's per-color dispatches only
+    // count live objects. Its index stays taken until the next compaction. False if the handle is stale
+    bool removeObject(PhysicsHandle handle);
+    bool removeConstraint(PhysicsHandle handle);
+    // Current index of a handle's element, -1 once it is removed
+    int getObjectIndex(PhysicsHandle handle) const { return object_handles.getIndex(handle); }
+    int getConstraintIndex(PhysicsHandle handle) const { return constraint_handles.getIndex(handle); }
+    PhysicsHandle getObjectHandle(int index) const { return object_handles.getHandle(index); }
+    PhysicsHandle getConstraintHandle(int index) const { return constraint_handles.getHandle(index); }
+    // Compaction moves the live objects and constraints down over the removed ones on the GPU, in order, and
+    // rewrites the constraints' object indices, so the object dispatches shrink to the live count. update()
+    // compacts once the removed objects or constraints reach this fraction of their buffer (0 after every
+    // removal). Indices change, getCompactionCount() tells holders of raw indices when to look them up again
+    void setCompactionThreshold(float fraction) { compaction_threshold = fraction; }
+    void compact();
+    uint64_t getCompactionCount() const { return compaction_count; }
+    int getLiveObjectCount() const { return object_count - int(object_handles.getRemovedCount()); }
+    int getLiveConstraintCount() const { return constraint_count - int(constraint_handles.getRemovedCount()); }
+
+    // Batched worlds: independent simulations packed into the same buffers and advanced by the same dispatches,
+    // for evaluating a whole population at once. Objects and constraints always go into the last world, with
+    // constraint indices into the shared object buffer. addWorld() starts a new one (or configures world 0 while
+    // the system is still empty) and returns its index. The second form adds a whole world in one call, its
+    // constraint indices are relative to its own first object
+    int addWorld(const PhysicsWorldParameters& parameters = PhysicsWorldParameters());
+    int addWorld(const PhysicsWorldParameters& parameters, const GPUPhysicsObject* objects, size_t object_count,
+                 const GPUPhysicsConstraint* constraints, size_t constraint_count);
+    void setWorldParameters(int world, const PhysicsWorldParameters& parameters);
+    int getWorldCount() const { return int(worlds.size()); }
+    const GPUPhysicsWorld& getWorld(int world) const { return worlds[world]; }
+
+    // Edits are queued and scattered into the buffers in one pass at the start of the next update,
+    // a later edit of the same field replaces an earlier one
+    void setObjectPosition(int index, const glm::vec4& position);
+    void setObjectVelocity(int index, const glm::vec4& velocity);
+    void setObjectAcceleration(int index, const glm::vec4& acceleration);
+    void setObjectMass(int index, float mass);
+    void setObjectRadius(int index, float radius);
+    // PhysicsObjectFlags without OBJECT_SLEEPING, which belongs to the island pass
+    void setObjectFlags(int index, uint32_t flags);
+    void setConstraintRestLength(int index, float rest_length);
+    void setConstraintStiffness(int index, float stiffness);
+    void setConstraintLambda(int index, float lambda);
+
     void update(float dt);
     void setIterations(int iterations);
+    // Balls collide through contact constraints (type 4) found by a uniform-grid broad phase every step
+    void setCollisionsEnabled(bool enabled);
+    // Grid cell size, 0 picks twice the largest radius added so far
+    void setContactCellSize(float cell_size) { contact_cell_size = cell_size; }
+    // Penalty a new contact starts from, contacts that persist keep theirs
+    void setContactStiffness(float stiffness) { contact_stiffness = stiffness; }
+    // Dual update, stiffness clamp, warm start and the adaptive iteration count. setIterations() sets the maximum,
+    // the iterations each step ran and its final residual come back with the stats
+    void setSolverParameters(const SolverParameters& parameters) { solver_parameters = parameters; }
+    const SolverParameters& getSolverParameters() const { return solver_parameters; }
+    // Islands and sleeping. Static objects and sleeping islands drop out of the per-color dispatches, which are
+    // compacted on the GPU every step, so a settled scene costs little more than its broad phase
+    void setSleepParameters(const SleepParameters& parameters) { sleep_parameters = parameters; }
+    const SleepParameters& getSleepParameters() const { return sleep_parameters; }
+    // Blocking read of every object, stalls until the GPU has finished all queued work
     std::vector<GPUPhysicsObject> getObjectsData();
+    std::vector<GPUPhysicsConstraint> getConstraintsData();
+    // Writes objects, constraints, the colored constraint graph and the solver state (snapshot.h), stalling
+    // like getObjectsData(). Removed elements are compacted away first. Contacts are not saved, they are found
+    // again on the next step
+    bool saveSnapshot(const char* path);
+    // Replaces the whole system with a snapshot: the file is mapped and every array uploaded from it in one
+    // transfer, with no recoloring. Handles given out before are invalidated. Errors go to stderr and leave
+    // the system unchanged
+    bool loadSnapshot(const char* path);
+    // Asynchronous readback: queue a copy of objects [first, first + count) after update() (count -1 reads to the end),
+    // then fetch the newest finished copy without waiting. Returns false until the first copy has finished
+    void requestObjectsReadback(int first = 0, int count = -1);
+    bool getLatestObjectsData(std::vector<GPUPhysicsObject>& data, int* first = nullptr, uint64_t* step = nullptr);
+    uint64_t getStepCount() const { return step_count; }
+    // Energy, momentum, bounds and constraint violation reduced on the GPU into one small buffer, read back
+    // through the same kind of ring as the objects. Potential energy is measured from reference_height
+    void requestStats(float reference_height = 0.0f);
+    bool getLatestStats(GPUPhysicsStats& stats, uint64_t* step = nullptr);
+    // Centre of mass, momentum, energy, bounds and constraint violation of every world in one dispatch and
+    // one small readback, indexed by world
+    void requestWorldStats();
+    bool getLatestWorldStats(std::vector<GPUWorldStats>& stats, uint64_t* step = nullptr);
     
+    // Holds getObjectStride() bytes per object, GPUPhysicsObject2D in 2D and GPUPhysicsObject in 3D
     GLuint getObjectDataBuffer() const { return object_data_buffer; }
+    int getDimensions() const { return dimensions; }
+    size_t getObjectStride() const { return object_stride; }
     GLuint getConstraintDataBuffer() const { return constraint_data_buffer; }
+    // GPUIslandState per object, kernels that change the scene behind the solver's back wake islands through it
+    GLuint getIslandBuffer() const { return island_buffer; }
+    // Contacts of the last step, up to getContactCapacity() of them
+    GLuint getContactDataBuffer() const { return contact_buffers[(contact_frame + 1) & 1]; }
+    int getContactCapacity() const { return contact_capacity; }
+    const ConstraintGraph& getConstraintGraph() const { return constraint_graph; }
     int getObjectCount() const { return object_count; }
     int getConstraintCount() const { return constraint_count; }
+    int getColorCount() const { return constraint_graph.getColorCount(); }
+    // Times update() on the CPU and each of its passes on the GPU, null turns profiling off
+    void setProfiler(GPUProfiler* profiler) { this->profiler = profiler; }
+    GPUProfiler* getProfiler() const { return profiler; }
+    // One compute shader from shaders/ by file name (shader_cache.h), built for 2 or 3 dimensions and cached
+    // on disk once linked. Errors go to stderr
+    static GLuint loadComputeShader(const std::string& name, int dimensions = 3);
+    // Shader source with physicsShaderPrelude(dimensions) inserted after its #version line
+    static std::string insertShaderPrelude(const std::string& source, int dimensions);
 
 private:
     GLuint object_compute_shader_program;
     GLuint constraint_compute_shader_program;
+    GLuint edit_compute_shader_program;
+    GLuint grid_count_compute_shader_program;
+    GLuint grid_scan_compute_shader_program;
+    GLuint grid_scatter_compute_shader_program;
+    GLuint contact_compute_shader_program;
+    GLuint dispatch_prep_compute_shader_program;
+    GLuint stats_compute_shader_program;
+    GLuint convergence_compute_shader_program;
+    GLuint world_stats_compute_shader_program;
+    GLuint activation_compute_shader_program;
+    GLuint island_compute_shader_program;
+    GLuint compact_compute_shader_program;
     GLuint object_data_buffer;
     GLuint constraint_data_buffer;
+    GLuint adjacency_offset_buffer;
+    GLuint adjacency_index_buffer;
+    GLuint color_order_buffer;
+    GLuint solver_state_buffer;
+    GLuint edit_buffer;
+    GLuint grid_buffer;
+    GLuint contact_buffers[2]; // this step's and last step's contacts, swapped every step
+    GLuint contact_list_buffers[2]; // per object: count, then max_contacts_per_object contact indices
+    GLuint header_buffer; // GPUPhysicsHeader, the counts the kernels read, then the awake objects per color
+    GLuint dispatch_buffer; // GPUDispatchIndirectCommand per PhysicsDispatch slot
+    GLuint stats_partial_buffer; // one GPUPhysicsStats per work group of the first reduction pass
+    GLuint stats_buffer; // GPUPhysicsStats
+    GLuint world_buffer; // GPUPhysicsWorld per world
+    GLuint world_stats_buffer; // GPUWorldStats per world
+    GLuint island_buffer; // GPUIslandState per object, also the awake objects of every color by color order slot
+    GLuint color_offset_buffer; // ConstraintGraph::getColorOffsets()
+    GLuint object_remap_buffer; // new index of every object during a compaction
+    GLuint constraint_remap_buffer;
+    size_t adjacency_offset_capacity;
+    size_t adjacency_index_capacity;
+    size_t color_order_capacity;
+    size_t edit_capacity;
+    size_t grid_capacity;
+    size_t world_capacity = 0; // bytes
+    size_t world_stats_capacity = 0; // bytes
+    size_t header_capacity = 0; // bytes
+    size_t color_offset_capacity = 0; // bytes
+    size_t dispatch_capacity = 0; // bytes
+    size_t object_remap_capacity = 0; // bytes
+    size_t constraint_remap_capacity = 0; // bytes
+    ConstraintGraph constraint_graph;
+    ReadbackRing object_readback;
+    ReadbackRing stats_readback;
+    ReadbackRing world_stats_readback;
+    uint64_t step_count = 0;
+    GPUProfiler* profiler = nullptr;
+
+    std::vector<GPUPhysicsWorld> worlds; // never empty, world 0 holds everything added before the first addWorld()
+    bool worlds_dirty = true;
+
+    HandleTable object_handles;
+    HandleTable constraint_handles;
+    std::vector<uint32_t> object_remap, constraint_remap;
+    float compaction_threshold = 0.25f;
+    uint64_t compaction_count = 0;
+
+    std::vector<GPUPhysicsEdit> pending_edits;
+    std::unordered_map<uint64_t, size_t> pending_edit_slots; // (field, index) -> slot in pending_edits
     
-    int max_objects;
-    int max_constraints;
+    int object_capacity;
+    int constraint_capacity;
     int iterations;
     int object_count;
     int constraint_count;
     int SCREEN_WIDTH, SCREEN_HEIGHT;
+    int dimensions;
+    bool supported;
+    size_t object_stride;       // bytes per object in object_data_buffer
+    size_t solver_state_stride; // bytes per object in solver_state_buffer, inertial, start and iteration position
+
+    bool collisions_enabled = false;
+    bool previous_contacts_valid = false;
+    int contact_capacity = 0;
+    int contact_list_capacity = 0; // objects
+    int contact_frame = 0;
+    float contact_cell_size = 0.0f;
+    float contact_stiffness = 1.0f;
+    SolverParameters solver_parameters;
+    SleepParameters sleep_parameters;
+    float max_radius = 0.0f;
     
     void setupBuffers();
-    GLuint loadComputeShader(const std::string compute_path);
+    void reserveContacts();
+    void findContacts();
+    void writeHeader(size_t offset, uint32_t value);
+    void prepareDispatch();
+    void dispatchIndirect(int slot); // PhysicsDispatch, or DISPATCH_COUNT + color
+    void uploadConstraintGraph();
+    void uploadColorBatches();
+    void initializeIslands(const GPUPhysicsObject* objects, int first, size_t count);
+    void activateObjects();
+    void findIslands(GLuint contact_buffer);
+    void removeConstraintAt(int index);
+    bool needsCompaction() const;
+    void uploadIndexBuffer(GLuint buffer, size_t& capacity, const uint32_t* data, size_t count, size_t first = 0);
+    void uploadBuffer(GLuint buffer, size_t& capacity_bytes, const void* data, size_t bytes, size_t first_byte = 0);
+    void growBuffer(GLuint& buffer, size_t used_bytes, size_t new_bytes);
+    void queueEdit(PhysicsEditField field, int index, const glm::vec4& value);
+    void applyEdits();
+    void uploadWorlds();
+    // Device objects [first, first + count) in the host layout, world taken from the world ranges in 2D
+    void unpackObjects(const void* device_objects, int first, size_t count, GPUPhysicsObject* objects) const;
 };
 
+// How GPURenderer2D draws bodies
+struct RenderParameters {
+    float outline_width = 1.5f; // pixels, 0 fills the circles
+    float point_radius = 1.0f;  // pixels, smaller bodies are drawn as single points
+};
+
+// Every body is one screen-aligned quad with an analytic circle, or a point once it is smaller than a pixel.
+// A compute pass (cull_compute_shader.glsl) lists the bodies and constraints on screen and counts them into
+// indirect draws, so nothing goes through the host and off-screen bodies cost no vertices.
+// Its lists sit at bindings 5-8, which update() rebinds for the solver every step
 class GPURenderer2D {
 public:
-    GPURenderer2D(int width, int height);
+    // dimensions must match the physics system whose object buffers are drawn
+    GPURenderer2D(int width, int height, int dimensions = 3);
     ~GPURenderer2D();
+    // False if the context is short of shader storage, the vertex shaders read it and OpenGL 4.3 only
+    // guarantees it to compute shaders. Draws then do nothing
+    bool isSupported() const { return supported; }
     
     void renderObjects(const GPUPhysicsSystem& physics_system);
     void renderConstraints(const GPUPhysicsSystem& physics_system);
+    // Draws object positions blended from previous_object_buffer (alpha 0) to object_buffer (alpha 1)
+    void renderObjects(GLuint object_buffer, GLuint previous_object_buffer, int object_count, float alpha);
+    void renderConstraints(GLuint object_buffer, GLuint previous_object_buffer, GLuint constraint_buffer, int constraint_count, float alpha);
+    void setRenderParameters(const RenderParameters& parameters) { render_parameters = parameters; }
+    const RenderParameters& getRenderParameters() const { return render_parameters; }
 
 private:
     GLuint render_object_program;
     GLuint render_constraint_program;
-    GLuint circle_template_vao, circle_template_vbo, dummy_vao;
+    GLuint cull_compute_program;
+    GLuint dummy_vao;
+    GLuint visible_object_buffer; // quads, then points from the object count
+    GLuint visible_constraint_buffer;
+    GLuint draw_command_buffer; // GPUDrawArraysIndirectCommand per RenderDraw
+    size_t visible_object_capacity = 0, visible_constraint_capacity = 0; // bytes
     glm::mat4 projection;
+    glm::vec2 viewport_size;
+    int dimensions;
+    bool supported;
+    RenderParameters render_parameters;
     
-    void setupInstancedRendering();
-    GLuint loadRenderShaders(const char* instanced_vertex_shader, const char* instanced_fragment_shader);
+    void setupBuffers();
+    void reserveBuffer(GLuint buffer, size_t& capacity_bytes, size_t bytes);
+    void resetDrawCommand(int draw, uint32_t vertex_count);
+    void cull(int pass, GLuint object_buffer, GLuint previous_object_buffer, int count, float alpha);
+    GLuint loadRenderShaders(const char* vertex_shader, const char* fragment_shader);
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "gpu_profiler.h"
+#include <algorithm>
+
+GPUProfiler::GPUProfiler(Profiler* profiler, int frame_latency)
+    : profiler(profiler), slots(std::max(frame_latency, 1)) {
+    for (FrameSlot& slot : slots) {
+        slot.query_pool.resize(queries_per_frame);
+        glGenQueries(queries_per_frame, slot.query_pool.data());
+    }
+}
+
+GPUProfiler::~GPUProfiler() {
+    for (FrameSlot& slot : slots) {
+        glDeleteQueries(GLsizei(slot.query_pool.size()), slot.query_pool.data());
+    }
+}
+
+void GPUProfiler::collect(FrameSlot& slot) {
+    if (!slot.ranges.empty()) {
+        // The last query is the newest, if it has landed all of them have
+        GLint available = 0;
+        glGetQueryObjectiv(slot.ranges.back().queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            for (const Range& range : slot.ranges) {
+                GLuint64 begin_ns = 0, end_ns = 0;
+                glGetQueryObjectui64v(range.queries[0], GL_QUERY_RESULT, &begin_ns);
+                glGetQueryObjectui64v(range.queries[1], GL_QUERY_RESULT, &end_ns);
+                double start_us = double(begin_ns) / 1000.0 + slot.clock_offset_us;
+                double duration_us = double(end_ns - begin_ns) / 1000.0;
+                profiler->record(range.name, "gpu", start_us, duration_us, Profiler::gpu_thread);
+            }
+        }
+        // Otherwise the GPU is more than frame_latency frames behind, drop the frame rather than wait
+    }
+    slot.ranges.clear();
+    slot.used_queries = 0;
+}
+
+void GPUProfiler::beginFrame() {
+    if (!profiler) return;
+
+    current_slot = (current_slot + 1) % int(slots.size());
+    FrameSlot& slot = slots[current_slot];
+    collect(slot);
+
+    GLint64 gpu_time_ns = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time_ns);
+    slot.clock_offset_us = profiler->now() - double(gpu_time_ns) / 1000.0;
+}
+
+int GPUProfiler::begin(const char* name) {
+    if (!profiler || !profiler->isEnabled() || current_slot < 0) return -1;
+
+    FrameSlot& slot = slots[current_slot];
+    if (slot.used_queries + 2 > int(slot.query_pool.size())) return -1;
+
+    Range range;
+    range.name = name;
+    range.queries[0] = slot.query_pool[slot.used_queries++];
+    range.queries[1] = slot.query_pool[slot.used_queries++];
+    glQueryCounter(range.queries[0], GL_TIMESTAMP);
+    slot.ranges.push_back(range);
+    return int(slot.ranges.size()) - 1;
+}
+
+void GPUProfiler::end(int range) {
+    if (range < 0) return;
+    glQueryCounter(slots[current_slot].ranges[range].queries[1], GL_TIMESTAMP);
+}
+
+GPUProfileScope::GPUProfileScope(GPUProfiler* profiler, const char* name)
+    : profiler(profiler), range(profiler ? profiler->begin(name) : -1) {
+}
+
+GPUProfileScope::~GPUProfileScope() {
+    if (profiler) profiler->end(range);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include <cstdint>
+#include "profiler.h"
+
+// GPU side of the profiler: each range is a pair of GL_TIMESTAMP queries, read back frame_latency
+// frames later so collecting never waits on the GPU. Finished ranges go into the Profiler under
+// the "gpu" category on their own trace track, shifted onto the CPU clock.
+class GPUProfiler {
+public:
+    GPUProfiler(Profiler* profiler, int frame_latency = 3);
+    ~GPUProfiler();
+
+    // Collects the ranges of the frame that used this slot frame_latency frames ago
+    void beginFrame();
+
+    // Returns the range id to pass to end(), -1 when disabled or out of queries
+    int begin(const char* name);
+    void end(int range);
+
+    Profiler* getProfiler() const { return profiler; }
+
+private:
+    struct Range {
+        const char* name;
+        GLuint queries[2];
+    };
+    struct FrameSlot {
+        std::vector<GLuint> query_pool;
+        std::vector<Range> ranges;
+        int used_queries = 0;
+        double clock_offset_us = 0.0; // CPU time minus GPU time when the frame began
+    };
+
+    Profiler* profiler;
+    std::vector<FrameSlot> slots;
+    int current_slot = -1;
+
+    static const int queries_per_frame = 256;
+
+    void collect(FrameSlot& slot);
+};
+
+// Times the GL commands issued between construction and destruction, nothing when profiler is null
+class GPUProfileScope {
+public:
+    GPUProfileScope(GPUProfiler* profiler, const char* name);
+    ~GPUProfileScope();
+
+    GPUProfileScope(const GPUProfileScope&) = delete;
+    GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+
+private:
+    GPUProfiler* profiler;
+    int range;
+};
@@ -0,0 +1,77 @@
+#include "handle_table.h"
+
+PhysicsHandle HandleTable::add() {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = uint32_t(slots.size());
+        slots.push_back({removed_index, 0});
+    }
+    slots[slot].index = uint32_t(owners.size());
+    owners.push_back(slot);
+
+    PhysicsHandle handle;
+    handle.slot = slot;
+    handle.generation = slots[slot].generation;
+    return handle;
+}
+
+bool HandleTable::remove(PhysicsHandle handle) {
+    int index = getIndex(handle);
+    if (index < 0) return false;
+
+    // The next handle from this slot gets a new generation, this one stops resolving
+    Slot& slot = slots[handle.slot];
+    slot.index = removed_index;
+    slot.generation++;
+    free_slots.push_back(handle.slot);
+    owners[index] = removed_index;
+    removed_count++;
+    return true;
+}
+
+int HandleTable::getIndex(PhysicsHandle handle) const {
+    if (handle.slot >= slots.size()) return -1;
+    const Slot& slot = slots[handle.slot];
+    if (slot.generation != handle.generation || slot.index == removed_index) return -1;
+    return int(slot.index);
+}
+
+PhysicsHandle HandleTable::getHandle(int index) const {
+    PhysicsHandle handle;
+    if (index < 0 || size_t(index) >= owners.size() || owners[index] == removed_index) return handle;
+    handle.slot = owners[index];
+    handle.generation = slots[handle.slot].generation;
+    return handle;
+}
+
+void HandleTable::compact(std::vector<uint32_t>& remap) {
+    remap.resize(owners.size());
+    uint32_t count = 0;
+    for (size_t i = 0; i < owners.size(); ++i) {
+        if (owners[i] == removed_index) {
+            remap[i] = removed_index;
+            continue;
+        }
+        // In order, so every element moves down or stays and the owners can be compacted in place
+        remap[i] = count;
+        slots[owners[i]].index = count;
+        owners[count++] = owners[i];
+    }
+    owners.resize(count);
+    removed_count = 0;
+}
+
+void HandleTable::clear() {
+    // Bumping every generation keeps old handles from resolving to the elements added next
+    free_slots.clear();
+    for (size_t slot = slots.size(); slot-- > 0;) {
+        if (slots[slot].index != removed_index) slots[slot].generation++;
+        slots[slot].index = removed_index;
+        free_slots.push_back(uint32_t(slot));
+    }
+    owners.clear();
+    removed_count = 0;
+}
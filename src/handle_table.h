@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "physics_types.h"
+
+// New index of a removed element in a compaction remap
+const uint32_t removed_index = 0xffffffffu;
+
+// Generational handles to the elements of an array that only appends and is compacted now and then.
+// A handle names a slot, the slot holds the element's current index and a generation that is bumped when the
+// element is removed, so a stale handle resolves to -1 instead of to whatever later moved into its place.
+// Removed elements keep their index until compact(). Freed slots are reused through a free list, so adding and
+// removing are O(1) and the table never grows past the most elements alive at once plus the removed ones
+class HandleTable {
+public:
+    // Handle of the element appended at index size()
+    PhysicsHandle add();
+    // Marks the element removed, false if the handle is stale
+    bool remove(PhysicsHandle handle);
+    // Current index of the element, -1 once it is removed
+    int getIndex(PhysicsHandle handle) const;
+    // Handle of the element at index, the default handle if it is removed
+    PhysicsHandle getHandle(int index) const;
+    bool isRemoved(int index) const { return owners[index] == removed_index; }
+
+    // Elements including the removed ones not yet compacted away
+    size_t size() const { return owners.size(); }
+    size_t getRemovedCount() const { return removed_count; }
+
+    // Drops the removed elements and keeps the order of the rest. remap[old index] is the new index, or
+    // removed_index for a removed element. Handles of the remaining elements follow them
+    void compact(std::vector<uint32_t>& remap);
+    // Forgets every element and invalidates every handle given out so far
+    void clear();
+
+private:
+    struct Slot {
+        uint32_t index;      // removed_index while the slot is free
+        uint32_t generation;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> owners; // slot of every element, removed_index once removed
+    size_t removed_count = 0;
+};
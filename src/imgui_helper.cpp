@@ -1,5 +1,7 @@
 #include "imgui_helper.h"
+#include "shader_cache.h"
 #include <algorithm>
+#include <iostream>
 #define IMPLOT_IMPLEMENTATION
 
 void ImguiHelper::Init(GLFWwindow* window) {
@@ -16,6 +18,10 @@ void ImguiHelper::Init(GLFWwindow* window) {
     // Setup Platform/Renderer backends
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 430");
+
+    kinetic_series = energy_history.addSeries("Total Kinetic Energy");
+    potential_series = energy_history.addSeries("Potential Energy");
+    total_series = energy_history.addSeries("Total Energy");
 }
 
 void ImguiHelper::NewFrame() {
@@ -30,92 +36,70 @@ void ImguiHelper::Render() {
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
-void ImguiHelper::AddElements(GPUPhysicsSystem* physics_system, std::vector<GPUPhysicsObject> physics_data, float dt) {
+void ImguiHelper::AddElements(SimulationThread* simulation, const SimulationFrame* frame, float dt) {
+    static const SimulationFrame empty_frame;
+    if (!frame) frame = &empty_frame;
+    const GPUPhysicsStats& stats = frame->stats;
+    const std::vector<GPUPhysicsObject>& physics_data = frame->inspected_objects;
+
     // Create ImGui window for physics tracking
     ImGui::Begin("Physics Object Tracker");
     
     ImGui::Text("Delta Time: %.3f ms", dt * 1000.0f);
     ImGui::Text("FPS: %.0f", 1/dt);
-    ImGui::Text("Number of Objects: %zu", physics_data.size());
+    ImGui::Text("Number of Objects: %d (%d slots)", frame->live_object_count, frame->object_count);
+    ImGui::Text("Simulation Step: %llu", (unsigned long long)frame->step);
+    ImGui::Text("Dropped Simulation Time: %.3f s", simulation->getDroppedSeconds());
+    ShaderCacheStats shader_stats = getShaderCacheStats();
+    ImGui::Text("Shaders: %d compiled in %.1f ms, %d from cache in %.1f ms", shader_stats.compiled_programs, shader_stats.compile_ms,
+                shader_stats.cached_programs, shader_stats.cache_ms);
     ImGui::Separator();
     
-    // Calculate total kinetic energy for this frame
-    float total_kinetic_energy = 0.0f;
-    float total_potential_energy = 0.0f;
-    for (const auto& obj : physics_data) {
-        total_potential_energy -= obj.mass * obj.acceleration.y * (obj.position.y - 300.0f);
-        total_kinetic_energy += 0.5f * obj.mass * 
-            (obj.velocity.x * obj.velocity.x + 
-             obj.velocity.y * obj.velocity.y + 
-             obj.velocity.z * obj.velocity.z);
-    }
+    // Totals for this frame, reduced on the GPU
+    float total_kinetic_energy = stats.kinetic_energy;
+    float total_potential_energy = stats.potential_energy;
     
     // Update history buffers
     static float accumulated_time = 0.0f;
     accumulated_time += dt;
-    
-    kinetic_energy_history.push_back(total_kinetic_energy);
-    potential_energy_history.push_back(total_potential_energy);
-    time_history.push_back(accumulated_time);
-
-    if (time_history.size() > max_history_points) {
-        // remove every second element from the history buffers
-        size_t j = 0;
-        for (size_t i = 0; i < time_history.size(); ++i) {
-            if (i % 2 != 0) { // Keep elements at odd indices (0-indexed)
-                time_history[j++] = time_history[i];
-            }
-        }
-        time_history.resize(j);
-        j = 0;
-        for (size_t i = 0; i < kinetic_energy_history.size(); ++i) {
-            if (i % 2 != 0) { // Keep elements at odd indices (0-indexed)
-                kinetic_energy_history[j++] = kinetic_energy_history[i];
-            }
-        }
-        kinetic_energy_history.resize(j);
-        j = 0;
-        for (size_t i = 0; i < potential_energy_history.size(); ++i) {
-            if (i % 2 != 0) { // Keep elements at odd indices (0-indexed)
-                potential_energy_history[j++] = potential_energy_history[i];
-            }
-        }
-        potential_energy_history.resize(j);
-    }
 
-    ImGui::Text("time: %zu", time_history.size());
+    float energies[3];
+    energies[kinetic_series] = total_kinetic_energy;
+    energies[potential_series] = total_potential_energy;
+    energies[total_series] = total_kinetic_energy + total_potential_energy;
+    energy_history.push(accumulated_time, energies);
+
+    ImGui::Text("time: %zu", energy_history.getSampleCount());
     
     // Display current kinetic energy
     ImGui::Text("Total Kinetic Energy: %.3f J", total_kinetic_energy);
     ImGui::Text("Total Potential Energy: %.3f J", total_potential_energy);
     ImGui::Text("Total Energy: %.3f J", total_kinetic_energy + total_potential_energy);
+    ImGui::Text("Momentum: (%.3f, %.3f, %.3f)", stats.momentum.x, stats.momentum.y, stats.momentum.z);
+    ImGui::Text("Bounds: (%.1f, %.1f) - (%.1f, %.1f)", stats.bounds_min.x, stats.bounds_min.y, stats.bounds_max.x, stats.bounds_max.y);
+    ImGui::Text("Max Constraint Violation: %.3f", stats.max_constraint_violation);
+    ImGui::Text("Solver Iterations: %u, Residual: %.4g", stats.solver_iterations, stats.solver_residual);
+    ImGui::Text("Sleeping Objects: %u / %u", stats.sleeping_count, stats.object_count);
     
     // Kinetic Energy Plot
     if (ImGui::CollapsingHeader("Kinetic Energy Graph", ImGuiTreeNodeFlags_DefaultOpen)) {
-        // Convert deques to vectors for plotting (since deques don't have .data())
-        std::vector<float> time_vec(time_history.begin(), time_history.end());
-        std::vector<float> kinetic_energy_vec(kinetic_energy_history.begin(), kinetic_energy_history.end());
-        std::vector<float> potential_energy_vec(potential_energy_history.begin(), potential_energy_history.end());
-        std::vector<float> total_energy(kinetic_energy_vec.size());
-        std::transform(kinetic_energy_vec.begin(), kinetic_energy_vec.end(), potential_energy_vec.begin(), total_energy.begin(), [](float a, float b) { return a + b; });
+        // Plot straight out of the history rings, at the finest level with at most a point per pixel
+        int level = energy_history.selectLevel(0.0f, std::max(int(ImGui::GetContentRegionAvail().x), 1));
+        float energy_low = 0.0f, energy_high = 0.0f;
+        energy_history.range(total_series, level, energy_low, energy_high);
         
         if (ImPlot::BeginPlot("Kinetic Energy Over Time")) {
             ImPlot::SetupAxes("Time (s)", "Energy (J)");
             ImPlot::SetupAxisLimits(ImAxis_X1, 0.0f, accumulated_time, ImGuiCond_Always);
-            ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0f, *std::max_element(total_energy.begin(), total_energy.end()), ImGuiCond_Always);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0f, energy_high, ImGuiCond_Always);
             
-            ImPlot::PlotLine("Total Kinetic Energy", 
-                            time_vec.data(), 
-                            kinetic_energy_vec.data(), 
-                            time_vec.size());
-            ImPlot::PlotLine("Potential Energy", 
-                            time_vec.data(), 
-                            potential_energy_vec.data(), 
-                            time_vec.size());
-            ImPlot::PlotLine("Total Energy", 
-                            time_vec.data(), 
-                            total_energy.data(), 
-                            time_vec.size());
+            for (int series = 0; series < energy_history.getSeriesCount(); ++series) {
+                TimeSeriesStore::View view = energy_history.view(series, level);
+                const char* name = energy_history.getName(series).c_str();
+                // Decimated levels draw the min and max envelope under one legend entry
+                ImPlot::PlotLine(name, view.time, view.min, view.count, 0, view.offset);
+                if (level > 0) ImPlot::PlotLine(name, view.time, view.max, view.count, 0, view.offset);
+            }
             
             ImPlot::EndPlot();
         }
@@ -129,8 +113,7 @@ void ImguiHelper::AddElements(GPUPhysicsSystem* physics_system, std::vector<GPUP
         
         ImGui::SameLine();
         if (ImGui::Button("Clear Data")) {
-            kinetic_energy_history.clear();
-            time_history.clear();
+            energy_history.clear();
             accumulated_time = 0.0f;
         }
     }
@@ -225,25 +208,132 @@ void ImguiHelper::AddElements(GPUPhysicsSystem* physics_system, std::vector<GPUP
     
     static int iterations = 1;
     if (ImGui::SliderInt("Iterations", &iterations, 1, 100)) {
-        physics_system->setIterations(iterations);
+        int value = iterations;
+        simulation->post([value](GPUPhysicsSystem& physics_system) { physics_system.setIterations(value); });
+    }
+
+    // Steps stop iterating once the largest position change is within tolerance, Iterations is the most they run
+    static int min_iterations = 1;
+    static float residual_tolerance = SolverParameters().residual_tolerance;
+    bool min_changed = ImGui::SliderInt("Min Iterations", &min_iterations, 1, 100);
+    bool tolerance_changed = ImGui::InputFloat("Residual Tolerance", &residual_tolerance, 0.001f, 0.01f, "%.4f");
+    if (min_changed || tolerance_changed) {
+        int min_value = min_iterations;
+        float tolerance_value = std::max(residual_tolerance, 0.0f);
+        simulation->post([min_value, tolerance_value](GPUPhysicsSystem& physics_system) {
+            SolverParameters parameters = physics_system.getSolverParameters();
+            parameters.min_iterations = min_value;
+            parameters.residual_tolerance = tolerance_value;
+            physics_system.setSolverParameters(parameters);
+        });
+    }
+
+    // Checkpoint of the whole simulation, taken and restored between two steps
+    if (ImGui::Button("Save Snapshot")) {
+        simulation->post([](GPUPhysicsSystem& physics_system) {
+            if (physics_system.saveSnapshot("enn_snapshot.bin")) std::cout << "Wrote snapshot enn_snapshot.bin" << std::endl;
+        });
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Snapshot")) {
+        simulation->post([](GPUPhysicsSystem& physics_system) { physics_system.loadSnapshot("enn_snapshot.bin"); });
+    }
+
+    // Every step's positions and velocities, compressed on a background thread
+    if (!frame->recording) {
+        if (ImGui::Button("Record Trajectory")) simulation->startRecording("enn_trajectory.bin");
+    } else {
+        if (ImGui::Button("Stop Recording")) simulation->stopRecording();
+        ImGui::SameLine();
+        ImGui::Text("%llu frames, %.1f MB, %llu stalls", (unsigned long long)frame->recorded_frames,
+                    frame->recorded_bytes / (1024.0 * 1024.0), (unsigned long long)frame->recording_stalls);
+    }
+
+    // Fixed simulation rate, independent of the frame rate
+    static int step_rate = 120;
+    if (ImGui::SliderInt("Step Rate (Hz)", &step_rate, 15, 480)) {
+        simulation->setStepSeconds(1.0 / step_rate);
+    }
+    static int substeps = 1;
+    if (ImGui::SliderInt("Substeps", &substeps, 1, 16)) {
+        simulation->setSubsteps(substeps);
+    }
+
+    static bool collisions = false;
+    if (ImGui::Checkbox("Collisions", &collisions)) {
+        bool value = collisions;
+        simulation->post([value](GPUPhysicsSystem& physics_system) { physics_system.setCollisionsEnabled(value); });
     }
     
     if (ImGui::Button("Reset Objects")) {
+        GPUPhysicsObject balls[3] = {};
         for (int i = 0; i < 3; ++i) {
-            GPUPhysicsObject ball = {};
-            ball.position = {400.0f + i * 50.0f, 300.0f + i * 30.0f, 0,0};
-            ball.velocity = {(i - 1) * 100.0f, (i - 1) * 80.0f, 0,0};
-            ball.acceleration = {0.0f, 300.0f, 0,0};
-            ball.mass = 1.0f + i * 0.5f;
-            physics_system->addObject(ball);
+            balls[i].position = {400.0f + i * 50.0f, 300.0f + i * 30.0f, 0,0};
+            balls[i].velocity = {(i - 1) * 100.0f, (i - 1) * 80.0f, 0,0};
+            balls[i].acceleration = {0.0f, 300.0f, 0,0};
+            balls[i].mass = 1.0f + i * 0.5f;
         }
+        // The balls of the last reset go, through their handles since compaction moves them
+        std::vector<GPUPhysicsObject> objects(balls, balls + 3);
+        std::shared_ptr<std::vector<PhysicsHandle>> handles = reset_handles;
+        simulation->post([objects, handles](GPUPhysicsSystem& physics_system) {
+            for (PhysicsHandle handle : *handles) physics_system.removeObject(handle);
+            handles->resize(objects.size());
+            physics_system.addObjects(objects.data(), objects.size(), handles->data());
+        });
     }
 
-    past_velocity = {physics_data[0].velocity.x, physics_data[0].velocity.y, physics_data[0].velocity.z};
+    if (!physics_data.empty()) {
+        past_velocity = {physics_data[0].velocity.x, physics_data[0].velocity.y, physics_data[0].velocity.z};
+    }
     
     ImGui::End();
 }
 
+void ImguiHelper::AddProfiler(Profiler& profiler) {
+    ImGui::Begin("Profiler");
+
+    bool enabled = profiler.isEnabled();
+    if (ImGui::Checkbox("Enabled", &enabled)) {
+        profiler.setEnabled(enabled);
+    }
+    ImGui::SameLine();
+    if (!profiler.isCapturing()) {
+        if (ImGui::Button("Start Capture")) profiler.setCapture(true);
+    } else {
+        if (ImGui::Button("Stop and Write Trace")) {
+            profiler.setCapture(false);
+            if (profiler.writeChromeTrace("enn_trace.json")) {
+                std::cout << "Wrote enn_trace.json, open it in chrome://tracing or ui.perfetto.dev" << std::endl;
+            }
+        }
+    }
+
+    // GPU times lag the CPU ones by a few frames, they are read back without waiting
+    if (ImGui::BeginTable("ProfilerStages", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthFixed, 150.0f);
+        ImGui::TableSetupColumn("Where", ImGuiTableColumnFlags_WidthFixed, 50.0f);
+        ImGui::TableSetupColumn("ms", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+        ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 50.0f);
+        ImGui::TableHeadersRow();
+
+        for (const Profiler::Stat& stat : profiler.getFrameStats()) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", stat.name);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%s", stat.category);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", stat.total_ms);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%d", stat.calls);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
 void ImguiHelper::Cleanup() {
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
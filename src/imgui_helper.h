@@ -7,22 +7,31 @@
 
 #include <vector>
 #include <string>
-#include <deque>
 #include <algorithm>
+#include <memory>
 
 #include "gpu_physics.h"
+#include "simulation_thread.h"
+#include "time_series.h"
+#include "profiler.h"
 
 class ImguiHelper {
 public:
     void Init(GLFWwindow* window);
     void NewFrame();
     void Render();
-    void AddElements(GPUPhysicsSystem* physics_system, std::vector<GPUPhysicsObject> physics_data, float dt);
+    // frame is the simulation's newest published frame, nullptr before the first. Its stats cover every object,
+    // its inspected objects are the few shown in the table. Controls are posted to the simulation thread
+    void AddElements(SimulationThread* simulation, const SimulationFrame* frame, float dt);
+    // Per-stage times of the last frame, and a button to capture frames into a Chrome trace
+    void AddProfiler(Profiler& profiler);
     void Cleanup();
 private:
     glm::vec3 past_velocity = {0.0f, 0.0f, 0.0f};
-    std::deque<float> kinetic_energy_history;
-    std::deque<float> potential_energy_history;
-    std::deque<float> time_history;
-    const size_t max_history_points = 10000;
+    TimeSeriesStore energy_history;
+    int kinetic_series = 0;
+    int potential_series = 0;
+    int total_series = 0;
+    // Balls added by "Reset Objects", only touched on the simulation thread
+    std::shared_ptr<std::vector<PhysicsHandle>> reset_handles = std::make_shared<std::vector<PhysicsHandle>>();
 };
\ No newline at end of file
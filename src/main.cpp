@@ -1,6 +1,9 @@
 #include "gpu_physics.h"
 #include "window.h"
 #include "imgui_helper.h"
+#include "profiler.h"
+#include "gpu_profiler.h"
+#include "simulation_thread.h"
 #include <chrono>
 #include <iostream>
 
@@ -24,91 +27,124 @@ int main() {
     std::cout << "Max compute work groups: " << work_group_count[0] << ", " 
               << work_group_count[1] << ", " << work_group_count[2] << std::endl;
     
-    // Initialize GPU physics system
-    GPUPhysicsSystem physics_system(100, 100, 10, SCREEN_WIDTH, SCREEN_HEIGHT); // Start with fewer objects for testing
-    GPURenderer2D renderer(SCREEN_WIDTH, SCREEN_HEIGHT);
+    // Everything in the demo is flat, physics and renderer use the compact 2D object layout
+    const int dimensions = 2;
+    GPURenderer2D renderer(SCREEN_WIDTH, SCREEN_HEIGHT, dimensions);
+    if (!renderer.isSupported()) return -1;
+
+    // Per-stage CPU and GPU timings, shown in the Profiler window
+    Profiler profiler;
+    GPUProfiler gpu_profiler(&profiler);
+
+    // Objects read back for the table in the ImGui window
+    const int inspected_object_count = 16;
+
+    // GPU physics runs on its own thread and context at a fixed 120 Hz, the loop below only draws its newest state
+    SimulationThread simulation(window, 1.0 / 120.0, 1, inspected_object_count, dimensions);
+    simulation.setReferenceHeight(300.0f);
     
-    // Create some balls
-    GPUPhysicsObject ball = {};
-    ball.position = {SCREEN_WIDTH/2+SCREEN_HEIGHT/4, SCREEN_HEIGHT/2, 0.0f, 0.0f};
-    ball.velocity = {0.0f, 0.0f, 0.0f, 0.0f};
-    ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
-    ball.mass = 1.0f;
-    ball.radius = 20.0f;
+    simulation.start([](GPUPhysicsSystem& physics_system) {
+        // Create some balls
+        GPUPhysicsObject ball = {};
+        ball.position = {SCREEN_WIDTH/2+SCREEN_HEIGHT/4, SCREEN_HEIGHT/2, 0.0f, 0.0f};
+        ball.velocity = {0.0f, 0.0f, 0.0f, 0.0f};
+        ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
+        ball.mass = 1.0f;
+        ball.radius = 20.0f;
     
-    physics_system.addObject(ball);
-
-    ball = {};
-    ball.position = {SCREEN_WIDTH/2.0f, 3.0f*SCREEN_HEIGHT/4.0f, 0.0f, 0.0f};
-    ball.velocity = {1.0f, 0.0f, 0.0f, 0.0f};
-    ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
-    ball.mass = 1.0f;
-    ball.radius = 20.0f;
+        physics_system.addObject(ball);
+
+        ball = {};
+        ball.position = {SCREEN_WIDTH/2.0f, 3.0f*SCREEN_HEIGHT/4.0f, 0.0f, 0.0f};
+        ball.velocity = {1.0f, 0.0f, 0.0f, 0.0f};
+        ball.acceleration = {0.0f, -100.0f, 0.0f, 0.0f}; // gravity
+        ball.mass = 1.0f;
+        ball.radius = 20.0f;
     
-    physics_system.addObject(ball);
-
-    // Ball showing correct path
-    ball = {};
-    ball.position = {SCREEN_WIDTH/2, SCREEN_HEIGHT/2, 0.0f, 0.0f};
-    ball.velocity = {0.0f, 0.0f, 0.0f, 0.0f};
-    ball.acceleration = {0.0f, 0.0f, 0.0f, 0.0f}; // gravity
-    ball.mass = 1.0f;
-    ball.radius = SCREEN_HEIGHT/4.0f;
+        physics_system.addObject(ball);
+
+        // Ball showing correct path
+        ball = {};
+        ball.position = {SCREEN_WIDTH/2, SCREEN_HEIGHT/2, 0.0f, 0.0f};
+        ball.velocity = {0.0f, 0.0f, 0.0f, 0.0f};
+        ball.acceleration = {0.0f, 0.0f, 0.0f, 0.0f}; // gravity
+        ball.mass = 1.0f;
+        ball.radius = SCREEN_HEIGHT/4.0f;
+        ball.flags = OBJECT_STATIC;
     
-    physics_system.addObject(ball);
-
-    for (int i = 0; i < physics_system.getObjectCount(); i++) {
-        GPUPhysicsConstraint constraint = {};
-        constraint.type = 0;
-        constraint.indexA = 2;
-        constraint.indexB = i;
-        constraint.restLength = SCREEN_HEIGHT/4.0f;
-        constraint.stiffness = 1.0f;
+        physics_system.addObject(ball);
+
+        std::vector<GPUPhysicsConstraint> constraints;
+        for (int i = 0; i < physics_system.getObjectCount(); i++) {
+            if (i == 2) continue; // the anchor, a constraint to itself is violated by its whole rest length
+            GPUPhysicsConstraint constraint = {};
+            constraint.type = 0;
+            constraint.indexA = 2;
+            constraint.indexB = i;
+            constraint.restLength = SCREEN_HEIGHT/4.0f;
+            constraint.stiffness = 1.0f;
         
-        physics_system.addConstraint(constraint);   
-    }
+            constraints.push_back(constraint);
+        }
+        physics_system.addConstraints(constraints.data(), constraints.size());
+    }, &profiler);
     
     auto last_time = std::chrono::high_resolution_clock::now();
-
-    // Storage for physics data read back from GPU
-    std::vector<GPUPhysicsObject> physics_data;
     
-    while (!window.shouldClose()) {
+    // The simulation thread gives up on a context short of what the kernels need
+    while (!window.shouldClose() && !simulation.hasFailed()) {
         window.pollEvents();
 
+        profiler.beginFrame();
+        gpu_profiler.beginFrame();
+        double frame_start = profiler.now();
+
         imgui.NewFrame();
 
-        // Calculate delta time
+        // Frame time, only for display now that the simulation keeps its own clock
         auto current_time = std::chrono::high_resolution_clock::now();
-        // float dt = 0.5f;
         float dt = std::chrono::duration<float>(current_time - last_time).count();
         last_time = current_time;
-        
-        // Cap delta time to avoid large jumps
-        dt = std::min(dt, 0.033f); // ~30fps minimum
-        
-        // Update physics on GPU
-        physics_system.update(dt);
 
-        // Read back physics data for ImGui display
-        physics_data = physics_system.getObjectsData();
+        // Newest state published by the simulation thread, with its stats and inspected objects
+        const SimulationFrame* frame = simulation.acquireFrame();
 
         // Add elements to ImGui window
-        imgui.AddElements(&physics_system, physics_data, dt);
+        imgui.AddElements(&simulation, frame, dt);
+        imgui.AddProfiler(profiler);
         
-        // Render directly from GPU buffers
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        renderer.renderObjects(physics_system);
-        renderer.renderConstraints(physics_system);
+        // Render the published state, one step behind and blended between its last two steps
+        {
+            ProfileScope scope(&profiler, "render");
+            GPUProfileScope gpu_scope(&gpu_profiler, "render");
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            if (frame) {
+                float alpha = simulation.getAlpha(*frame);
+                renderer.renderObjects(frame->object_buffer, frame->previous_object_buffer, frame->object_count, alpha);
+                renderer.renderConstraints(frame->object_buffer, frame->previous_object_buffer, frame->constraint_buffer, frame->constraint_count, alpha);
+            }
+        }
+        simulation.releaseFrame();
 
-        imgui.Render();
+        {
+            ProfileScope scope(&profiler, "imgui");
+            GPUProfileScope gpu_scope(&gpu_profiler, "imgui");
+            imgui.Render();
+        }
         
-        window.swapBuffers();
+        {
+            ProfileScope scope(&profiler, "swap");
+            window.swapBuffers();
+        }
         window.pollEvents();
+
+        profiler.record("frame", "cpu", frame_start, profiler.now() - frame_start, profiler.threadIndex());
+        profiler.endFrame();
     }
 
+    simulation.stop();
     imgui.Cleanup();
     
-    return 0;
+    return simulation.hasFailed() ? -1 : 0;
 }
\ No newline at end of file
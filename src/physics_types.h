@@ -0,0 +1,322 @@
+#pragma once
+#include "../vendor/glm/glm/glm.hpp"
+#include <cstdint>
+#include <string>
+
+// GPU-aligned struct (std430 layout)
+struct GPUPhysicsObject {
+    glm::vec4 position;     // 16 bytes
+    glm::vec4 velocity;     // 16 bytes
+    glm::vec4 acceleration; // 16 bytes
+    float mass;             // 4 bytes
+    float radius;           // 4 bytes
+    uint32_t world;         // 4 bytes, index into the world buffer, set by GPUPhysicsSystem::addObjects
+    uint32_t flags;         // 4 bytes, PhysicsObjectFlags
+}; // 64 bytes it must be a multiple of 16 bytes
+
+// How an object moves, zero is an ordinary dynamic object
+enum PhysicsObjectFlags {
+    OBJECT_STATIC = 1,    // never moves, the solver treats it as an anchor
+    OBJECT_KINEMATIC = 2, // follows its own velocity, nothing pushes it back
+    OBJECT_SLEEPING = 4,  // set and cleared by the island pass (SleepParameters), objects added with it start asleep
+    OBJECT_REMOVED = 8,   // set by removeObject() together with OBJECT_STATIC, the slot is dropped at the next compaction
+};
+
+// Stable name of an object or constraint (HandleTable). Indices move when removed elements are compacted away,
+// a handle follows its element and stops resolving once the element is removed. The default handle never resolves
+struct PhysicsHandle {
+    uint32_t slot = 0xffffffffu;
+    uint32_t generation = 0;
+};
+
+// Compact layout of a system built for 2 dimensions (std430 layout), what the device buffers hold in place
+// of GPUPhysicsObject. The host API keeps using GPUPhysicsObject, z is dropped on the way in and zero on the
+// way out. There is no world field, the shaders find it from the index (objectWorld() in the prelude below)
+struct GPUPhysicsObject2D {
+    glm::vec2 position;     // 8 bytes
+    glm::vec2 velocity;     // 8 bytes
+    glm::vec2 acceleration; // 8 bytes
+    float mass;             // 4 bytes
+    float radius;           // 4 bytes
+    uint32_t flags;         // 4 bytes, PhysicsObjectFlags
+    uint32_t _pad;          // 4 bytes, std430 rounds the struct up to its 8-byte vec2 alignment
+}; // 40 bytes
+static_assert(sizeof(GPUPhysicsObject2D) == 40, "GPUPhysicsObject2D must match the std430 PhysicsObject of the 2D shaders");
+static_assert(sizeof(GPUPhysicsObject) == 64, "GPUPhysicsObject must match the std430 PhysicsObject of the 3D shaders");
+
+inline GPUPhysicsObject2D toObject2D(const GPUPhysicsObject& object) {
+    GPUPhysicsObject2D compact;
+    compact.position = glm::vec2(object.position.x, object.position.y);
+    compact.velocity = glm::vec2(object.velocity.x, object.velocity.y);
+    compact.acceleration = glm::vec2(object.acceleration.x, object.acceleration.y);
+    compact.mass = object.mass;
+    compact.radius = object.radius;
+    compact.flags = object.flags;
+    compact._pad = 0;
+    return compact;
+}
+
+inline GPUPhysicsObject toObject3D(const GPUPhysicsObject2D& compact, uint32_t world) {
+    GPUPhysicsObject object = {};
+    object.position = glm::vec4(compact.position, 0.0f, 1.0f);
+    object.velocity = glm::vec4(compact.velocity, 0.0f, 0.0f);
+    object.acceleration = glm::vec4(compact.acceleration, 0.0f, 0.0f);
+    object.mass = compact.mass;
+    object.radius = compact.radius;
+    object.world = world;
+    object.flags = compact.flags;
+    return object;
+}
+
+// GLSL definition of the object layout and the worlds for 2 or 3 dimensions, inserted after the #version line
+// of every shader (GPUPhysicsSystem::loadComputeShader). Kernels only touch object vectors through the macros,
+// so one source compiles for both layouts:
+//   vecD / matD             the solver's vector and Hessian types, vec2 / mat2 or vec3 / mat3
+//   toVecD(v), toVec3(v)    a stored vector (or any vec4) as vecD, or as vec3 with z = 0 in 2D
+//   toObjectVector(v, w)    a vecD or vec4 in the stored layout, w is only kept in 3D
+//   objectWorld(index)      world of an object, stored in 3D and found by binary search over the
+//                           contiguous world ranges in 2D
+// and the PhysicsObjectFlags as OBJECT_* constants, and CONSTRAINT_REMOVED
+inline const char* physicsShaderPrelude(int dimensions) {
+    static const char* const world_glsl =
+        "const uint OBJECT_STATIC = 1u;\n"
+        "const uint OBJECT_KINEMATIC = 2u;\n"
+        "const uint OBJECT_SLEEPING = 4u;\n"
+        "const uint OBJECT_REMOVED = 8u;\n"
+        "const int CONSTRAINT_REMOVED = -1;\n"
+        "struct World {\n"
+        "    vec4 gravity;\n"
+        "    uint object_offset;\n"
+        "    uint object_count;\n"
+        "    uint constraint_offset;\n"
+        "    uint constraint_count;\n"
+        "    float dt; // 0 uses u_deltaTime\n"
+        "    int iterations; // 0 runs every iteration\n"
+        "};\n"
+        "layout(std430, binding = 3) restrict readonly buffer WorldBuffer {\n"
+        "    World worlds[];\n"
+        "};\n";
+    static const std::string prelude_2d = std::string(
+        "#define DIMENSION 2\n"
+        "#define vecD vec2\n"
+        "#define matD mat2\n"
+        "#define ObjectVector vec2\n"
+        "#define toVecD(v) ((v).xy)\n"
+        "#define toVec3(v) vec3((v).xy, 0.0)\n"
+        "#define toObjectVector(v, w) ((v).xy)\n"
+        "struct PhysicsObject {\n"
+        "    vec2 position;\n"
+        "    vec2 velocity;\n"
+        "    vec2 acceleration;\n"
+        "    float mass;\n"
+        "    float radius;\n"
+        "    uint flags;\n"
+        "};\n") + world_glsl +
+        "uint objectWorld(uint index) {\n"
+        "    uint low = 0, high = uint(worlds.length());\n"
+        "    while (high - low > 1) {\n"
+        "        uint middle = (low + high) / 2;\n"
+        "        if (worlds[middle].object_offset <= index) low = middle; else high = middle;\n"
+        "    }\n"
+        "    return low;\n"
+        "}\n";
+    static const std::string prelude_3d = std::string(
+        "#define DIMENSION 3\n"
+        "#define vecD vec3\n"
+        "#define matD mat3\n"
+        "#define ObjectVector vec4\n"
+        "#define toVecD(v) ((v).xyz)\n"
+        "#define toVec3(v) ((v).xyz)\n"
+        "#define toObjectVector(v, w) vec4((v).xyz, (w))\n"
+        "struct PhysicsObject {\n"
+        "    vec4 position;\n"
+        "    vec4 velocity;\n"
+        "    vec4 acceleration;\n"
+        "    float mass;\n"
+        "    float radius;\n"
+        "    uint world;\n"
+        "    uint flags;\n"
+        "};\n") + world_glsl +
+        "#define objectWorld(index) objects[index].world\n";
+    return dimensions == 2 ? prelude_2d.c_str() : prelude_3d.c_str();
+}
+
+struct GPUPhysicsConstraint {
+    int type;       // 0 for distance, 1 for hard, 2 for angle, 3 for volume, 4 for contact
+    int indexA;
+    int indexB;
+    float restLength;
+    float stiffness; // material stiffness, the cap of a soft constraint's penalty
+    float lambda; // λ_j^(n)
+    float penalty; // k_j^(n), ramped by the solver, see SolverParameters
+    float stabilization; // αC_j(x^t) of a contact while warm starting, else 0
+    // Could also add min/max bounds for inequality constraints
+}; // 32 bytes
+
+// Contacts are generated every step by the broad/narrow phase, C = distance - (radiusA + radiusB) only pushes
+const int CONSTRAINT_CONTACT = 4;
+// Type of a constraint removed by removeConstraint(), skipped by every pass until the next compaction
+const int CONSTRAINT_REMOVED = -1;
+
+// Dual update and warm start of the augmented Lagrangian (AVBD Eq. 11, 12 and 19). The solver works with the
+// constraint's penalty k, its stiffness is the material value and is never written by the solver.
+// Every iteration hard constraints and contacts update λ ← kC + λ, and every constraint ramps k ← min(k + β|C|, k_cap).
+// Contacts only push: their λ and force are clamped to at most 0, and k stops ramping while λ is 0.
+// At the start of a step the values carried over are scaled: λ ← αγλ, k ← clamp(γk, k_min, k_cap).
+// k_cap is k_max for hard constraints and contacts, min(stiffness, k_max) for soft ones.
+// While warm starting, contacts solve C(x) - αC(x^t): a step only corrects 1 - α of the overlap it starts with,
+// so a large penalty cannot throw overlapping objects apart in one step. Joints are left without it, on a
+// stretched chain it only leaves the error to later steps
+struct SolverParameters {
+    float alpha = 0.99f;
+    float gamma = 0.99f;
+    float beta = 1.0e5f; // AVBD's default, smaller ramps leave hard constraints soft for many steps and their λ winds up
+    float stiffness_min = 1.0f;
+    float stiffness_max = 1.0e6f;
+    bool warm_start = true; // false restarts every step from λ = 0, k = min(stiffness_min, k_cap)
+
+    // Adaptive iteration count: a step stops once the largest |Δx| of an iteration is at most residual_tolerance,
+    // after at least min_iterations. The iteration count set on the system is the maximum, a tolerance of 0
+    // always runs all of them
+    int min_iterations = 1;
+    float residual_tolerance = 0.01f;
+};
+
+// Islands are the objects joined by constraints and contacts, static and kinematic objects join none. Every
+// island_interval steps the islands are found again, and one whose objects have all stayed at or below
+// sleep_energy (kinetic energy per unit mass, ½|v|²) for sleep_time seconds goes to sleep: its objects stop
+// moving and drop out of the solve. A sleeping island wakes as a whole when an awake object touches it,
+// through a contact or a constraint, or when one of its objects or constraints is edited
+struct SleepParameters {
+    bool enabled = true;
+    int island_interval = 10; // steps
+    float sleep_energy = 0.5f;
+    float sleep_time = 0.5f;  // seconds
+};
+
+// Per-object bookkeeping of the island pass (IslandBuffer, binding 4)
+struct GPUIslandState {
+    uint32_t label;     // parent while islands are merged, then the island's root object
+    float rest_time;    // seconds the object has been at or below the sleep energy
+    uint32_t min_rest;  // float bits, on the root: smallest rest_time of the island
+    uint32_t wake;      // on the root: set when something touched the island this step
+    uint32_t active_object; // slot i of the awake objects sorted by color, not object i
+    uint32_t color;         // of object i the last time it was awake, same-color contact partners read a snapshot
+}; // 24 bytes
+
+// Per-world settings of a batched system, see GPUPhysicsSystem::addWorld. Zero dt and iterations use the
+// values of the whole system
+struct PhysicsWorldParameters {
+    glm::vec3 gravity = glm::vec3(0.0f); // added to the acceleration of every object in the world
+    float dt = 0.0f;
+    int iterations = 0; // at most the system's iteration count
+};
+
+// One world of a batched system (WorldBuffer, binding 3). Its objects and constraints are contiguous ranges
+// of the shared buffers, constraints only connect objects of the same world and contacts are never made
+// between worlds
+struct GPUPhysicsWorld {
+    glm::vec4 gravity; // w unused
+    uint32_t object_offset;
+    uint32_t object_count;
+    uint32_t constraint_offset;
+    uint32_t constraint_count;
+    float dt;
+    int32_t iterations;
+    uint32_t _pad[2];
+}; // 48 bytes
+
+// Per-world reduction for fitness evaluation (WorldStatsBuffer, binding 5 of world_stats_compute_shader.glsl), one work group per world
+struct GPUWorldStats {
+    glm::vec4 centre_of_mass; // Σ m x / Σ m, w is the total mass
+    glm::vec4 momentum;       // Σ m v, w unused
+    glm::vec4 bounds_min;     // bounding box of the object centres, w unused
+    glm::vec4 bounds_max;
+    float kinetic_energy;
+    float max_constraint_violation;
+    uint32_t object_count;
+    uint32_t _pad;
+}; // 80 bytes
+
+// Field written by a queued edit, see GPUPhysicsSystem::setObject* / setConstraint*
+enum PhysicsEditField {
+    EDIT_OBJECT_POSITION = 0,
+    EDIT_OBJECT_VELOCITY = 1,
+    EDIT_OBJECT_ACCELERATION = 2,
+    EDIT_OBJECT_MASS = 3,
+    EDIT_OBJECT_RADIUS = 4,
+    EDIT_CONSTRAINT_REST_LENGTH = 5,
+    EDIT_CONSTRAINT_STIFFNESS = 6,
+    EDIT_CONSTRAINT_LAMBDA = 7,
+    EDIT_OBJECT_FLAGS = 8,
+    EDIT_CONSTRAINT_TYPE = 9,
+};
+
+struct GPUPhysicsEdit {
+    int field;       // PhysicsEditField
+    int index;       // object or constraint index
+    glm::vec2 _pad;
+    glm::vec4 value; // vectors use xyzw, scalars use x
+}; // 32 bytes
+
+// Counts the kernels read instead of uniforms (PhysicsHeaderBuffer, binding 2),
+// so work created on the GPU never has to round-trip through the host. The buffer continues with one awake
+// object count per color, filled by activation_compute_shader.glsl
+struct GPUPhysicsHeader {
+    uint32_t object_count;
+    uint32_t constraint_count;
+    uint32_t contact_count;    // written by the narrow phase, clamped to contact_capacity
+    uint32_t contact_overflow; // 1 when contacts were dropped this step
+    uint32_t contact_capacity;
+    uint32_t solver_converged;  // set by the convergence pass, the remaining iterations of the step do nothing
+    uint32_t solver_iterations; // iterations run this step
+    float solver_residual;      // largest |Δx| of the last iteration run, atomicMax'd as uint bits
+}; // 32 bytes
+
+// Layout of glDispatchComputeIndirect arguments
+struct GPUDispatchIndirectCommand {
+    uint32_t num_groups_x;
+    uint32_t num_groups_y;
+    uint32_t num_groups_z;
+}; // 12 bytes
+
+// Slots in the dispatch buffer, filled by dispatch_prep_compute_shader.glsl from the header
+enum PhysicsDispatch {
+    DISPATCH_OBJECTS = 0,
+    DISPATCH_CONSTRAINTS = 1,
+    DISPATCH_CONTACTS = 2,
+    DISPATCH_SOLVE_CONSTRAINTS = 3, // copies of the two above the convergence pass zeroes once a step has converged
+    DISPATCH_SOLVE_CONTACTS = 4,
+    DISPATCH_COUNT = 5, // followed by one slot per color, the awake objects of the color (activation_compute_shader.glsl)
+};
+
+// Layout of glDrawArraysIndirect arguments
+struct GPUDrawArraysIndirectCommand {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first;
+    uint32_t base_instance;
+}; // 16 bytes
+
+// Slots in the renderer's draw buffer, instance counts filled by cull_compute_shader.glsl
+enum RenderDraw {
+    DRAW_QUADS = 0,       // one SDF quad per body (object_vertex_shader.glsl)
+    DRAW_POINTS = 1,      // one point per body smaller than RenderParameters::point_radius
+    DRAW_CONSTRAINTS = 2, // one line per constraint with an endpoint on screen
+    DRAW_COUNT = 3,
+};
+
+// Whole-system diagnostics, reduced on the device (StatsBuffer, binding 6 of stats_compute_shader.glsl) or by CPUPhysicsSystem::computeStats
+struct GPUPhysicsStats {
+    glm::vec4 momentum;   // Σ m v, w unused
+    glm::vec4 bounds_min; // bounding box of the object centres, w unused
+    glm::vec4 bounds_max;
+    float kinetic_energy;   // Σ ½ m |v|²
+    float potential_energy; // -Σ m a.y (y - reference height)
+    float max_constraint_violation; // max |distance - rest length| over the constraints
+    uint32_t object_count;
+    uint32_t solver_iterations; // iterations the last step ran
+    float solver_residual;      // largest |Δx| of its last iteration
+    uint32_t sleeping_count;    // objects of sleeping islands
+    uint32_t _pad;
+}; // 80 bytes
@@ -0,0 +1,102 @@
+#include "profiler.h"
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+
+Profiler::Profiler() : origin(std::chrono::steady_clock::now()) {
+}
+
+double Profiler::now() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Profiler::accumulate(std::vector<Stat>& stats, const char* name, const char* category, double ms) {
+    for (Stat& stat : stats) {
+        if ((stat.name == name || std::strcmp(stat.name, name) == 0) && std::strcmp(stat.category, category) == 0) {
+            stat.total_ms += ms;
+            stat.calls++;
+            return;
+        }
+    }
+    stats.push_back({name, category, ms, 1});
+}
+
+void Profiler::record(const char* name, const char* category, double start_us, double duration_us, int thread) {
+    if (!enabled) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    accumulate(current_frame, name, category, duration_us / 1000.0);
+    accumulate(totals, name, category, duration_us / 1000.0);
+    if (capturing && events.size() < max_events) {
+        events.push_back({name, category, start_us, duration_us, thread});
+    }
+}
+
+int Profiler::threadIndex() {
+    std::thread::id id = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        if (threads[i] == id) return int(i);
+    }
+    threads.push_back(id);
+    return int(threads.size()) - 1;
+}
+
+void Profiler::beginFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    current_frame.clear();
+}
+
+void Profiler::endFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    last_frame = current_frame;
+    frame_count++;
+}
+
+void Profiler::setCapture(bool capture) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capture && !capturing) events.clear();
+    capturing = capture;
+}
+
+std::vector<Profiler::Stat> Profiler::getFrameStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return last_frame;
+}
+
+std::vector<Profiler::Stat> Profiler::getTotalStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Could not write trace " << path << std::endl;
+        return false;
+    }
+
+    // Complete events ("ph":"X"), one process, CPU threads and the GPU as separate tracks
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", gpu_thread);
+    for (const Event& event : events) {
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                     event.name, event.category, event.start_us, event.duration_us, event.thread);
+    }
+    std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    std::fclose(file);
+    return true;
+}
+
+ProfileScope::ProfileScope(Profiler* profiler, const char* name)
+    : profiler(profiler && profiler->isEnabled() ? profiler : nullptr), name(name), start(0.0) {
+    if (this->profiler) start = this->profiler->now();
+}
+
+ProfileScope::~ProfileScope() {
+    if (!profiler) return;
+    double end = profiler->now();
+    profiler->record(name, "cpu", start, end - start, profiler->threadIndex());
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+// Collects named time ranges per frame, from RAII CPU scopes here and GPU timer queries (gpu_profiler.h).
+// Keeps per-name totals of the last finished frame and of the whole run, and while capturing
+// also every range so it can be written as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Needs no GL context, so headless runs can be profiled.
+class Profiler {
+public:
+    Profiler();
+
+    struct Stat {
+        const char* name;     // string literal, compared by pointer first
+        const char* category; // "cpu" or "gpu"
+        double total_ms;
+        int calls;
+    };
+
+    void beginFrame();
+    void endFrame();
+
+    // Microseconds since the profiler was created
+    double now() const;
+    // name and category must outlive the profiler, string literals in practice
+    void record(const char* name, const char* category, double start_us, double duration_us, int thread);
+    // Small stable index for the calling thread, the trace's tid
+    int threadIndex();
+
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+    void setCapture(bool capture);
+    bool isCapturing() const { return capturing; }
+    bool writeChromeTrace(const std::string& path);
+
+    std::vector<Stat> getFrameStats();
+    std::vector<Stat> getTotalStats();
+    uint64_t getFrameCount() const { return frame_count; }
+
+    // Thread index used for GPU ranges in the trace
+    static const int gpu_thread = 1000;
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        double start_us;
+        double duration_us;
+        int thread;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+    bool enabled = true;
+    bool capturing = false;
+    uint64_t frame_count = 0;
+    std::vector<Stat> current_frame, last_frame, totals;
+    std::vector<Event> events; // while capturing, up to max_events
+    std::vector<std::thread::id> threads;
+
+    static const size_t max_events = 1 << 22;
+
+    static void accumulate(std::vector<Stat>& stats, const char* name, const char* category, double ms);
+};
+
+// Records the time between construction and destruction on the calling thread, nothing when profiler is null
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const char* name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* profiler;
+    const char* name;
+    double start;
+};
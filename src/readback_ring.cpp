@@ -0,0 +1,137 @@
+#include "readback_ring.h"
+#include <cstring>
+
+ReadbackRing::ReadbackRing(int slot_count, bool in_order)
+    : slots(slot_count > 1 ? slot_count : 2), persistent(GLEW_ARB_buffer_storage != 0), in_order(in_order) {
+    for (Slot& slot : slots) glGenBuffers(1, &slot.buffer);
+}
+
+ReadbackRing::~ReadbackRing() {
+    for (Slot& slot : slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (persistent && slot.mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void ReadbackRing::reserve(Slot& slot, size_t size) {
+    if (size <= slot.capacity) return;
+
+    // Immutable storage can't be resized, so a larger slot is a new buffer
+    size_t capacity = size > slot.capacity * 2 ? size : slot.capacity * 2;
+    if (persistent && slot.mapped) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glDeleteBuffers(1, &slot.buffer);
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+
+    if (persistent) {
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+        slot.mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slot.capacity = capacity;
+}
+
+bool ReadbackRing::enqueue(GLuint source, size_t offset, size_t size, uint64_t frame) {
+    poll();
+    if (size == 0) return false;
+
+    Slot& slot = slots[next_slot];
+    if (slot.fence) return false; // the GPU is more than slot_count frames behind, skip rather than wait
+    if (in_order && slot.unread) return false;
+    slot.unread = false;
+    if (next_slot == newest_ready) newest_ready = -1;
+
+    reserve(slot, size);
+    slot.size = size;
+    slot.offset = offset;
+    slot.frame = frame;
+
+    // Shader writes to source have to land before the copy reads it
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    next_slot = (next_slot + 1) % int(slots.size());
+    return true;
+}
+
+void ReadbackRing::poll() {
+    // Slots complete in submission order, walk them oldest first
+    for (size_t n = 0; n < slots.size(); ++n) {
+        int index = (next_slot + int(n)) % int(slots.size());
+        Slot& slot = slots[index];
+        if (!slot.fence) continue;
+
+        // Zero timeout, only asks whether the fence has signalled
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.unread = true;
+        newest_ready = index;
+
+        // Without persistent mapping the copy has finished, so this map doesn't wait either
+        if (!persistent) {
+            slot.fallback.resize(slot.size);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+            if (data) {
+                std::memcpy(slot.fallback.data(), data, slot.size);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            slot.mapped = slot.fallback.data();
+        }
+    }
+}
+
+const void* ReadbackRing::latest(size_t* size, uint64_t* frame, size_t* offset) {
+    poll();
+    if (newest_ready < 0) return nullptr;
+
+    const Slot& slot = slots[newest_ready];
+    if (size) *size = slot.size;
+    if (frame) *frame = slot.frame;
+    if (offset) *offset = slot.offset;
+    return slot.mapped;
+}
+
+const void* ReadbackRing::next(size_t* size, uint64_t* frame, size_t* offset, bool wait) {
+    poll();
+
+    // next_slot is the oldest submission, the first unread or pending slot from there on is the one to hand out
+    for (size_t n = 0; n < slots.size(); ++n) {
+        Slot& slot = slots[(next_slot + int(n)) % int(slots.size())];
+        if (!slot.unread && !slot.fence) continue;
+
+        if (slot.fence) {
+            if (!wait) return nullptr;
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            poll();
+            if (slot.fence) return nullptr; // still not done after a second
+        }
+
+        slot.unread = false;
+        if (size) *size = slot.size;
+        if (frame) *frame = slot.frame;
+        if (offset) *offset = slot.offset;
+        return slot.mapped;
+    }
+    return nullptr;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Ring of staging buffers for reading GPU buffers back without stalling.
+// enqueue() records a GPU-side copy into the next slot plus a fence, latest() hands out the newest
+// copy whose fence has signalled and never waits. Slots are persistently mapped (glBufferStorage)
+// when ARB_buffer_storage is available, otherwise mapped once the copy has finished.
+// An in_order ring is for consumers that need every copy (recording): enqueue() never reuses a slot
+// that next() hasn't handed out yet, and next() returns the copies oldest first.
+class ReadbackRing {
+public:
+    ReadbackRing(int slot_count = 3, bool in_order = false);
+    ~ReadbackRing();
+
+    // Copies size bytes at offset of source into the next slot, tagged with a caller-chosen frame number.
+    // Returns false, dropping the request, if that slot is still waiting on the GPU
+    bool enqueue(GLuint source, size_t offset, size_t size, uint64_t frame);
+
+    // Newest finished copy, nullptr if none has finished yet. The pointer stays valid until
+    // the slot comes round again, slot_count - 1 enqueues later
+    const void* latest(size_t* size = nullptr, uint64_t* frame = nullptr, size_t* offset = nullptr);
+
+    // Oldest finished copy not handed out yet, nullptr if there is none. With wait it blocks on the oldest
+    // outstanding copy instead, nullptr then means nothing is in flight. Valid until the next enqueue()
+    const void* next(size_t* size = nullptr, uint64_t* frame = nullptr, size_t* offset = nullptr, bool wait = false);
+
+private:
+    struct Slot {
+        GLuint buffer = 0;
+        void* mapped = nullptr; // persistent mapping, or the copy taken after the fence
+        size_t capacity = 0;
+        size_t size = 0;
+        size_t offset = 0;
+        uint64_t frame = 0;
+        GLsync fence = nullptr;
+        bool unread = false; // finished but not returned by next()
+        std::vector<unsigned char> fallback; // mapped copy without ARB_buffer_storage
+    };
+
+    std::vector<Slot> slots;
+    int next_slot = 0;
+    int newest_ready = -1;
+    bool persistent;
+    bool in_order;
+
+    void reserve(Slot& slot, size_t size);
+    void poll();
+};
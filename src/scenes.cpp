@@ -0,0 +1,171 @@
+#include "scenes.h"
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+static const float scene_gravity = -100.0f;
+static const float anchor_mass = 1000.0f;
+
+static GPUPhysicsObject makeBall(float x, float y, float mass, float radius, bool gravity) {
+    GPUPhysicsObject ball = {};
+    ball.position = {x, y, 0.0f, 0.0f};
+    ball.acceleration = {0.0f, gravity ? scene_gravity : 0.0f, 0.0f, 0.0f};
+    ball.mass = mass;
+    ball.radius = radius;
+    return ball;
+}
+
+static void addSpring(Scene& scene, int a, int b) {
+    glm::vec4 delta = scene.objects[a].position - scene.objects[b].position;
+    GPUPhysicsConstraint constraint = {};
+    constraint.type = 0;
+    constraint.indexA = a;
+    constraint.indexB = b;
+    constraint.restLength = std::sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+    constraint.stiffness = 1.0f;
+    scene.constraints.push_back(constraint);
+}
+
+Scene makeRopeScene(int segment_count, float segment_length) {
+    Scene scene;
+    scene.name = "rope";
+    segment_count = std::max(segment_count, 1);
+    scene.objects.reserve(segment_count + 1);
+    scene.constraints.reserve(segment_count);
+
+    // Laid out horizontally so it swings down from the anchor
+    scene.objects.push_back(makeBall(0.0f, 1000.0f, anchor_mass, segment_length * 0.5f, false));
+    scene.objects.back().flags = OBJECT_STATIC;
+    for (int i = 1; i <= segment_count; ++i) {
+        scene.objects.push_back(makeBall(i * segment_length, 1000.0f, 1.0f, segment_length * 0.5f, true));
+        addSpring(scene, i - 1, i);
+    }
+    return scene;
+}
+
+Scene makeClothScene(int width, int height, float spacing) {
+    Scene scene;
+    scene.name = "cloth";
+    width = std::max(width, 2);
+    height = std::max(height, 2);
+    scene.objects.reserve(size_t(width) * height);
+    scene.constraints.reserve(size_t(width) * height * 4);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            bool anchor = y == 0;
+            scene.objects.push_back(makeBall(x * spacing, 1000.0f - y * spacing, anchor ? anchor_mass : 1.0f, spacing * 0.5f, !anchor));
+            if (anchor) scene.objects.back().flags = OBJECT_STATIC;
+        }
+    }
+
+    auto index = [width](int x, int y) { return y * width + x; };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (x + 1 < width) addSpring(scene, index(x, y), index(x + 1, y));
+            if (y + 1 < height) addSpring(scene, index(x, y), index(x, y + 1));
+            if (x + 1 < width && y + 1 < height) {
+                addSpring(scene, index(x, y), index(x + 1, y + 1));
+                addSpring(scene, index(x + 1, y), index(x, y + 1));
+            }
+        }
+    }
+    return scene;
+}
+
+Scene makeSpringNetworkScene(int object_count, int constraint_count, uint32_t seed) {
+    Scene scene;
+    scene.name = "springs";
+    object_count = std::max(object_count, 2);
+    scene.objects.reserve(object_count);
+    scene.constraints.reserve(constraint_count);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x_dist(0.0f, 1600.0f);
+    std::uniform_real_distribution<float> y_dist(0.0f, 1200.0f);
+    std::uniform_int_distribution<int> index_dist(0, object_count - 1);
+
+    for (int i = 0; i < object_count; ++i) {
+        scene.objects.push_back(makeBall(x_dist(rng), y_dist(rng), 1.0f, 2.0f, true));
+    }
+    for (int i = 0; i < constraint_count; ++i) {
+        int a = index_dist(rng);
+        int b = index_dist(rng);
+        if (a == b) b = (b + 1) % object_count;
+        addSpring(scene, a, b);
+    }
+    return scene;
+}
+
+Scene makeBallPileScene(int ball_count, float radius, uint32_t seed) {
+    Scene scene;
+    scene.name = "balls";
+    scene.collisions = true;
+    scene.objects.reserve(ball_count);
+
+    // Square-ish column packed at 1.6 radii so neighbours start overlapping
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> jitter(-0.1f * radius, 0.1f * radius);
+    int columns = std::max(1, int(std::sqrt(float(ball_count))));
+    float spacing = 1.6f * radius;
+    for (int i = 0; i < ball_count; ++i) {
+        float x = (i % columns) * spacing + jitter(rng);
+        float y = (i / columns) * spacing + jitter(rng);
+        scene.objects.push_back(makeBall(x, y, 1.0f, radius, true));
+    }
+    return scene;
+}
+
+Scene makeCreatureScene(int creature_count, int segment_count, float segment_length) {
+    Scene scene;
+    scene.name = "creatures";
+    creature_count = std::max(creature_count, 1);
+    segment_count = std::max(segment_count, 1);
+    scene.body_object_count = 2 * (segment_count + 1);
+    scene.body_constraint_count = 4 * segment_count + 1;
+    scene.objects.reserve(size_t(creature_count) * scene.body_object_count);
+    scene.constraints.reserve(size_t(creature_count) * scene.body_constraint_count);
+
+    // Square-ish grid of creatures with a body length of room between them
+    int columns = std::max(1, int(std::sqrt(float(creature_count))));
+    float spacing = 2.0f * segment_count * segment_length;
+    for (int c = 0; c < creature_count; ++c) {
+        int first = int(scene.objects.size());
+        float origin_x = (c % columns) * spacing;
+        float origin_y = (c / columns) * spacing;
+        for (int i = 0; i <= segment_count; ++i) {
+            scene.objects.push_back(makeBall(origin_x + i * segment_length, origin_y, 1.0f, segment_length * 0.25f, false));
+            scene.objects.push_back(makeBall(origin_x + i * segment_length, origin_y + segment_length, 1.0f, segment_length * 0.25f, false));
+        }
+        // Rails, rungs and one diagonal per cell, the same order for every creature
+        addSpring(scene, first, first + 1);
+        for (int i = 0; i < segment_count; ++i) {
+            int a = first + 2 * i;
+            addSpring(scene, a, a + 2);
+            addSpring(scene, a + 1, a + 3);
+            addSpring(scene, a + 2, a + 3);
+            addSpring(scene, a, a + 3);
+        }
+    }
+    return scene;
+}
+
+bool makeScene(const std::string& name, int object_count, Scene& scene, uint32_t seed) {
+    if (name == "rope") {
+        scene = makeRopeScene(object_count - 1);
+    } else if (name == "cloth") {
+        int side = std::max(2, int(std::sqrt(float(object_count))));
+        scene = makeClothScene(side, side);
+    } else if (name == "springs") {
+        // Two springs per object, an average degree of four
+        scene = makeSpringNetworkScene(object_count, object_count * 2, seed);
+    } else if (name == "balls") {
+        scene = makeBallPileScene(object_count, 2.0f, seed);
+    } else if (name == "creatures") {
+        // Ten objects per creature
+        scene = makeCreatureScene(std::max(object_count / 10, 1));
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "physics_types.h"
+
+// Procedural scenes for benchmarks and tests, usable with either backend through addObjects/addConstraints.
+// Positions are in the demo's screen units with gravity along -y. Anchors are OBJECT_STATIC, like the centre
+// ball of the demo.
+struct Scene {
+    std::string name;
+    std::vector<GPUPhysicsObject> objects;
+    std::vector<GPUPhysicsConstraint> constraints;
+    bool collisions = false; // the scene relies on ball-ball contacts
+    // Creatures scene: every creature has the same body, body_object_count objects and body_constraint_count
+    // constraints laid out one creature after another
+    int body_object_count = 0;
+    int body_constraint_count = 0;
+};
+
+// Chain of segment_count + 1 objects hanging off a heavy anchor, one spring per link
+Scene makeRopeScene(int segment_count, float segment_length = 4.0f);
+// width x height grid hanging off a heavy top row, structural and shear springs
+Scene makeClothScene(int width, int height, float spacing = 4.0f);
+// Random springs between random objects, every spring starts at rest
+Scene makeSpringNetworkScene(int object_count, int constraint_count, uint32_t seed = 1234);
+// Overlapping column of balls with no constraints, only does work with collisions on
+Scene makeBallPileScene(int ball_count, float radius = 2.0f, uint32_t seed = 1234);
+// creature_count ladder-shaped bodies of segment_count cells floating without gravity, every spring a muscle
+// for a controller (controller.h) to drive
+Scene makeCreatureScene(int creature_count, int segment_count = 4, float segment_length = 8.0f);
+
+// Scene by name ("rope", "cloth", "springs", "balls", "creatures") with about object_count objects.
+// Returns false for an unknown name
+bool makeScene(const std::string& name, int object_count, Scene& scene, uint32_t seed = 1234);
@@ -0,0 +1,212 @@
+#include "shader_cache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static std::string shader_source_directory;
+static std::string shader_cache_directory = "shader_cache";
+static std::mutex stats_mutex;
+static ShaderCacheStats stats;
+
+void setShaderSourceDirectory(const std::string& directory) { shader_source_directory = directory; }
+void setShaderCacheDirectory(const std::string& directory) { shader_cache_directory = directory; }
+const std::string& getShaderCacheDirectory() { return shader_cache_directory; }
+
+ShaderCacheStats getShaderCacheStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
+
+std::string loadShaderSource(const std::string& name) {
+    if (!shader_source_directory.empty()) {
+        std::ifstream file(shader_source_directory + "/" + name);
+        if (file) return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::cerr << "Could not read shader " << shader_source_directory << "/" << name << std::endl;
+        return std::string();
+    }
+    for (size_t i = 0; i < embedded_shader_count; ++i) {
+        if (name == embedded_shaders[i].name) {
+            return std::string(reinterpret_cast<const char*>(embedded_shaders[i].source), embedded_shaders[i].size);
+        }
+    }
+    std::cerr << "No embedded shader " << name << std::endl;
+    return std::string();
+}
+
+// FNV-1a, 64 bits
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char* text) {
+    // The terminator too, so "ab" + "c" and "a" + "bc" differ
+    return text ? hashBytes(hash, text, std::strlen(text) + 1) : hashBytes(hash, "", 1);
+}
+
+// Binaries only load on the driver that wrote them, so the driver is part of the key
+static uint64_t programKey(const ShaderStage* stages, size_t stage_count) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    for (size_t i = 0; i < stage_count; ++i) {
+        hash = hashBytes(hash, &stages[i].type, sizeof(stages[i].type));
+        hash = hashString(hash, stages[i].source.c_str());
+    }
+    return hash;
+}
+
+static bool linked(GLuint program) {
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+static GLuint loadCachedProgram(const std::string& path, uint64_t key) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return 0;
+
+    ProgramCacheHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return 0;
+    if (std::memcmp(header.magic, program_cache_magic, sizeof(header.magic)) != 0 || header.version != program_cache_version ||
+        header.key != key || header.binary_bytes == 0) {
+        return 0;
+    }
+    std::vector<char> binary(header.binary_bytes);
+    if (!file.read(binary.data(), std::streamsize(binary.size()))) return 0;
+
+    // A driver update can reject a binary it wrote, the caller compiles the program again
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binary_format, binary.data(), GLsizei(binary.size()));
+    if (!linked(program)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void saveCachedProgram(GLuint program, const std::string& path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, program_cache_magic, sizeof(header.magic));
+    header.version = program_cache_version;
+    header.key = key;
+    std::vector<char> binary(size_t(length), 0);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0) return;
+    header.binary_format = format;
+    header.binary_bytes = uint64_t(length);
+
+    // Written aside and renamed into place, so processes starting together never read half a file
+    std::error_code error;
+    std::filesystem::create_directories(shader_cache_directory, error);
+    std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                                                        uint64_t(std::chrono::steady_clock::now().time_since_epoch().count())) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file) return;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), std::streamsize(header.binary_bytes));
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Could not write shader cache " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+static GLuint compileProgram(const ShaderStage* stages, size_t stage_count, bool retrievable) {
+    GLuint program = glCreateProgram();
+    std::vector<GLuint> shaders;
+    bool compiled = true;
+    int success;
+    char info_log[512];
+
+    for (size_t i = 0; i < stage_count; ++i) {
+        const char* source = stages[i].source.c_str();
+        GLuint shader = glCreateShader(stages[i].type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        // Check compilation
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, 512, nullptr, info_log);
+            std::cerr << "Shader " << stages[i].name << " compilation failed: " << info_log << std::endl;
+            compiled = false;
+        }
+        glAttachShader(program, shader);
+        shaders.push_back(shader);
+    }
+
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    if (compiled) glLinkProgram(program);
+
+    // Check linking
+    if (!compiled || !linked(program)) {
+        if (compiled) {
+            glGetProgramInfoLog(program, 512, nullptr, info_log);
+            std::cerr << "Shader program " << stages[0].name << " linking failed: " << info_log << std::endl;
+        }
+        glDeleteProgram(program);
+        program = 0;
+    }
+
+    for (GLuint shader : shaders) glDeleteShader(shader);
+    return program;
+}
+
+GLuint buildProgram(const ShaderStage* stages, size_t stage_count) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Drivers without a binary format have nothing to cache
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    std::string path;
+    uint64_t key = 0;
+    if (!shader_cache_directory.empty() && format_count > 0) {
+        key = programKey(stages, stage_count);
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        path = shader_cache_directory + "/" + name;
+    }
+
+    GLuint program = path.empty() ? 0 : loadCachedProgram(path, key);
+    bool cached = program != 0;
+    if (!cached) {
+        program = compileProgram(stages, stage_count, !path.empty());
+        if (program && !path.empty()) saveCachedProgram(program, path, key);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    if (cached) {
+        stats.cached_programs++;
+        stats.cache_ms += ms;
+    } else {
+        stats.compiled_programs++;
+        stats.compile_ms += ms;
+    }
+    return program;
+}
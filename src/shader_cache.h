@@ -0,0 +1,57 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// GLSL sources compiled into the binary, generated from shaders/*.glsl by cmake/embed_shaders.cmake
+struct EmbeddedShader {
+    const char* name; // file name in shaders/
+    const unsigned char* source;
+    size_t size;
+};
+extern const EmbeddedShader embedded_shaders[];
+extern const size_t embedded_shader_count;
+
+// Source of a shader by file name, from the embedded copies or from setShaderSourceDirectory().
+// Empty, with a message on stderr, if there is no such shader
+std::string loadShaderSource(const std::string& name);
+// Reads shaders from this directory instead of the embedded copies, for editing them without a rebuild.
+// Empty goes back to the embedded copies
+void setShaderSourceDirectory(const std::string& directory);
+
+// Linked programs are cached on disk as driver binaries (glGetProgramBinary). There is one file per hash of
+// the stage sources and the driver's vendor, renderer and version. The prelude's dimensions are part of the
+// source, so every variant gets its own entry. Entries the driver rejects are compiled again and replaced.
+// The directory defaults to shader_cache under the working directory, empty turns the cache off
+const char program_cache_magic[8] = {'E', 'N', 'N', 'P', 'R', 'O', 'G', '\0'};
+const uint32_t program_cache_version = 1;
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binary_format; // from glGetProgramBinary
+    uint64_t key;           // same hash as the file name
+    uint64_t binary_bytes;
+};
+
+void setShaderCacheDirectory(const std::string& directory);
+const std::string& getShaderCacheDirectory();
+
+struct ShaderStage {
+    GLenum type;        // GL_COMPUTE_SHADER, GL_VERTEX_SHADER, ...
+    std::string source; // with the prelude already inserted
+    std::string name;   // for error messages
+};
+
+// Compiles and links a program, or loads it from the cache. 0 if it does not compile or link, the log goes to stderr
+GLuint buildProgram(const ShaderStage* stages, size_t stage_count);
+
+// Where the programs built so far came from and how long they took, cold starts compile, warm starts load
+struct ShaderCacheStats {
+    int compiled_programs = 0;
+    int cached_programs = 0;
+    double compile_ms = 0.0;
+    double cache_ms = 0.0;
+};
+ShaderCacheStats getShaderCacheStats();
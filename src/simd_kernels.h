@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Instruction sets the CPU kernels are built for, ENN_SIMD picks which of them the build compiles
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,   // AVX2 and FMA
+    SIMD_AVX512 = 2, // AVX-512F
+};
+
+// Widest kernel both compiled in and supported by this CPU, detected once. The rest of enn_core is built for
+// the baseline instruction set, so the same binary runs scalar on CPUs without AVX2
+SimdLevel getSimdLevel();
+const char* simdLevelName(SimdLevel level);
+int simdLevelWidth(SimdLevel level);
+
+// The kernel sources are built for wider instruction sets than the rest of enn_core, so they take raw arrays and
+// counts: nothing they include may define an inline function (std::vector, class accessors, glm) that the linker
+// could keep in its AVX build for every caller. soa_solver.cpp and controller.cpp fill these from the SoA state
+struct SimdObjectArrays {
+    float* x;
+    float* y;
+    float* z;
+    const float* inertial_x;
+    const float* inertial_y;
+    const float* inertial_z;
+    const float* vel_x;
+    const float* vel_y;
+    const float* vel_z;
+    const float* mass;
+};
+
+struct SimdConstraintArrays {
+    const int32_t* type;
+    const int32_t* index_a;
+    const int32_t* index_b;
+    const float* rest_length;
+    const float* lambda;
+    const float* penalty;
+    const float* stabilization;
+};
+
+// A constraint set and its per-object CSR adjacency, see SoAConstraintView
+struct SimdConstraintSet {
+    SimdConstraintArrays constraints;
+    const uint32_t* offsets;
+    const uint32_t* indices;
+};
+
+// A ControllerPopulation and its topology, see controller.h
+struct SimdControllerArrays {
+    const float* weights;
+    size_t stride;
+    size_t controller_count;
+    const uint32_t* object_offsets;
+    const uint32_t* constraint_offsets;
+    const uint32_t* sensor_objects;
+    int sensor_count;
+    const uint32_t* sensor_constraints;
+    int strain_count;
+    const uint32_t* actuators;
+    const float* actuator_rest_lengths;
+    int actuator_count;
+    int input_count;
+    int hidden_count;
+    float actuator_range;
+    float position_scale;
+    float velocity_scale;
+    float clock_frequency;
+};
+
+// Constraint types the kernels branch on, soa_solver.cpp checks them against physics_types.h
+const int32_t SIMD_CONSTRAINT_HARD = 1;
+const int32_t SIMD_CONSTRAINT_CONTACT = 4;
+
+// One instantiation of the kernels in simd_kernels_impl.h per instruction set, only call those getSimdLevel() allows.
+// See solveObjectsSoA and evaluateControllersSoA for what they do. The controllers write the actuators' rest lengths
+// to rest_length, scratch holds (input_count + hidden_count) * 16 floats
+float solveObjectsScalar(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                         const uint32_t* order, size_t count, float dt, int dimensions);
+float solveObjectsAvx2(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                       const uint32_t* order, size_t count, float dt, int dimensions);
+float solveObjectsAvx512(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                         const uint32_t* order, size_t count, float dt, int dimensions);
+void evaluateControllersScalar(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                               float* rest_length, size_t first, size_t count, float time, float* scratch);
+void evaluateControllersAvx2(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                             float* rest_length, size_t first, size_t count, float time, float* scratch);
+void evaluateControllersAvx512(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                               float* rest_length, size_t first, size_t count, float time, float* scratch);
@@ -0,0 +1,15 @@
+#include "simd_kernels_impl.h"
+
+// Compiled with -mavx512f (/arch:AVX512) when ENN_SIMD enables it, empty otherwise
+#if defined(__AVX512F__)
+float solveObjectsAvx512(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                         const uint32_t* order, size_t count, float dt, int dimensions) {
+    if (dimensions == 2) return solveObjects<Avx512Lanes, 2>(objects, sets, set_count, order, count, dt);
+    return solveObjects<Avx512Lanes, 3>(objects, sets, set_count, order, count, dt);
+}
+
+void evaluateControllersAvx512(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                               float* rest_length, size_t first, size_t count, float time, float* scratch) {
+    evaluateControllers<Avx512Lanes>(controllers, objects, constraints, rest_length, first, count, time, scratch);
+}
+#endif
@@ -0,0 +1,289 @@
+#pragma once
+#include <math.h>
+#include "simd_lanes.h"
+#include "simd_kernels.h"
+
+// The CPU kernels, written once over a lane traits struct (simd_lanes.h) and instantiated by
+// simd_kernels_scalar.cpp, simd_kernels_avx2.cpp and simd_kernels_avx512.cpp, each built for its own instruction set.
+// Keep them free of library code the other sources share: an inline function emitted here is compiled for the wider
+// instruction set and the linker may keep that copy for every caller, hence the raw arrays of simd_kernels.h, the
+// C math functions and the scratch the caller allocates. The lane structs are in an anonymous namespace for the same reason.
+
+template <class S>
+struct LaneAccumulator {
+    typename S::F fx, fy, fz;
+    typename S::F hxx, hxy, hxz, hyy, hyz, hzz;
+};
+
+// 12. Every lane walks its own adjacency range in one constraint set, lanes with fewer constraints idle.
+// With D = 2 the z terms are never computed, they stay zero in the accumulator
+template <class S, int D>
+static void accumulateConstraints(LaneAccumulator<S>& acc, const SimdObjectArrays& objects, const SimdConstraintSet& set,
+                                  typename S::I index, typename S::M active,
+                                  typename S::F px, typename S::F py, typename S::F pz) {
+    using F = typename S::F;
+    using I = typename S::I;
+    using M = typename S::M;
+
+    const SimdConstraintArrays& constraints = set.constraints;
+    const int32_t* offsets = reinterpret_cast<const int32_t*>(set.offsets);
+    const int32_t* indices = reinterpret_cast<const int32_t*>(set.indices);
+    const F zero = S::set1(0.0f);
+    const F one = S::set1(1.0f);
+    const F epsilon = S::set1(1e-6f);
+    const I one_i = S::set1i(1);
+    const I hard_i = S::set1i(SIMD_CONSTRAINT_HARD);
+    const I contact_i = S::set1i(SIMD_CONSTRAINT_CONTACT);
+
+    I adjacency = S::gatheri(offsets, index, active);
+    I adjacency_end = S::gatheri(offsets, S::addi(index, one_i), active);
+    for (;;) {
+        M m = S::andm(active, S::lti(adjacency, adjacency_end));
+        if (!S::any(m)) break;
+
+        I k = S::gatheri(indices, adjacency, m);
+        I a = S::gatheri(constraints.index_a, k, m);
+        I b = S::gatheri(constraints.index_b, k, m);
+        I other = S::selecti(S::eqi(a, index), b, a);
+
+        // direction of the constraint δCⱼ/δxⱼ
+        F dx = S::sub(px, S::gather(objects.x, other, m));
+        F dy = S::sub(py, S::gather(objects.y, other, m));
+        F dz = zero;
+        if constexpr (D == 3) dz = S::sub(pz, S::gather(objects.z, other, m));
+        F length = S::sqrt(D == 3 ? S::fmadd(dx, dx, S::fmadd(dy, dy, S::mul(dz, dz))) : S::fmadd(dx, dx, S::mul(dy, dy)));
+        M valid = S::gt(length, epsilon);
+        F inv_length = S::div(one, S::select(valid, length, one));
+        F gx = S::select(valid, S::mul(dx, inv_length), zero);
+        F gy = S::select(valid, S::mul(dy, inv_length), one);
+        F gz = D == 3 ? S::select(valid, S::mul(dz, inv_length), zero) : zero;
+
+        F distance = S::sub(length, S::add(S::gather(constraints.rest_length, k, m), S::gather(constraints.stabilization, k, m)));
+        I type = S::gatheri(constraints.type, k, m);
+
+        // 13./15. hard constraints and contacts add the dual variable, soft constraints don't
+        F stiffness = S::select(m, S::gather(constraints.penalty, k, m), zero);
+        M hard = S::andm(m, S::orm(S::eqi(type, hard_i), S::eqi(type, contact_i)));
+        F constraint_force = S::fmadd(stiffness, distance, S::gather(constraints.lambda, k, hard));
+        // Clamped like λ, a contact only pushes. Its stiffness stays in the Hessian while it is released
+        M released = S::andm(S::eqi(type, contact_i), S::notm(S::gt(zero, constraint_force)));
+        constraint_force = S::select(S::andm(m, S::notm(released)), constraint_force, zero);
+        acc.fx = S::sub(acc.fx, S::mul(constraint_force, gx));
+        acc.fy = S::sub(acc.fy, S::mul(constraint_force, gy));
+
+        // 18. Hessian += k ∇C ∇Cᵀ (stiffness is zero on idle lanes)
+        F kgx = S::mul(stiffness, gx), kgy = S::mul(stiffness, gy);
+        acc.hxx = S::fmadd(kgx, gx, acc.hxx);
+        acc.hxy = S::fmadd(kgx, gy, acc.hxy);
+        acc.hyy = S::fmadd(kgy, gy, acc.hyy);
+
+        // Geometric stiffness f/|d| (I - ∇C ∇Cᵀ) of stretched constraints. Compressed ones would make the
+        // Hessian indefinite and are left out. Without it stiff chains overshoot sideways and blow up
+        F tension = S::select(S::gt(constraint_force, zero), S::mul(constraint_force, inv_length), zero);
+        F tgx = S::mul(tension, gx), tgy = S::mul(tension, gy);
+        acc.hxx = S::add(acc.hxx, S::sub(tension, S::mul(tgx, gx)));
+        acc.hyy = S::add(acc.hyy, S::sub(tension, S::mul(tgy, gy)));
+        acc.hxy = S::sub(acc.hxy, S::mul(tgx, gy));
+
+        if constexpr (D == 3) {
+            acc.fz = S::sub(acc.fz, S::mul(constraint_force, gz));
+            F kgz = S::mul(stiffness, gz), tgz = S::mul(tension, gz);
+            acc.hxz = S::fmadd(kgx, gz, acc.hxz);
+            acc.hyz = S::fmadd(kgy, gz, acc.hyz);
+            acc.hzz = S::fmadd(kgz, gz, acc.hzz);
+            acc.hzz = S::add(acc.hzz, S::sub(tension, S::mul(tgz, gz)));
+            acc.hxz = S::sub(acc.hxz, S::mul(tgx, gz));
+            acc.hyz = S::sub(acc.hyz, S::mul(tgy, gz));
+        }
+
+        adjacency = S::addi(adjacency, one_i);
+    }
+}
+
+template <class S, int D>
+static float solveObjects(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                         const uint32_t* order, size_t count, float dt) {
+    using F = typename S::F;
+    using I = typename S::I;
+    using M = typename S::M;
+
+    const F zero = S::set1(0.0f);
+    const F one = S::set1(1.0f);
+    const F epsilon = S::set1(1e-6f);
+    const F inv_dt2 = S::set1(1.0f / (dt * dt));
+    F max_step2 = zero; // largest |Δx|² written
+
+    for (size_t base = 0; base < count; base += S::width) {
+        size_t lanes = count - base < size_t(S::width) ? count - base : size_t(S::width);
+        M active = S::laneMask(lanes);
+        I index = S::loadIndices(order + base, lanes);
+
+        F px = S::gather(objects.x, index, active);
+        F py = S::gather(objects.y, index, active);
+        F pz = D == 3 ? S::gather(objects.z, index, active) : zero;
+
+        // 10. Inertial force M/dt² (y - x) and 11. Hessian M/dt² I
+        F inertia = S::mul(S::gather(objects.mass, index, active), inv_dt2);
+        LaneAccumulator<S> acc;
+        acc.fx = S::mul(inertia, S::sub(S::gather(objects.inertial_x, index, active), px));
+        acc.fy = S::mul(inertia, S::sub(S::gather(objects.inertial_y, index, active), py));
+        acc.fz = D == 3 ? S::mul(inertia, S::sub(S::gather(objects.inertial_z, index, active), pz)) : zero;
+        acc.hxx = inertia;
+        acc.hyy = inertia;
+        acc.hzz = inertia;
+        acc.hxy = zero;
+        acc.hxz = zero;
+        acc.hyz = zero;
+
+        for (int set = 0; set < set_count; ++set) {
+            accumulateConstraints<S, D>(acc, objects, sets[set], index, active, px, py, pz);
+        }
+
+        // 20. Closed-form symmetric solve, in place of inverse(LocalHessian)
+        F nx, ny, nz = pz;
+        M solvable;
+        if constexpr (D == 2) {
+            F det = S::sub(S::mul(acc.hxx, acc.hyy), S::mul(acc.hxy, acc.hxy));
+            solvable = S::andm(active, S::gt(S::abs(det), epsilon));
+            F inv_det = S::div(one, S::select(solvable, det, one));
+            nx = S::add(px, S::mul(inv_det, S::sub(S::mul(acc.hyy, acc.fx), S::mul(acc.hxy, acc.fy))));
+            ny = S::add(py, S::mul(inv_det, S::sub(S::mul(acc.hxx, acc.fy), S::mul(acc.hxy, acc.fx))));
+        } else {
+            // 3x3 through the cofactors
+            F cxx = S::sub(S::mul(acc.hyy, acc.hzz), S::mul(acc.hyz, acc.hyz));
+            F cxy = S::sub(S::mul(acc.hxz, acc.hyz), S::mul(acc.hxy, acc.hzz));
+            F cxz = S::sub(S::mul(acc.hxy, acc.hyz), S::mul(acc.hxz, acc.hyy));
+            F cyy = S::sub(S::mul(acc.hxx, acc.hzz), S::mul(acc.hxz, acc.hxz));
+            F cyz = S::sub(S::mul(acc.hxy, acc.hxz), S::mul(acc.hxx, acc.hyz));
+            F czz = S::sub(S::mul(acc.hxx, acc.hyy), S::mul(acc.hxy, acc.hxy));
+            F det = S::fmadd(acc.hxx, cxx, S::fmadd(acc.hxy, cxy, S::mul(acc.hxz, cxz)));
+            solvable = S::andm(active, S::gt(S::abs(det), epsilon));
+            F inv_det = S::div(one, S::select(solvable, det, one));
+
+            nx = S::add(px, S::mul(inv_det, S::fmadd(cxx, acc.fx, S::fmadd(cxy, acc.fy, S::mul(cxz, acc.fz)))));
+            ny = S::add(py, S::mul(inv_det, S::fmadd(cxy, acc.fx, S::fmadd(cyy, acc.fy, S::mul(cyz, acc.fz)))));
+            nz = S::add(pz, S::mul(inv_det, S::fmadd(cxz, acc.fx, S::fmadd(cyz, acc.fy, S::mul(czz, acc.fz)))));
+        }
+
+        // 23. Update position, keeping the old one if the solve produced NaNs
+        M nan = S::orm(S::isnan(nx), S::orm(S::isnan(ny), S::isnan(nz)));
+        M write = S::andm(solvable, S::notm(nan));
+        S::scatter(objects.x, index, nx, write);
+        S::scatter(objects.y, index, ny, write);
+        if constexpr (D == 3) S::scatter(objects.z, index, nz, write);
+
+        F sx = S::sub(nx, px), sy = S::sub(ny, py), sz = S::sub(nz, pz);
+        F step2 = S::fmadd(sx, sx, S::fmadd(sy, sy, S::mul(sz, sz)));
+        max_step2 = S::max(max_step2, S::select(write, step2, zero));
+    }
+    return sqrtf(S::reduceMax(max_step2));
+}
+
+// Clamped rational approximation of tanh, exactly ±1 at ±3. Same formula as activation() in
+// controller_compute_shader.glsl so both paths drive the muscles the same way
+template <class S>
+static typename S::F activation(typename S::F x) {
+    x = S::min(S::max(x, S::set1(-3.0f)), S::set1(3.0f));
+    typename S::F x2 = S::mul(x, x);
+    return S::div(S::mul(x, S::add(S::set1(27.0f), x2)), S::fmadd(S::set1(9.0f), x2, S::set1(27.0f)));
+}
+
+// scratch holds (input_count + hidden_count) * S::width floats
+template <class S>
+static void evaluateControllers(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                                float* rest_length, size_t first, size_t count, float time, float* scratch) {
+    using F = typename S::F;
+    using I = typename S::I;
+    using M = typename S::M;
+    const int sensor_count = controllers.sensor_count;
+    const int strain_count = controllers.strain_count;
+    const int input_count = controllers.input_count;
+    const int hidden_count = controllers.hidden_count;
+    const size_t row = size_t(input_count) + 1;
+    const size_t stride = controllers.stride;
+    const float* weights = controllers.weights;
+    const size_t end = first + count < controllers.controller_count ? first + count : controllers.controller_count;
+
+    const float clock = 2.0f * 3.14159265f * controllers.clock_frequency * time;
+    const F clock_sin = S::set1(sinf(clock));
+    const F clock_cos = S::set1(cosf(clock));
+    const F position_scale = S::set1(controllers.position_scale);
+    const F velocity_scale = S::set1(controllers.velocity_scale);
+    const F zero = S::set1(0.0f);
+
+    // Lane-major scratch, input i of lane l at i * width + l
+    float* inputs = scratch;
+    float* hidden = scratch + size_t(input_count) * S::width;
+
+    for (size_t base = first; base < end; base += S::width) {
+        size_t lanes = end - base < size_t(S::width) ? end - base : size_t(S::width);
+        M mask = S::laneMask(lanes);
+        I object_offset = S::loadIndices(controllers.object_offsets + base, lanes);
+        I constraint_offset = S::loadIndices(controllers.constraint_offsets + base, lanes);
+
+        // 1. Centroid of the sensor objects, positions are sensed relative to it
+        F centre_x = zero, centre_y = zero, centre_z = zero;
+        for (int s = 0; s < sensor_count; ++s) {
+            I index = S::addi(object_offset, S::set1i(int32_t(controllers.sensor_objects[s])));
+            centre_x = S::add(centre_x, S::gather(objects.x, index, mask));
+            centre_y = S::add(centre_y, S::gather(objects.y, index, mask));
+            centre_z = S::add(centre_z, S::gather(objects.z, index, mask));
+        }
+        if (sensor_count > 0) {
+            F inv_count = S::set1(1.0f / float(sensor_count));
+            centre_x = S::mul(centre_x, inv_count);
+            centre_y = S::mul(centre_y, inv_count);
+            centre_z = S::mul(centre_z, inv_count);
+        }
+
+        // 2. Inputs
+        float* input = inputs;
+        for (int s = 0; s < sensor_count; ++s) {
+            I index = S::addi(object_offset, S::set1i(int32_t(controllers.sensor_objects[s])));
+            S::store(input, S::mul(S::sub(S::gather(objects.x, index, mask), centre_x), position_scale)); input += S::width;
+            S::store(input, S::mul(S::sub(S::gather(objects.y, index, mask), centre_y), position_scale)); input += S::width;
+            S::store(input, S::mul(S::sub(S::gather(objects.z, index, mask), centre_z), position_scale)); input += S::width;
+            S::store(input, S::mul(S::gather(objects.vel_x, index, mask), velocity_scale)); input += S::width;
+            S::store(input, S::mul(S::gather(objects.vel_y, index, mask), velocity_scale)); input += S::width;
+            S::store(input, S::mul(S::gather(objects.vel_z, index, mask), velocity_scale)); input += S::width;
+        }
+        for (int k = 0; k < strain_count; ++k) {
+            I index = S::addi(constraint_offset, S::set1i(int32_t(controllers.sensor_constraints[k])));
+            I a = S::gatheri(constraints.index_a, index, mask);
+            I b = S::gatheri(constraints.index_b, index, mask);
+            F dx = S::sub(S::gather(objects.x, a, mask), S::gather(objects.x, b, mask));
+            F dy = S::sub(S::gather(objects.y, a, mask), S::gather(objects.y, b, mask));
+            F dz = S::sub(S::gather(objects.z, a, mask), S::gather(objects.z, b, mask));
+            F length = S::sqrt(S::fmadd(dx, dx, S::fmadd(dy, dy, S::mul(dz, dz))));
+            F rest = S::gather(constraints.rest_length, index, mask);
+            F strain = S::div(S::sub(length, rest), rest);
+            S::store(input, S::select(S::gt(rest, zero), strain, zero));
+            input += S::width;
+        }
+        S::store(input, clock_sin); input += S::width;
+        S::store(input, clock_cos);
+
+        // 3. Hidden layer, bias first then the inputs in order like the shader
+        for (int j = 0; j < hidden_count; ++j) {
+            const float* w = weights + j * row * stride + base;
+            F sum = S::load(w + input_count * stride);
+            for (int i = 0; i < input_count; ++i) {
+                sum = S::fmadd(S::load(w + i * stride), S::load(inputs + i * S::width), sum);
+            }
+            S::store(hidden + j * S::width, activation<S>(sum));
+        }
+
+        // 4. Output layer, each output sets its actuator's rest length
+        const float* output_weights = weights + hidden_count * row * stride + base;
+        for (int k = 0; k < controllers.actuator_count; ++k) {
+            const float* w = output_weights + k * (hidden_count + 1) * stride;
+            F sum = S::load(w + hidden_count * stride);
+            for (int j = 0; j < hidden_count; ++j) {
+                sum = S::fmadd(S::load(w + j * stride), S::load(hidden + j * S::width), sum);
+            }
+            F scale = S::fmadd(S::set1(controllers.actuator_range), activation<S>(sum), S::set1(1.0f));
+            I index = S::addi(constraint_offset, S::set1i(int32_t(controllers.actuators[k])));
+            S::scatter(rest_length, index, S::mul(S::set1(controllers.actuator_rest_lengths[k]), scale), mask);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#include "simd_kernels_impl.h"
+
+#if defined(_MSC_VER) && (defined(ENN_SIMD_AVX2) || defined(ENN_SIMD_AVX512))
+#include <intrin.h>
+#endif
+
+// Built for the baseline instruction set like the rest of enn_core, so the detection itself runs anywhere
+static SimdLevel detectSimdLevel() {
+#if defined(ENN_SIMD_AVX2) || defined(ENN_SIMD_AVX512)
+#if defined(_MSC_VER)
+    // CPUID for the instructions, XGETBV for the OS saving the wider registers
+    int info[4];
+    __cpuid(info, 0);
+    int leaf_count = info[0];
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || !fma || leaf_count < 7) return SIMD_SCALAR;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+#else
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+#if defined(ENN_SIMD_AVX512)
+    if (avx2 && avx512) return SIMD_AVX512;
+#endif
+    if (avx2) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel getSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX512: return "avx512";
+    case SIMD_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+int simdLevelWidth(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX512: return 16;
+    case SIMD_AVX2: return 8;
+    default: return 1;
+    }
+}
+
+float solveObjectsScalar(const SimdObjectArrays& objects, const SimdConstraintSet* sets, int set_count,
+                         const uint32_t* order, size_t count, float dt, int dimensions) {
+    if (dimensions == 2) return solveObjects<ScalarLanes, 2>(objects, sets, set_count, order, count, dt);
+    return solveObjects<ScalarLanes, 3>(objects, sets, set_count, order, count, dt);
+}
+
+void evaluateControllersScalar(const SimdControllerArrays& controllers, const SimdObjectArrays& objects, const SimdConstraintArrays& constraints,
+                               float* rest_length, size_t first, size_t count, float time, float* scratch) {
+    evaluateControllers<ScalarLanes>(controllers, objects, constraints, rest_length, first, count, time, scratch);
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <math.h>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Each traits struct wraps one instruction set behind the same small set of operations, so the CPU kernels
+// (simd_kernels_impl.h) are written once. Masked-off lanes of a gather read as zero.
+// Only include from the kernel sources (simd_kernels_*.cpp), each compiled for the instruction set it instantiates.
+// The anonymous namespace keeps every source's copy of the member functions its own, built with its own flags.
+namespace {
+
+struct ScalarLanes {
+    static constexpr int width = 1;
+    static constexpr const char* name = "scalar";
+    using F = float;
+    using I = int32_t;
+    using M = bool;
+
+    static F set1(float v) { return v; }
+    static F load(const float* p) { return p[0]; }
+    static void store(float* p, F v) { p[0] = v; }
+    static I set1i(int32_t v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F fmadd(F a, F b, F c) { return a * b + c; }
+    static F sqrt(F a) { return sqrtf(a); }
+    static F abs(F a) { return fabsf(a); }
+    static F max(F a, F b) { return a > b ? a : b; }
+    static F min(F a, F b) { return a < b ? a : b; }
+    static float reduceMax(F a) { return a; }
+    static I addi(I a, I b) { return a + b; }
+    static M gt(F a, F b) { return a > b; }
+    static M isnan(F a) { return a != a; }
+    static M lti(I a, I b) { return a < b; }
+    static M eqi(I a, I b) { return a == b; }
+    static M andm(M a, M b) { return a && b; }
+    static M orm(M a, M b) { return a || b; }
+    static M notm(M a) { return !a; }
+    static bool any(M m) { return m; }
+    static F select(M m, F a, F b) { return m ? a : b; }
+    static I selecti(M m, I a, I b) { return m ? a : b; }
+    static M laneMask(size_t) { return true; }
+    static I loadIndices(const uint32_t* p, size_t) { return int32_t(p[0]); }
+    static F gather(const float* base, I index, M m) { return m ? base[index] : 0.0f; }
+    static I gatheri(const int32_t* base, I index, M m) { return m ? base[index] : 0; }
+    static void scatter(float* base, I index, F v, M m) { if (m) base[index] = v; }
+};
+
+#if defined(__AVX2__)
+struct Avx2Lanes {
+    static constexpr int width = 8;
+    static constexpr const char* name = "avx2";
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256;
+
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static I set1i(int32_t v) { return _mm256_set1_epi32(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+    static F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static F fmadd(F a, F b, F c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+    static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static float reduceMax(F a) {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M isnan(F a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+    static M lti(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a)); }
+    static M eqi(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static M andm(M a, M b) { return _mm256_and_ps(a, b); }
+    static M orm(M a, M b) { return _mm256_or_ps(a, b); }
+    static M notm(M a) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static I selecti(M m, I a, I b) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m)); }
+    static M laneMask(size_t lanes) {
+        return lti(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int32_t(lanes)));
+    }
+    static I loadIndices(const uint32_t* p, size_t lanes) {
+        if (lanes == width) return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        alignas(32) int32_t tail[width] = {};
+        for (size_t i = 0; i < lanes; ++i) tail[i] = int32_t(p[i]);
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(tail));
+    }
+    static F gather(const float* base, I index, M m) {
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, m, 4);
+    }
+    static I gatheri(const int32_t* base, I index, M m) {
+        return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, _mm256_castps_si256(m), 4);
+    }
+    static void scatter(float* base, I index, F v, M m) {
+        // No scatter before AVX-512
+        alignas(32) int32_t indices[width];
+        alignas(32) float values[width];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(indices), index);
+        _mm256_store_ps(values, v);
+        int bits = _mm256_movemask_ps(m);
+        for (int i = 0; i < width; ++i) {
+            if (bits & (1 << i)) base[indices[i]] = values[i];
+        }
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct Avx512Lanes {
+    static constexpr int width = 16;
+    static constexpr const char* name = "avx512";
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+
+    static F set1(float v) { return _mm512_set1_ps(v); }
+    static F load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+    static I set1i(int32_t v) { return _mm512_set1_epi32(v); }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+    static F sqrt(F a) { return _mm512_sqrt_ps(a); }
+    static F abs(F a) { return _mm512_abs_ps(a); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    // By hand rather than _mm512_reduce_max_ps, which GCC 12 warns about reading an uninitialized register
+    static float reduceMax(F a) {
+        __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1));
+        __m256 h = _mm256_max_ps(_mm512_castps512_ps256(a), high);
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+    static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M isnan(F a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+    static M lti(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+    static M eqi(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+    static M andm(M a, M b) { return M(a & b); }
+    static M orm(M a, M b) { return M(a | b); }
+    static M notm(M a) { return M(~a); }
+    static bool any(M m) { return m != 0; }
+    static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+    static I selecti(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+    static M laneMask(size_t lanes) { return M(lanes >= width ? 0xFFFF : (1u << lanes) - 1); }
+    static I loadIndices(const uint32_t* p, size_t lanes) {
+        return _mm512_maskz_loadu_epi32(laneMask(lanes), p);
+    }
+    static F gather(const float* base, I index, M m) {
+        return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, index, base, 4);
+    }
+    static I gatheri(const int32_t* base, I index, M m) {
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, index, base, 4);
+    }
+    static void scatter(float* base, I index, F v, M m) {
+        _mm512_mask_i32scatter_ps(base, m, index, v, 4);
+    }
+};
+#endif
+
+} // namespace
@@ -0,0 +1,238 @@
+#include "simulation_thread.h"
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+SimulationThread::SimulationThread(Window& window, double step_seconds, int substeps, int inspected_object_count, int dimensions)
+    : context(window.createSharedContext()), running(false), failed(false), step_seconds(step_seconds), substeps(std::max(substeps, 1)),
+      dropped_seconds(0.0), reference_height(0.0f), screen_width(window.getWidth()), screen_height(window.getHeight()),
+      inspected_object_count(inspected_object_count), dimensions(dimensions) {
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+    if (context) glfwDestroyWindow(context);
+}
+
+double SimulationThread::now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimulationThread::start(const Command& setup, Profiler* profiler) {
+    if (running.load() || !context) return;
+    running.store(true);
+    thread = std::thread(&SimulationThread::run, this, setup, profiler);
+}
+
+void SimulationThread::stop() {
+    if (!running.exchange(false)) return;
+    if (thread.joinable()) thread.join();
+}
+
+void SimulationThread::post(const Command& command) {
+    std::lock_guard<std::mutex> lock(command_mutex);
+    commands.push_back(command);
+}
+
+void SimulationThread::runCommands(GPUPhysicsSystem& physics_system) {
+    std::vector<Command> pending;
+    {
+        std::lock_guard<std::mutex> lock(command_mutex);
+        pending.swap(commands);
+    }
+    for (const Command& command : pending) command(physics_system);
+}
+
+void SimulationThread::startRecording(const std::string& path, const TrajectoryOptions& options) {
+    post([this, path, options](GPUPhysicsSystem&) {
+        if (recording) recording->open(path, options);
+    });
+}
+
+void SimulationThread::stopRecording() {
+    post([this](GPUPhysicsSystem&) {
+        if (recording) recording->close();
+    });
+}
+
+static void allocateBuffer(GLuint& buffer, size_t bytes) {
+    if (buffer == 0) glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static void copyBuffer(GLuint source, GLuint destination, size_t bytes) {
+    if (bytes == 0) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void SimulationThread::prepareBackFrame(const GPUPhysicsSystem& physics_system) {
+    SimulationFrame& frame = frames.getBack();
+
+    // The copies last published from this frame must be done before it is refilled. Waiting on them
+    // also keeps the simulation at most three batches ahead of the GPU
+    if (frame.write_fence) {
+        while (glClientWaitSync(frame.write_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(frame.write_fence);
+        frame.write_fence = nullptr;
+    }
+    // And the renderer's draws from it, waited for on the GPU only
+    if (frame.read_fence) {
+        glWaitSync(frame.read_fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(frame.read_fence);
+        frame.read_fence = nullptr;
+    }
+
+    size_t object_count = size_t(physics_system.getObjectCount());
+    if (frame.object_buffer == 0 || frame.object_capacity < object_count) {
+        frame.object_capacity = std::max<size_t>(std::max(object_count, frame.object_capacity * 2), 1);
+        allocateBuffer(frame.previous_object_buffer, frame.object_capacity * physics_system.getObjectStride());
+        allocateBuffer(frame.object_buffer, frame.object_capacity * physics_system.getObjectStride());
+    }
+
+    // State before the last step of the batch
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    copyBuffer(physics_system.getObjectDataBuffer(), frame.previous_object_buffer, object_count * physics_system.getObjectStride());
+    frame.object_count = int(object_count);
+    back_frame_compaction_count = physics_system.getCompactionCount();
+}
+
+void SimulationThread::publish(GPUPhysicsSystem& physics_system, double time) {
+    SimulationFrame& frame = frames.getBack();
+
+    size_t constraint_count = size_t(physics_system.getConstraintCount());
+    if (frame.constraint_buffer == 0 || frame.constraint_capacity < constraint_count) {
+        frame.constraint_capacity = std::max<size_t>(std::max(constraint_count, frame.constraint_capacity * 2), 1);
+        allocateBuffer(frame.constraint_buffer, frame.constraint_capacity * sizeof(GPUPhysicsConstraint));
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    // A compaction in the last step moved the objects, the state before it no longer lines up and is not interpolated from
+    if (physics_system.getCompactionCount() != back_frame_compaction_count) {
+        frame.object_count = physics_system.getObjectCount();
+        copyBuffer(physics_system.getObjectDataBuffer(), frame.previous_object_buffer, size_t(frame.object_count) * physics_system.getObjectStride());
+    }
+    copyBuffer(physics_system.getObjectDataBuffer(), frame.object_buffer, size_t(frame.object_count) * physics_system.getObjectStride());
+    copyBuffer(physics_system.getConstraintDataBuffer(), frame.constraint_buffer, constraint_count * sizeof(GPUPhysicsConstraint));
+    frame.constraint_count = int(constraint_count);
+    frame.live_object_count = physics_system.getLiveObjectCount();
+    frame.step = physics_system.getStepCount();
+    frame.time = time;
+    frame.step_seconds = step_seconds.load();
+
+    // Diagnostics for the UI, through the physics system's own readback rings
+    physics_system.requestStats(reference_height.load());
+    physics_system.getLatestStats(latest_stats);
+    physics_system.requestObjectsReadback(0, inspected_object_count);
+    physics_system.getLatestObjectsData(latest_inspected_objects);
+    frame.stats = latest_stats;
+    frame.inspected_objects = latest_inspected_objects;
+    frame.recording = recording && recording->isOpen();
+    if (recording) {
+        frame.recorded_frames = recording->getWriter().getFrameCount();
+        frame.recorded_bytes = recording->getWriter().getBytesWritten();
+        frame.recording_stalls = recording->getWriter().getStalledFrames();
+    }
+
+    // Flushed so the render context can wait on the fence
+    frame.write_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    frames.publish();
+}
+
+void SimulationThread::run(Command setup, Profiler* profiler) {
+    glfwMakeContextCurrent(context);
+
+    {
+        GPUPhysicsSystem physics_system(100, 100, 10, screen_width, screen_height, dimensions); // Initial capacities, buffers grow on demand
+        if (!physics_system.isSupported()) {
+            // The constructor reported what the context lacks, a system that never steps would only look frozen
+            std::cerr << "SimulationThread: the GPU physics system cannot run on this context, not simulating" << std::endl;
+            failed.store(true);
+        } else {
+            GPUProfiler gpu_profiler(profiler);
+            if (profiler) physics_system.setProfiler(&gpu_profiler);
+            TrajectoryCapture capture;
+            recording = &capture;
+            setup(physics_system);
+
+            FixedTimestep timestep(step_seconds.load());
+            double last_time = now();
+            double simulated_time = 0.0;
+
+            while (running.load()) {
+                runCommands(physics_system);
+                if (step_seconds.load() != timestep.getStepSeconds()) timestep.setStepSeconds(step_seconds.load());
+
+                double current_time = now();
+                int due = timestep.advance(current_time - last_time);
+                last_time = current_time;
+                dropped_seconds.store(timestep.getDroppedSeconds());
+
+                if (due == 0) {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(timestep.getTimeToNextStep()));
+                    continue;
+                }
+
+                int step_substeps = substeps.load();
+                float dt = float(timestep.getStepSeconds() / step_substeps);
+                for (int i = 0; i < due; ++i) {
+                    if (i == due - 1) prepareBackFrame(physics_system);
+                    gpu_profiler.beginFrame();
+                    for (int s = 0; s < step_substeps; ++s) {
+                        physics_system.update(dt);
+                    }
+                    simulated_time += timestep.getStepSeconds();
+                    capture.capture(physics_system, simulated_time);
+                }
+                // The newest state belongs to the clock time the steps have covered
+                publish(physics_system, current_time - timestep.getRemainder());
+            }
+
+            capture.close();
+            recording = nullptr;
+        }
+        glFinish();
+    }
+
+    // Frames are the simulation context's to delete, the renderer no longer draws from them once stopped
+    for (int i = 0; i < 3; ++i) {
+        SimulationFrame& frame = frames.getSlot(i);
+        glDeleteBuffers(1, &frame.previous_object_buffer);
+        glDeleteBuffers(1, &frame.object_buffer);
+        glDeleteBuffers(1, &frame.constraint_buffer);
+        if (frame.write_fence) glDeleteSync(frame.write_fence);
+        if (frame.read_fence) glDeleteSync(frame.read_fence);
+        frame = SimulationFrame();
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+const SimulationFrame* SimulationThread::acquireFrame() {
+    if (frames.acquire()) {
+        has_frame = true;
+        SimulationFrame& frame = frames.getFront();
+        if (frame.write_fence) glWaitSync(frame.write_fence, 0, GL_TIMEOUT_IGNORED);
+    }
+    return has_frame ? &frames.getFront() : nullptr;
+}
+
+void SimulationThread::releaseFrame() {
+    if (!has_frame) return;
+    SimulationFrame& frame = frames.getFront();
+    if (frame.read_fence) glDeleteSync(frame.read_fence);
+    frame.read_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+float SimulationThread::getAlpha(const SimulationFrame& frame) const {
+    if (frame.step_seconds <= 0.0) return 1.0f;
+    double alpha = (now() - frame.time) / frame.step_seconds;
+    return float(std::min(std::max(alpha, 0.0), 1.0));
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "gpu_physics.h"
+#include "gpu_profiler.h"
+#include "window.h"
+#include "triple_buffer.h"
+#include "fixed_timestep.h"
+#include "trajectory_capture.h"
+
+// A published simulation state: copies of the objects before and after the last step, so the renderer can
+// interpolate, and of the constraints, all in buffers of the shared context that only the renderer reads
+// while the frame is its front.
+struct SimulationFrame {
+    GLuint previous_object_buffer = 0;
+    GLuint object_buffer = 0;
+    GLuint constraint_buffer = 0;
+    size_t object_capacity = 0; // objects
+    size_t constraint_capacity = 0; // constraints
+    int object_count = 0;
+    int constraint_count = 0;
+    int live_object_count = 0; // object_count without the removed objects awaiting compaction
+    uint64_t step = 0;
+    double time = 0.0; // SimulationThread::now() the newer state belongs to
+    double step_seconds = 0.0;
+    GLsync write_fence = nullptr; // the simulation's copies into this frame
+    GLsync read_fence = nullptr; // the renderer's draws from this frame
+
+    // Read back asynchronously on the simulation thread, a few steps behind the buffers
+    GPUPhysicsStats stats = {};
+    std::vector<GPUPhysicsObject> inspected_objects;
+
+    // Trajectory recording, see SimulationThread::startRecording()
+    bool recording = false;
+    uint64_t recorded_frames = 0;
+    uint64_t recorded_bytes = 0;
+    uint64_t recording_stalls = 0;
+};
+
+// Runs GPUPhysicsSystem on its own thread and GL context (shared with the window's) at a fixed timestep,
+// independent of vsync and of how long the UI takes. Every batch of steps is copied into the back frame of a
+// triple buffer and published, the render thread draws its newest frame, interpolated between its two states.
+// The physics system lives on the simulation thread, other threads change it through post().
+class SimulationThread {
+public:
+    typedef std::function<void(GPUPhysicsSystem&)> Command;
+
+    // dimensions selects the physics system's object layout (GPUPhysicsSystem), the renderer must use the same
+    SimulationThread(Window& window, double step_seconds = 1.0 / 120.0, int substeps = 1, int inspected_object_count = 16, int dimensions = 2);
+    ~SimulationThread();
+
+    // setup runs once on the simulation thread, after the physics system is created and before the first step
+    void start(const Command& setup, Profiler* profiler = nullptr);
+    void stop();
+    // Runs command on the simulation thread before its next step
+    void post(const Command& command);
+
+    // Each fixed step runs substeps physics updates of step_seconds / substeps
+    void setStepSeconds(double step_seconds) { this->step_seconds.store(step_seconds); }
+    void setSubsteps(int substeps) { this->substeps.store(substeps < 1 ? 1 : substeps); }
+    double getStepSeconds() const { return step_seconds.load(); }
+    int getSubsteps() const { return substeps.load(); }
+    double getDroppedSeconds() const { return dropped_seconds.load(); }
+    // True once the simulation thread found the physics system unsupported (GPUPhysicsSystem::isSupported()),
+    // it then never steps or publishes a frame
+    bool hasFailed() const { return failed.load(); }
+    // Potential energy in the published stats is measured from this height
+    void setReferenceHeight(float height) { reference_height.store(height); }
+
+    // Render thread: swaps in the newest published frame, nullptr until the first one. The GPU waits for the
+    // simulation's copies before any later command, the CPU does not
+    const SimulationFrame* acquireFrame();
+    // Render thread: call after the last draw from the acquired frame, so the simulation waits for those draws
+    // before reusing its buffers
+    void releaseFrame();
+    // Render thread: how far to blend from the older to the newer state of frame, drawing one step behind
+    float getAlpha(const SimulationFrame& frame) const;
+
+    // Records every fixed step to a trajectory file (trajectory.h) until stopRecording(), progress comes back
+    // with the published frames. Both run on the simulation thread before its next step
+    void startRecording(const std::string& path, const TrajectoryOptions& options = TrajectoryOptions());
+    void stopRecording();
+
+    // Seconds on the steady clock shared by both threads
+    static double now();
+
+private:
+    GLFWwindow* context;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> failed;
+    std::atomic<double> step_seconds;
+    std::atomic<int> substeps;
+    std::atomic<double> dropped_seconds;
+    std::atomic<float> reference_height;
+    int screen_width, screen_height;
+    int inspected_object_count;
+    int dimensions;
+
+    std::mutex command_mutex;
+    std::vector<Command> commands;
+
+    TripleBuffer<SimulationFrame> frames;
+    bool has_frame = false;
+
+    // Simulation thread only
+    GPUPhysicsStats latest_stats = {};
+    std::vector<GPUPhysicsObject> latest_inspected_objects;
+    uint64_t back_frame_compaction_count = 0; // GPUPhysicsSystem::getCompactionCount() when the back frame was prepared
+    TrajectoryCapture* recording = nullptr; // lives in run(), on the simulation context
+
+    void run(Command setup, Profiler* profiler);
+    void runCommands(GPUPhysicsSystem& physics_system);
+    void prepareBackFrame(const GPUPhysicsSystem& physics_system);
+    void publish(GPUPhysicsSystem& physics_system, double time);
+};
@@ -0,0 +1,250 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+}
+
+bool writeSnapshot(const char* path, const SnapshotData& data) {
+    const SnapshotState& state = data.state;
+    const SolverParameters& parameters = state.solver_parameters;
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.byte_order = snapshot_byte_order;
+    header.header_bytes = sizeof(SnapshotHeader);
+    header.object_stride = sizeof(GPUPhysicsObject);
+    header.constraint_stride = sizeof(GPUPhysicsConstraint);
+    header.world_stride = sizeof(GPUPhysicsWorld);
+    header.flags = (state.collisions_enabled ? SNAPSHOT_FLAG_COLLISIONS : 0) | (parameters.warm_start ? SNAPSHOT_FLAG_WARM_START : 0);
+    header.step = state.step;
+    header.iterations = state.iterations;
+    header.contact_cell_size = state.contact_cell_size;
+    header.contact_stiffness = state.contact_stiffness;
+    header.alpha = parameters.alpha;
+    header.gamma = parameters.gamma;
+    header.beta = parameters.beta;
+    header.stiffness_min = parameters.stiffness_min;
+    header.stiffness_max = parameters.stiffness_max;
+    header.min_iterations = parameters.min_iterations;
+    header.residual_tolerance = parameters.residual_tolerance;
+    header.max_radius = state.max_radius;
+
+    const void* arrays[SNAPSHOT_SECTION_COUNT] = {
+        data.objects, data.constraints, data.graph.offsets, data.graph.indices,
+        data.graph.endpoint_a, data.graph.endpoint_b, data.color_order, data.color_offsets, data.worlds,
+    };
+    uint64_t counts[SNAPSHOT_SECTION_COUNT] = {
+        data.object_count, data.constraint_count, data.object_count + 1, data.edge_count,
+        data.constraint_count, data.constraint_count, data.object_count, data.color_count + 1, data.world_count,
+    };
+    uint64_t strides[SNAPSHOT_SECTION_COUNT] = {
+        sizeof(GPUPhysicsObject), sizeof(GPUPhysicsConstraint), 4, 4, 4, 4, 4, 4, sizeof(GPUPhysicsWorld),
+    };
+
+    // Sections one after another, each on its own page
+    uint64_t offset = alignUp(sizeof(SnapshotHeader));
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s) {
+        if (!arrays[s]) counts[s] = 0;
+        header.sections[s] = {offset, counts[s]};
+        offset = alignUp(offset + counts[s] * strides[s]);
+    }
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        std::fprintf(stderr, "Could not write snapshot %s\n", path);
+        return false;
+    }
+
+    static const unsigned char zeros[snapshot_alignment] = {};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT && ok; ++s) {
+        ok = std::fwrite(zeros, 1, size_t(header.sections[s].offset - written), file) == header.sections[s].offset - written;
+        written = header.sections[s].offset;
+        size_t bytes = size_t(counts[s] * strides[s]);
+        if (ok && bytes > 0) ok = std::fwrite(arrays[s], 1, bytes, file) == bytes;
+        written += bytes;
+    }
+    // Pad the last section out too, so every section can be mapped whole
+    if (ok) ok = std::fwrite(zeros, 1, size_t(offset - written), file) == offset - written;
+
+    if (std::fclose(file) != 0) ok = false;
+    if (!ok) std::fprintf(stderr, "Writing snapshot %s failed\n", path);
+    return ok;
+}
+
+SnapshotFile::~SnapshotFile() {
+    close();
+}
+
+void SnapshotFile::close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (mapping) munmap(const_cast<unsigned char*>(mapping), mapping_bytes);
+#endif
+    mapping = nullptr;
+    mapping_bytes = 0;
+    data = SnapshotData();
+}
+
+bool SnapshotFile::open(const char* path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size = {};
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        std::fprintf(stderr, "Could not open snapshot %s\n", path);
+        return false;
+    }
+    file_handle = file;
+    mapping_bytes = size_t(size.QuadPart);
+    if (mapping_bytes >= sizeof(SnapshotHeader)) {
+        mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_handle) mapping = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int file = ::open(path, O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0) {
+        if (file >= 0) ::close(file);
+        std::fprintf(stderr, "Could not open snapshot %s\n", path);
+        return false;
+    }
+    mapping_bytes = size_t(status.st_size);
+    if (mapping_bytes >= sizeof(SnapshotHeader)) {
+        void* address = mmap(nullptr, mapping_bytes, PROT_READ, MAP_PRIVATE, file, 0);
+        if (address != MAP_FAILED) {
+            mapping = static_cast<const unsigned char*>(address);
+            // Loads stream through every page once
+            madvise(address, mapping_bytes, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(file); // the mapping keeps its own reference
+#endif
+
+    if (!mapping) {
+        std::fprintf(stderr, "Could not map snapshot %s\n", path);
+        close();
+        return false;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0) {
+        std::fprintf(stderr, "%s is not a snapshot\n", path);
+        close();
+        return false;
+    }
+    if (header.byte_order != snapshot_byte_order || header.version != snapshot_version || header.header_bytes != sizeof(SnapshotHeader) ||
+        header.object_stride != sizeof(GPUPhysicsObject) || header.constraint_stride != sizeof(GPUPhysicsConstraint) ||
+        header.world_stride != sizeof(GPUPhysicsWorld)) {
+        std::fprintf(stderr, "Snapshot %s has version %u and layout %u/%u/%u/%u, this build reads version %u with %u/%u/%u/%u\n", path,
+                     header.version, header.header_bytes, header.object_stride, header.constraint_stride, header.world_stride,
+                     snapshot_version, unsigned(sizeof(SnapshotHeader)), unsigned(sizeof(GPUPhysicsObject)), unsigned(sizeof(GPUPhysicsConstraint)),
+                     unsigned(sizeof(GPUPhysicsWorld)));
+        close();
+        return false;
+    }
+
+    const uint64_t strides[SNAPSHOT_SECTION_COUNT] = {
+        sizeof(GPUPhysicsObject), sizeof(GPUPhysicsConstraint), 4, 4, 4, 4, 4, 4, sizeof(GPUPhysicsWorld),
+    };
+    const void* arrays[SNAPSHOT_SECTION_COUNT];
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s) {
+        const SnapshotSection& section = header.sections[s];
+        // Counts are checked by division so a corrupt count cannot overflow the bound
+        if (section.offset % snapshot_alignment != 0 || section.offset > mapping_bytes ||
+            section.count > (mapping_bytes - section.offset) / strides[s]) {
+            std::fprintf(stderr, "Snapshot %s is truncated or corrupt (section %d)\n", path, s);
+            close();
+            return false;
+        }
+        arrays[s] = mapping + section.offset;
+    }
+
+    // Array sizes have to agree with each other, the contents are trusted
+    uint64_t object_count = header.sections[SNAPSHOT_OBJECTS].count;
+    uint64_t constraint_count = header.sections[SNAPSHOT_CONSTRAINTS].count;
+    uint64_t color_offset_count = header.sections[SNAPSHOT_COLOR_OFFSETS].count;
+    const uint32_t* graph_offsets = static_cast<const uint32_t*>(arrays[SNAPSHOT_GRAPH_OFFSETS]);
+    const uint32_t* color_offsets = static_cast<const uint32_t*>(arrays[SNAPSHOT_COLOR_OFFSETS]);
+    if (header.sections[SNAPSHOT_GRAPH_OFFSETS].count != object_count + 1 ||
+        header.sections[SNAPSHOT_ENDPOINT_A].count != constraint_count ||
+        header.sections[SNAPSHOT_ENDPOINT_B].count != constraint_count ||
+        header.sections[SNAPSHOT_COLOR_ORDER].count != object_count || color_offset_count == 0 ||
+        graph_offsets[object_count] != header.sections[SNAPSHOT_GRAPH_INDICES].count ||
+        color_offsets[color_offset_count - 1] != object_count) {
+        std::fprintf(stderr, "Snapshot %s has inconsistent section sizes\n", path);
+        close();
+        return false;
+    }
+
+    // Worlds have to tile the objects and constraints in order
+    const GPUPhysicsWorld* worlds = static_cast<const GPUPhysicsWorld*>(arrays[SNAPSHOT_WORLDS]);
+    uint64_t world_count = header.sections[SNAPSHOT_WORLDS].count;
+    uint64_t world_objects = 0, world_constraints = 0;
+    bool tiled = true;
+    for (uint64_t w = 0; w < world_count && tiled; ++w) {
+        tiled = worlds[w].object_offset == world_objects && worlds[w].constraint_offset == world_constraints;
+        world_objects += worlds[w].object_count;
+        world_constraints += worlds[w].constraint_count;
+    }
+    if (world_count > 0 && (!tiled || world_objects != object_count || world_constraints != constraint_count)) {
+        std::fprintf(stderr, "Snapshot %s has worlds that do not cover its objects and constraints\n", path);
+        close();
+        return false;
+    }
+
+    data.objects = static_cast<const GPUPhysicsObject*>(arrays[SNAPSHOT_OBJECTS]);
+    data.object_count = size_t(object_count);
+    data.constraints = static_cast<const GPUPhysicsConstraint*>(arrays[SNAPSHOT_CONSTRAINTS]);
+    data.constraint_count = size_t(constraint_count);
+    data.graph.offsets = graph_offsets;
+    data.graph.indices = static_cast<const uint32_t*>(arrays[SNAPSHOT_GRAPH_INDICES]);
+    data.graph.endpoint_a = static_cast<const uint32_t*>(arrays[SNAPSHOT_ENDPOINT_A]);
+    data.graph.endpoint_b = static_cast<const uint32_t*>(arrays[SNAPSHOT_ENDPOINT_B]);
+    data.edge_count = size_t(header.sections[SNAPSHOT_GRAPH_INDICES].count);
+    data.color_order = static_cast<const uint32_t*>(arrays[SNAPSHOT_COLOR_ORDER]);
+    data.color_offsets = color_offsets;
+    data.color_count = size_t(color_offset_count - 1);
+    data.worlds = worlds;
+    data.world_count = size_t(world_count);
+
+    SnapshotState& state = data.state;
+    state.step = header.step;
+    state.iterations = header.iterations;
+    state.collisions_enabled = (header.flags & SNAPSHOT_FLAG_COLLISIONS) != 0;
+    state.contact_cell_size = header.contact_cell_size;
+    state.contact_stiffness = header.contact_stiffness;
+    state.max_radius = header.max_radius;
+    state.solver_parameters.alpha = header.alpha;
+    state.solver_parameters.gamma = header.gamma;
+    state.solver_parameters.beta = header.beta;
+    state.solver_parameters.stiffness_min = header.stiffness_min;
+    state.solver_parameters.stiffness_max = header.stiffness_max;
+    state.solver_parameters.warm_start = (header.flags & SNAPSHOT_FLAG_WARM_START) != 0;
+    state.solver_parameters.min_iterations = header.min_iterations;
+    state.solver_parameters.residual_tolerance = header.residual_tolerance;
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "physics_types.h"
+#include "constraint_graph.h"
+
+// Binary snapshot of a physics system: objects and constraints exactly as the std430 SSBOs hold them, the
+// flattened constraint graph with its coloring, the batched worlds and the solver state. Every array starts on a page boundary,
+// so a loader maps the file and hands the arrays straight to glBufferSubData or the host containers.
+// Files are native-endian, byte_order tells a reader on the other endianness apart.
+const char snapshot_magic[8] = {'E', 'N', 'N', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t snapshot_version = 3;
+const uint32_t snapshot_byte_order = 0x01020304;
+const uint64_t snapshot_alignment = 4096;
+
+enum SnapshotSectionIndex {
+    SNAPSHOT_OBJECTS = 0,       // GPUPhysicsObject[object_count]
+    SNAPSHOT_CONSTRAINTS = 1,   // GPUPhysicsConstraint[constraint_count]
+    SNAPSHOT_GRAPH_OFFSETS = 2, // uint32_t[object_count + 1], ConstraintGraph::getOffsets()
+    SNAPSHOT_GRAPH_INDICES = 3, // uint32_t[edges]
+    SNAPSHOT_ENDPOINT_A = 4,    // uint32_t[constraint_count]
+    SNAPSHOT_ENDPOINT_B = 5,
+    SNAPSHOT_COLOR_ORDER = 6,   // uint32_t[object_count]
+    SNAPSHOT_COLOR_OFFSETS = 7, // uint32_t[colors + 1]
+    SNAPSHOT_WORLDS = 8,        // GPUPhysicsWorld[worlds], empty for a system without batched worlds
+    SNAPSHOT_SECTION_COUNT = 9,
+};
+
+struct SnapshotSection {
+    uint64_t offset; // bytes from the start of the file, a multiple of snapshot_alignment
+    uint64_t count;  // elements
+};
+
+// Solver state beside the arrays
+struct SnapshotState {
+    uint64_t step = 0;
+    int iterations = 5;
+    bool collisions_enabled = false;
+    float contact_cell_size = 0.0f;
+    float contact_stiffness = 1.0f;
+    float max_radius = 0.0f; // largest object radius, sizes the contact grid without scanning the objects
+    SolverParameters solver_parameters;
+};
+
+// On-disk header, at offset 0
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_bytes;      // sizeof(SnapshotHeader)
+    uint32_t object_stride;     // sizeof(GPUPhysicsObject)
+    uint32_t constraint_stride; // sizeof(GPUPhysicsConstraint)
+    uint32_t flags;             // SNAPSHOT_FLAG_*
+    uint64_t step;
+    int32_t iterations;
+    float contact_cell_size;
+    float contact_stiffness;
+    float alpha, gamma, beta;
+    float stiffness_min, stiffness_max;
+    int32_t min_iterations;
+    float residual_tolerance;
+    float max_radius;
+    uint32_t world_stride;      // sizeof(GPUPhysicsWorld)
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+}; // 232 bytes
+
+enum SnapshotFlags {
+    SNAPSHOT_FLAG_COLLISIONS = 1,
+    SNAPSHOT_FLAG_WARM_START = 2,
+};
+
+// Pointers into a mapped file, or into the arrays being written
+struct SnapshotData {
+    const GPUPhysicsObject* objects = nullptr;
+    size_t object_count = 0;
+    const GPUPhysicsConstraint* constraints = nullptr;
+    size_t constraint_count = 0;
+    CSREdgeSet graph = {}; // offsets has object_count + 1 entries, endpoints constraint_count
+    size_t edge_count = 0;
+    const uint32_t* color_order = nullptr;
+    const uint32_t* color_offsets = nullptr;
+    size_t color_count = 0;
+    const GPUPhysicsWorld* worlds = nullptr; // each covers a contiguous range of the objects and constraints
+    size_t world_count = 0;
+    SnapshotState state;
+};
+
+// Writes data to path, errors go to stderr
+bool writeSnapshot(const char* path, const SnapshotData& data);
+
+// A snapshot mapped read-only. The data points into the mapping and stays valid until close() or destruction
+class SnapshotFile {
+public:
+    SnapshotFile() = default;
+    ~SnapshotFile();
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    // Maps path and checks the header and that every section lies inside the file, errors go to stderr
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+    const SnapshotData& getData() const { return data; }
+
+private:
+    const unsigned char* mapping = nullptr;
+    size_t mapping_bytes = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+    SnapshotData data;
+};
@@ -0,0 +1,126 @@
+#include "soa_solver.h"
+#include "simd_kernels.h"
+#include "handle_table.h"
+#include "physics_types.h"
+#include <cstdio>
+
+static_assert(SIMD_CONSTRAINT_CONTACT == CONSTRAINT_CONTACT, "the kernels' contact type must match physics_types.h");
+
+void SoAObjectState::resize(size_t n) {
+    for (std::vector<float>* field : {&x, &y, &z, &prev_x, &prev_y, &prev_z, &inertial_x, &inertial_y, &inertial_z,
+                                      &vel_x, &vel_y, &vel_z, &acc_x, &acc_y, &acc_z, &mass, &inv_mass, &radius, &rest_time}) {
+        field->resize(n, 0.0f);
+    }
+    flags.resize(n, 0);
+}
+
+void SoAConstraintState::resize(size_t n) {
+    type.resize(n, 0);
+    index_a.resize(n, 0);
+    index_b.resize(n, 0);
+    rest_length.resize(n, 0.0f);
+    stiffness.resize(n, 0.0f);
+    lambda.resize(n, 0.0f);
+    penalty.resize(n, 0.0f);
+    stabilization.resize(n, 0.0f);
+}
+
+// In order, so every element moves down or stays and no element is read after it was overwritten
+template <class T>
+static void compactField(std::vector<T>& field, const std::vector<uint32_t>& remap, size_t count) {
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] != removed_index) field[remap[i]] = field[i];
+    }
+    field.resize(count);
+}
+
+void SoAObjectState::compact(const std::vector<uint32_t>& remap, size_t count) {
+    for (std::vector<float>* field : {&x, &y, &z, &prev_x, &prev_y, &prev_z, &inertial_x, &inertial_y, &inertial_z,
+                                      &vel_x, &vel_y, &vel_z, &acc_x, &acc_y, &acc_z, &mass, &inv_mass, &radius, &rest_time}) {
+        compactField(*field, remap, count);
+    }
+    compactField(flags, remap, count);
+}
+
+void SoAConstraintState::compact(const std::vector<uint32_t>& remap, size_t count) {
+    compactField(type, remap, count);
+    compactField(index_a, remap, count);
+    compactField(index_b, remap, count);
+    compactField(rest_length, remap, count);
+    compactField(stiffness, remap, count);
+    compactField(lambda, remap, count);
+    compactField(penalty, remap, count);
+    compactField(stabilization, remap, count);
+}
+
+// The objects are written through x, y and z by solveObjects* only
+SimdObjectArrays simdObjectArrays(const SoAObjectState& objects) {
+    SimdObjectArrays arrays;
+    arrays.x = const_cast<float*>(objects.x.data());
+    arrays.y = const_cast<float*>(objects.y.data());
+    arrays.z = const_cast<float*>(objects.z.data());
+    arrays.inertial_x = objects.inertial_x.data();
+    arrays.inertial_y = objects.inertial_y.data();
+    arrays.inertial_z = objects.inertial_z.data();
+    arrays.vel_x = objects.vel_x.data();
+    arrays.vel_y = objects.vel_y.data();
+    arrays.vel_z = objects.vel_z.data();
+    arrays.mass = objects.mass.data();
+    return arrays;
+}
+
+SimdConstraintArrays simdConstraintArrays(const SoAConstraintState& constraints) {
+    SimdConstraintArrays arrays;
+    arrays.type = constraints.type.data();
+    arrays.index_a = constraints.index_a.data();
+    arrays.index_b = constraints.index_b.data();
+    arrays.rest_length = constraints.rest_length.data();
+    arrays.lambda = constraints.lambda.data();
+    arrays.penalty = constraints.penalty.data();
+    arrays.stabilization = constraints.stabilization.data();
+    return arrays;
+}
+
+static int simdConstraintSets(const SoAConstraintView* sets, int set_count, SimdConstraintSet* simd_sets) {
+    if (set_count > soa_max_constraint_sets) {
+        fprintf(stderr, "solveObjectsSoA: %d constraint sets, at most %d are solved\n", set_count, soa_max_constraint_sets);
+        set_count = soa_max_constraint_sets;
+    }
+    for (int set = 0; set < set_count; ++set) {
+        simd_sets[set].constraints = simdConstraintArrays(*sets[set].constraints);
+        simd_sets[set].offsets = sets[set].offsets;
+        simd_sets[set].indices = sets[set].indices;
+    }
+    return set_count;
+}
+
+float solveObjectsSoAScalar(SoAObjectState& objects, const SoAConstraintView* sets, int set_count,
+                            const uint32_t* order, size_t count, float dt, int dimensions) {
+    SimdConstraintSet simd_sets[soa_max_constraint_sets];
+    set_count = simdConstraintSets(sets, set_count, simd_sets);
+    return solveObjectsScalar(simdObjectArrays(objects), simd_sets, set_count, order, count, dt, dimensions);
+}
+
+float solveObjectsSoA(SoAObjectState& objects, const SoAConstraintView* sets, int set_count,
+                      const uint32_t* order, size_t count, float dt, int dimensions) {
+    SimdConstraintSet simd_sets[soa_max_constraint_sets];
+    set_count = simdConstraintSets(sets, set_count, simd_sets);
+    SimdObjectArrays arrays = simdObjectArrays(objects);
+    switch (getSimdLevel()) {
+#if defined(ENN_SIMD_AVX512)
+    case SIMD_AVX512: return solveObjectsAvx512(arrays, simd_sets, set_count, order, count, dt, dimensions);
+#endif
+#if defined(ENN_SIMD_AVX2) || defined(ENN_SIMD_AVX512)
+    case SIMD_AVX2: return solveObjectsAvx2(arrays, simd_sets, set_count, order, count, dt, dimensions);
+#endif
+    default: return solveObjectsScalar(arrays, simd_sets, set_count, order, count, dt, dimensions);
+    }
+}
+
+const char* soaKernelName() {
+    return simdLevelName(getSimdLevel());
+}
+
+int soaKernelWidth() {
+    return simdLevelWidth(getSimdLevel());
+}
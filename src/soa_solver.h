@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "simd_kernels.h"
+
+// Object state as structure-of-arrays, the layout the CPU vertex kernel streams through.
+// A 64-byte GPUPhysicsObject is split so each pass only touches the fields it needs.
+struct SoAObjectState {
+    std::vector<float> x, y, z;                            // current position
+    std::vector<float> prev_x, prev_y, prev_z;             // position at the start of the step
+    std::vector<float> inertial_x, inertial_y, inertial_z; // inertial target y
+    std::vector<float> vel_x, vel_y, vel_z;
+    std::vector<float> acc_x, acc_y, acc_z;
+    std::vector<float> mass, inv_mass;
+    std::vector<float> radius;
+    std::vector<float> rest_time;   // seconds at or below the sleep energy, see SleepParameters
+    std::vector<uint32_t> flags;    // PhysicsObjectFlags
+
+    size_t size() const { return x.size(); }
+    void resize(size_t n);
+    // Moves element i to remap[i] and shrinks to count, removed_index drops it. The remap must keep the order
+    void compact(const std::vector<uint32_t>& remap, size_t count);
+};
+
+struct SoAConstraintState {
+    std::vector<int32_t> type;
+    std::vector<int32_t> index_a, index_b;
+    std::vector<float> rest_length;
+    std::vector<float> stiffness; // material stiffness, caps the penalty of a soft constraint
+    std::vector<float> lambda;    // λ_j^(n)
+    std::vector<float> penalty;   // k_j^(n)
+    std::vector<float> stabilization; // αC_j(x^t), see SolverParameters
+
+    size_t size() const { return type.size(); }
+    void resize(size_t n);
+    // Same as SoAObjectState::compact, the object indices are left to the caller
+    void compact(const std::vector<uint32_t>& remap, size_t count);
+};
+
+// A constraint set and its per-object CSR adjacency: constraints touching object i are
+// indices[offsets[i]] .. indices[offsets[i + 1] - 1]
+struct SoAConstraintView {
+    const SoAConstraintState* constraints;
+    const uint32_t* offsets;
+    const uint32_t* indices;
+};
+
+// Most constraint sets one solveObjectsSoA call accumulates
+const int soa_max_constraint_sets = 4;
+
+// Raw arrays of the state for the kernels in simd_kernels.h
+SimdObjectArrays simdObjectArrays(const SoAObjectState& objects);
+SimdConstraintArrays simdConstraintArrays(const SoAConstraintState& constraints);
+
+// One VBD local solve for each object in order[0 .. count - 1]: accumulates the inertial force and the
+// forces of every constraint set (distance constraints, contacts, ...) plus the 3x3 Hessian, then applies
+// Δx = H⁻¹ f with a closed-form symmetric solve. The objects must share no constraint (one color batch).
+// Returns the largest |Δx| applied, the residual the adaptive iteration count converges on.
+// dimensions 2 instantiates the kernel without z: no z loads or stores and a 2x2 solve, z is left as it was.
+// Runs the widest kernel the build compiles and the CPU supports (getSimdLevel in simd_kernels.h), scalar code otherwise.
+float solveObjectsSoA(SoAObjectState& objects, const SoAConstraintView* sets, int set_count,
+                      const uint32_t* order, size_t count, float dt, int dimensions = 3);
+
+// Same as solveObjectsSoA but always scalar, the reference the SIMD kernels are checked against
+float solveObjectsSoAScalar(SoAObjectState& objects, const SoAConstraintView* sets, int set_count,
+                            const uint32_t* order, size_t count, float dt, int dimensions = 3);
+
+// Kernel solveObjectsSoA picked on this CPU, "avx512", "avx2" or "scalar"
+const char* soaKernelName();
+int soaKernelWidth();
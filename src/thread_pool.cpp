@@ -0,0 +1,143 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int thread_count) {
+    if (thread_count <= 0) thread_count = int(std::thread::hardware_concurrency());
+    if (thread_count <= 0) thread_count = 1;
+    steal_ranges.reset(new StealRange[thread_count]);
+
+    // The calling thread is the last worker
+    for (int i = 0; i < thread_count - 1; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t min_chunk) {
+    if (end <= begin) return;
+
+    size_t count = end - begin;
+    size_t thread_count = workers.size() + 1;
+    // A few chunks per thread so uneven chunks still balance
+    size_t chunk = std::max(min_chunk, (count + thread_count * 4 - 1) / (thread_count * 4));
+
+    // Not worth waking anyone
+    if (workers.empty() || count <= chunk) {
+        body(begin, end);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        job_begin = begin;
+        job_end = end;
+        job_chunk = chunk;
+        chunk_count = (count + chunk - 1) / chunk;
+        chunks_finished = 0;
+        next_chunk.store(0, std::memory_order_release);
+        job_generation++;
+    }
+    work_ready.notify_all();
+
+    size_t finished = runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    chunks_finished += finished;
+    if (chunks_finished == chunk_count) {
+        job = nullptr;
+    } else {
+        work_done.wait(lock, [this] { return chunks_finished == chunk_count; });
+        job = nullptr;
+    }
+}
+
+static uint64_t packRange(uint64_t begin, uint64_t end) { return begin << 32 | end; }
+
+bool ThreadPool::popRange(int slot, size_t& index) {
+    std::atomic<uint64_t>& range = steal_ranges[slot].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    for (;;) {
+        uint64_t begin = current >> 32, end = current & 0xFFFFFFFFu;
+        if (begin >= end) return false;
+        if (range.compare_exchange_weak(current, packRange(begin + 1, end), std::memory_order_acq_rel)) {
+            index = size_t(begin);
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::stealRange(int slot, size_t& index) {
+    int slot_count = getThreadCount();
+    for (int offset = 1; offset < slot_count; ++offset) {
+        std::atomic<uint64_t>& victim = steal_ranges[(slot + offset) % slot_count].range;
+        uint64_t current = victim.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t begin = current >> 32, end = current & 0xFFFFFFFFu;
+            if (begin >= end) break;
+            // Take the back half, the last single index included
+            uint64_t middle = begin + (end - begin) / 2;
+            if (victim.compare_exchange_weak(current, packRange(begin, middle), std::memory_order_acq_rel)) {
+                steal_ranges[slot].range.store(packRange(middle + 1, end), std::memory_order_release);
+                index = size_t(middle);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::parallelForStealing(size_t count, const std::function<void(size_t, int)>& body) {
+    if (count == 0) return;
+    int slot_count = getThreadCount();
+    for (int slot = 0; slot < slot_count; ++slot) {
+        steal_ranges[slot].range.store(packRange(count * slot / slot_count, count * (slot + 1) / slot_count), std::memory_order_relaxed);
+    }
+    // One chunk per slot, whichever thread picks a chunk up works as that slot until nothing is left to steal
+    parallelFor(0, size_t(slot_count), [&](size_t slot_begin, size_t slot_end) {
+        for (size_t slot = slot_begin; slot < slot_end; ++slot) {
+            size_t index;
+            while (popRange(int(slot), index) || stealRange(int(slot), index)) body(index, int(slot));
+        }
+    }, 1);
+}
+
+size_t ThreadPool::runChunks() {
+    size_t finished = 0;
+    for (;;) {
+        size_t chunk_index = next_chunk.fetch_add(1, std::memory_order_acq_rel);
+        if (chunk_index >= chunk_count) break;
+        size_t chunk_begin = job_begin + chunk_index * job_chunk;
+        size_t chunk_end = std::min(job_end, chunk_begin + job_chunk);
+        (*job)(chunk_begin, chunk_end);
+        finished++;
+    }
+    return finished;
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long long seen_generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&] { return stopping || (job != nullptr && job_generation != seen_generation); });
+            if (stopping) return;
+            seen_generation = job_generation;
+        }
+
+        size_t finished = runChunks();
+
+        if (finished > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunks_finished += finished;
+            if (chunks_finished == chunk_count) work_done.notify_one();
+        }
+    }
+}
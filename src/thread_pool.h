@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+
+// Fixed set of worker threads for data-parallel loops.
+// parallelFor splits [begin, end) into contiguous chunks, the calling thread works on a chunk too
+// and returns once every chunk is done.
+// parallelForStealing is for items of uneven cost: every slot starts with an equal share and, once
+// its own share is done, steals half of another slot's remainder.
+class ThreadPool {
+public:
+    ThreadPool(int thread_count = 0); // 0 uses every hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t min_chunk = 64);
+    // Calls body(index, slot) for every index in [0, count), at most 2^32 of them. slot is in [0, getThreadCount())
+    // and only runs on one thread at a time, so per-slot state needs no lock
+    void parallelForStealing(size_t count, const std::function<void(size_t, int)>& body);
+    int getThreadCount() const { return int(workers.size()) + 1; }
+
+private:
+    // Remaining indices of one slot, begin in the high half and end in the low half so the owner taking
+    // from the front and thieves splitting off the back agree through one compare-exchange
+    struct alignas(64) StealRange {
+        std::atomic<uint64_t> range{0};
+    };
+    std::unique_ptr<StealRange[]> steal_ranges;
+
+    bool popRange(int slot, size_t& index);
+    bool stealRange(int slot, size_t& index);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    // Current job, guarded by mutex
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t job_begin = 0, job_end = 0, job_chunk = 0;
+    std::atomic<size_t> next_chunk{0};
+    size_t chunk_count = 0;
+    size_t chunks_finished = 0;
+    unsigned long long job_generation = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    size_t runChunks();
+};
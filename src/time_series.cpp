@@ -0,0 +1,112 @@
+#include "time_series.h"
+#include <algorithm>
+#include <iostream>
+
+TimeSeriesStore::TimeSeriesStore(size_t capacity, int level_count, int factor)
+    : capacity(std::max<size_t>(capacity, 2)), factor(std::max(factor, 2)), levels(std::max(level_count, 1)) {
+}
+
+int TimeSeriesStore::addSeries(const std::string& name) {
+    if (sample_count > 0) {
+        std::cerr << "TimeSeriesStore: series " << name << " added after the first sample" << std::endl;
+        return -1;
+    }
+    names.push_back(name);
+    allocate();
+    return int(names.size()) - 1;
+}
+
+void TimeSeriesStore::allocate() {
+    size_t series_count = names.size();
+    for (Level& level : levels) {
+        level.time.assign(capacity, 0.0f);
+        level.min.assign(capacity * series_count, 0.0f);
+        level.max.assign(capacity * series_count, 0.0f);
+        level.pending_min.assign(series_count, 0.0f);
+        level.pending_max.assign(series_count, 0.0f);
+        level.head = 0;
+        level.count = 0;
+        level.pending = 0;
+    }
+}
+
+void TimeSeriesStore::clear() {
+    sample_count = 0;
+    allocate();
+}
+
+void TimeSeriesStore::push(float time, const float* values) {
+    write(0, time, values, values);
+    sample_count++;
+}
+
+void TimeSeriesStore::write(int level_index, float time, const float* min, const float* max) {
+    Level& level = levels[level_index];
+    size_t series_count = names.size();
+
+    for (size_t s = 0; s < series_count; ++s) {
+        level.min[s * capacity + level.head] = min[s];
+        level.max[s * capacity + level.head] = max[s];
+    }
+    level.time[level.head] = time;
+    level.head = (level.head + 1) % capacity;
+    level.count = std::min(level.count + 1, capacity);
+
+    // Fold the entry into the coarser level's bucket, which is written once it holds `factor` entries
+    if (level_index + 1 >= int(levels.size())) return;
+    Level& coarser = levels[level_index + 1];
+    if (coarser.pending == 0) {
+        coarser.pending_time = time;
+        std::copy(min, min + series_count, coarser.pending_min.begin());
+        std::copy(max, max + series_count, coarser.pending_max.begin());
+    } else {
+        for (size_t s = 0; s < series_count; ++s) {
+            coarser.pending_min[s] = std::min(coarser.pending_min[s], min[s]);
+            coarser.pending_max[s] = std::max(coarser.pending_max[s], max[s]);
+        }
+    }
+    if (++coarser.pending == factor) {
+        coarser.pending = 0;
+        write(level_index + 1, coarser.pending_time, coarser.pending_min.data(), coarser.pending_max.data());
+    }
+}
+
+TimeSeriesStore::View TimeSeriesStore::view(int series, int level_index) const {
+    const Level& level = levels[level_index];
+    // Until the ring wraps the oldest entry is at 0, afterwards it is the next write
+    int offset = level.count < capacity ? 0 : int(level.head);
+    return {level.time.data(), level.min.data() + series * capacity, level.max.data() + series * capacity,
+            int(level.count), offset};
+}
+
+int TimeSeriesStore::selectLevel(float time_begin, int max_points) const {
+    for (int l = 0; l < int(levels.size()); ++l) {
+        const Level& level = levels[l];
+        if (level.count == 0) return std::max(l - 1, 0);
+
+        // This level must still reach back to time_begin
+        size_t oldest = level.count < capacity ? 0 : level.head;
+        if (level.count == capacity && level.time[oldest] > time_begin) continue;
+
+        // and hold few enough entries after it, counted from the newest backwards
+        int points = 0;
+        size_t index = (level.head + capacity - 1) % capacity;
+        for (size_t n = 0; n < level.count && level.time[index] >= time_begin; ++n) {
+            if (++points > max_points) break;
+            index = (index + capacity - 1) % capacity;
+        }
+        if (points <= max_points) return l;
+    }
+    return int(levels.size()) - 1;
+}
+
+bool TimeSeriesStore::range(int series, int level_index, float& low, float& high) const {
+    const Level& level = levels[level_index];
+    if (level.count == 0) return false;
+
+    const float* min = level.min.data() + series * capacity;
+    const float* max = level.max.data() + series * capacity;
+    low = *std::min_element(min, min + level.count);
+    high = *std::max_element(max, max + level.count);
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Ring-buffered time series with a min/max pyramid.
+// Every series shares one time axis. Level 0 keeps the newest raw samples, and each coarser level keeps
+// buckets of `factor` entries of the level below as (min, max), so level l covers capacity * factor^l samples.
+// All levels are fixed-size rings allocated up front: a push costs the same however long the run is,
+// and plotting hands ImPlot pointers into a ring (offset = oldest entry) instead of copying.
+class TimeSeriesStore {
+public:
+    TimeSeriesStore(size_t capacity = 2048, int level_count = 12, int factor = 4);
+
+    // Series must be added before the first push, returns the series id
+    int addSeries(const std::string& name);
+    // One sample for every series, values[series id]
+    void push(float time, const float* values);
+    void clear();
+
+    // Contiguous ring of one series at one level, in ImPlot's (count, offset, stride) form
+    struct View {
+        const float* time;
+        const float* min;
+        const float* max;
+        int count;
+        int offset; // index of the oldest entry
+    };
+    View view(int series, int level) const;
+
+    // Finest level that still holds everything since time_begin in at most max_points entries
+    int selectLevel(float time_begin, int max_points) const;
+    // Range of a series over a level, false when the level is empty
+    bool range(int series, int level, float& low, float& high) const;
+
+    int getSeriesCount() const { return int(names.size()); }
+    int getLevelCount() const { return int(levels.size()); }
+    const std::string& getName(int series) const { return names[series]; }
+    size_t getSampleCount() const { return sample_count; }
+
+private:
+    struct Level {
+        std::vector<float> time;
+        std::vector<float> min, max; // series-major, capacity entries per series
+        size_t head = 0;  // next write
+        size_t count = 0;
+        // Bucket being built from the level below
+        int pending = 0;
+        float pending_time = 0.0f;
+        std::vector<float> pending_min, pending_max;
+    };
+
+    size_t capacity;
+    int factor;
+    std::vector<std::string> names;
+    std::vector<Level> levels;
+    size_t sample_count = 0;
+
+    void allocate();
+    void write(int level, float time, const float* min, const float* max);
+};
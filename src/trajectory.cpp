@@ -0,0 +1,451 @@
+#include "trajectory.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// 64-bit file offsets, trajectories of large scenes pass 2 GB quickly
+static bool seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t fileSize(FILE* file) {
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    return uint64_t(_ftelli64(file));
+#else
+    fseeko(file, 0, SEEK_END);
+    return uint64_t(ftello(file));
+#endif
+}
+
+static void writeVarint(std::vector<unsigned char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static bool readVarint(const std::vector<unsigned char>& in, size_t& cursor, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && cursor < in.size(); shift += 7) {
+        unsigned char byte = in[cursor++];
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Small magnitudes of either sign become small unsigned values, only a zero delta maps to 0
+static uint64_t zigzag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+static int64_t quantize(float value, double inverse_precision) {
+    double q = std::nearbyint(double(value) * inverse_precision);
+    if (!(q == q)) return 0;
+    // Far inside int64 so deltas between two values cannot overflow
+    return int64_t(std::min(std::max(q, -4.0e18), 4.0e18));
+}
+
+// Field f of object i: position x, y, z then velocity x, y, z
+static float& fieldValue(TrajectoryFrame& frame, int field, size_t i) {
+    return field < 3 ? frame.positions[i][field] : frame.velocities[i][field - 3];
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const std::string& path, const TrajectoryOptions& options) {
+    close();
+
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::fprintf(stderr, "Could not write trajectory %s\n", path.c_str());
+        return false;
+    }
+
+    this->options = options;
+    this->options.frames_per_chunk = std::max(options.frames_per_chunk, 1);
+    this->options.queue_capacity = std::max(options.queue_capacity, 1);
+
+    TrajectoryFileHeader header = {};
+    std::memcpy(header.magic, trajectory_magic, sizeof(header.magic));
+    header.version = trajectory_version;
+    header.header_bytes = sizeof(TrajectoryFileHeader);
+    header.position_precision = options.position_precision;
+    header.velocity_precision = options.velocity_precision;
+    header.frames_per_chunk = uint32_t(this->options.frames_per_chunk);
+    write_failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+    file_offset = sizeof(header);
+
+    frames.assign(size_t(this->options.queue_capacity) + 1, TrajectoryFrame());
+    free_frames.clear();
+    for (TrajectoryFrame& frame : frames) free_frames.push_back(&frame);
+    queue.clear();
+    stopping = false;
+    payload.clear();
+    previous_count = 0;
+    chunk_frames = 0;
+    chunk_first_frame = 0;
+    index.clear();
+    frame_count = 0;
+    bytes_written = file_offset;
+    stalled_frames = 0;
+    dropped_frames = 0;
+
+    thread = std::thread(&TrajectoryWriter::run, this);
+    return true;
+}
+
+void TrajectoryWriter::close() {
+    if (!file) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    if (thread.joinable()) thread.join();
+
+    // Index and footer, a reader finds them from the end of the file
+    TrajectoryFooter footer = {};
+    footer.index_offset = file_offset;
+    footer.chunk_count = index.size();
+    footer.frame_count = frame_count;
+    std::memcpy(footer.magic, trajectory_index_magic, sizeof(footer.magic));
+    if (!index.empty() && std::fwrite(index.data(), sizeof(TrajectoryIndexEntry), index.size(), file) != index.size()) write_failed = true;
+    if (std::fwrite(&footer, sizeof(footer), 1, file) != 1) write_failed = true;
+    if (std::fclose(file) != 0) write_failed = true;
+    if (write_failed) std::fprintf(stderr, "Writing the trajectory failed, the file is incomplete\n");
+    bytes_written = file_offset + index.size() * sizeof(TrajectoryIndexEntry) + sizeof(footer);
+    file = nullptr;
+}
+
+TrajectoryFrame* TrajectoryWriter::acquire(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (free_frames.empty()) {
+        if (!wait) {
+            dropped_frames++;
+            return nullptr;
+        }
+        stalled_frames++;
+        queue_changed.wait(lock, [&]() { return !free_frames.empty(); });
+    }
+    TrajectoryFrame* frame = free_frames.back();
+    free_frames.pop_back();
+    return frame;
+}
+
+void TrajectoryWriter::submit(TrajectoryFrame* frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(frame);
+    }
+    queue_changed.notify_all();
+}
+
+void TrajectoryWriter::push(uint64_t step, double time, const GPUPhysicsObject* objects, size_t count) {
+    if (!file) return;
+    TrajectoryFrame* frame = acquire(true);
+    frame->step = step;
+    frame->time = time;
+    frame->positions.resize(count);
+    frame->velocities.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        frame->positions[i] = glm::vec3(objects[i].position);
+        frame->velocities[i] = glm::vec3(objects[i].velocity);
+    }
+    submit(frame);
+}
+
+void TrajectoryWriter::push(uint64_t step, double time, const GPUPhysicsObject2D* objects, size_t count) {
+    if (!file) return;
+    TrajectoryFrame* frame = acquire(true);
+    frame->step = step;
+    frame->time = time;
+    frame->positions.resize(count);
+    frame->velocities.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        frame->positions[i] = glm::vec3(objects[i].position.x, objects[i].position.y, 0.0f);
+        frame->velocities[i] = glm::vec3(objects[i].velocity.x, objects[i].velocity.y, 0.0f);
+    }
+    submit(frame);
+}
+
+void TrajectoryWriter::push(uint64_t step, double time, const float* const fields[6], size_t count) {
+    if (!file) return;
+    TrajectoryFrame* frame = acquire(true);
+    frame->step = step;
+    frame->time = time;
+    frame->positions.resize(count);
+    frame->velocities.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        frame->positions[i] = glm::vec3(fields[0][i], fields[1][i], fields[2][i]);
+        frame->velocities[i] = glm::vec3(fields[3][i], fields[4][i], fields[5][i]);
+    }
+    submit(frame);
+}
+
+bool TrajectoryWriter::tryPush(uint64_t step, double time, const GPUPhysicsObject* objects, size_t count) {
+    if (!file) return false;
+    TrajectoryFrame* frame = acquire(false);
+    if (!frame) return false;
+    frame->step = step;
+    frame->time = time;
+    frame->positions.resize(count);
+    frame->velocities.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        frame->positions[i] = glm::vec3(objects[i].position);
+        frame->velocities[i] = glm::vec3(objects[i].velocity);
+    }
+    submit(frame);
+    return true;
+}
+
+void TrajectoryWriter::run() {
+    for (;;) {
+        TrajectoryFrame* frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_changed.wait(lock, [&]() { return !queue.empty() || stopping; });
+            if (queue.empty()) break; // stopping, and everything pushed is written
+            frame = queue.front();
+            queue.pop_front();
+        }
+
+        encode(*frame);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_frames.push_back(frame);
+        }
+        queue_changed.notify_all();
+    }
+
+    flushChunk();
+}
+
+// Frame: varint step, raw double time, varint object count, then per field (field-major) one token per object
+// run: a nonzero token is zigzag(q - q_previous), a zero token is followed by a varint count of unchanged objects
+void TrajectoryWriter::encode(const TrajectoryFrame& frame) {
+    size_t count = frame.positions.size();
+    writeVarint(payload, frame.step);
+    unsigned char time_bytes[sizeof(double)];
+    std::memcpy(time_bytes, &frame.time, sizeof(double));
+    payload.insert(payload.end(), time_bytes, time_bytes + sizeof(double));
+    writeVarint(payload, count);
+
+    quantized.resize(6 * count);
+    for (int field = 0; field < 6; ++field) {
+        double inverse_precision = 1.0 / double(field < 3 ? options.position_precision : options.velocity_precision);
+        const int64_t* previous_field = previous.data() + field * previous_count;
+        int64_t* quantized_field = quantized.data() + field * count;
+        uint64_t unchanged = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            float value = field < 3 ? frame.positions[i][field] : frame.velocities[i][field - 3];
+            int64_t q = quantize(value, inverse_precision);
+            quantized_field[i] = q;
+
+            // Objects added since the last frame, and every object of a chunk's first frame, start from zero
+            int64_t delta = q - (i < previous_count ? previous_field[i] : 0);
+            if (delta == 0) {
+                unchanged++;
+                continue;
+            }
+            if (unchanged > 0) {
+                payload.push_back(0);
+                writeVarint(payload, unchanged);
+                unchanged = 0;
+            }
+            writeVarint(payload, zigzag(delta));
+        }
+        if (unchanged > 0) {
+            payload.push_back(0);
+            writeVarint(payload, unchanged);
+        }
+    }
+
+    previous.swap(quantized);
+    previous_count = count;
+    chunk_frames++;
+    frame_count++;
+    if (chunk_frames >= uint32_t(options.frames_per_chunk)) flushChunk();
+}
+
+void TrajectoryWriter::flushChunk() {
+    if (chunk_frames == 0) return;
+
+    TrajectoryChunkHeader header = {};
+    header.magic = trajectory_chunk_magic;
+    header.frame_count = chunk_frames;
+    header.first_frame = chunk_first_frame;
+    header.payload_bytes = payload.size();
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 ||
+        std::fwrite(payload.data(), 1, payload.size(), file) != payload.size()) {
+        write_failed = true;
+    }
+
+    index.push_back({chunk_first_frame, file_offset});
+    file_offset += sizeof(header) + payload.size();
+    bytes_written = file_offset;
+
+    // The next chunk starts from a keyframe
+    chunk_first_frame += chunk_frames;
+    chunk_frames = 0;
+    payload.clear();
+    previous_count = 0;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+void TrajectoryReader::close() {
+    if (file) std::fclose(file);
+    file = nullptr;
+    index.clear();
+    frame_count = 0;
+    loaded_chunk = -1;
+}
+
+bool TrajectoryReader::open(const std::string& path) {
+    close();
+
+    file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::fprintf(stderr, "Could not open trajectory %s\n", path.c_str());
+        return false;
+    }
+
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, trajectory_magic, sizeof(header.magic)) != 0 ||
+        header.version != trajectory_version || header.header_bytes != sizeof(TrajectoryFileHeader)) {
+        std::fprintf(stderr, "%s is not a version %u trajectory\n", path.c_str(), trajectory_version);
+        close();
+        return false;
+    }
+
+    uint64_t size = fileSize(file);
+
+    // The index written by close()
+    TrajectoryFooter footer = {};
+    bool indexed = size >= sizeof(header) + sizeof(footer) && seekFile(file, size - sizeof(footer)) &&
+                   std::fread(&footer, sizeof(footer), 1, file) == 1 &&
+                   std::memcmp(footer.magic, trajectory_index_magic, sizeof(footer.magic)) == 0 &&
+                   footer.index_offset <= size - sizeof(footer) &&
+                   footer.chunk_count == (size - sizeof(footer) - footer.index_offset) / sizeof(TrajectoryIndexEntry);
+    if (indexed) {
+        index.resize(size_t(footer.chunk_count));
+        indexed = seekFile(file, footer.index_offset) &&
+                  (index.empty() || std::fread(index.data(), sizeof(TrajectoryIndexEntry), index.size(), file) == index.size());
+        frame_count = footer.frame_count;
+    }
+
+    // Otherwise walk the chunk headers, a chunk cut short by a crash ends the trajectory
+    if (!indexed) {
+        index.clear();
+        frame_count = 0;
+        uint64_t offset = sizeof(header);
+        TrajectoryChunkHeader chunk;
+        while (offset + sizeof(chunk) <= size && seekFile(file, offset) && std::fread(&chunk, sizeof(chunk), 1, file) == 1 &&
+               chunk.magic == trajectory_chunk_magic && chunk.payload_bytes <= size - offset - sizeof(chunk)) {
+            index.push_back({frame_count, offset});
+            frame_count += chunk.frame_count;
+            offset += sizeof(chunk) + chunk.payload_bytes;
+        }
+        std::fprintf(stderr, "Trajectory %s has no index, recovered %llu frames\n", path.c_str(), (unsigned long long)frame_count);
+    }
+    return true;
+}
+
+bool TrajectoryReader::loadChunk(size_t chunk) {
+    TrajectoryChunkHeader chunk_header;
+    if (!seekFile(file, index[chunk].offset) || std::fread(&chunk_header, sizeof(chunk_header), 1, file) != 1 ||
+        chunk_header.magic != trajectory_chunk_magic) {
+        return false;
+    }
+    payload.resize(size_t(chunk_header.payload_bytes));
+    if (!payload.empty() && std::fread(payload.data(), 1, payload.size(), file) != payload.size()) return false;
+
+    loaded_chunk = int64_t(chunk);
+    cursor = 0;
+    next_frame = chunk_header.first_frame;
+    previous_count = 0;
+    return true;
+}
+
+// Mirrors TrajectoryWriter::encode
+bool TrajectoryReader::decodeNext() {
+    uint64_t step, count;
+    if (!readVarint(payload, cursor, step) || cursor + sizeof(double) > payload.size()) return false;
+    current.step = step;
+    std::memcpy(&current.time, payload.data() + cursor, sizeof(double));
+    cursor += sizeof(double);
+    if (!readVarint(payload, cursor, count) || count > payload.size() * 64) return false;
+
+    current.positions.resize(size_t(count));
+    current.velocities.resize(size_t(count));
+    quantized.resize(6 * size_t(count));
+    for (int field = 0; field < 6; ++field) {
+        double precision = field < 3 ? header.position_precision : header.velocity_precision;
+        const int64_t* previous_field = previous.data() + field * previous_count;
+        int64_t* quantized_field = quantized.data() + field * count;
+
+        for (size_t i = 0; i < count;) {
+            uint64_t token;
+            if (!readVarint(payload, cursor, token)) return false;
+            uint64_t run = 1;
+            int64_t delta = 0;
+            if (token == 0) {
+                if (!readVarint(payload, cursor, run) || run > count - i) return false;
+            } else {
+                delta = unzigzag(token);
+            }
+            for (uint64_t r = 0; r < run; ++r, ++i) {
+                int64_t q = (i < previous_count ? previous_field[i] : 0) + delta;
+                quantized_field[i] = q;
+                fieldValue(current, field, i) = float(double(q) * precision);
+            }
+        }
+    }
+
+    previous.swap(quantized);
+    previous_count = size_t(count);
+    next_frame++;
+    return true;
+}
+
+bool TrajectoryReader::readFrame(uint64_t n, TrajectoryFrame& frame) {
+    if (!file || n >= frame_count || index.empty()) return false;
+
+    // Last chunk starting at or before n
+    auto found = std::upper_bound(index.begin(), index.end(), n,
+                                  [](uint64_t frame_number, const TrajectoryIndexEntry& entry) { return frame_number < entry.first_frame; });
+    size_t chunk = size_t(found - index.begin()) - 1;
+
+    if (int64_t(chunk) != loaded_chunk || n < next_frame) {
+        if (!loadChunk(chunk)) {
+            loaded_chunk = -1;
+            return false;
+        }
+    }
+    while (next_frame <= n) {
+        if (!decodeNext()) {
+            loaded_chunk = -1;
+            return false;
+        }
+    }
+
+    frame = current;
+    return true;
+}
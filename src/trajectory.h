@@ -0,0 +1,170 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "physics_types.h"
+
+// Recorded trajectories: every frame's object positions and velocities, quantized to a fixed precision and
+// delta-encoded against the previous frame, then packed as zigzag varints with runs of unchanged values
+// collapsed. Frames are grouped into chunks that each start from zero (a keyframe), and an index of chunk
+// offsets at the end of the file lets a reader seek to any frame by decoding at most one chunk.
+//
+// File: TrajectoryFileHeader, chunks (TrajectoryChunkHeader + payload), TrajectoryIndexEntry per chunk,
+// TrajectoryFooter. A file whose writer never closed it has no index, readers then scan the chunk headers.
+const char trajectory_magic[8] = {'E', 'N', 'N', 'T', 'R', 'A', 'J', '\0'};
+const char trajectory_index_magic[8] = {'E', 'N', 'N', 'T', 'I', 'D', 'X', '\0'};
+const uint32_t trajectory_chunk_magic = 0x4B4E4843; // "CHNK"
+const uint32_t trajectory_version = 1;
+
+struct TrajectoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes; // sizeof(TrajectoryFileHeader)
+    float position_precision;
+    float velocity_precision;
+    uint32_t frames_per_chunk;
+    uint32_t _pad;
+}; // 32 bytes
+
+struct TrajectoryChunkHeader {
+    uint32_t magic; // trajectory_chunk_magic
+    uint32_t frame_count;
+    uint64_t first_frame;
+    uint64_t payload_bytes;
+}; // 24 bytes
+
+struct TrajectoryIndexEntry {
+    uint64_t first_frame;
+    uint64_t offset; // of the chunk header
+};
+
+struct TrajectoryFooter {
+    uint64_t index_offset;
+    uint64_t chunk_count;
+    uint64_t frame_count;
+    char magic[8]; // trajectory_index_magic
+}; // 32 bytes
+
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    double time = 0.0;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+};
+
+struct TrajectoryOptions {
+    float position_precision = 1e-3f; // world units, values are stored as round(value / precision)
+    float velocity_precision = 1e-3f;
+    int frames_per_chunk = 64;        // frames decoded at most to reach any frame
+    int queue_capacity = 8;           // frames waiting for the writer thread before push() blocks
+};
+
+// Encodes and writes frames on its own thread. push() copies the frame into a pooled buffer and returns; when
+// queue_capacity frames are already waiting it blocks until the writer catches up, so a slow disk slows the
+// producer down instead of growing memory without bound.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter() = default;
+    ~TrajectoryWriter();
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Errors go to stderr
+    bool open(const std::string& path, const TrajectoryOptions& options = TrajectoryOptions());
+    // Writes the last partial chunk and the index. Waits for every pushed frame
+    void close();
+    bool isOpen() const { return file != nullptr; }
+
+    void push(uint64_t step, double time, const GPUPhysicsObject* objects, size_t count);
+    // Compact 2D objects, recorded with z = 0
+    void push(uint64_t step, double time, const GPUPhysicsObject2D* objects, size_t count);
+    // Structure-of-arrays source, fields are position x, y, z then velocity x, y, z
+    void push(uint64_t step, double time, const float* const fields[6], size_t count);
+    // Same as push() but returns false instead of blocking when the queue is full
+    bool tryPush(uint64_t step, double time, const GPUPhysicsObject* objects, size_t count);
+
+    uint64_t getFrameCount() const { return frame_count; }
+    uint64_t getBytesWritten() const { return bytes_written; }
+    // Frames push() had to wait for, and tryPush() dropped
+    uint64_t getStalledFrames() const { return stalled_frames; }
+    uint64_t getDroppedFrames() const { return dropped_frames; }
+
+private:
+    FILE* file = nullptr;
+    TrajectoryOptions options;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<TrajectoryFrame*> queue;
+    std::vector<TrajectoryFrame*> free_frames;
+    std::vector<TrajectoryFrame> frames; // the pool, queue_capacity + 1 so the writer can hold one
+    bool stopping = false;
+
+    // Writer thread only
+    std::vector<unsigned char> payload;
+    std::vector<int64_t> previous; // quantized values of the last frame, field-major
+    std::vector<int64_t> quantized;
+    size_t previous_count = 0;
+    uint64_t file_offset = 0;
+    bool write_failed = false;
+    uint32_t chunk_frames = 0;
+    uint64_t chunk_first_frame = 0;
+    std::vector<TrajectoryIndexEntry> index;
+
+    // Written by the writer thread, read anywhere
+    std::atomic<uint64_t> frame_count{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> stalled_frames{0};
+    std::atomic<uint64_t> dropped_frames{0};
+
+    TrajectoryFrame* acquire(bool wait);
+    void submit(TrajectoryFrame* frame);
+    void run();
+    void encode(const TrajectoryFrame& frame);
+    void flushChunk();
+};
+
+// Random access to a recorded trajectory
+class TrajectoryReader {
+public:
+    TrajectoryReader() = default;
+    ~TrajectoryReader();
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    // Reads the index, or rebuilds it from the chunk headers if the file was never closed. Errors go to stderr
+    bool open(const std::string& path);
+    void close();
+
+    uint64_t getFrameCount() const { return frame_count; }
+    float getPositionPrecision() const { return header.position_precision; }
+    float getVelocityPrecision() const { return header.velocity_precision; }
+    // Decodes frame n. Reading forward within a chunk continues from the last frame read
+    bool readFrame(uint64_t n, TrajectoryFrame& frame);
+
+private:
+    FILE* file = nullptr;
+    TrajectoryFileHeader header = {};
+    std::vector<TrajectoryIndexEntry> index;
+    uint64_t frame_count = 0;
+
+    // The chunk being decoded and how far
+    int64_t loaded_chunk = -1;
+    std::vector<unsigned char> payload;
+    size_t cursor = 0;
+    uint64_t next_frame = 0;
+    std::vector<int64_t> previous;
+    std::vector<int64_t> quantized;
+    size_t previous_count = 0;
+    TrajectoryFrame current;
+
+    bool loadChunk(size_t chunk);
+    bool decodeNext();
+};
@@ -0,0 +1,57 @@
+#include "trajectory_capture.h"
+
+TrajectoryCapture::TrajectoryCapture(int slot_count) : readback(slot_count, true) {
+}
+
+TrajectoryCapture::~TrajectoryCapture() {
+    close();
+}
+
+bool TrajectoryCapture::open(const std::string& path, const TrajectoryOptions& options) {
+    close();
+    times.clear();
+    return writer.open(path, options);
+}
+
+void TrajectoryCapture::close() {
+    if (!writer.isOpen()) return;
+    drain(true);
+    writer.close();
+}
+
+bool TrajectoryCapture::pushNext(bool wait) {
+    size_t size;
+    uint64_t step;
+    const void* data = readback.next(&size, &step, nullptr, wait);
+    if (!data) return false;
+    double time = times.empty() ? 0.0 : times.front();
+    if (!times.empty()) times.pop_front();
+    // Frame numbers are the step counts, the ring hands the copies back in the order they were captured
+    if (dimensions == 2) {
+        writer.push(step, time, static_cast<const GPUPhysicsObject2D*>(data), size / sizeof(GPUPhysicsObject2D));
+    } else {
+        writer.push(step, time, static_cast<const GPUPhysicsObject*>(data), size / sizeof(GPUPhysicsObject));
+    }
+    return true;
+}
+
+void TrajectoryCapture::drain(bool wait) {
+    while (pushNext(wait)) {}
+}
+
+void TrajectoryCapture::capture(GPUPhysicsSystem& physics_system, double time) {
+    if (!writer.isOpen()) return;
+
+    size_t bytes = size_t(physics_system.getObjectCount()) * physics_system.getObjectStride();
+    uint64_t step = physics_system.getStepCount();
+    if (bytes == 0) return;
+    // Copies of the other layout are written out before the ring takes any of this one
+    drain(dimensions != physics_system.getDimensions());
+    dimensions = physics_system.getDimensions();
+    // Every slot in flight or unread: the oldest has to finish before this step can be copied
+    if (!readback.enqueue(physics_system.getObjectDataBuffer(), 0, bytes, step)) {
+        pushNext(true);
+        if (!readback.enqueue(physics_system.getObjectDataBuffer(), 0, bytes, step)) return;
+    }
+    times.push_back(time);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <deque>
+#include "gpu_physics.h"
+#include "readback_ring.h"
+#include "trajectory.h"
+
+// Records a GPUPhysicsSystem to a trajectory file: every captured step is copied out of the object buffer
+// through an in-order readback ring and handed to a TrajectoryWriter, whose thread does the encoding and disk
+// writes. The GL context's thread only issues copies and copies finished ones into the writer's queue.
+class TrajectoryCapture {
+public:
+    TrajectoryCapture(int slot_count = 4);
+    ~TrajectoryCapture();
+
+    bool open(const std::string& path, const TrajectoryOptions& options = TrajectoryOptions());
+    // Waits for every copy still on the GPU, then closes the writer
+    void close();
+    bool isOpen() const { return writer.isOpen(); }
+
+    // Call after update(), with the time the new state belongs to. Only waits on the GPU when every slot
+    // of the ring is still in flight
+    void capture(GPUPhysicsSystem& physics_system, double time);
+
+    const TrajectoryWriter& getWriter() const { return writer; }
+
+private:
+    ReadbackRing readback;
+    TrajectoryWriter writer;
+    std::deque<double> times; // of the copies not handed to the writer yet, oldest first
+    int dimensions = 3;       // object layout of the copies in the ring
+
+    // Pushes finished copies to the writer, with wait until nothing is left in flight
+    void drain(bool wait);
+    bool pushNext(bool wait);
+};
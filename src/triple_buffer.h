@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer single-consumer triple buffer.
+// The producer fills the back slot and publishes it, the consumer acquires the newest published slot as its
+// front. Neither side ever waits: the producer always has a free slot, and the consumer keeps its front
+// until a newer one arrives. The middle slot and a fresh bit are packed into one atomic byte.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : state(1) {}
+
+    // Producer side
+    T& getBack() { return slots[back]; }
+    void publish() {
+        uint8_t previous = state.exchange(uint8_t(back | fresh_bit), std::memory_order_acq_rel);
+        back = previous & index_mask;
+    }
+
+    // Consumer side, acquire() swaps in the newest published slot, false if nothing new was published
+    bool acquire() {
+        if ((state.load(std::memory_order_relaxed) & fresh_bit) == 0) return false;
+        uint8_t previous = state.exchange(front, std::memory_order_acq_rel);
+        front = previous & index_mask;
+        return true;
+    }
+    T& getFront() { return slots[front]; }
+
+    // Every slot, only for setup and teardown while neither side is running
+    T& getSlot(int index) { return slots[index]; }
+
+private:
+    static const uint8_t index_mask = 3;
+    static const uint8_t fresh_bit = 4;
+
+    T slots[3];
+    std::atomic<uint8_t> state; // middle slot index | fresh_bit
+    uint8_t back = 0;
+    uint8_t front = 2;
+};
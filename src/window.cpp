@@ -34,6 +34,16 @@ Window::~Window() {
     glfwTerminate();
 }
 
+GLFWwindow* Window::createSharedContext() {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* shared = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!shared) {
+        std::cerr << "Failed to create shared GL context\n";
+    }
+    return shared;
+}
+
 bool Window::shouldClose() const {
     return glfwWindowShouldClose(window);
 }
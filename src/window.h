@@ -13,6 +13,10 @@ public:
     void swapBuffers();
     void pollEvents();
 
+    // Hidden window whose context shares buffers, programs and syncs with this one, for a worker thread
+    // to make current. Create and destroy it on the main thread
+    GLFWwindow* createSharedContext();
+
     GLFWwindow* getGLFWwindow() const { return window; }
     int getWidth() const { return width; }
     int getHeight() const { return height; }
@@ -0,0 +1,103 @@
+// Checks CPUPhysicsSystem against cases with a known answer, run by ctest. Exits non-zero on the first failure
+#include "cpu_physics.h"
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+
+static int failures = 0;
+
+static void expect(bool condition, const char* test, const char* what, float value) {
+    if (condition) return;
+    std::fprintf(stderr, "%s: %s (%g)\n", test, what, value);
+    failures++;
+}
+
+static GPUPhysicsObject makeBall(float x, float y, float gravity, uint32_t flags = 0) {
+    GPUPhysicsObject ball = {};
+    ball.position = {x, y, 0.0f, 0.0f};
+    ball.acceleration = {0.0f, gravity, 0.0f, 0.0f};
+    ball.mass = 1.0f;
+    ball.radius = 5.0f;
+    ball.flags = flags;
+    return ball;
+}
+
+static GPUPhysicsConstraint makeSpring(int a, int b, float rest_length, int type, float stiffness) {
+    GPUPhysicsConstraint constraint = {};
+    constraint.type = type;
+    constraint.indexA = a;
+    constraint.indexB = b;
+    constraint.restLength = rest_length;
+    constraint.stiffness = stiffness;
+    return constraint;
+}
+
+// Two bodies joined by a spring at its rest length, nothing acting on them: nothing may move
+static void testSpringAtRest(int dimensions) {
+    CPUPhysicsSystem physics_system(10, 1, dimensions);
+    physics_system.addObject(makeBall(100.0f, 100.0f, 0.0f));
+    physics_system.addObject(makeBall(150.0f, 100.0f, 0.0f));
+    physics_system.addConstraint(makeSpring(0, 1, 50.0f, 0, 100.0f));
+    for (int i = 0; i < 120; ++i) physics_system.update(1.0f / 60.0f);
+
+    GPUPhysicsStats stats = physics_system.computeStats();
+    std::vector<GPUPhysicsObject> objects = physics_system.getObjectsData();
+    expect(stats.max_constraint_violation < 1e-4f, "spring at rest", "constraint violation", stats.max_constraint_violation);
+    expect(std::abs(objects[0].position.x - 100.0f) < 1e-4f, "spring at rest", "first body moved", objects[0].position.x);
+    expect(stats.kinetic_energy < 1e-6f, "spring at rest", "kinetic energy", stats.kinetic_energy);
+}
+
+// A chain of hard constraints hanging straight down from a static anchor has to hold its rest lengths under
+// gravity and stay put. Every thread count must give the same bits
+static void testHangingChain(int dimensions, std::vector<GPUPhysicsObject>& result, int threads) {
+    const int links = 20;
+    const float spacing = 10.0f;
+    CPUPhysicsSystem physics_system(20, threads, dimensions);
+    physics_system.addObject(makeBall(0.0f, 0.0f, 0.0f, OBJECT_STATIC));
+    for (int i = 1; i <= links; ++i) {
+        physics_system.addObject(makeBall(0.0f, -float(i) * spacing, -100.0f));
+        physics_system.addConstraint(makeSpring(i - 1, i, spacing, 1, 1000.0f));
+    }
+    for (int i = 0; i < 600; ++i) physics_system.update(1.0f / 60.0f);
+
+    GPUPhysicsStats stats = physics_system.computeStats();
+    result = physics_system.getObjectsData();
+    float tip_x = result[links].position.x;
+    float tip_y = result[links].position.y;
+    expect(stats.max_constraint_violation < 0.05f, "hanging chain", "constraint violation", stats.max_constraint_violation);
+    expect(std::abs(tip_x) < 1e-3f, "hanging chain", "tip swung sideways", tip_x);
+    expect(std::abs(tip_y + float(links) * spacing) < 1.0f, "hanging chain", "tip height", tip_y);
+    expect(stats.kinetic_energy < 1.0f, "hanging chain", "kinetic energy", stats.kinetic_energy);
+}
+
+// A ball dropped onto a static ball straight below it has to come to rest on top, not sink through
+static void testBallRestsOnStatic(int dimensions) {
+    CPUPhysicsSystem physics_system(10, 1, dimensions);
+    physics_system.setCollisionsEnabled(true);
+    physics_system.addObject(makeBall(0.0f, -5.0f, 0.0f, OBJECT_STATIC));
+    physics_system.addObject(makeBall(0.0f, 6.0f, -100.0f));
+    for (int i = 0; i < 300; ++i) physics_system.update(1.0f / 60.0f);
+
+    std::vector<GPUPhysicsObject> objects = physics_system.getObjectsData();
+    expect(std::abs(objects[1].position.y - 5.0f) < 0.5f, "ball on static", "resting height", objects[1].position.y);
+    expect(std::abs(objects[1].velocity.y) < 1.0f, "ball on static", "still moving", objects[1].velocity.y);
+}
+
+static void testThreadCountsAgree(int dimensions) {
+    std::vector<GPUPhysicsObject> single, pooled;
+    testHangingChain(dimensions, single, 1);
+    testHangingChain(dimensions, pooled, 4);
+    for (size_t i = 0; i < single.size(); ++i) {
+        expect(std::memcmp(&single[i].position, &pooled[i].position, sizeof(glm::vec4)) == 0, "thread counts", "positions differ at object", float(i));
+    }
+}
+
+int main() {
+    for (int dimensions = 2; dimensions <= 3; ++dimensions) {
+        testSpringAtRest(dimensions);
+        testThreadCountsAgree(dimensions);
+        testBallRestsOnStatic(dimensions);
+    }
+    if (failures == 0) std::printf("All CPU physics tests passed\n");
+    return failures == 0 ? 0 : 1;
+}